@@ -0,0 +1,158 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef ACTION_TABLE_H
+#define ACTION_TABLE_H
+
+#include <CernVM/ParameterMap.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+// Maximum number of parameters an action can declare
+#define CVMWA_ACTION_MAX_PARAMS		4
+
+// Action flags
+#define ACTION_INLINE 				0x00 	// Run on the I/O thread
+#define ACTION_WORKER 				0x01 	// Run on a worker thread
+#define ACTION_PRIVILEGED 			0x02 	// Requires a privileged connection
+#define ACTION_LONG 				0x04 	// Run on the long-running lane of the workers
+#define ACTION_BATCH 				0x08 	// A list of actions, each run on its own lane
+
+// Parameter types
+#define ACTION_PARAM_STRING 		0
+#define ACTION_PARAM_INT 			1
+
+/**
+ * FNV-1a hash of an action or key name
+ */
+inline unsigned int actionHash( const char * str, const size_t length ) {
+	unsigned int h = 2166136261u;
+	for (size_t i = 0; i < length; ++i)
+		h = (h ^ (unsigned char)str[i]) * 16777619u;
+	return h;
+}
+inline unsigned int actionHash( const char * str ) {
+	return actionHash( str, strlen(str) );
+}
+inline unsigned int actionHash( const std::string& str ) {
+	return actionHash( str.data(), str.length() );
+}
+
+/**
+ * Declaration of an action parameter
+ */
+struct ActionParam {
+	const char *	name;
+	int 			type;
+	bool 			required;
+};
+
+/**
+ * Declaration of an action: it's name, the handler, the ACTION_* flags
+ * and the parameters it accepts. Unused parameter slots are left empty.
+ */
+template <typename Handler>
+struct ActionEntry {
+	const char * 	name;
+	Handler 		handler;
+	int 			flags;
+	ActionParam 	params[CVMWA_ACTION_MAX_PARAMS];
+};
+
+/**
+ * Validate the parameters of a request against their declaration.
+ * On error, a message for the user is placed in ``error``.
+ */
+inline bool actionValidate( const ActionParam * params, ParameterMapPtr parameters, std::string * error ) {
+	for (int i = 0; (i < CVMWA_ACTION_MAX_PARAMS) && (params[i].name != NULL); ++i) {
+		const ActionParam& p = params[i];
+		if (!parameters->contains(p.name)) {
+			if (p.required) {
+				*error = std::string("Missing '") + p.name + "' parameter";
+				return false;
+			}
+			continue;
+		}
+		if (p.type == ACTION_PARAM_INT) {
+			std::string v = parameters->get(p.name);
+			size_t j = (!v.empty() && (v[0] == '-')) ? 1 : 0;
+			bool valid = (j < v.length());
+			for (; valid && (j < v.length()); ++j)
+				valid = (v[j] >= '0') && (v[j] <= '9');
+			if (!valid) {
+				*error = std::string("Invalid '") + p.name + "' parameter";
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * An open-addressing hash table over a static array of entries that
+ * have a ``name`` member. Lookups are O(1): one hash and (usually) one
+ * string comparison.
+ */
+template <typename Entry>
+class ActionTable {
+public:
+
+	/**
+	 * Index the given entries
+	 */
+	ActionTable( const Entry * entries, const size_t count ) : entries(entries), slots(), hashes(), mask(0) {
+		size_t size = 8;
+		while (size < count * 2) size <<= 1;
+		mask = size - 1;
+		slots.assign( size, -1 );
+		hashes.assign( size, 0 );
+		for (size_t i = 0; i < count; ++i) {
+			unsigned int h = actionHash( entries[i].name );
+			size_t j = h & mask;
+			while (slots[j] != -1) j = (j + 1) & mask;
+			slots[j] = (int) i;
+			hashes[j] = h;
+		}
+	};
+
+	/**
+	 * Find the entry with the given name, or return NULL
+	 */
+	const Entry * 	find( const std::string& name ) const {
+		unsigned int h = actionHash( name );
+		for (size_t j = h & mask; slots[j] != -1; j = (j + 1) & mask) {
+			if ((hashes[j] == h) && (name == entries[slots[j]].name))
+				return &entries[slots[j]];
+		}
+		return NULL;
+	};
+
+private:
+	const Entry * 				entries;
+	std::vector< int > 			slots;
+	std::vector< unsigned int >	hashes;
+	size_t 						mask;
+
+};
+
+#endif /* end of include guard: ACTION_TABLE_H */
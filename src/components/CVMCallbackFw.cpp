@@ -22,6 +22,15 @@
 // (Including cross-referencing)
 #include "daemon.h"
 
+/**
+ * Convert a variant event argument to JSON
+ */
+class VariantArgToJSON : public boost::static_visitor<Json::Value> {
+public:
+	template <typename T>
+	Json::Value operator()( const T& value ) const { return Json::Value( value ); }
+};
+
 /**
  * Unregister everything upon destruction
  */
@@ -37,6 +46,10 @@ CVMCallbackFw::~CVMCallbackFw() {
 
 	// Remove all entries
 	listening.clear();
+
+	// Report the progress frames we saved
+	if (progressThrottle.dropped() > 0)
+		CVMWA_LOG("Debug", "Coalesced " << progressThrottle.dropped() << " progress events of request '" << sessionID << "'");
 	CRASH_REPORT_END;
 }
 
@@ -48,7 +61,7 @@ void CVMCallbackFw::listen( FiniteTaskPtr cb ) {
 
 	// Register an anyEvent receiver and keep the slot reference
 	listening.push_back(
-		new DisposableDelegate( cb, boost::bind( &CVMCallbackFw::fire, this, _1, _2 ) )
+		new DisposableDelegate( cb, boost::bind( static_cast< void (CVMCallbackFw::*)( const std::string&, VariantArgList& ) >( &CVMCallbackFw::fire ), this, _1, _2 ) )
 	);
 		
 	CRASH_REPORT_END;
@@ -89,8 +102,101 @@ void CVMCallbackFw::stopListening( FiniteTaskPtr cb ) {
 void CVMCallbackFw::fire( const std::string& name, VariantArgList& args ) {
 	CRASH_REPORT_BEGIN;
 
-	// Forward the event to the interface
-	api.sendEvent( name, args, sessionID );
+	// Drop intermediate progress updates
+	if (name == "progress") {
+		if (!coalesceProgress( args )) send( name, args );
+		return;
+	}
+
+	// The last progress update goes out before the outcome
+	flushProgress();
+
+	// Collect the result of a batched action
+	if (collects(name)) {
+		Json::Value values( Json::arrayValue );
+		for (VariantArgList::iterator it = args.begin(); it != args.end(); ++it)
+			values.append( boost::apply_visitor( VariantArgToJSON(), *it ) );
+		collect( name, values );
+		return;
+	}
+	send( name, args );
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Forward the event to the interface. A newer progress event
+ * of the same request supersedes the queued one.
+ */
+void CVMCallbackFw::send( const std::string& name, VariantArgList& args ) {
+	CRASH_REPORT_BEGIN;
+	if (bus != NULL) {
+		bus->publish( busSession, EVENT_PROGRESS, WebsocketAPI::buildEvent( name, args, sessionID ), (name == "progress") ? "progress:" + sessionID : "" );
+	} else if (name == "progress") {
+		api->sendEvent( name, args, sessionID, "progress:" + sessionID );
+	} else {
+		api->sendEvent( name, args, sessionID );
+	}
+	CRASH_REPORT_END;
+}
+
+/**
+ * Store the result of a batched action
+ */
+void CVMCallbackFw::collect( const std::string& name, const Json::Value& args ) {
+	CRASH_REPORT_BEGIN;
+	(*result)["status"] = name;
+	(*result)["data"] = args;
+	CRASH_REPORT_END;
+}
+
+/**
+ * Limit the progress frames of this request
+ */
+void CVMCallbackFw::setProgressRate( int framesPerSecond ) {
+	CRASH_REPORT_BEGIN;
+	boost::unique_lock<boost::mutex> lock(progressMutex);
+	progressThrottle.setInterval( (framesPerSecond > 0) ? (1000 / framesPerSecond) : 0 );
+	CRASH_REPORT_END;
+}
 
+/**
+ * Check if the given progress event should be dropped. Updates of the same
+ * step that arrive faster than the progress rate are dropped, while a new
+ * step is always delivered (see ProgressThrottle). The other events (started,
+ * completed, failed) are never coalesced, and the last update that was
+ * dropped is sent before them.
+ */
+bool CVMCallbackFw::coalesceProgress( VariantArgList& args ) {
+	CRASH_REPORT_BEGIN;
+	boost::unique_lock<boost::mutex> lock(progressMutex);
+	const std::string * message = args.empty() ? NULL : boost::get<std::string>( &args[0] );
+	if (progressThrottle.drop( message, getMillis() )) {
+		progressHeld = true;
+		progressPending = args;
+		return true;
+	}
+
+	// Deliver it
+	progressHeld = false;
+	progressPending.clear();
+	return false;
+	CRASH_REPORT_END;
+}
+
+/**
+ * Send the progress update that was held back, if any
+ */
+void CVMCallbackFw::flushProgress() {
+	CRASH_REPORT_BEGIN;
+	VariantArgList args;
+	{
+		boost::unique_lock<boost::mutex> lock(progressMutex);
+		if (!progressHeld) return;
+		progressHeld = false;
+		progressThrottle.undrop();
+		args.swap( progressPending );
+	}
+	send( "progress", args );
 	CRASH_REPORT_END;
 }
@@ -23,6 +23,14 @@
 #define DAEMON_COMPONENT_CALLBACKS_H
 
 #include <CernVM/ProgressFeedback.h>
+#include <json/json.h>
+#include <utilities.h>
+#include <progress_throttle.h>
+
+#include <boost/thread/mutex.hpp>
+
+// The default maximum number of progress frames per second for every request
+#define CVMWA_PROGRESS_RATE		10
 
 /**
  * A utility class that keeps track of the delegated Callbacks
@@ -64,8 +72,24 @@ class CVMCallbackFw {
 public:
 
 	// Constructor
-	CVMCallbackFw( WebsocketAPI& api, const std::string& sessionID ) 
-		: listening(), api(api), sessionID(sessionID) { };
+	CVMCallbackFw( WebsocketAPI& api, const std::string& sessionID, CancelTokenPtr cancelToken = CancelTokenPtr() ) 
+		: listening(), api(&api), sessionID(sessionID), result(NULL), cancelToken(cancelToken), bus(NULL), busSession(0), progressMutex(),
+		  progressThrottle(1000 / CVMWA_PROGRESS_RATE), progressHeld(false), progressPending() { };
+
+	// Constructor for the events of a session: they are published to the subscribers
+	// of the session on the bus, so they don't depend on the connection it's attached to
+	CVMCallbackFw( EventBus& bus, int session, const std::string& sessionID ) 
+		: listening(), api(NULL), sessionID(sessionID), result(NULL), cancelToken(), bus(&bus), busSession(session), progressMutex(),
+		  progressThrottle(1000 / CVMWA_PROGRESS_RATE), progressHeld(false), progressPending() { };
+
+	// Constructor for an action of a batch: the 'succeed' or 'failed' event is
+	// collected in 'result' and everything else is forwarded through the parent
+	CVMCallbackFw( CVMCallbackFw& parent, Json::Value * result ) 
+		: listening(), api(parent.api), sessionID(parent.sessionID), result(result), cancelToken(parent.cancelToken), bus(parent.bus), busSession(parent.busSession), progressMutex(),
+		  progressThrottle(parent.progressThrottle.getInterval()), progressHeld(false), progressPending() { };
+
+	// Check if the request was cancelled or missed its deadline
+	bool cancelled							( ) { return cancelToken && cancelToken->isCancelled(); };
 
 	// Destructor
 	~CVMCallbackFw();
@@ -73,6 +97,41 @@ public:
 	// Trigger a custom event
 	void fire								( const std::string& name, VariantArgList& args );
 
+	// Trigger a custom event with fixed-shape arguments
+	template <typename A>
+	void fire								( const std::string& name, const A& a ) {
+		flushProgress();
+		if (bus != NULL) { bus->publish( busSession, busClass(name), WebsocketAPI::buildTypedEvent( name, sessionID, a ) ); return; }
+		if (!collects(name)) { api->sendTypedEvent( name, sessionID, a ); return; }
+		Json::Value args( Json::arrayValue );
+		args.append( resultValue(a) );
+		collect( name, args );
+	};
+	template <typename A, typename B>
+	void fire								( const std::string& name, const A& a, const B& b ) {
+		flushProgress();
+		if (bus != NULL) { bus->publish( busSession, busClass(name), WebsocketAPI::buildTypedEvent( name, sessionID, a, b ) ); return; }
+		if (!collects(name)) { api->sendTypedEvent( name, sessionID, a, b ); return; }
+		Json::Value args( Json::arrayValue );
+		args.append( resultValue(a) );
+		args.append( resultValue(b) );
+		collect( name, args );
+	};
+	template <typename A, typename B, typename C>
+	void fire								( const std::string& name, const A& a, const B& b, const C& c ) {
+		flushProgress();
+		if (bus != NULL) { bus->publish( busSession, busClass(name), WebsocketAPI::buildTypedEvent( name, sessionID, a, b, c ) ); return; }
+		if (!collects(name)) { api->sendTypedEvent( name, sessionID, a, b, c ); return; }
+		Json::Value args( Json::arrayValue );
+		args.append( resultValue(a) );
+		args.append( resultValue(b) );
+		args.append( resultValue(c) );
+		collect( name, args );
+	};
+
+	// Limit the progress frames of this request to the given number per second (0 to disable)
+	void setProgressRate					( int framesPerSecond );
+
 	// Receive events from the specified callback object
 	void listen								( FiniteTaskPtr ch );
 
@@ -81,14 +140,51 @@ public:
 
 private:
 
+	// Check if the specified event is collected instead of sent
+	bool collects							( const std::string& name ) { return (result != NULL) && ((name == "succeed") || (name == "failed")); };
+
+	// Store the collected event
+	void collect							( const std::string& name, const Json::Value& args );
+
+	// The class the specified event is published under
+	static int busClass						( const std::string& name ) { return (name == "succeed") ? EVENT_STATE : ((name == "failed") ? EVENT_FAILURE : EVENT_PROGRESS); };
+
+	// Send an event that was not collected
+	void send								( const std::string& name, VariantArgList& args );
+
+	// Convert an event argument the same way it is sent (booleans as 0/1)
+	static Json::Value resultValue			( const bool value ) { return Json::Value( value ? 1 : 0 ); };
+	template <typename A>
+	static Json::Value resultValue			( const A& value ) { return Json::Value( value ); };
+
 	// The registry of the objects we are listening events for
 	std::vector< DisposableDelegate* >		listening;
 
-	// The API session to send messages to
-	WebsocketAPI&							api;
+	// The API session to send messages to (NULL if they are published on the bus)
+	WebsocketAPI *							api;
+
+	// The current event ID (a copy, since the forwarder of a request
+	// outlives the task that received the ID)
+	const std::string						sessionID;
+
+	// Where the result of a batched action is collected
+	Json::Value *							result;
+
+	// The cancellation token of the request
+	CancelTokenPtr							cancelToken;
+
+	// The event bus and the session we publish to
+	EventBus *								bus;
+	int										busSession;
 
-	// The current event ID
-	const std::string&						sessionID;
+	// Coalescing of the progress events. The last update that was dropped
+	// is held, and it's sent before the next event of the request.
+	bool coalesceProgress					( VariantArgList& args );
+	void flushProgress						( );
+	boost::mutex							progressMutex;
+	ProgressThrottle						progressThrottle;
+	bool									progressHeld;
+	VariantArgList							progressPending;
 
 };
 
@@ -23,236 +23,415 @@
 #include "daemon.h"
 #include <utilities.h>
 
+/**
+ * The session actions
+ */
+const CVMWebAPISession::Action CVMWebAPISession::actionList[] = {
+
+	// Power commands
+	{ "start",			&CVMWebAPISession::actionStart,			ACTION_WORKER | ACTION_LONG, { } },
+	{ "stop",			&CVMWebAPISession::actionStop,			ACTION_WORKER | ACTION_LONG, { } },
+	{ "pause",			&CVMWebAPISession::actionPause,			ACTION_WORKER | ACTION_LONG, { } },
+	{ "resume",			&CVMWebAPISession::actionResume,		ACTION_WORKER | ACTION_LONG, { } },
+	{ "hibernate",		&CVMWebAPISession::actionHibernate,		ACTION_WORKER | ACTION_LONG, { } },
+	{ "reset",			&CVMWebAPISession::actionReset,			ACTION_WORKER | ACTION_LONG, { } },
+	{ "close",			&CVMWebAPISession::actionClose,			ACTION_WORKER | ACTION_LONG, { } },
+
+	// State variables. They read or update the parameters and the properties
+	// of the libcernvm session, which are not locked, so they run on the
+	// strand of the session like every other action that touches them.
+	{ "sync",			&CVMWebAPISession::actionSync,			ACTION_WORKER, { } },
+	{ "get",			&CVMWebAPISession::actionGet,			ACTION_WORKER,
+		{ { "key", ACTION_PARAM_STRING, false } } },
+	{ "set",			&CVMWebAPISession::actionSet,			ACTION_WORKER,
+		{ { "key", ACTION_PARAM_STRING, false }, { "value", ACTION_PARAM_STRING, false } } },
+	{ "setProperty",	&CVMWebAPISession::actionSetProperty,	ACTION_WORKER,
+		{ { "key", ACTION_PARAM_STRING, false }, { "value", ACTION_PARAM_STRING, false } } },
+
+	// Many actions in one request
+	{ "batch",			NULL,									ACTION_BATCH,
+		{ { "actions", ACTION_PARAM_STRING, true } } },
+
+};
+
+/**
+ * The session variables accessible with get/set
+ */
+const CVMWebAPISession::Key CVMWebAPISession::keyList[] = {
+	{ "apiURL",			NULL,		&CVMWebAPISession::keyApiURL,	false,	NULL },
+	{ "rdpURL",			NULL,		&CVMWebAPISession::keyRdpURL,	false,	NULL },
+	{ "ip",				"",			NULL,							false,	NULL },
+	{ "cpus",			"1",		NULL,							true,	NULL },
+	{ "disk",			"1024",		NULL,							true,	NULL },
+	{ "memory",			"512",		NULL,							true,	NULL },
+	{ "cernvmVersion",	"1.17-11",	NULL,							true,	NULL },
+	{ "cernvmFlavor",	"prod",		NULL,							true,	NULL },
+	{ "executionCap",	"prod",		NULL,							true,	&CVMWebAPISession::applyExecutionCap },
+	{ "flags",			"0",		NULL,							true,	NULL },
+};
+
+/**
+ * The index of the session actions
+ */
+const ActionTable< CVMWebAPISession::Action >& CVMWebAPISession::actions() {
+	static const ActionTable< Action > table( actionList, sizeof(actionList) / sizeof(actionList[0]) );
+	return table;
+}
+
+/**
+ * The index of the session variables
+ */
+const ActionTable< CVMWebAPISession::Key >& CVMWebAPISession::keys() {
+	static const ActionTable< Key > table( keyList, sizeof(keyList) / sizeof(keyList[0]) );
+	return table;
+}
+
 /**
  * Handle session commands
  */
-void CVMWebAPISession::handleAction( CVMCallbackFw& cb, const std::string& action, ParameterMapPtr parameters ) {
+void CVMWebAPISession::handleAction( CVMCallbackFw& cb, const Action* action, ParameterMapPtr parameters ) {
 	CRASH_REPORT_BEGIN;
-	int ret;
-    if (isAborting) return;
-
-	//////////////////////////////////
-	if (action == "start") {
-	//////////////////////////////////
-
-		ret = hvSession->start( parameters );
-		if (ret == HVE_SCHEDULED) {
-	        cb.fire("succeed", ArgumentList("Session will start promptly"));
-		} else if (ret == HVE_OK) {
-	        cb.fire("succeed", ArgumentList("Session started successfully"));
-		} else {
-	        cb.fire("failed", ArgumentList( "Unable to start session" )( ret ) );
-		}
+    if (aborted() || (action->handler == NULL)) return;
+	(this->*(action->handler))( cb, parameters );
+	CRASH_REPORT_END;
+}
 
-		// Send state variables in case they were modified by hypervisor code
-		sendStateVariables();
-
-	//////////////////////////////////
-	} else if (action == "stop") {
-	//////////////////////////////////
-        
-		ret = hvSession->stop();
-		if (ret == HVE_SCHEDULED) {
-	        cb.fire("succeed", ArgumentList("Session will stop promptly"));
-		} else if (ret == HVE_OK) {
-	        cb.fire("succeed", ArgumentList("Session stoped successfully"));
-		} else {
-	        cb.fire("failed", ArgumentList( "Unable to stop session" )( ret ) );
-		}
+/**
+ * Forward the result of a power command
+ */
+static void fireResult( CVMCallbackFw& cb, const int ret, const char * scheduled, const char * completed, const char * failed ) {
+	if (ret == HVE_SCHEDULED) {
+        cb.fire("succeed", scheduled);
+	} else if (ret == HVE_OK) {
+        cb.fire("succeed", completed);
+	} else {
+        cb.fire("failed", failed, ret);
+	}
+}
 
-		// Send state variables in case they were modified by hypervisor code
-		sendStateVariables();
-
-	//////////////////////////////////
-	} else if (action == "pause") {
-	//////////////////////////////////
-        
-		ret = hvSession->pause();
-		if (ret == HVE_SCHEDULED) {
-	        cb.fire("succeed", ArgumentList("Session will pause promptly"));
-		} else if (ret == HVE_OK) {
-	        cb.fire("succeed", ArgumentList("Session paused successfully"));
-		} else {
-	        cb.fire("failed", ArgumentList( "Unable to pause session" )( ret ) );
-		}
+/**
+ * Power commands
+ */
+void CVMWebAPISession::actionStart( CVMCallbackFw& cb, ParameterMapPtr parameters ) {
+	CRASH_REPORT_BEGIN;
+	fireResult( cb, hvSession->start( parameters ), "Session will start promptly", "Session started successfully", "Unable to start session" );
 
-		// Send state variables in case they were modified by hypervisor code
-		sendStateVariables();
-
-	//////////////////////////////////
-	} else if (action == "resume") {
-	//////////////////////////////////
-        
-		ret = hvSession->resume();
-		if (ret == HVE_SCHEDULED) {
-	        cb.fire("succeed", ArgumentList("Session will resume promptly"));
-		} else if (ret == HVE_OK) {
-	        cb.fire("succeed", ArgumentList("Session resumed successfully"));
-		} else {
-	        cb.fire("failed", ArgumentList( "Unable to resume session" )( ret ) );
-		}
+	// Send state variables in case they were modified by hypervisor code
+	sendStateVariables();
+	CRASH_REPORT_END;
+}
+void CVMWebAPISession::actionStop( CVMCallbackFw& cb, ParameterMapPtr /*parameters*/ ) {
+	CRASH_REPORT_BEGIN;
+	fireResult( cb, hvSession->stop(), "Session will stop promptly", "Session stoped successfully", "Unable to stop session" );
+	sendStateVariables();
+	CRASH_REPORT_END;
+}
+void CVMWebAPISession::actionPause( CVMCallbackFw& cb, ParameterMapPtr /*parameters*/ ) {
+	CRASH_REPORT_BEGIN;
+	fireResult( cb, hvSession->pause(), "Session will pause promptly", "Session paused successfully", "Unable to pause session" );
+	sendStateVariables();
+	CRASH_REPORT_END;
+}
+void CVMWebAPISession::actionResume( CVMCallbackFw& cb, ParameterMapPtr /*parameters*/ ) {
+	CRASH_REPORT_BEGIN;
+	fireResult( cb, hvSession->resume(), "Session will resume promptly", "Session resumed successfully", "Unable to resume session" );
+	sendStateVariables();
+	CRASH_REPORT_END;
+}
+void CVMWebAPISession::actionHibernate( CVMCallbackFw& cb, ParameterMapPtr /*parameters*/ ) {
+	CRASH_REPORT_BEGIN;
+	fireResult( cb, hvSession->hibernate(), "Session will hibernate promptly", "Session hibernated successfully", "Unable to hibernate session" );
+	sendStateVariables();
+	CRASH_REPORT_END;
+}
+void CVMWebAPISession::actionReset( CVMCallbackFw& cb, ParameterMapPtr /*parameters*/ ) {
+	CRASH_REPORT_BEGIN;
+	fireResult( cb, hvSession->reset(), "Session will reset promptly", "Session resetd successfully", "Unable to reset session" );
+	sendStateVariables();
+	CRASH_REPORT_END;
+}
+void CVMWebAPISession::actionClose( CVMCallbackFw& cb, ParameterMapPtr /*parameters*/ ) {
+	CRASH_REPORT_BEGIN;
+	fireResult( cb, hvSession->close(), "Session will close promptly", "Session closed successfully", "Unable to close session" );
+	sendStateVariables();
+	CRASH_REPORT_END;
+}
 
-		// Send state variables in case they were modified by hypervisor code
-		sendStateVariables();
-
-	//////////////////////////////////
-	} else if (action == "hibernate") {
-	//////////////////////////////////
-        
-		ret = hvSession->hibernate();
-		if (ret == HVE_SCHEDULED) {
-	        cb.fire("succeed", ArgumentList("Session will hibernate promptly"));
-		} else if (ret == HVE_OK) {
-	        cb.fire("succeed", ArgumentList("Session hibernated successfully"));
-		} else {
-	        cb.fire("failed", ArgumentList( "Unable to hibernate session" )( ret ) );
-		}
+/**
+ * When synchronized, get the state variables
+ */
+void CVMWebAPISession::actionSync( CVMCallbackFw& /*cb*/, ParameterMapPtr /*parameters*/ ) {
+	CRASH_REPORT_BEGIN;
+	sendStateVariables( true );
+	CRASH_REPORT_END;
+}
 
-		// Send state variables in case they were modified by hypervisor code
-		sendStateVariables();
-
-	//////////////////////////////////
-	} else if (action == "reset") {
-	//////////////////////////////////
-        
-		ret = hvSession->reset();
-		if (ret == HVE_SCHEDULED) {
-	        cb.fire("succeed", ArgumentList("Session will reset promptly"));
-		} else if (ret == HVE_OK) {
-	        cb.fire("succeed", ArgumentList("Session resetd successfully"));
-		} else {
-	        cb.fire("failed", ArgumentList( "Unable to reset session" )( ret ) );
-		}
+/**
+ * Return the value of a session variable
+ */
+void CVMWebAPISession::actionGet( CVMCallbackFw& cb, ParameterMapPtr parameters ) {
+	CRASH_REPORT_BEGIN;
 
-		// Send state variables in case they were modified by hypervisor code
-		sendStateVariables();
-
-	//////////////////////////////////
-	} else if (action == "close") {
-	//////////////////////////////////
-        
-		ret = hvSession->close();
-		if (ret == HVE_SCHEDULED) {
-	        cb.fire("succeed", ArgumentList("Session will close promptly"));
-		} else if (ret == HVE_OK) {
-	        cb.fire("succeed", ArgumentList("Session closed successfully"));
-		} else {
-	        cb.fire("failed", ArgumentList( "Unable to close session" )( ret ) );
-		}
+	// Return value
+    cb.fire("succeed", getKey( parameters->get("key", "") ));
+	CRASH_REPORT_END;
+}
 
-		// Send state variables in case they were modified by hypervisor code
-		sendStateVariables();
-
-	//////////////////////////////////
-	} else if (action == "sync") {
-	//////////////////////////////////
-
-		// When synchronized, get the state variables
-		sendStateVariables();
-
-	//////////////////////////////////
-	} else if (action == "get") {
-	//////////////////////////////////
-
-		std::string keyName = parameters->get("key", ""),
-					keyValue = "";
-
-		// Reply only to known key values
-		if (keyName == "apiURL") {
-			// Calculate the API URL
-			std::string host = hvSession->local->get("apiHost",""),
-						port = hvSession->local->get("apiPort", "");
-			keyValue = "http://" + host + ":" + port + "/";
-
-		} else if (keyName == "rdpURL") {
-			// Calculate the VRDE path:port
-			std::string resolution = hvSession->getExtraInfo(EXIF_VIDEO_MODE);
-			keyValue = hvSession->getRDPAddress() + "@" + resolution;
-
-        } else if (keyName == "ip") {
-			keyValue = hvSession->parameters->get("ip", "");
-		} else if (keyName == "cpus") {
-			keyValue = hvSession->parameters->get("cpus", "1");
-        } else if (keyName == "disk") {
-			keyValue = hvSession->parameters->get("disk", "1024");
-		} else if (keyName == "memory") {
-			keyValue = hvSession->parameters->get("memory", "512");
-		} else if (keyName == "cernvmVersion") {
-			keyValue = hvSession->parameters->get("cernvmVersion", "1.17-11");
-		} else if (keyName == "cernvmFlavor") {
-			keyValue = hvSession->parameters->get("cernvmFlavor", "prod");
-		} else if (keyName == "executionCap") {
-			keyValue = hvSession->parameters->get("executionCap", "prod");
-		} else if (keyName == "flags") {
-			keyValue = hvSession->parameters->get("flags", "0");
+/**
+ * Update the value of a session variable
+ */
+void CVMWebAPISession::actionSet( CVMCallbackFw& cb, ParameterMapPtr parameters ) {
+	CRASH_REPORT_BEGIN;
+	setKey( parameters->get("key", ""), parameters->get("value", ""), true );
 
-		}
+	// Notify success
+    cb.fire("succeed", 1);
+	CRASH_REPORT_END;
+}
+
+/**
+ * Update a session property
+ */
+void CVMWebAPISession::actionSetProperty( CVMCallbackFw& cb, ParameterMapPtr parameters ) {
+	CRASH_REPORT_BEGIN;
+	ParameterMapPtr properties = hvSession->parameters->subgroup("properties");
+	std::string keyName = parameters->get("key", ""),
+				keyValue = parameters->get("value", "");
+
+	// Update property
+	hvSession->setProperty(keyName, keyValue);
+
+	// Notify success
+    cb.fire("succeed", 1);
+	CRASH_REPORT_END;
+}
+
+/**
+ * Convert a scalar JSON value to the string representation
+ * used by the action parameters
+ */
+static std::string batchParameter( const Json::Value& value ) {
+	if (value.isString()) return value.asString();
+	if (value.isBool()) return value.asBool() ? "1" : "0";
+	Json::FastWriter writer;
+	std::string text = writer.write( value );
+	if (!text.empty() && (text[text.length()-1] == '\n'))
+		text.resize( text.length() - 1 );
+	return text;
+}
+
+/**
+ * Parse the list of actions of a batch:
+ *
+ *  [ { "name": "get", "data": { "keys": ["cpus", "memory"] } },
+ *    { "name": "set", "data": { "values": { "cpus": 2 } } },
+ *    { "name": "start" } ]
+ */
+bool CVMWebAPIBatch::parse( const std::string& actions ) {
+	CRASH_REPORT_BEGIN;
+	Json::Reader reader;
+	return reader.parse( actions, items ) && items.isArray();
+	CRASH_REPORT_END;
+}
+
+/**
+ * The lane of an action of a batch, the same one it would run on
+ * if it was sent on its own
+ */
+int CVMWebAPISession::batchLane( const Json::Value& item ) {
+	CRASH_REPORT_BEGIN;
+	if (!item.isObject()) return WORKER_LANE_INTERACTIVE;
+	const Action* action = actions().find( batchParameter( item.get("name", "") ) );
+	if ((action != NULL) && (action->flags & ACTION_LONG)) return WORKER_LANE_LONG;
+	return WORKER_LANE_INTERACTIVE;
+	CRASH_REPORT_END;
+}
+
+/**
+ * [Strand] Run the action ``index`` of a batch. The actions of a batch
+ * are posted together, so they run one after the other on the strand.
+ *
+ * The 'succeed' or 'failed' event of every action is collected as
+ * { "status": <event>, "data": [<arguments>] } and all of them are sent
+ * in a single 'succeed' reply after the last one. Other events (ex.
+ * progress) are forwarded as usual with the id of the batch request.
+ */
+void CVMWebAPISession::batchAction( CVMCallbackFw& cb, CVMWebAPIBatchPtr batch, Json::Value::ArrayIndex index ) {
+	CRASH_REPORT_BEGIN;
+	if (batch->over) return;
+
+	// Stop if nobody waits for the results any more
+	if (cb.cancelled()) {
+		batch->over = true;
+		cb.fire("failed", "The request was cancelled", HVE_USAGE_ERROR);
+		return;
+	}
+
+	// Reply what we have if the session is going away
+	if (aborted()) {
+		batch->over = true;
+		cb.fire("succeed", batch->results);
+		return;
+	}
+
+	const Json::Value& item = batch->items[index];
+	Json::Value data = item.isObject() ? item.get("data", Json::Value()) : Json::Value();
+	std::string name = item.isObject() ? batchParameter( item.get("name", "") ) : "";
+	Json::Value result( Json::objectValue );
+	{
+		CVMCallbackFw itemCb( cb, &result );
+
+		// Multi-key projections of get and set
+		if ((name == "get") && data.isObject() && data["keys"].isArray()) {
+			Json::Value values( Json::objectValue );
+			for (Json::Value::ArrayIndex j = 0; j < data["keys"].size(); ++j) {
+				std::string key = batchParameter( data["keys"][j] );
+				values[key] = getKey( key );
+			}
+			itemCb.fire("succeed", values);
+
+		} else if ((name == "set") && data.isObject() && data["values"].isObject()) {
+			std::vector<std::string> names = data["values"].getMemberNames();
+			for (std::vector<std::string>::iterator it = names.begin(); it != names.end(); ++it)
+				setKey( *it, batchParameter( data["values"][*it] ) );
+			itemCb.fire("succeed", 1);
+
+		} else {
+
+			// Look up the action, rejecting nested batches
+			std::string error;
+			const Action* action = actions().find( name );
+			if ((action == NULL) || (action->flags & ACTION_BATCH)) {
+				itemCb.fire("failed", "Unknown action '" + name + "'", HVE_USAGE_ERROR);
+			} else {
+
+				// Collect the parameters and validate them
+				ParameterMapPtr itemParameters = ParameterMap::instance();
+				if (data.isObject()) {
+					std::vector<std::string> names = data.getMemberNames();
+					for (std::vector<std::string>::iterator it = names.begin(); it != names.end(); ++it)
+						if (!data[*it].isNull()) itemParameters->set( *it, batchParameter( data[*it] ) );
+				}
+				if (!actionValidate( action->params, itemParameters, &error )) {
+					itemCb.fire("failed", error, HVE_USAGE_ERROR);
+				} else {
+					(this->*(action->handler))( itemCb, itemParameters );
+				}
+
+			}
 
-		// Return value
-        cb.fire("succeed", ArgumentList(keyValue));
-
-	//////////////////////////////////
-	} else if (action == "set") {
-	//////////////////////////////////
-
-		std::string keyName = parameters->get("key", ""),
-					keyValue = parameters->get("value", "");
-
-		// Update only particular variables
-		if (keyName == "cpus") {
-			hvSession->parameters->set("cpus", keyValue);
-        } else if (keyName == "disk") {
-			hvSession->parameters->set("disk", keyValue);
-		} else if (keyName == "memory") {
-			hvSession->parameters->set("memory", keyValue);
-		} else if (keyName == "cernvmVersion") {
-			hvSession->parameters->set("cernvmVersion", keyValue);
-		} else if (keyName == "cernvmFlavor") {
-			hvSession->parameters->set("cernvmFlavor", keyValue);
-		} else if (keyName == "executionCap") {
-			hvSession->parameters->set("executionCap", keyValue);
-
-			// Try to apply execution cap right-away
-			hvSession->setExecutionCap( ston<int>(keyValue) );
-
-		} else if (keyName == "flags") {
-			hvSession->parameters->set("flags", keyValue);
 		}
+	}
+	batch->results.append( result );
 
-		// Notify success
-        cb.fire("succeed", ArgumentList(1));
+	// Reply all the results after the last action
+	if (index + 1 >= batch->items.size()) {
+		batch->over = true;
+		cb.fire("succeed", batch->results);
+	}
+	CRASH_REPORT_END;
+}
 
-	//////////////////////////////////
-	} else if (action == "setProperty") {
-	//////////////////////////////////
+/**
+ * Return the value of a session variable
+ */
+std::string CVMWebAPISession::getKey( const std::string& name ) {
+	CRASH_REPORT_BEGIN;
 
-		ParameterMapPtr properties = hvSession->parameters->subgroup("properties");
-		std::string keyName = parameters->get("key", ""),
-					keyValue = parameters->get("value", "");
+	// Reply only to known key values
+	const Key * key = keys().find( name );
+	if (key == NULL) return "";
+	if (key->getter != NULL) return (this->*(key->getter))();
+	return hvSession->parameters->get(key->name, key->defaultValue);
 
-		// Update property
-		hvSession->setProperty(keyName, keyValue);
+	CRASH_REPORT_END;
+}
 
-		// Notify success
-        cb.fire("succeed", ArgumentList(1));
+/**
+ * Update the value of a session variable
+ */
+void CVMWebAPISession::setKey( const std::string& name, const std::string& value, bool onStrand ) {
+	CRASH_REPORT_BEGIN;
 
+	// Update only particular variables
+	const Key * key = keys().find( name );
+	if ((key == NULL) || !key->writable) return;
+	hvSession->parameters->set(key->name, value);
+
+	// The hooks talk to the hypervisor, so they don't hold the interactive lane
+	if (key->onSet == NULL) return;
+	if (onStrand) {
+		strand->post( boost::bind( &CVMWebAPISession::applyKey_task, shared_from_this(), key, value ), WORKER_LANE_LONG, this );
+	} else {
+		(this->*(key->onSet))( value );
 	}
+
 	CRASH_REPORT_END;
 }
 
+/**
+ * Apply the hook of a session variable, in order with the other actions
+ */
+void CVMWebAPISession::applyKey_task( const Key* key, const std::string& value ) {
+	CRASH_REPORT_BEGIN;
+	if (aborted()) return;
+	(this->*(key->onSet))( value );
+	CRASH_REPORT_END;
+}
+
+/**
+ * Calculate the API URL
+ */
+std::string CVMWebAPISession::keyApiURL() {
+	std::string host = hvSession->local->get("apiHost",""),
+				port = hvSession->local->get("apiPort", "");
+	return "http://" + host + ":" + port + "/";
+}
+
+/**
+ * Calculate the VRDE path:port
+ */
+std::string CVMWebAPISession::keyRdpURL() {
+	std::string resolution = hvSession->getExtraInfo(EXIF_VIDEO_MODE);
+	return hvSession->getRDPAddress() + "@" + resolution;
+}
+
+/**
+ * Try to apply execution cap right-away
+ */
+void CVMWebAPISession::applyExecutionCap( const std::string& value ) {
+	hvSession->setExecutionCap( ston<int>(value) );
+}
+
 /**
  * Enable or disable periodic jobs
  */
 void CVMWebAPISession::enablePeriodicJobs( bool status ) {
-    if (isAborting) return;
+	boost::unique_lock<boost::mutex> lock(periodicJobsMutex);
+    if (aborted()) return;
 	acceptPeriodicJobs = status;
+
+	// Start or stop polling
+	if (status) {
+		schedulePeriodicJobs();
+	} else {
+		cancelPeriodicJobs();
+	}
 }
 
 /**
  * Send a failure message
  */
 void CVMWebAPISession::sendFailure( const std::string& message ) {
-	connection.sendEvent( "failure", ArgumentList(message), uuid_str );
+	core->eventBus.publish( uuid, EVENT_FAILURE, WebsocketAPI::buildTypedEvent( "failure", uuid_str, message ) );
+}
+
+/**
+ * Raise the isAborting flag
+ */
+void CVMWebAPISession::setAborting() {
+	boost::unique_lock<boost::mutex> lock(abortMutex);
+	isAborting = true;
 }
 
 /**
@@ -260,10 +439,11 @@ void CVMWebAPISession::sendFailure( const std::string& message ) {
  */
 void CVMWebAPISession::abort() {
 
-	// Raise the isAborting flag
+	// Raise the isAborting flag and stop polling
 	{
 		boost::unique_lock<boost::mutex> lock(periodicJobsMutex);
-		isAborting = true;
+		setAborting();
+		cancelPeriodicJobs();
 	}
 
 	// Abort any download provider 
@@ -272,22 +452,75 @@ void CVMWebAPISession::abort() {
 }
 
 /**
- * Handle timed event
+ * Close the hypervisor session
  */
-void CVMWebAPISession::processPeriodicJobs() {
+void CVMWebAPISession::close() {
 	CRASH_REPORT_BEGIN;
-    if (isAborting) return;
-	if (!acceptPeriodicJobs) return;
-	if (periodicsRunning) return;
+	if (isClosed) return;
 
-	// Delete previous thread instance
-	if (periodicJobsThreadPtr != NULL)
-		delete periodicJobsThreadPtr;
+	// Stop the periodic jobs and wait for a run in progress
+	{
+		boost::unique_lock<boost::mutex> lock(periodicJobsMutex);
+		setAborting();
+		cancelPeriodicJobs();
+	}
+	{
+		DrainWaitLock lock(periodicDrain);
+	}
 
-	// Create new periodic jobs thread
-	try {
-		periodicJobsThreadPtr = new boost::thread( boost::bind( &CVMWebAPISession::periodicJobsThread, this ) );
-	} catch (boost::thread_resource_error& e) {
+	// Cleanup & abort libcernvm session threads
+	hvSession->off( "stateChanged", hStateChanged );
+	hvSession->off( "resolutionChanged", hResChanged );
+	hvSession->off( "failure", hFailure );
+
+	// Close session (unless the hypervisor was uninstalled)
+	HVInstancePtr hv = core->getHypervisor();
+	if (hv) hv->sessionClose( hvSession );
+	isClosed = true;
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Schedule the next poll
+ */
+void CVMWebAPISession::schedulePeriodicJobs() {
+	CRASH_REPORT_BEGIN;
+	if ((periodicTimer != 0) || periodicRunning) return;
+
+	// Poll faster while booting, and not at all while hibernated
+	int interval;
+	int sessionState = hvSession->local->getNum<int>("state", 0);
+	if (sessionState == SS_SAVED) {
+		return;
+	} else if (sessionState == SS_RUNNING) {
+		interval = apiPortOnline ? CVMWA_SESS_POLL_RUNNING : CVMWA_SESS_POLL_BOOTING;
+	} else {
+		interval = CVMWA_SESS_POLL_IDLE;
+	}
+
+	// The probes of the API port can block for a while, so
+	// don't keep the interactive workers busy with them
+	periodicDrain.increment();
+	periodicTimer = core->timers.schedule( interval, boost::bind( &CVMWebAPISession::periodicJobs, this ), WORKER_LANE_LONG, this );
+	if (periodicTimer == 0)
+		periodicDrain.decrement();
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Cancel the scheduled poll
+ */
+void CVMWebAPISession::cancelPeriodicJobs() {
+	CRASH_REPORT_BEGIN;
+	if (periodicTimer == 0) return;
+
+	// If the timer has already expired, the poll is queued on the
+	// workers. It clears the timer and releases the drain by itself.
+	if (core->timers.cancel( periodicTimer )) {
+		periodicDrain.decrement();
+		periodicTimer = 0;
 	}
 
 	CRASH_REPORT_END;
@@ -296,15 +529,37 @@ void CVMWebAPISession::processPeriodicJobs() {
 /**
  * Handle timed event
  */
-void CVMWebAPISession::periodicJobsThread() {
+void CVMWebAPISession::periodicJobs() {
 	CRASH_REPORT_BEGIN;
-	boost::unique_lock<boost::mutex> lock(periodicJobsMutex);
-    if (isAborting) return;
+	bool poll;
+	{
+		boost::unique_lock<boost::mutex> lock(periodicJobsMutex);
+		periodicTimer = 0;
+		poll = periodicRunning = !aborted() && acceptPeriodicJobs;
+	}
 
-	try {
+	// The poll can block for seconds, so it runs without the mutex, which
+	// abort() takes on the I/O thread. close() waits for it on periodicDrain.
+	if (poll) {
+		periodicJobsPoll();
 
-		// Mark the thread as running
-		periodicsRunning = true;
+		boost::unique_lock<boost::mutex> lock(periodicJobsMutex);
+		periodicRunning = false;
+		if (!aborted() && acceptPeriodicJobs)
+			schedulePeriodicJobs();
+	}
+
+	// The session might be destructed right after this
+	periodicDrain.decrement();
+	CRASH_REPORT_END;
+}
+
+/**
+ * Poll the session state and the API port
+ */
+void CVMWebAPISession::periodicJobsPoll() {
+	CRASH_REPORT_BEGIN;
+	try {
 
 		// Synchronize session state with VirtualBox (or file)
 		hvSession->update(false);
@@ -321,7 +576,7 @@ void CVMWebAPISession::periodicJobsThread() {
 	    		// Check if API port has gone online
 	    		bool newState = hvSession->isAPIAlive(HSK_HTTP, 1);
 	    		if (newState) {
-		    		connection.sendEvent( "apiStateChanged", ArgumentList(true)(apiURL), uuid_str );
+		    		core->eventBus.publish( uuid, EVENT_STATE, WebsocketAPI::buildTypedEvent( "apiStateChanged", uuid_str, true, apiURL ) );
 	    			apiPortOnline = true;
 	    			apiPortDownCounter = 0;
 	    			apiPortCounter = 0;
@@ -335,7 +590,7 @@ void CVMWebAPISession::periodicJobsThread() {
 	    			// Check for offline port
 		    		if (!hvSession->isAPIAlive(HSK_HTTP, 10)) {
 		    			if (++apiPortDownCounter >= CVMWA_SESS_APIPORT_DOWN_RETRIES) {
-				    		connection.sendEvent( "apiStateChanged", ArgumentList(false)(apiURL), uuid_str );
+				    		core->eventBus.publish( uuid, EVENT_STATE, WebsocketAPI::buildTypedEvent( "apiStateChanged", uuid_str, false, apiURL ) );
 			    			apiPortOnline = false;
 			    		}
 		    		} else {
@@ -350,26 +605,21 @@ void CVMWebAPISession::periodicJobsThread() {
 	    } else {
 	    	if (apiPortOnline) {
 	    		// In any other state, the port is just offline
-	    		connection.sendEvent( "apiStateChanged", ArgumentList(false)(apiURL), uuid_str );
+	    		core->eventBus.publish( uuid, EVENT_STATE, WebsocketAPI::buildTypedEvent( "apiStateChanged", uuid_str, false, apiURL ) );
 	    		apiPortOnline = false;
 	    		apiPortDownCounter = 0;
 	    		apiPortCounter = 0;
 	    	}
 	    }
 
-	    // Mark the thread as completed
-	    periodicsRunning = false;
-
     } catch (std::bad_alloc&) {
 
         // An object was destructed but the thread was still running
         CVMWA_LOG("CRITICAL", "Object pointer access error on restructed object");
-        periodicsRunning = false;
 
 	} catch (boost::thread_interrupted &e) {
 		
 		// We are interrupted
-		periodicsRunning = false;
 
 	}
 
@@ -381,13 +631,13 @@ void CVMWebAPISession::periodicJobsThread() {
  */
 void CVMWebAPISession::__cbFailure( VariantArgList& args ) {
 	CRASH_REPORT_BEGIN;
-    if (isAborting) return;
+    if (aborted()) return;
 
 	// Check if we switched to a state where API is not available any more
 	int failureFlags = boost::get<int>(args[0]);
 
 	// Forward the failure to the UI
-	connection.sendEvent( "failure", args, uuid_str );
+	core->eventBus.publish( uuid, EVENT_FAILURE, WebsocketAPI::buildEvent( "failure", args, uuid_str ) );
 
 	// Poweroff the vm in particular cases
 	if ( (failureFlags & HFL_NO_VIRTUALIZATION != 0) ) {
@@ -402,11 +652,11 @@ void CVMWebAPISession::__cbFailure( VariantArgList& args ) {
  */
 void CVMWebAPISession::__cbStateChanged( VariantArgList& args ) {
 	CRASH_REPORT_BEGIN;
-    if (isAborting) return;
+    if (aborted()) return;
 
 	// Before sending stateChanged, send the updated state variables
 	sendStateVariables();
-	connection.sendEvent( "stateChanged", args, uuid_str );
+	core->eventBus.publish( uuid, EVENT_STATE, WebsocketAPI::buildEvent( "stateChanged", args, uuid_str ) );
 
 	// Check if we switched to a state where API is not available any more
 	int sessionState = boost::get<int>(args[0]);
@@ -416,10 +666,19 @@ void CVMWebAPISession::__cbStateChanged( VariantArgList& args ) {
 
 	if ((sessionState != SS_RUNNING) && apiPortOnline) {
 		// In any other state, the port is just offline
-		connection.sendEvent( "apiStateChanged", ArgumentList(false)(apiURL), uuid_str );
+		core->eventBus.publish( uuid, EVENT_STATE, WebsocketAPI::buildTypedEvent( "apiStateChanged", uuid_str, false, apiURL ) );
 		apiPortOnline = false;
 	}
 
+	// Adapt the polling interval to the new state (or resume polling if the
+	// session was hibernated). If the lock is taken, the poll is running or
+	// being (re)scheduled by the holder anyway.
+	boost::unique_lock<boost::mutex> lock(periodicJobsMutex, boost::try_to_lock);
+	if (lock.owns_lock() && acceptPeriodicJobs && !aborted()) {
+		cancelPeriodicJobs();
+		schedulePeriodicJobs();
+	}
+
 	CRASH_REPORT_END;
 }
 
@@ -428,7 +687,7 @@ void CVMWebAPISession::__cbStateChanged( VariantArgList& args ) {
  */
 void CVMWebAPISession::__cbResolutionChanged( VariantArgList& args ) {
 	CRASH_REPORT_BEGIN;
-    if (isAborting) return;
+    if (aborted()) return;
 
 	// Get resolution information
 	int width = boost::get<int>(args[0]),
@@ -436,7 +695,7 @@ void CVMWebAPISession::__cbResolutionChanged( VariantArgList& args ) {
 		bpp = boost::get<int>(args[2]);
 
 	// Send state variables
-	connection.sendEvent( "resolutionChanged", ArgumentList(width)(height)(bpp), uuid_str );
+	core->eventBus.publish( uuid, EVENT_STATE, WebsocketAPI::buildTypedEvent( "resolutionChanged", uuid_str, width, height, bpp ) );
 
 	CRASH_REPORT_END;
 }
@@ -446,21 +705,17 @@ void CVMWebAPISession::__cbResolutionChanged( VariantArgList& args ) {
  * Compile and send all the required properties to the
  * remote endpoint. 
  */
-void CVMWebAPISession::sendStateVariables() {
+void CVMWebAPISession::sendStateVariables( bool full ) {
 	CRASH_REPORT_BEGIN;
 
-    if (isAborting) return;
-	Json::Value root;
-
-	// Populate core protocol fields
-	root["type"] = "event";
-	root["name"] = "stateVariables";
-	root["id"] = uuid_str;
-	root["data"] = sessionStateInfoToJSON( hvSession );
+    if (aborted()) return;
 
-	// Send JSON response
-	Json::FastWriter writer;
-	connection.sendRawData( writer.write(root) );
+	// Take the snapshot and hand it to the subscribers under the lock, so
+	// the frames of concurrent calls reach them in the order of their state
+	boost::unique_lock<boost::mutex> lock(stateMutex);
+	Json::Value state = sessionStateInfoToJSON( hvSession );
+	StateEncoder encoder( uuid_str, state );
+	core->eventBus.publishState( uuid, encoder, full );
 
 	CRASH_REPORT_END;
 }
@@ -29,20 +29,45 @@
 
 #include <CernVM/Hypervisor/Virtualbox/VBoxSession.h>
 
+#include <boost/enable_shared_from_this.hpp>
+
 // How many times to retry before deciding that
 // the API port is really offline.
 #define CVMWA_SESS_APIPORT_DOWN_RETRIES		2
 
-class CVMWebAPISession {
+// How often to poll the session (in milliseconds) while the VM is booting
+// (running but its API port is not online yet), running, or in any other
+// state. Saved (hibernated) sessions are not polled until their state changes.
+#define CVMWA_SESS_POLL_BOOTING				500
+#define CVMWA_SESS_POLL_RUNNING				1000
+#define CVMWA_SESS_POLL_IDLE				5000
+
+/**
+ * The actions of a batch request and their results so far. The actions
+ * run on the strand of the session, so only one of them touches it at a time.
+ */
+struct CVMWebAPIBatch {
+	CVMWebAPIBatch() : items(), results( Json::arrayValue ), over(false) { };
+
+	// Parse the 'actions' parameter of the request
+	bool 			parse( const std::string& actions );
+
+	Json::Value 	items;
+	Json::Value 	results;
+	bool 			over; 		// The reply was sent
+};
+
+class CVMWebAPISession : public boost::enable_shared_from_this< CVMWebAPISession > {
 public:
 
 	/**
 	 * Constructor for the CernVM WebAPI Session 
 	 */
 	CVMWebAPISession( DaemonCore* core, DaemonConnection& connection, HVSessionPtr hvSession, int uuid  )
-		: core(core), connection(connection), hvSession(hvSession), uuid(uuid), uuid_str(ntos<int>(uuid)), 
-		  callbackForwarder( connection, uuid_str ), apiPortOnline(false), periodicsRunning(false), apiPortCounter(0),
-		  periodicJobsThreadPtr(NULL), apiPortDownCounter(0), isAborting(false), periodicJobsMutex()
+		: core(core), connection(&connection), domain(connection.getDomain()), leaseToken(newGUID()), leaseTimer(0),
+		  hvSession(hvSession), uuid(uuid), uuid_str(ntos<int>(uuid)), callbackForwarder( core->eventBus, uuid, uuid_str ),
+		  apiPortOnline(false), periodicTimer(0), periodicDrain(), periodicRunning(false), apiPortCounter(0), apiPortDownCounter(0), isAborting(false), isClosed(false), periodicJobsMutex(),
+		  stateMutex(), abortMutex()
 	{ 
 	    CRASH_REPORT_BEGIN;
 
@@ -60,9 +85,15 @@ public:
         // make callbackForwarder to listen for it's progress events, and then
         // give the progress feedback object for use by the FSM  
         //
+        // (The events are published on the bus and never sent to the connection
+        // directly, so they follow the session when it's resumed on another one)
+        //
         FiniteTaskPtr ft = boost::make_shared<FiniteTask>();
         callbackForwarder.listen( ft );
 
+        // The worker actions of the session run in order on its own strand
+        strand = boost::make_shared<WorkerStrand>( boost::ref(core->workerPool) );
+
         // Clone the download provider in order to provide a multi-threaded support
         downloadProvider = DownloadProvider::Default()->clone();
         hvSession->setDownloadProvider(downloadProvider);
@@ -81,39 +112,34 @@ public:
 	virtual ~CVMWebAPISession() {
 	    CRASH_REPORT_BEGIN;
 		CVMWA_LOG("Debug", "Destructing CVMWebAPISession");
-
-		// Wait for periodic jobs thread to complete
-		if (periodicJobsThreadPtr != NULL) {
-
-			// Join periodic threads
-			if (periodicsRunning)
-				periodicJobsThreadPtr->join();
-
-			// Delete pointer
-			delete periodicJobsThreadPtr;
-
-        }
-
-		// Cleanup & abort libcernvm session threads
-		hvSession->off( "stateChanged", hStateChanged );
-		hvSession->off( "resolutionChanged", hResChanged );
-		hvSession->off( "failure", hFailure );
-
-		// Close session
-		core->hypervisor->sessionClose( hvSession );
-
+		close();
 	    CRASH_REPORT_END;
 	}
 
+	/**
+	 * The declarations of the session actions
+	 */
+	typedef CVMWebAPISessionAction Action;
+
+	/**
+	 * The index of the session actions
+	 */
+	static const ActionTable< Action >& actions();
+
 	/**
 	 * Handling of commands directed for this session
 	 */
-	void handleAction( CVMCallbackFw& cb, const std::string& action, ParameterMapPtr parameters );
+	void handleAction( CVMCallbackFw& cb, const Action* action, ParameterMapPtr parameters );
+
+	/**
+	 * The lane an action of a batch runs on
+	 */
+	static int 			batchLane( const Json::Value& item );
 
 	/**
-	 * Session polling timer
+	 * [Strand] Run an action of a batch, replying the results after the last one
 	 */
-	void 				processPeriodicJobs( );
+	void 				batchAction( CVMCallbackFw& cb, CVMWebAPIBatchPtr batch, Json::Value::ArrayIndex index );
 
 	/**
 	 * Set status of the periodic jobs thread
@@ -122,9 +148,13 @@ public:
 
 	/**
 	 * Send the configuration variable values (not to use polling for some
-	 * time-critical operations)
+	 * time-critical operations).
+	 *
+	 * A browser that accepts deltas only receives the keys changed since
+	 * the last frame it got, unless ``full`` is true. Nothing is sent to
+	 * a subscriber whose state did not change, unless ``full`` is true.
 	 */
-	void 				sendStateVariables();
+	void 				sendStateVariables( bool full = false );
 
 	/**
 	 * Send a failure message
@@ -136,6 +166,18 @@ public:
 	 */
 	void 				abort();
 
+	/**
+	 * Stop the periodic jobs, unhook from the hypervisor session and close
+	 * it. Nothing is done if the session is already closed. The object is
+	 * released when the last action that still holds it is over.
+	 */
+	void 				close();
+
+	/**
+	 * Check if the session was aborted
+	 */
+	bool 				aborted() { boost::unique_lock<boost::mutex> lock(abortMutex); return isAborting; };
+
 	/**
 	 * The session ID
 	 */
@@ -147,9 +189,22 @@ public:
 	std::string 		uuid_str;
 
 	/**
-	 * The websocket connection used for I/O
+	 * The websocket connection the session is attached to, or NULL while
+	 * it's leased (waiting for its page to reconnect and resume it)
 	 */
-	DaemonConnection& 	connection;
+	DaemonConnection* 	connection;
+
+	/**
+	 * The domain of the website that opened the session
+	 */
+	std::string 		domain;
+
+	/**
+	 * The secret the page uses for resuming the session, and the timer
+	 * that closes it if the lease expires
+	 */
+	std::string 		leaseToken;
+	TimerID 			leaseTimer;
 
 	/**
 	 * The custom DownloadProvider for this thread
@@ -161,8 +216,65 @@ public:
 	 */
 	HVSessionPtr		hvSession;
 
+	/**
+	 * The serial queue of the worker actions of this session
+	 */
+	WorkerStrandPtr		strand;
+
 private:
 
+	/**
+	 * A session variable that can be accessed with the get/set actions
+	 */
+	struct Key {
+		const char * 	name;
+		const char * 	defaultValue; 							// Default of the session parameter
+		std::string 	(CVMWebAPISession::*getter)(); 			// Computed value (instead of the session parameter)
+		bool 			writable; 								// Can be changed with 'set'
+		void 			(CVMWebAPISession::*onSet)( const std::string& value );	// Applied after 'set'
+	};
+
+	/**
+	 * The session actions, the session variables and their index
+	 */
+	static const Action 				actionList[];
+	static const Key 					keyList[];
+	static const ActionTable< Key >& 	keys();
+
+	/**
+	 * Action handlers
+	 */
+	void actionStart		( CVMCallbackFw& cb, ParameterMapPtr parameters );
+	void actionStop			( CVMCallbackFw& cb, ParameterMapPtr parameters );
+	void actionPause		( CVMCallbackFw& cb, ParameterMapPtr parameters );
+	void actionResume		( CVMCallbackFw& cb, ParameterMapPtr parameters );
+	void actionHibernate	( CVMCallbackFw& cb, ParameterMapPtr parameters );
+	void actionReset		( CVMCallbackFw& cb, ParameterMapPtr parameters );
+	void actionClose		( CVMCallbackFw& cb, ParameterMapPtr parameters );
+	void actionSync			( CVMCallbackFw& cb, ParameterMapPtr parameters );
+	void actionGet			( CVMCallbackFw& cb, ParameterMapPtr parameters );
+	void actionSet			( CVMCallbackFw& cb, ParameterMapPtr parameters );
+	void actionSetProperty	( CVMCallbackFw& cb, ParameterMapPtr parameters );
+
+	/**
+	 * Read or update a session variable (unknown or read-only keys are ignored).
+	 * The hook of the variable is applied on the strand if ``onStrand`` is set.
+	 */
+	std::string getKey( const std::string& name );
+	void setKey( const std::string& name, const std::string& value, bool onStrand = false );
+
+	/**
+	 * [Strand] Apply the hook of a session variable that was updated
+	 */
+	void applyKey_task( const Key* key, const std::string& value );
+
+	/**
+	 * Computed session variables and hooks
+	 */
+	std::string keyApiURL();
+	std::string keyRdpURL();
+	void applyExecutionCap( const std::string& value );
+
 	/**
 	 * Event callbacks from the hypervisor session
 	 */
@@ -171,19 +283,42 @@ private:
 	void __cbFailure( VariantArgList& args );
 
 	/*
-	 * Periodic jobs thread
+	 * [Timer] Poll the session and schedule the next poll
+	 */
+	void periodicJobs( );
+
+	/**
+	 * Synchronize the session state and probe the API port
 	 */
-	void periodicJobsThread( );
+	void periodicJobsPoll( );
 
 	/**
-	 * Flab which indicates that the periodic job thread is running
+	 * Schedule the next poll, with an interval that depends on the state
+	 * of the VM (the caller must hold periodicJobsMutex)
 	 */
-	bool 				periodicsRunning;
+	void schedulePeriodicJobs( );
 
 	/**
-	 * The pointer to the thread that runs the periodic job
+	 * Cancel the scheduled poll (the caller must hold periodicJobsMutex)
 	 */
-	boost::thread* 	periodicJobsThreadPtr;
+	void cancelPeriodicJobs( );
+
+	/**
+	 * The timer of the next poll (zero if none is scheduled)
+	 */
+	TimerID 			periodicTimer;
+
+	/**
+	 * The number of polls scheduled or running, used for
+	 * waiting them before destruction.
+	 */
+	DrainSemaphore 		periodicDrain;
+
+	/**
+	 * Flag raised while a poll runs outside periodicJobsMutex
+	 * (protected by periodicJobsMutex)
+	 */
+	bool 				periodicRunning;
 
 	/**
 	 * The daemon's core state manager
@@ -206,7 +341,8 @@ private:
 	NamedEventSlotPtr 	hFailure;
 
 	/**
-	 * Callback forwarding object
+	 * Callback forwarding object (publishing on the event bus, since the
+	 * session can move to another connection when it's resumed)
 	 */
 	CVMCallbackFw		callbackForwarder;
 
@@ -227,7 +363,7 @@ private:
 
 	/**
 	 * Flag that defines if we should accept periodic
-	 * updates from the periodicJobsThread();
+	 * updates from the periodicJobs();
 	 */
 	bool				acceptPeriodicJobs;
 
@@ -236,11 +372,33 @@ private:
      */
     bool                isAborting;
 
+    /**
+     * Flag that is raised when the hypervisor session is closed
+     */
+    bool                isClosed;
+
     /**
      * Periodic jobs mutex
      */
     boost::mutex		periodicJobsMutex;
 
+    /**
+     * Mutex that keeps the state frames in the egress order
+     * (the state each subscriber has is kept by the event bus)
+     */
+    boost::mutex		stateMutex;
+
+    /**
+     * Mutex for accessing the isAborting flag, which is read by
+     * the callbacks and the actions while the session is polled
+     */
+    boost::mutex		abortMutex;
+
+    /**
+     * Raise the isAborting flag
+     */
+    void 				setAborting();
+
 };
 
 #endif /* end of include guard: DAEMON_COMPONENT_WEBAPISESSION_H */
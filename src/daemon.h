@@ -24,6 +24,10 @@
 
 #include "web/webserver.h"
 #include "web/api.h"
+#include "action_table.h"
+#include "event_bus.h"
+#include "worker_pool.h"
+#include "timer_wheel.h"
 
 #include <boost/shared_ptr.hpp>
 
@@ -34,8 +38,14 @@ class DaemonFactory;
 
 class CVMCallbackFw;
 class CVMWebAPISession;
+struct CVMWebAPIBatch;
 
 typedef boost::shared_ptr< CVMWebAPISession >	CVMWebAPISessionPtr;
+typedef boost::shared_ptr< CVMWebAPIBatch >		CVMWebAPIBatchPtr;
+
+// Declaration of the session actions (see CVMWebAPISession::actionList)
+typedef void (CVMWebAPISession::*CVMWebAPISessionActionHandler)( CVMCallbackFw& cb, ParameterMapPtr parameters );
+typedef ActionEntry< CVMWebAPISessionActionHandler >	CVMWebAPISessionAction;
 
 // Include implementations
 #include "daemon_core.h"
@@ -33,218 +33,682 @@
 /**
  * Cleanup before destuction
  */
-void DaemonConnection::cleanup() {
+bool DaemonConnection::cleanup() {
     CRASH_REPORT_BEGIN;
+    bool released = true;
 
-    // Abort user interaction
+    // Stop receiving session events
+    core.eventBus.unsubscribeAll( this );
+
+    // Abort user interaction, dropping the requests waiting for the user
     userInteraction->abort(true);
+    {
+        boost::mutex::scoped_lock lock(promptsMutex);
+        prompts.clear();
+    }
 
-    // Abort and join all threads
-    runningThreads.interrupt_all();
+    // Skip our queued tasks, cancel and interrupt the running ones
+    // and wait until all of them are over
+    {
+        boost::mutex::scoped_lock lock(flagsMutex);
+        closing = true;
+    }
+    {
+        boost::unique_lock<boost::mutex> lock(requestsMutex);
+        for (std::map< std::string, boost::weak_ptr< CancelToken > >::iterator it = requests.begin(); it != requests.end(); ++it) {
+            CancelTokenPtr cancelToken = it->second.lock();
+            if (cancelToken) cancelToken->cancel();
+        }
+    }
+    core.workerPool.interrupt( this );
     {
-        DrainWaitLock lock(threadDrain); // Wait until nobody is playing with the runningThreads
-        runningThreads.join_all();
+        boost::mutex::scoped_lock lock(throttleMutex);
+        cancelTask( throttleTimer );
+        throttleTimer = 0;
+    }
+    if (!threadDrain.wait( CVMWA_TEARDOWN_DEADLINE )) {
+        CVMWA_LOG("Warning", "Connection tasks still running after " << CVMWA_TEARDOWN_DEADLINE << "ms, aborting their sessions");
+        core.abortConnectionSessions( *this );
+        core.workerPool.interrupt( this );
+        if (!threadDrain.wait( CVMWA_TEARDOWN_DEADLINE )) {
+            CVMWA_LOG("Error", "Connection tasks still running after aborting their sessions, abandoning the connection");
+            released = false;
+        }
     }
 
     // If an installation was initiated by this session, it was just
-    // aborted. Clear the installation flag
-    if (installInProgress) {
-        installInProgress = false;
-        core.installInProgress = false;
+    // aborted. Clear the installation flag (a task that is still
+    // running clears it when it's over)
+    if (released) endInstall();
+
+    // Release all sessions by this connection. They are closed in
+    // parallel, but they refer to us, so we must wait for all of them.
+    DrainSemaphorePtr sessionsDrain = core.releaseConnectionSessions( *this );
+    if (!sessionsDrain->wait( CVMWA_TEARDOWN_DEADLINE )) {
+        CVMWA_LOG("Error", "Connection sessions still closing after " << CVMWA_TEARDOWN_DEADLINE << "ms, abandoning the connection");
+        released = false;
     }
+    return released;
 
-    // Release all sessions by this connection
-    core.releaseConnectionSessions( *this );
-    
     CRASH_REPORT_END;
 }
 
+/**
+ * The actions of the daemon connection
+ */
+const DaemonConnection::Action DaemonConnection::actionList[] = {
+
+    // Common actions
+    { "handshake",              &DaemonConnection::actionHandshake,             ACTION_INLINE,
+        { { "auth", ACTION_PARAM_STRING, false }, { "batch", ACTION_PARAM_INT, false }, { "delta", ACTION_PARAM_INT, false } } },
+    { "interactionCallback",    &DaemonConnection::actionInteractionCallback,   ACTION_INLINE,
+        { { "result", ACTION_PARAM_INT, true } } },
+
+    // Session management
+    { "requestSession",         &DaemonConnection::actionRequestSession,        ACTION_INLINE,
+        { { "vmcp", ACTION_PARAM_STRING, true } } },
+    { "resumeSession",          &DaemonConnection::actionResumeSession,         ACTION_INLINE,
+        { { "token", ACTION_PARAM_STRING, true } } },
+
+    // Power-user commands
+    { "stopService",            &DaemonConnection::actionStopService,           ACTION_INLINE | ACTION_PRIVILEGED,
+        { } },
+    { "enumSessions",           &DaemonConnection::actionEnumSessions,          ACTION_INLINE | ACTION_PRIVILEGED,
+        { } },
+    { "controlSession",         &DaemonConnection::actionControlSession,        ACTION_INLINE | ACTION_PRIVILEGED,
+        { { "session", ACTION_PARAM_STRING, true }, { "action", ACTION_PARAM_STRING, true } } },
+
+    // Request management
+    { "cancel",                 &DaemonConnection::actionCancel,                ACTION_INLINE,
+        { { "target", ACTION_PARAM_STRING, true } } },
+
+    // Session events
+    { "subscribe",              &DaemonConnection::actionSubscribe,             ACTION_INLINE,
+        { { "session", ACTION_PARAM_INT, false }, { "events", ACTION_PARAM_STRING, false } } },
+
+};
+
+/**
+ * The index of the daemon connection actions
+ */
+const ActionTable< DaemonConnection::Action >& DaemonConnection::actions() {
+    static const ActionTable< Action > table( actionList, sizeof(actionList) / sizeof(actionList[0]) );
+    return table;
+}
+
 /**
  * Handle incoming websocket action
  */
 void DaemonConnection::handleAction( const std::string& id, const std::string& action, ParameterMapPtr parameters ) {
     CRASH_REPORT_BEGIN;
-    Json::Value data;
+    std::string error;
 
     // Useful information for crash reporting
     crashReportAddInfo( "domain", domain );
     crashReportAddInfo( "web-action", action );
 
-    // This is a critical section for runningThreadsMute
+    // Cleanup must wait until we are done submitting tasks
     DrainUseLock lock(threadDrain);
 
-    // =============================
-    //  Common actions
-    // =============================
+    // Handle the actions of the daemon
+    const Action * a = actions().find( action );
+    if (a != NULL) {
 
-    // [Handshake] 
-    //  Sent right after the connection is established
-	if (action == "handshake") {
+        // Power-user commands are ignored on unprivileged connections
+        if ((a->flags & ACTION_PRIVILEGED) && !privileged)
+            return;
 
-		// Reply the server information
-		data["version"] = CERNVM_WEBAPI_VERSION;
-		reply(id, data);
+        // Validate parameters and handle action
+        if (!actionValidate( a->params, parameters, &error )) {
+            sendError(error, id);
+            return;
+        }
+        (this->*(a->handler))( id, parameters );
 
-		// Check if we are privileged
-		if (parameters->contains("auth")) {
-			privileged = core.authKeyValid( parameters->get("auth") );
-		}
+    }
 
-        // Let UI know about it's priviledges
-        sendEvent("privileged", ArgumentList(privileged));
+    // [Session commands]
+    //  If there is a 'session_id' parameter in the request,
+    //  forward the command to the appropriate action
+    else if (parameters->contains("session_id")) {
 
-    }
+        // Lookup session action
+        const CVMWebAPISessionAction * sa = CVMWebAPISession::actions().find( action );
+        if (sa == NULL) return;
 
-    // [Interation Callback] 
-    //  Sent as a response to a user-interaction request
-    else if (action == "interactionCallback") {
+        // Lookup session pointer
+        int session_id = parameters->getNum<int>("session_id");
+        parameters->erase("session_id");
 
-        // Fire result callback
-        if (parameters->contains("result")) {
-            interactionCallback( parameters->getNum<int>("result") );
+        CVMWebAPISessionPtr session = core.getSession(session_id);
+        if (!session) {
+            sendError("Unable to find a session with the specified session id!", id);
+        } else if (!actionValidate( sa->params, parameters, &error )) {
+            sendError(error, id);
+        } else if (sa->flags & ACTION_BATCH) {
+            // Queue the actions of the batch on the strand of the session
+            CancelTokenPtr cancelToken = beginRequest( id, parameters );
+            handleBatch( session, id, parameters, cancelToken );
+        } else if (sa->flags & (ACTION_WORKER | ACTION_LONG)) {
+            // Handle session action on the strand of the session, so the
+            // actions of the same VM run in the order they were sent
+            CancelTokenPtr cancelToken = beginRequest( id, parameters );
+            submitTask( boost::bind( &DaemonConnection::handleAction_thread, this, session, id, sa, parameters, cancelToken ),
+                        (sa->flags & ACTION_LONG) ? WORKER_LANE_LONG : WORKER_LANE_INTERACTIVE, session->strand );
         } else {
-            sendError("Missing 'result' parameter", id);
+            // Handle session action right away
+            CVMCallbackFw cb( *this, id );
+            session->handleAction(cb, sa, parameters);
         }
 
     }
 
-    // =============================
-    //  Session management
-    // =============================
+    CRASH_REPORT_END;
+}
 
-    // [Request Session] 
-    //  A request to contact the specified VMCP and initialize the
-    //  CernVM WebAPI Session.
-	else if (action == "requestSession") {
+/**
+ * [Handshake] 
+ *  Sent right after the connection is established
+ */
+void DaemonConnection::actionHandshake( const std::string& id, ParameterMapPtr parameters ) {
+    CRASH_REPORT_BEGIN;
+    Json::Value data;
 
-        // Schedule the new session request on a new thread
-        if (parameters->contains("vmcp")) {
+    // Check if the browser can unpack batched frames
+    if (parameters->getNum<int>("batch", 0) != 0) {
+        setEgressBatching( true );
+        data["batch"] = 1;
+    }
 
-            // Create the object where we can forward the events
-            CVMCallbackFw cb( *this, id );
+    // Check if the browser can apply state variable deltas
+    if (parameters->getNum<int>("delta", 0) != 0) {
+        {
+            boost::mutex::scoped_lock lock(flagsMutex);
+            stateDeltas = true;
+        }
+        data["delta"] = 1;
+    }
 
-            // Block requests when reached throttled state
-            if (this->throttleBlock) {
-                cb.fire("failed", ArgumentList( "Request denied by throttle protection" )( HVE_ACCESS_DENIED ) );
-                return;
-            }
+    // Reply the server information
+    data["version"] = CERNVM_WEBAPI_VERSION;
+    reply(id, data);
 
-            // Re-check hypervisor if it's missing
-            core.syncHypervisorReflection();
+    // Check if we are privileged
+    if (parameters->contains("auth")) {
+        privileged = core.authKeyValid( parameters->get("auth") );
+    }
 
-            // Check if a hypervisor is installed. If not,
-            // use the installer thread.
-            if (core.hypervisor && (core.hypervisor->version.compareStr(CERNVM_WEBAPI_MIN_HV_VERSION) <= 0)) {
+    // Let UI know about it's priviledges
+    sendTypedEvent("privileged", "", privileged);
 
-                // Try to open session
-                boost::thread* t = NULL;
-                t = new boost::thread( boost::bind( &DaemonConnection::requestSession_thread, this, &t, id, parameters->get("vmcp") ) );
-                runningThreads.add_thread(t);
+    CRASH_REPORT_END;
+}
 
-            } else {
+/**
+ * [Interation Callback] 
+ *  Sent as a response to a user-interaction request
+ */
+void DaemonConnection::actionInteractionCallback( const std::string& /*id*/, ParameterMapPtr parameters ) {
+    CRASH_REPORT_BEGIN;
 
-                // If we are already installing, warn the user
-                if (core.installInProgress) {
-                    cb.fire("failed", ArgumentList( "A hypervisor installation is in progress please wait until it's finished and try again." )( HVE_USAGE_ERROR ));
-                    return;
-                }
+    // Pop the prompt that was shown and show the next one
+    callbackResult callback;
+    {
+        boost::mutex::scoped_lock lock(promptsMutex);
+        if (prompts.empty()) return;
+        callback = prompts.front().callback;
+        prompts.pop_front();
+        if (!prompts.empty())
+            sendTypedEvent("interact", "", prompts.front().type, prompts.front().title, prompts.front().body);
+    }
 
-                // Mark installation in progress
-                core.installInProgress = true;
-                installInProgress = true;
+    // Fire result callback
+    callback( parameters->getNum<int>("result") );
 
-                // Try to install first and then open session
-                boost::thread* t = NULL;
-                t = new boost::thread( boost::bind( &DaemonConnection::installHV_andRequestSession_thread, this, &t, id, parameters->get("vmcp") ) );
-                runningThreads.add_thread(t);
+    CRASH_REPORT_END;
+}
 
-            }
+/**
+ * [Request Session] 
+ *  A request to contact the specified VMCP and initialize the
+ *  CernVM WebAPI Session.
+ */
+void DaemonConnection::actionRequestSession( const std::string& id, ParameterMapPtr parameters ) {
+    CRASH_REPORT_BEGIN;
 
-        } else {
-            sendError("Missing 'vmcp' parameter", id);
-        }
+    // Create the object where we can forward the events
+    CVMCallbackFw cb( *this, id );
 
+    // Block requests when reached throttled state
+    if (throttled()) {
+        cb.fire("failed", "Request denied by throttle protection", HVE_ACCESS_DENIED);
+        return;
     }
 
-    // [Session commands]
-    //  If there is a 'session_id' parameter in the request,
-    //  forward the command to the appropriate action
-    else if (parameters->contains("session_id")) {
+    // Re-check hypervisor if it's missing
+    core.syncHypervisorReflection();
 
-        // Lookup session pointer
-        int session_id = parameters->getNum<int>("session_id");
-        parameters->erase("session_id");
+    // The request can be cancelled from now on
+    CancelTokenPtr cancelToken = beginRequest( id, parameters );
+    int progressRate = parameters->getNum<int>("progressRate", CVMWA_PROGRESS_RATE);
 
-        if (core.sessions.find(session_id) == core.sessions.end()) {
-            sendError("Unable to find a session with the specified session id!", id);
-        } else {
-            // Handle session action in another thread
-            boost::thread* t = NULL;
-            t = new boost::thread( boost::bind( &DaemonConnection::handleAction_thread, this, &t, core.sessions[session_id], id, action, parameters ) );
-            runningThreads.add_thread(t);
+    // Check if a hypervisor is installed. If not,
+    // use the installer thread.
+    HVInstancePtr hv = core.getHypervisor();
+    if (hv && (hv->version.compareStr(CERNVM_WEBAPI_MIN_HV_VERSION) <= 0)) {
+
+        // Try to open session
+        submitTask( boost::bind( &DaemonConnection::requestSession_begin, this, id, parameters->get("vmcp"), cancelToken, progressRate ), WORKER_LANE_INTERACTIVE );
+
+    } else {
+
+        // Mark installation in progress, or warn the user if
+        // we are already installing
+        if (!core.beginInstall()) {
+            cb.fire("failed", "A hypervisor installation is in progress please wait until it's finished and try again.", HVE_USAGE_ERROR);
+            return;
+        }
+        {
+            boost::mutex::scoped_lock lock(flagsMutex);
+            installInProgress = true;
         }
 
+        // Pick a message to prompt
+        std::string pTitle = "Hypervisor required";
+        std::string pMessage = "For this website to work you must have a hypervisor installed in your system. Would you like us to install VirtualBox for you?";
+        if (hv) {
+            pTitle = "Hypervisor too old";
+            pMessage = "It seems that your current VirtualBox installation (version " + hv->version.verString + ") is too old and not properly supported by the CernVM WebAPI. Would you like us to install the latest version for you?";
+        }
+
+        // Ask the user first and then install and open session
+        promptUser( "confirm", pTitle, pMessage, boost::bind( &DaemonConnection::installHV_confirmed, this, id, parameters->get("vmcp"), cancelToken, progressRate, _1 ) );
+
     }
 
-    // =============================
-    //  Power-user commands
-    // =============================
+    CRASH_REPORT_END;
+}
 
-    else if (privileged) {
+/**
+ * [Resume Session] 
+ *  Attach a session leased after its connection closed, using the
+ *  token given when it was opened. This skips the whole session request.
+ */
+void DaemonConnection::actionResumeSession( const std::string& id, ParameterMapPtr parameters ) {
+    CRASH_REPORT_BEGIN;
+    CVMCallbackFw cb( *this, id );
+
+    // Find the lease
+    CVMWebAPISessionPtr session = core.resumeSession( *this, parameters->get("token") );
+    if (!session) {
+        cb.fire("failed", "The session lease was not found or it has expired", HVE_NOT_FOUND);
+        return;
+    }
+
+    // Completed
+    cb.fire("succeed", "Session resumed successfully", session->uuid, session->leaseToken);
+
+    // The page has missed the events while it was away, so send a fresh snapshot
+    session->sendStateVariables( true );
+    core.eventBus.publish( session->uuid, EVENT_STATE, buildEvent("stateChanged", ArgumentList(session->hvSession->local->getNum<int>("state", 0)), session->uuid_str) );
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * [Stop] 
+ *  Shut down the CernVM WebAPI Daemon.
+ */
+void DaemonConnection::actionStopService( const std::string& /*id*/, ParameterMapPtr /*parameters*/ ) {
+    CRASH_REPORT_BEGIN;
 
-        // [Stop] 
-        //  Shut down the CernVM WebAPI Daemon.
-        if ( action == "stopService" ) {
+    // Mark core for forced shutdown
+    core.requestExit();
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * [Enumerate Session] 
+ *  List the running sessions.
+ */
+void DaemonConnection::actionEnumSessions( const std::string& id, ParameterMapPtr /*parameters*/ ) {
+    CRASH_REPORT_BEGIN;
+    Json::Value data, sessions;
+    HVInstancePtr hv = core.getHypervisor();
+
+    // Enumerate sessions (there are none without a hypervisor)
+    if (hv) {
+        for (std::map< std::string, HVSessionPtr >::iterator it = hv->sessions.begin(); it != hv->sessions.end(); ++it) {
+            Json::Value session;
+
+            // Keep session information
+            session["uuid"] = (*it).first;
+            session["config"] = sessionStateInfoToJSON((*it).second);
+
+            // Store on session object
+            sessions.append(session);
 
-            // Mark core for forced shutdown
-            core.running = false;
         }
+    }
+
+    data["sessions"] = sessions;
+    reply(id, data);
+
+    CRASH_REPORT_END;
+}
 
-        // [Enumerate Session] 
-        //  List the running sessions.
-        else if (action == "enumSessions") {
+/**
+ * [Control Session] 
+ *  Control an active session sessions.
+ */
+void DaemonConnection::actionControlSession( const std::string& /*id*/, ParameterMapPtr /*parameters*/ ) {
+    CRASH_REPORT_BEGIN;
 
-            Json::Value sessions;
-            HVInstancePtr hv = core.hypervisor;
+    // Try to find this on the hypervisor sessions
 
-            // Enumerate sessions
-            for (std::map< std::string, HVSessionPtr >::iterator it = hv->sessions.begin(); it != hv->sessions.end(); ++it) {
-                Json::Value session;
+    CRASH_REPORT_END;
+}
 
-                // Keep session information
-                session["uuid"] = (*it).first;
-                session["config"] = sessionStateInfoToJSON((*it).second);
+/**
+ * [Cancel] 
+ *  Cancel the request with the given id. The work in progress stops
+ *  at the next stage boundary and its downloads are aborted.
+ */
+void DaemonConnection::actionCancel( const std::string& /*id*/, ParameterMapPtr parameters ) {
+    CRASH_REPORT_BEGIN;
+    CancelTokenPtr cancelToken;
 
-                // Store on session object
-                sessions.append(session);
+    // Find the request
+    {
+        boost::unique_lock<boost::mutex> lock(requestsMutex);
+        std::map< std::string, boost::weak_ptr< CancelToken > >::iterator it = requests.find( parameters->get("target") );
+        if (it != requests.end()) cancelToken = it->second.lock();
+    }
 
-            }
+    // Cancel it if it's still in progress
+    if (cancelToken) {
+        CVMWA_LOG("Debug", "Cancelling request " << parameters->get("target"));
+        cancelToken->cancel();
+    }
+
+    CRASH_REPORT_END;
+}
 
-            data["sessions"] = sessions;
-            reply(id, data);
+/**
+ * [Subscribe] 
+ *  Receive the events of a session (or of all sessions) opened by
+ *  another connection. The 'events' parameter is a comma-separated
+ *  list of event classes (state, progress, failure or all). An empty
+ *  list removes the subscription.
+ */
+void DaemonConnection::actionSubscribe( const std::string& id, ParameterMapPtr parameters ) {
+    CRASH_REPORT_BEGIN;
+    CVMCallbackFw cb( *this, id );
+    int classes = EventBus::parseClasses( parameters->get("events", "all") );
 
+    // Only the privileged connections can watch all the sessions
+    if (!parameters->contains("session")) {
+        if (!privileged) {
+            cb.fire("failed", "Only privileged connections can watch all the sessions", HVE_ACCESS_DENIED);
+            return;
         }
+        core.eventBus.subscribe( this, EVENT_ALL_SESSIONS, classes );
+        cb.fire("succeed", 1);
+        return;
+    }
 
-        // [Control Session] 
-        //  Control an active session sessions.
-        else if (action == "controlSession") {
+    // Lookup session
+    int session_id = parameters->getNum<int>("session");
+    CVMWebAPISessionPtr session = core.getSession(session_id);
+    if (!session) {
+        cb.fire("failed", "Unable to find a session with the specified session id!", HVE_USAGE_ERROR);
+        return;
+    }
 
-            // Check for missing parameters
-            if (!parameters->contains("session")) {
-                sendError("Missing 'session' parameter", id);
-                return;
-            }
-            if (!parameters->contains("action")) {
-                sendError("Missing 'action' parameter", id);
-                return;
-            }
+    // Sessions of other websites can be watched only by privileged connections
+    if (!privileged && (session->domain != domain)) {
+        cb.fire("failed", "The session belongs to another domain", HVE_ACCESS_DENIED);
+        return;
+    }
 
-            // Try to find this on the hypervisor sessions
+    // Subscribe and let the subscriber know the current state
+    core.eventBus.subscribe( this, session_id, classes );
+    cb.fire("succeed", 1);
+    if (classes & EVENT_STATE)
+        session->sendStateVariables( true );
 
+    CRASH_REPORT_END;
+}
+
+/**
+ * [Timer] Cancel a request whose deadline has passed, if it's still running
+ */
+static void expireRequest( boost::weak_ptr< CancelToken > token ) {
+    CancelTokenPtr cancelToken = token.lock();
+    if (cancelToken) cancelToken->expire();
+}
+
+/**
+ * Create the cancellation token of a request. The optional 'deadline'
+ * parameter is the time in milliseconds the request is allowed to run.
+ */
+CancelTokenPtr DaemonConnection::beginRequest( const std::string& id, ParameterMapPtr parameters ) {
+    CRASH_REPORT_BEGIN;
+    int timeout = 0;
+
+    // Consume the deadline parameter
+    if (parameters->contains("deadline")) {
+        timeout = parameters->getNum<int>("deadline", 0);
+        parameters->erase("deadline");
+    }
+    CancelTokenPtr cancelToken = boost::make_shared<CancelToken>( (timeout > 0) ? getMillis() + timeout : 0 );
+
+    // Cancel the request when the deadline passes, even if it's stuck in a
+    // download (the stages check the token only when they are over). The
+    // timer is cancelled when the request is over and the token released.
+    if (timeout > 0) {
+        TimerID timer = core.timers.schedule( timeout, boost::bind( &expireRequest, boost::weak_ptr< CancelToken >( cancelToken ) ) );
+        if (timer != 0)
+            cancelToken->onRelease( boost::bind( &TimerWheel::cancel, &core.timers, timer ) );
+    }
+
+    // Register the token, forgetting the requests that are over
+    boost::unique_lock<boost::mutex> lock(requestsMutex);
+    for (std::map< std::string, boost::weak_ptr< CancelToken > >::iterator it = requests.begin(); it != requests.end(); ) {
+        if (it->second.expired()) {
+            requests.erase( it++ );
+        } else {
+            ++it;
         }
+    }
+    requests[id] = cancelToken;
+    return cancelToken;
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Run a task of this connection on the worker pool
+ */
+void DaemonConnection::submitTask( const WorkerTask& task, int lane, WorkerStrandPtr strand ) {
+    CRASH_REPORT_BEGIN;
+
+    // Cleanup waits until all the submitted tasks are over
+    threadDrain.increment();
+    if (strand) {
+        strand->post( boost::bind( &DaemonConnection::runTask, this, task ), lane, this );
+    } else {
+        core.workerPool.submit( boost::bind( &DaemonConnection::runTask, this, task ), lane, this );
+    }
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Run a submitted task, unless the connection is closing
+ */
+void DaemonConnection::runTask( const WorkerTask& task ) {
+    try {
+        if (!isClosing()) task();
+    } catch (boost::thread_interrupted &e) {
+        // Interrupted by cleanup
+    } catch (...) {
+        CVMWA_LOG("Error", "Unhandled exception in connection task");
+    }
+    threadDrain.decrement();
+}
 
+/**
+ * Check if the connection is closing
+ */
+bool DaemonConnection::isClosing() {
+    boost::mutex::scoped_lock lock(flagsMutex);
+    return closing;
+}
+
+/**
+ * Check if the browser can apply delta-encoded state variables
+ */
+bool DaemonConnection::acceptsStateDeltas() {
+    boost::mutex::scoped_lock lock(flagsMutex);
+    return stateDeltas;
+}
+
+/**
+ * Clear the installation flag of this connection, releasing the
+ * installation lock of the core if it was raised by us
+ */
+void DaemonConnection::endInstall() {
+    {
+        boost::mutex::scoped_lock lock(flagsMutex);
+        if (!installInProgress) return;
+        installInProgress = false;
     }
+    core.endInstall();
+}
+
+/**
+ * Run a deferred task, keeping the drain until it's over
+ */
+static void runDeferred( const WorkerTask& task, boost::shared_ptr< DrainUseLock > /*hold*/ ) {
+    task();
+}
+
+/**
+ * Wrap a task of this connection that someone else runs later
+ */
+WorkerTask DaemonConnection::deferTask( const WorkerTask& task ) {
+    CRASH_REPORT_BEGIN;
+
+    // The drain is held by the copies of the task, so it's released
+    // when the task has run, or when it's dropped without running.
+    boost::shared_ptr< DrainUseLock > hold( new DrainUseLock( threadDrain ) );
+    return boost::bind( &runDeferred, task, hold );
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Run a task of this connection after a delay
+ */
+TimerID DaemonConnection::scheduleTask( unsigned long delay, const WorkerTask& task ) {
+    CRASH_REPORT_BEGIN;
+
+    // The drain is held from now on, so cleanup waits for the
+    // timer, unless it cancels it first.
+    threadDrain.increment();
+    TimerID id = core.timers.schedule( delay, boost::bind( &DaemonConnection::runTask, this, task ), WORKER_LANE_INTERACTIVE, this );
+    if (id == 0) threadDrain.decrement();
+    return id;
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Cancel a scheduled task
+ */
+void DaemonConnection::cancelTask( TimerID id ) {
+    CRASH_REPORT_BEGIN;
+    if (core.timers.cancel( id ))
+        threadDrain.decrement();
+    CRASH_REPORT_END;
+}
+
+/**
+ * Check if the session requests are blocked by the throttle protection
+ */
+bool DaemonConnection::throttled() {
+    boost::mutex::scoped_lock lock(throttleMutex);
+    return throttleBlock;
+}
+
+/**
+ * Count a denied session request
+ */
+void DaemonConnection::throttleDeny() {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(throttleMutex);
+
+    // The first deny opens the throttle window
+    if (throttleTimer == 0) {
+        throttleDenies = 1;
+        throttleTimer = scheduleTask( THROTTLE_TIMESPAN, boost::bind( &DaemonConnection::throttleExpire, this ) );
+    } else if (++throttleDenies >= THROTTLE_TRIES) {
+        throttleBlock = true;
+    }
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Forget the past denies
+ */
+void DaemonConnection::throttleAccept() {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(throttleMutex);
+    cancelTask( throttleTimer );
+    throttleTimer = 0;
+    throttleDenies = 0;
+    CRASH_REPORT_END;
+}
+
+/**
+ * [Timer] Close the throttle window
+ */
+void DaemonConnection::throttleExpire() {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(throttleMutex);
+    throttleTimer = 0;
+    throttleDenies = 0;
+    CRASH_REPORT_END;
+}
+
+/**
+ * Fire a 'failed' event if the request was cancelled
+ */
+bool DaemonConnection::requestCancelled( CVMCallbackFw& cb ) {
+    CRASH_REPORT_BEGIN;
+    if (!cb.cancelled()) return false;
+    cb.fire("failed", "The request was cancelled", HVE_USAGE_ERROR);
+    return true;
+    CRASH_REPORT_END;
+}
 
+/**
+ * Show a prompt to the user, or queue it after the one that is shown
+ */
+void DaemonConnection::promptUser( const std::string& type, const std::string& title, const std::string& body, const callbackResult& cb ) {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(promptsMutex);
+    Prompt prompt;
+    prompt.type = type;
+    prompt.title = title;
+    prompt.body = body;
+    prompt.callback = cb;
+    prompts.push_back( prompt );
+    if (prompts.size() == 1)
+        sendTypedEvent("interact", "", type, title, body);
     CRASH_REPORT_END;
 }
 
@@ -253,8 +717,7 @@ void DaemonConnection::handleAction( const std::string& id, const std::string& a
  */
 void DaemonConnection::__callbackConfim (const std::string& title, const std::string& body, const callbackResult& cb) {
     CRASH_REPORT_BEGIN;
-    sendEvent("interact", ArgumentList("confirm")(title)(body));
-    interactionCallback = cb;
+    promptUser("confirm", title, body, cb);
     CRASH_REPORT_END;
 }
 
@@ -263,8 +726,7 @@ void DaemonConnection::__callbackConfim (const std::string& title, const std::st
  */
 void DaemonConnection::__callbackAlert (const std::string& title, const std::string& body, const callbackResult& cb) {
     CRASH_REPORT_BEGIN;
-    sendEvent("interact", ArgumentList("alert")(title)(body));
-    interactionCallback = cb;
+    promptUser("alert", title, body, cb);
     CRASH_REPORT_END;
 }
 
@@ -273,8 +735,7 @@ void DaemonConnection::__callbackAlert (const std::string& title, const std::str
  */
 void DaemonConnection::__callbackLicense (const std::string& title, const std::string& body, const callbackResult& cb) {
     CRASH_REPORT_BEGIN;
-    sendEvent("interact", ArgumentList("confirmLicense")(title)(body));
-    interactionCallback = cb;
+    promptUser("confirmLicense", title, body, cb);
     CRASH_REPORT_END;
 }
 
@@ -283,86 +744,141 @@ void DaemonConnection::__callbackLicense (const std::string& title, const std::s
  */
 void DaemonConnection::__callbackLicenseURL (const std::string& title, const std::string& url, const callbackResult& cb) {
     CRASH_REPORT_BEGIN;
-    sendEvent("interact", ArgumentList("confirmLicenseURL")(title)(url));
-    interactionCallback = cb;
+    promptUser("confirmLicenseURL", title, url, cb);
     CRASH_REPORT_END;
 }
 
 /**
  * [Thread] Handle action for the given session in another thread
  */
-void DaemonConnection::handleAction_thread( boost::thread** thread, CVMWebAPISession* session, const std::string& eventID, const std::string& action, ParameterMapPtr parameters ) {
+void DaemonConnection::handleAction_thread( CVMWebAPISessionPtr session, const std::string& eventID, const CVMWebAPISessionAction* action, ParameterMapPtr parameters, CancelTokenPtr cancelToken ) {
     CRASH_REPORT_BEGIN;
-    boost::thread *thisThread = *thread;
-    CVMCallbackFw cb( *this, eventID );
-    DrainUseLock lock(threadDrain);
+    CVMCallbackFw cb( *this, eventID, cancelToken );
+
+    // Apply the progress rate of the request
+    if (parameters->contains("progressRate")) {
+        cb.setProgressRate( parameters->getNum<int>("progressRate", CVMWA_PROGRESS_RATE) );
+        parameters->erase("progressRate");
+    }
 
     try {
-        // Handle action
-        session->handleAction(cb, action, parameters);
-        // Remove this thread from the active threads
-        runningThreads.remove_thread(thisThread);
+        // Handle action, unless nobody waits for it any more
+        if (!requestCancelled(cb))
+            session->handleAction(cb, action, parameters);
     } catch (boost::thread_interrupted &e) {
         // 
     }
     CRASH_REPORT_END;
 }
 
+/**
+ * Queue the actions of a batch on the strand of the session. They are
+ * posted together, so no other action of the session runs in between,
+ * but each one runs on the lane it would use if it was sent on its own.
+ */
+void DaemonConnection::handleBatch( CVMWebAPISessionPtr session, const std::string& eventID, ParameterMapPtr parameters, CancelTokenPtr cancelToken ) {
+    CRASH_REPORT_BEGIN;
+    int progressRate = parameters->getNum<int>("progressRate", CVMWA_PROGRESS_RATE);
+
+    // Parse the list of actions
+    CVMWebAPIBatchPtr batch = boost::make_shared<CVMWebAPIBatch>();
+    if (!batch->parse( parameters->get("actions", "") )) {
+        CVMCallbackFw cb( *this, eventID, cancelToken );
+        cb.fire("failed", "Invalid batch actions", HVE_USAGE_ERROR);
+        return;
+    }
+    if (batch->items.size() == 0) {
+        CVMCallbackFw cb( *this, eventID, cancelToken );
+        cb.fire("succeed", batch->results);
+        return;
+    }
+
+    for (Json::Value::ArrayIndex i = 0; i < batch->items.size(); ++i)
+        submitTask( boost::bind( &DaemonConnection::handleBatch_thread, this, session, eventID, batch, i, cancelToken, progressRate ),
+                    CVMWebAPISession::batchLane( batch->items[i] ), session->strand );
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * [Thread] Run an action of a batch on the strand of the session
+ */
+void DaemonConnection::handleBatch_thread( CVMWebAPISessionPtr session, const std::string& eventID, CVMWebAPIBatchPtr batch, Json::Value::ArrayIndex index, CancelTokenPtr cancelToken, int progressRate ) {
+    CRASH_REPORT_BEGIN;
+    CVMCallbackFw cb( *this, eventID, cancelToken );
+    cb.setProgressRate( progressRate );
+
+    try {
+        session->batchAction(cb, batch, index);
+    } catch (boost::thread_interrupted &e) {
+        // 
+    }
+    CRASH_REPORT_END;
+}
+
+/**
+ * [Prompt] The user answered if the hypervisor should be installed
+ */
+void DaemonConnection::installHV_confirmed( const std::string& eventID, const std::string& vmcpURL, CancelTokenPtr cancelToken, int progressRate, int result ) {
+    CRASH_REPORT_BEGIN;
+
+    if (result != UI_OK) {
+        CVMCallbackFw cb( *this, eventID, cancelToken );
+        cb.fire("failed", "You must have a hypervisor installed in your system to continue.", HVE_USAGE_ERROR);
+        endInstall();
+        return;
+    }
+
+    // Installing holds a worker of the blocking lane until it's over
+    submitTask( boost::bind( &DaemonConnection::installHV_andRequestSession_thread, this, eventID, vmcpURL, cancelToken, progressRate ), WORKER_LANE_BLOCKING );
+
+    CRASH_REPORT_END;
+}
+
 /**
  * [Thread] Install hypervisor first, request session later
  */
-void DaemonConnection::installHV_andRequestSession_thread( boost::thread ** thread, const std::string& eventID, const std::string& vmcpURL ) {
+void DaemonConnection::installHV_andRequestSession_thread( const std::string& eventID, const std::string& vmcpURL, CancelTokenPtr cancelToken, int progressRate ) {
     CRASH_REPORT_BEGIN;
-    DrainUseLock lock(threadDrain);
 
     try {
 
-        boost::thread *thisThread = *thread;
-        CVMWA_LOG("Debug", "installHV_andRequestSession_thread: " << thisThread);
+        CVMWA_LOG("Debug", "installHV_andRequestSession_thread: " << eventID);
 
         // Create a progress feedback
-        CVMCallbackFw cb( *this, eventID );
+        CVMCallbackFw cb( *this, eventID, cancelToken );
+        cb.setProgressRate( progressRate );
         FiniteTaskPtr pTasks = boost::make_shared<FiniteTask>();
         cb.listen( pTasks );
 
-        // Pick a message to prompt
-        std::string pTitle = "Hypervisor required";
-        std::string pMessage = "For this website to work you must have a hypervisor installed in your system. Would you like us to install VirtualBox for you?";
-        if (core.hypervisor && core.hypervisor->version.compareStr(CERNVM_WEBAPI_MIN_HV_VERSION) > 0) {
-            pTitle = "Hypervisor too old";
-            pMessage = "It seems that your current VirtualBox installation (version " + core.hypervisor->version.verString + ") is too old and not properly supported by the CernVM WebAPI. Would you like us to install the latest version for you?";
-        }
-
-        // Prompt the user first
-        if (userInteraction->confirm(pTitle, pMessage) != UI_OK) {
-            cb.fire("failed", ArgumentList( "You must have a hypervisor installed in your system to continue." )( HVE_USAGE_ERROR ));
-            runningThreads.remove_thread(thisThread);
-            core.installInProgress = false;
-            installInProgress = false;
-
-            // Check if user navigated away with the 
-            // interaction prompt in place
-            if (userInteraction->aborted)
-                userInteraction->abortHandled();
+        // Downloads of this request are aborted if it's cancelled
+        DownloadProviderPtr downloadProvider = core.downloadProvider->clone();
+        cancelToken->attach( downloadProvider );
 
+        // Check if the request was cancelled while prompting
+        if (requestCancelled(cb)) {
+            endInstall();
             return;
         }
 
-        // Install hypervisor
-        int ans = installHypervisor(
-                    core.downloadProvider,
-                    core.keystore,
-                    userInteraction,
-                    pTasks,
-                    2
-                );
+        // Install hypervisor (it validates the configuration
+        // against the keystore, so it holds it while reading)
+        int ans;
+        {
+            boost::shared_lock< boost::shared_mutex > lock(core.keystoreMutex);
+            ans = installHypervisor(
+                        downloadProvider,
+                        core.keystore,
+                        userInteraction,
+                        pTasks,
+                        2
+                    );
+        }
 
         // Check if user navigated away with the 
         // interaction prompt in place
         if (userInteraction->aborted) {
-            runningThreads.remove_thread(thisThread);
-            core.installInProgress = false;
-            installInProgress = false;
+            endInstall();
             userInteraction->abortHandled();
             return;
         }
@@ -370,38 +886,29 @@ void DaemonConnection::installHV_andRequestSession_thread( boost::thread ** thre
         // Check for error cases
         if (ans != HVE_OK) {
             if ((ans == HVE_NOT_VALIDATED) || (ans == HVE_NOT_TRUSTED)) {
-                cb.fire("failed", ArgumentList( "Integrity validation of the hypervisor configuration failed. Please try again later." )( HVE_USAGE_ERROR ));
+                cb.fire("failed", "Integrity validation of the hypervisor configuration failed. Please try again later.", HVE_USAGE_ERROR);
             } else {
-                cb.fire("failed", ArgumentList( "We were unable to install a hypervisor in your system. Please try again manually." )( HVE_USAGE_ERROR ));
+                cb.fire("failed", "We were unable to install a hypervisor in your system. Please try again manually.", HVE_USAGE_ERROR);
             }
-            runningThreads.remove_thread(thisThread);
-            core.installInProgress = false;
-            installInProgress = false;
+            endInstall();
             return;
         }
 
-        // Try to detecy hypervisor again
-        core.hypervisor = detectHypervisor();
+        // Try to detecy hypervisor again, loading its stored sessions
+        HVInstancePtr hv = core.reloadHypervisor();
 
         // Was the installation successful? Start requestSession thread
-        if (core.hypervisor) {
-            
-            // Load stored sessions
-            core.hypervisor->loadSessions();
+        if (hv) {
 
             // Request session in the same thread
-            core.installInProgress = false;
-            installInProgress = false;
-            this->requestSession_thread( &thisThread, eventID, vmcpURL );
+            endInstall();
+            this->requestSession_begin( eventID, vmcpURL, cancelToken, progressRate );
 
-            // (Thread will be removed from the pool from within the requestSession)
             return;
 
         } else {
-            cb.fire("failed", ArgumentList( "The hypervisor isntallation completed but we were not able to detect it! Please try again later or try to re-install it manually." )( HVE_USAGE_ERROR ));
-            runningThreads.remove_thread(thisThread);
-            core.installInProgress = false;
-            installInProgress = false;
+            cb.fire("failed", "The hypervisor isntallation completed but we were not able to detect it! Please try again later or try to re-install it manually.", HVE_USAGE_ERROR);
+            endInstall();
             return;
         }
 
@@ -414,288 +921,447 @@ void DaemonConnection::installHV_andRequestSession_thread( boost::thread ** thre
 }
 
 /**
- * [Thread] Request Session
+ * The stage graph of the session requests
  */
-void DaemonConnection::requestSession_thread( boost::thread ** thread, const std::string& eventID, const std::string& vmcpURL ) {
+const DaemonConnection::SessionRequestNode DaemonConnection::requestGraph[] = {
+
+    // The hypervisor initialization does not depend on anything. It reads
+    // the keystore while the keystore stage (of this or another request)
+    // may update it, which is safe since every access of the keystore
+    // takes core.keystoreMutex (shared for reads, exclusive for the update).
+    { REQUEST_STAGE_READY,      &DaemonConnection::requestSession_ready,        WORKER_LANE_BLOCKING,
+        0 },
+
+    // The VMCP endpoint is contacted only after the domain is known to be trusted
+    { REQUEST_STAGE_KEYSTORE,   &DaemonConnection::requestSession_keystore,     WORKER_LANE_BLOCKING,
+        0 },
+    { REQUEST_STAGE_FETCH,      &DaemonConnection::requestSession_fetch,        WORKER_LANE_BLOCKING,
+        REQUEST_STAGE_KEYSTORE },
+
+    // The validation of the signature is CPU-bound
+    { REQUEST_STAGE_VALIDATE,   &DaemonConnection::requestSession_validate,     WORKER_LANE_INTERACTIVE,
+        REQUEST_STAGE_READY | REQUEST_STAGE_FETCH },
+
+};
+
+/**
+ * [Worker] Request Session: Initialize the request and start its stages
+ */
+void DaemonConnection::requestSession_begin( const std::string& eventID, const std::string& vmcpURL, CancelTokenPtr cancelToken, int progressRate ) {
 	CRASH_REPORT_BEGIN;
-    Json::Value data;
-	HVInstancePtr hv = core.hypervisor;
-    boost::thread *thisThread = *thread;
-    int res;
+    CVMWA_LOG("Debug", "requestSession_begin: " << eventID);
 
-    // We are in a critical section, so nobody should touch threadsMutex
-    DrainUseLock lock(threadDrain);
+    // Create the state of the request, including the object
+    // where we can forward the events
+    SessionRequestPtr req = boost::make_shared<SessionRequest>();
+    req->eventID = eventID;
+    req->vmcpURL = vmcpURL;
+    req->cancelToken = cancelToken;
+    req->cb = boost::make_shared<CVMCallbackFw>( boost::ref(*this), req->eventID, cancelToken );
+    req->cb->setProgressRate( progressRate );
 
-    // Create the object where we can forward the events
-    CVMCallbackFw cb( *this, eventID );
-    CVMWA_LOG("Debug", "requestSession_thread: " << thisThread);
+    // Downloads of this request are aborted if it's cancelled
+    req->downloadProvider = core.downloadProvider->clone();
+    cancelToken->attach( req->downloadProvider );
 
     // Block requests when reached throttled state
-    if (this->throttleBlock) {
-        cb.fire("failed", ArgumentList( "Request denied by throttle protection" )( HVE_ACCESS_DENIED ) );
-        runningThreads.remove_thread(thisThread);
+    if (throttled()) {
+        req->cb->fire("failed", "Request denied by throttle protection", HVE_ACCESS_DENIED);
         return;
     }
 
+    // Create a progress feedback mechanism
+    req->pTasks = boost::make_shared<FiniteTask>();
+    req->pTasks->setMax( 2 );
+    req->cb->listen( req->pTasks );
+
+    // Create two sub-tasks that will be used for equally
+    // dividing the progress into two tasks: validate and start
+    req->pInit = req->pTasks->begin<FiniteTask>( "Preparing for session request" );
+    req->pInit->setMax( 4 );
+
+    // Start the stages that do not depend on anything
+    requestSession_advance( req, 0 );
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Mark a stage as completed and start the stages that depend on it
+ */
+void DaemonConnection::requestSession_advance( SessionRequestPtr req, int completed ) {
+    CRASH_REPORT_BEGIN;
+    std::vector< const SessionRequestNode* > ready;
+    {
+        boost::mutex::scoped_lock lock(req->mutex);
+        if (req->failed) return;
+        req->completed |= completed;
+        stageGraphReady( requestGraph, sizeof(requestGraph) / sizeof(SessionRequestNode), &req->started, req->completed, &ready );
+    }
+    for (std::vector< const SessionRequestNode* >::iterator it = ready.begin(); it != ready.end(); ++it)
+        requestSession_continue( req, (*it)->stage, (*it)->lane, (*it)->id );
+    CRASH_REPORT_END;
+}
+
+/**
+ * Hand the request over to the given stage, unless it was cancelled
+ */
+void DaemonConnection::requestSession_continue( SessionRequestPtr req, SessionRequestStage stage, int lane, int id ) {
+    CRASH_REPORT_BEGIN;
+    if (requestSession_cancelled( req )) return;
+    submitTask( boost::bind( &DaemonConnection::requestSession_step, this, req, stage, id ), lane );
+    CRASH_REPORT_END;
+}
+
+/**
+ * [Worker] Run a stage of the request, and the stages that depend on it
+ */
+void DaemonConnection::requestSession_step( SessionRequestPtr req, SessionRequestStage stage, int id ) {
+    CRASH_REPORT_BEGIN;
     try {
 
-        // Create a progress feedback mechanism
-        FiniteTaskPtr pTasks = boost::make_shared<FiniteTask>();
-        pTasks->setMax( 2 );
-        cb.listen( pTasks );
+        if ((this->*stage)( req ) && (id != 0))
+            requestSession_advance( req, id );
 
-        // Create two sub-tasks that will be used for equally
-        // dividing the progress into two tasks: validate and start
-        FiniteTaskPtr pInit = pTasks->begin<FiniteTask>( "Preparing for session request" );
-        pInit->setMax( 4 );
+    } catch (boost::thread_interrupted &e) {
 
-        // =======================================================================
+        // Interrupted
 
-        // Wait for delaied hypervisor initiation
-        hv->waitTillReady( core.keystore, pInit->begin<FiniteTask>( "Initializing hypervisor" ), userInteraction );
+    } catch (...) {
 
-        // Check if user navigated away with the 
-        // interaction prompt in place
-        if (userInteraction->aborted) {
-            runningThreads.remove_thread(thisThread);
-            userInteraction->abortHandled();
-            return;
-        }
+        CVMWA_LOG("Error", "Exception occured!");
 
-        // =======================================================================
+        // Raise failure
+        requestSession_fail( req, "Unexpected exception occured while requesting session", HVE_EXTERNAL_ERROR );
 
-        // Try to update authorized keystore if it's in an invalid state
-        pInit->doing("Initializing crypto store");
-    
-        // Trigger update in the keystore (if it's nessecary)
-        res = core.keystore.updateAuthorizedKeystore( core.downloadProvider );
+    }
+    CRASH_REPORT_END;
+}
 
-        // Still invalid? Something's wrong
-        if (!core.keystore.valid) {
-            cb.fire("failed", ArgumentList( "Unable to initialize cryptographic store" )( HVE_NOT_VALIDATED ) );
-            runningThreads.remove_thread(thisThread);
-            return;
-        }
+/**
+ * Fail the request (only once, even if parallel stages fail) and
+ * stop its other stages
+ */
+void DaemonConnection::requestSession_fail( SessionRequestPtr req, const std::string& message, int code ) {
+    CRASH_REPORT_BEGIN;
+    {
+        boost::mutex::scoped_lock lock(req->mutex);
+        if (req->failed) return;
+        req->failed = true;
+    }
+    req->cancelToken->cancel();
+    req->cb->fire("failed", message, code);
+    CRASH_REPORT_END;
+}
 
-        // Block requests from untrusted domains
-        if (!core.keystore.isDomainValid(domain)) {
-            cb.fire("failed", ArgumentList( "The domain is not trusted" )( HVE_NOT_TRUSTED ) );
-            runningThreads.remove_thread(thisThread);
-            return;
-        }
-        
-        pInit->done("Crypto store initialized");
-    
-        // =======================================================================
+/**
+ * Fail the request if it was cancelled
+ */
+bool DaemonConnection::requestSession_cancelled( SessionRequestPtr req ) {
+    CRASH_REPORT_BEGIN;
+    if (!req->cb->cancelled()) return false;
+    requestSession_fail( req, "The request was cancelled", HVE_USAGE_ERROR );
+    return true;
+    CRASH_REPORT_END;
+}
 
-        // Validate arguments
-        pInit->doing("Contacting the VMCP endpoint");
-    
-        // Put salt and user-specific ID in the URL
-        std::string salt = core.keystore.generateSalt();
-        std::string glueChar = "&";
-        if (vmcpURL.find("?") == std::string::npos) glueChar = "?";
-        std::string newURL = 
-            vmcpURL + glueChar + 
-            "cvm_salt=" + salt + "&" +
-            "cvm_hostid=" + core.calculateHostID( domain );
-    
-        // Download data from URL
-        std::string jsonString;
-        res = core.downloadProvider->downloadText( newURL, &jsonString );
-        if (res < 0) {
-            cb.fire("failed", ArgumentList( "Unable to contact the VMCP endpoint" )( res ) );
-            runningThreads.remove_thread(thisThread);
-            return;
-        }
+/**
+ * [Worker] Request Session: Wait for the hypervisor
+ */
+bool DaemonConnection::requestSession_ready( SessionRequestPtr req ) {
+    CRASH_REPORT_BEGIN;
 
-        pInit->doing("Validating VMCP data");
-
-        // Try to parse the data
-        Json::Value jsonData;
-        Json::Reader jsonReader;
-        try {
-            bool parsingSuccessful = jsonReader.parse( jsonString, jsonData );
-            if ( !parsingSuccessful ) {
-                // report to the user the failure and their locations in the document.
-                cb.fire("failed", ArgumentList( "Unable to parse response data as JSON" )( HVE_QUERY_ERROR ) );
-                runningThreads.remove_thread(thisThread);
-                return;
-            }
-        } catch (std::exception& e) {
-            CVMWA_LOG("Error", "JSON Parse exception " << e.what());
-            cb.fire("failed", ArgumentList( "Unable to parse response data as JSON" )( HVE_QUERY_ERROR ) );
-            runningThreads.remove_thread(thisThread);
-            return;
-        }
-    
-        // Import response to a ParameterMap
-        ParameterMapPtr vmcpData = ParameterMap::instance();
-        CVMWA_LOG("Debug", "Parsing into data");
-        vmcpData->fromJSON(jsonData);
-
-        // Validate response
-        if (!vmcpData->contains("name")) {
-            cb.fire("failed", ArgumentList( "Missing 'name' parameter from the VMCP response" )( HVE_USAGE_ERROR ) );
-            runningThreads.remove_thread(thisThread);
-            return;
-        };
-        if (!vmcpData->contains("secret")) {
-            cb.fire("failed", ArgumentList( "Missing 'secret' parameter from the VMCP response" )( HVE_USAGE_ERROR ) );
-            runningThreads.remove_thread(thisThread);
-            return;
-        };
-        if (!vmcpData->contains("signature")) {
-            cb.fire("failed", ArgumentList( "Missing 'signature' parameter from the VMCP response" )( HVE_USAGE_ERROR ) );
-            runningThreads.remove_thread(thisThread);
-            return;
-        };
-        if (vmcpData->contains("diskURL") && !vmcpData->contains("diskChecksum")) {
-            cb.fire("failed", ArgumentList( "A 'diskURL' was specified, but no 'diskChecksum' was found in the VMCP response" )( HVE_USAGE_ERROR ) );
-            runningThreads.remove_thread(thisThread);
-            return;
-        }
+    // Wait for delaied hypervisor initiation. It reports its steps on a
+    // task of its own, relayed to pInit under the lock of the request,
+    // since the other stages update pInit at the same time.
+    req->doing("Initializing hypervisor");
+    FiniteTaskPtr pHypervisor = boost::make_shared<FiniteTask>();
+    DisposableDelegate relay( pHypervisor, boost::bind( &SessionRequest::relay, req.get(), _1, _2 ) );
+    int res = core.prepareHypervisor( pHypervisor, userInteraction,
+        deferTask( boost::bind( &DaemonConnection::requestSession_continue, this, req, &DaemonConnection::requestSession_ready, WORKER_LANE_BLOCKING, REQUEST_STAGE_READY ) ) );
+
+    // Someone else is initializing it, and the
+    // stage is retried when they are done
+    if (res == HVE_SCHEDULED) return false;
+
+    // Check if user navigated away with the 
+    // interaction prompt in place
+    if (userInteraction->aborted) {
+        userInteraction->abortHandled();
+        return false;
+    }
 
-        // Validate signature
-        res = core.keystore.signatureValidate( domain, salt, vmcpData );
-        if (res < 0) {
-            cb.fire("failed", ArgumentList( "The VMCP response signature could not be validated" )( res ) );
-            runningThreads.remove_thread(thisThread);
-            return;
-        }
+    // Don't go on with a hypervisor that failed to initialize
+    if (res < 0) {
+        requestSession_fail( req, "Unable to initialize the hypervisor", res );
+        return false;
+    }
 
-        CVMWA_LOG("Debug", "Signature valid");
+    req->done("Hypervisor initialized");
+    return true;
+    CRASH_REPORT_END;
+}
 
-        pInit->done("Obtained information from VMCP endpoint");
+/**
+ * [Worker] Request Session: Update the keystore
+ */
+bool DaemonConnection::requestSession_keystore( SessionRequestPtr req ) {
+    CRASH_REPORT_BEGIN;
 
-        // =======================================================================
+    // Try to update authorized keystore if it's in an invalid state
+    req->doing("Initializing crypto store");
 
-        CVMWA_LOG("Debug", "Validating session");
-    
-        // Check session state
-        res = hv->sessionValidate( vmcpData );
-        if (res == 2) { 
-            // Invalid password
-            cb.fire("failed", ArgumentList( "The password specified is invalid for this session" )( HVE_PASSWORD_DENIED ) );
-            runningThreads.remove_thread(thisThread);
-            return;
-        }
+    // Trigger update in the keystore (if it's nessecary). If someone
+    // else is updating it, the stage is retried when they are done.
+    if (!core.prepareKeystore( req->downloadProvider,
+            deferTask( boost::bind( &DaemonConnection::requestSession_continue, this, req, &DaemonConnection::requestSession_keystore, WORKER_LANE_BLOCKING, REQUEST_STAGE_KEYSTORE ) ) ))
+        return false;
 
-        // =======================================================================
+    // Still invalid? Something's wrong
+    boost::shared_lock< boost::shared_mutex > lock(core.keystoreMutex);
+    if (!core.keystore.valid) {
+        requestSession_fail( req, "Unable to initialize cryptographic store", HVE_NOT_VALIDATED );
+        return false;
+    }
 
-        CVMWA_LOG("Debug", "Validating request");
+    // Block requests from untrusted domains
+    if (!core.keystore.isDomainValid(domain)) {
+        requestSession_fail( req, "The domain is not trusted", HVE_NOT_TRUSTED );
+        return false;
+    }
     
-        /* Check if the session is new and prompt the user */
-        pInit->doing("Validating request");
-        if (res == 0) {
-            pInit->doing("Session is new, asking user for confirmation");
-
-            // Newline-specific split
-            std::string msg = "The website " + domain + " is trying to allocate a " + core.get_hv_name() + " Virtual Machine \"" + vmcpData->get("name") + "\". This website is validated and trusted by CernVM." _EOL _EOL "Do you want to continue?";
-
-            // Interaction might be interrupted
-            try {
-
-                // Prompt user using the currently active userInteraction 
-                if (userInteraction->confirm("New CernVM WebAPI Session", msg) != UI_OK) {
-
-                    // Check if user navigated away with the 
-                    // interaction prompt in place
-                    if (userInteraction->aborted) {
-                        runningThreads.remove_thread(thisThread);
-                        userInteraction->abortHandled();
-                        return;
-                    }
-
-                    // Manage throttling 
-                    if ((getMillis() - this->throttleTimestamp) <= THROTTLE_TIMESPAN) {
-                        if (++this->throttleDenies >= THROTTLE_TRIES)
-                            this->throttleBlock = true;
-                    } else {
-                        this->throttleDenies = 1;
-                        this->throttleTimestamp = getMillis();
-                    }
-
-                    // Fire error
-                    cb.fire("failed", ArgumentList( "User denied the allocation of new session" )( HVE_ACCESS_DENIED ) );
-                    runningThreads.remove_thread(thisThread);
-                    return;
-                
-                } else {
-                
-                    // Reset throttle
-                    this->throttleDenies = 0;
-                    this->throttleTimestamp = 0;
-                
-                }
-
-            } catch (boost::thread_interrupted &e) {
-
-                // Thread entered cleanup state before finishing with the prompt.
-                // Session is not yet open, we are safe to exit.
-                runningThreads.remove_thread(thisThread);
-                return;
+    req->done("Crypto store initialized");
+    return true;
 
-            }
-        
-        }
-        pInit->done("Request validated");
+    CRASH_REPORT_END;
+}
 
-        CVMWA_LOG("Debug", "Open session");
+/**
+ * [Worker] Request Session: Download the VMCP response
+ */
+bool DaemonConnection::requestSession_fetch( SessionRequestPtr req ) {
+    CRASH_REPORT_BEGIN;
+    int res;
 
-        // =======================================================================
+    // Validate arguments
+    req->doing("Contacting the VMCP endpoint");
 
-        // Prepare a progress task that will be used by sessionOpen    
-        FiniteTaskPtr pOpen = pTasks->begin<FiniteTask>( "Open session" );
+    // Put salt and user-specific ID in the URL
+    {
+        boost::shared_lock< boost::shared_mutex > lock(core.keystoreMutex);
+        req->salt = core.keystore.generateSalt();
+    }
+    std::string glueChar = "&";
+    if (req->vmcpURL.find("?") == std::string::npos) glueChar = "?";
+    std::string newURL = 
+        req->vmcpURL + glueChar + 
+        "cvm_salt=" + req->salt + "&" +
+        "cvm_hostid=" + core.calculateHostID( domain );
+
+    // Download data from URL
+    std::string jsonString;
+    res = req->downloadProvider->downloadText( newURL, &jsonString );
+    if (requestSession_cancelled( req )) {
+        return false;
+    }
+    if (res < 0) {
+        requestSession_fail( req, "Unable to contact the VMCP endpoint", res );
+        return false;
+    }
 
-        // Open/resume session
-        HVSessionPtr session = hv->sessionOpen( vmcpData, pOpen );
-        if (!session) {
-            cb.fire("failed", ArgumentList( "Unable to open session" )( HVE_ACCESS_DENIED ) );
-            runningThreads.remove_thread(thisThread);
-            return;
+    // Try to parse the data
+    Json::Value jsonData;
+    Json::Reader jsonReader;
+    try {
+        bool parsingSuccessful = jsonReader.parse( jsonString, jsonData );
+        if ( !parsingSuccessful ) {
+            // report to the user the failure and their locations in the document.
+            requestSession_fail( req, "Unable to parse response data as JSON", HVE_QUERY_ERROR );
+            return false;
         }
+    } catch (std::exception& e) {
+        CVMWA_LOG("Error", "JSON Parse exception " << e.what());
+        requestSession_fail( req, "Unable to parse response data as JSON", HVE_QUERY_ERROR );
+        return false;
+    }
 
-        // Wait until session FSM has routet itself accordingly
-        session->wait();
+    // Import response to a ParameterMap
+    req->vmcpData = ParameterMap::instance();
+    CVMWA_LOG("Debug", "Parsing into data");
+    req->vmcpData->fromJSON(jsonData);
 
-        // We have everything. Prepare CVMWebAPI Session and fire success
-        pTasks->complete( "Session open successfully" );
+    req->done("Obtained information from VMCP endpoint");
+    return true;
 
-        // Check if we need a daemon for our current services
-        hv->checkDaemonNeed();
-        
-        // Register session on store
-        CVMWebAPISession* cvmSession = core.storeSession( *this, session );
+    CRASH_REPORT_END;
+}
 
-        // Completed
-        cb.fire("succeed", ArgumentList("Session open successfully")(cvmSession->uuid));
+/**
+ * [Worker] Request Session: Validate the VMCP response and ask the user
+ */
+bool DaemonConnection::requestSession_validate( SessionRequestPtr req ) {
+    CRASH_REPORT_BEGIN;
+    ParameterMapPtr vmcpData = req->vmcpData;
+    int res;
 
-        // Send state variables
-        cvmSession->sendStateVariables();
+    req->doing("Validating VMCP data");
+    CVMWA_LOG("Debug", "Session request prepared in " << (getMillis() - req->beginTime) << "ms");
+
+    // Validate response
+    if (!vmcpData->contains("name")) {
+        requestSession_fail( req, "Missing 'name' parameter from the VMCP response", HVE_USAGE_ERROR );
+        return false;
+    };
+    if (!vmcpData->contains("secret")) {
+        requestSession_fail( req, "Missing 'secret' parameter from the VMCP response", HVE_USAGE_ERROR );
+        return false;
+    };
+    if (!vmcpData->contains("signature")) {
+        requestSession_fail( req, "Missing 'signature' parameter from the VMCP response", HVE_USAGE_ERROR );
+        return false;
+    };
+    if (vmcpData->contains("diskURL") && !vmcpData->contains("diskChecksum")) {
+        requestSession_fail( req, "A 'diskURL' was specified, but no 'diskChecksum' was found in the VMCP response", HVE_USAGE_ERROR );
+        return false;
+    }
 
-        // Send state changed message
-        sendEvent("stateChanged", ArgumentList(session->local->getNum<int>("state", 0)), cvmSession->uuid_str);
+    // Validate signature
+    {
+        boost::shared_lock< boost::shared_mutex > lock(core.keystoreMutex);
+        res = core.keystore.signatureValidate( domain, req->salt, vmcpData );
+    }
+    if (res < 0) {
+        requestSession_fail( req, "The VMCP response signature could not be validated", res );
+        return false;
+    }
 
-        // Enable periodic jobs thread after stateChanged is sent
-        // (This ensures that apiStateChanged is fired AFTER stateChanged event is sent)
-        cvmSession->enablePeriodicJobs(true);
+    CVMWA_LOG("Debug", "Signature valid");
+    if (requestSession_cancelled( req )) {
+        return false;
+    }
 
-    } catch (boost::thread_interrupted &e) {
+    // =======================================================================
 
-        // Interrupted
+    CVMWA_LOG("Debug", "Validating session");
 
-    } catch (...) {
+    // Check session state
+    HVInstancePtr hv = core.getHypervisor();
+    if (!hv) {
+        requestSession_fail( req, "Hypervisor was uninstalled", HVE_NOT_FOUND );
+        return false;
+    }
+    res = hv->sessionValidate( vmcpData );
+    if (res == 2) { 
+        // Invalid password
+        requestSession_fail( req, "The password specified is invalid for this session", HVE_PASSWORD_DENIED );
+        return false;
+    }
 
-        CVMWA_LOG("Error", "Exception occured!");
+    // =======================================================================
 
-        // Raise failure
-        cb.fire("failed", ArgumentList( "Unexpected exception occured while requesting session" )( HVE_EXTERNAL_ERROR ) );
+    CVMWA_LOG("Debug", "Validating request");
+
+    /* Check if the session is new and prompt the user */
+    req->doing("Validating request");
+    if (res == 0) {
+        req->doing("Session is new, asking user for confirmation");
+
+        // Newline-specific split
+        std::string msg = "The website " + domain + " is trying to allocate a " + core.get_hv_name() + " Virtual Machine \"" + vmcpData->get("name") + "\". This website is validated and trusted by CernVM." _EOL _EOL "Do you want to continue?";
+
+        // Continue when the user responds. No worker is held in the meantime,
+        // and if the connection closes first, the request is just dropped.
+        promptUser( "confirm", "New CernVM WebAPI Session", msg, boost::bind( &DaemonConnection::requestSession_confirmed, this, req, _1 ) );
+
+    } else {
+
+        // Existing session, open it right away
+        req->done("Request validated");
+        requestSession_continue( req, &DaemonConnection::requestSession_open, WORKER_LANE_BLOCKING );
 
     }
 
-    runningThreads.remove_thread(thisThread);
+    return true;
+    CRASH_REPORT_END;
+}
+
+/**
+ * Request Session: The user responded to the confirmation (this is
+ * called from the I/O thread, so it should not block)
+ */
+void DaemonConnection::requestSession_confirmed( SessionRequestPtr req, int result ) {
+    CRASH_REPORT_BEGIN;
+
+    if (result != UI_OK) {
+
+        // Manage throttling 
+        throttleDeny();
+
+        // Fire error
+        requestSession_fail( req, "User denied the allocation of new session", HVE_ACCESS_DENIED );
+        return;
+    
+    }
+
+    // Reset throttle
+    throttleAccept();
+
+    req->done("Request validated");
+
+    // Continue with opening the session
+    requestSession_continue( req, &DaemonConnection::requestSession_open, WORKER_LANE_BLOCKING );
 
     CRASH_REPORT_END;
 }
 
+/**
+ * [Worker] Request Session: Open the session
+ */
+bool DaemonConnection::requestSession_open( SessionRequestPtr req ) {
+    CRASH_REPORT_BEGIN;
+    HVInstancePtr hv = core.getHypervisor();
+    if (!hv) {
+        requestSession_fail( req, "Hypervisor was uninstalled", HVE_NOT_FOUND );
+        return false;
+    }
+
+    CVMWA_LOG("Debug", "Open session");
+
+    // Prepare a progress task that will be used by sessionOpen    
+    FiniteTaskPtr pOpen = req->pTasks->begin<FiniteTask>( "Open session" );
+
+    // Open/resume session
+    HVSessionPtr session = hv->sessionOpen( req->vmcpData, pOpen );
+    if (!session) {
+        requestSession_fail( req, "Unable to open session", HVE_ACCESS_DENIED );
+        return false;
+    }
+
+    // Wait until session FSM has routet itself accordingly
+    session->wait();
+
+    // We have everything. Prepare CVMWebAPI Session and fire success
+    req->pTasks->complete( "Session open successfully" );
+
+    // Check if we need a daemon for our current services
+    hv->checkDaemonNeed();
+    
+    // Register session on store
+    CVMWebAPISessionPtr cvmSession = core.storeSession( *this, session );
+
+    // Completed
+    req->cb->fire("succeed", "Session open successfully", cvmSession->uuid, cvmSession->leaseToken);
+
+    // Send state variables
+    cvmSession->sendStateVariables();
+
+    // Send state changed message
+    core.eventBus.publish( cvmSession->uuid, EVENT_STATE, buildEvent("stateChanged", ArgumentList(session->local->getNum<int>("state", 0)), cvmSession->uuid_str) );
+
+    // Enable periodic jobs thread after stateChanged is sent
+    // (This ensures that apiStateChanged is fired AFTER stateChanged event is sent)
+    cvmSession->enablePeriodicJobs(true);
+
+    return true;
+    CRASH_REPORT_END;
+}
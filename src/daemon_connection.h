@@ -23,6 +23,7 @@
 #define DAEMON_CONNECTION_H
 
 #include "daemon.h"
+#include "stage_graph.h"
 
 #include <CernVM/Config.h>
 #include <CernVM/UserInteraction.h>
@@ -30,10 +31,75 @@
 #include <CernVM/CrashReport.h>
 
 #include <boost/make_shared.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <utilities.h>
 
+#include <deque>
+
+// How long (in milliseconds) each step of the teardown of a connection waits
+// for its tasks and its sessions, before aborting them harder, and finally
+// abandoning the connection
+#define CVMWA_TEARDOWN_DEADLINE		5000
+
+// The stages of a session request (see DaemonConnection::requestGraph)
+#define REQUEST_STAGE_READY 		0x01 	// The hypervisor is ready
+#define REQUEST_STAGE_KEYSTORE 		0x02 	// The keystore is up to date and the domain is trusted
+#define REQUEST_STAGE_FETCH 		0x04 	// The VMCP response is downloaded and parsed
+#define REQUEST_STAGE_VALIDATE 		0x08 	// The VMCP response and the session are validated
+
+/**
+ * The state of a session request, carried from one stage of
+ * the request pipeline to the next.
+ */
+struct SessionRequest {
+	SessionRequest() : started(0), completed(0), failed(false), mutex(), beginTime(getMillis()), progressMutex() { };
+
+	/**
+	 * Report the progress of the preparation. The first stages run in
+	 * parallel and the progress objects are not thread-safe, so every
+	 * update of pInit goes through these.
+	 */
+	void doing( const std::string& message ) { boost::mutex::scoped_lock lock(progressMutex); pInit->doing(message); };
+	void done( const std::string& message ) { boost::mutex::scoped_lock lock(progressMutex); pInit->done(message); };
+
+	/**
+	 * Relay the progress messages of a stage's own task to pInit. That task
+	 * is updated from inside libcernvm, so it can't be a child of pInit.
+	 */
+	void relay( const std::string& name, VariantArgList& args ) {
+		const std::string * message = args.empty() ? NULL : boost::get<std::string>( &args[0] );
+		if ((name == "progress") && (message != NULL)) doing( *message );
+	};
+
+	/**
+	 * The stages that were started and completed (REQUEST_STAGE_* flags),
+	 * and a flag raised when the request has failed.
+	 */
+	int 								started;
+	int 								completed;
+	bool 								failed;
+	boost::mutex 						mutex;
+
+	/**
+	 * When the request started, for timing its preparation
+	 */
+	unsigned long 						beginTime;
+	boost::mutex 						progressMutex;
+
+	std::string 						eventID;
+	std::string 						vmcpURL;
+	CancelTokenPtr 						cancelToken;
+	boost::shared_ptr< CVMCallbackFw > 	cb;
+	DownloadProviderPtr 				downloadProvider;
+	FiniteTaskPtr 						pTasks;
+	FiniteTaskPtr 						pInit;
+	std::string 						salt;
+	ParameterMapPtr 					vmcpData;
+};
+typedef boost::shared_ptr< SessionRequest >	SessionRequestPtr;
+
 /**
  * Websocket Session
  */
@@ -44,7 +110,7 @@ public:
 	 * Constructor
 	 */
 	DaemonConnection( const std::string& domain, const std::string uri, DaemonCore& core )
-		: WebsocketAPI(domain, uri), core(core), privileged(false), userInteraction(), interactionCallback(), threadDrain(), installInProgress(false)
+		: WebsocketAPI(domain, uri), core(core), privileged(false), stateDeltas(false), userInteraction(), prompts(), promptsMutex(), threadDrain(), closing(false), installInProgress(false), flagsMutex(), requests(), requestsMutex()
 	{
 	    CRASH_REPORT_BEGIN;
 
@@ -56,17 +122,33 @@ public:
 		userInteraction->setLicenseURLHandler( boost::bind( &DaemonConnection::__callbackLicenseURL, this, _1, _2, _3 ) );
 
 		// Reset throttling parameters
-	    throttleTimestamp = 0;
+	    throttleTimer = 0;
 	    throttleDenies = 0;
 	    throttleBlock = false;
 
+	    // Prepare what the first session request of the page will need
+	    core.warmUp( domain );
+
 	    CRASH_REPORT_END;
 	};
 
 	/**
-	 * Cleanup before destruction
+	 * Cleanup before destruction. Returns false if the tasks or the
+	 * sessions of the connection were still running after the teardown
+	 * deadlines, in which case the connection must not be deleted.
+	 */
+	virtual bool cleanup();
+
+	/**
+	 * Action handlers and their declarations
+	 */
+	typedef void (DaemonConnection::*ActionHandler)( const std::string& id, ParameterMapPtr parameters );
+	typedef ActionEntry< ActionHandler > Action;
+
+	/**
+	 * Check if the browser can apply delta-encoded state variables
 	 */
-	virtual void cleanup();
+	bool 	acceptsStateDeltas();
 
 protected:
 
@@ -75,6 +157,42 @@ protected:
 	 */
 	virtual void handleAction( const std::string& id, const std::string& action, ParameterMapPtr parameters );
 
+	/**
+	 * The actions of the daemon connection and their index
+	 */
+	static const Action 					actionList[];
+	static const ActionTable< Action >& 	actions();
+
+	/**
+	 * Action handlers
+	 */
+	void actionHandshake				( const std::string& id, ParameterMapPtr parameters );
+	void actionInteractionCallback		( const std::string& id, ParameterMapPtr parameters );
+	void actionRequestSession			( const std::string& id, ParameterMapPtr parameters );
+	void actionResumeSession			( const std::string& id, ParameterMapPtr parameters );
+	void actionStopService				( const std::string& id, ParameterMapPtr parameters );
+	void actionEnumSessions				( const std::string& id, ParameterMapPtr parameters );
+	void actionControlSession			( const std::string& id, ParameterMapPtr parameters );
+	void actionCancel					( const std::string& id, ParameterMapPtr parameters );
+	void actionSubscribe				( const std::string& id, ParameterMapPtr parameters );
+
+	/**
+	 * Create and register the cancellation token of the given request,
+	 * consuming its optional 'deadline' parameter.
+	 */
+	CancelTokenPtr	beginRequest		( const std::string& id, ParameterMapPtr parameters );
+
+	/**
+	 * Fire a 'failed' event if the request was cancelled
+	 */
+	bool 			requestCancelled	( CVMCallbackFw& cb );
+
+	/**
+	 * The cancellation tokens of the requests in progress
+	 */
+	std::map< std::string, boost::weak_ptr< CancelToken > >	requests;
+	boost::mutex 	requestsMutex;
+
 	/**
 	 * The daemon core instance
 	 */
@@ -86,14 +204,73 @@ protected:
 	UserInteractionPtr	userInteraction;
 
 	/**
-	 * Bookkeeping of running threads (for clean shutdown)
+	 * The number of submitted tasks that are not over yet, used
+	 * for waiting them during cleanup (declared in utilities.h)
 	 */
-	boost::thread_group runningThreads;
+	DrainSemaphore 		threadDrain;
 
 	/**
-	 * The drain assistance semaphore (declared in utilities.h)
+	 * Flag raised during cleanup, to skip the tasks still queued
 	 */
-	DrainSemaphore 		threadDrain;
+	bool 				closing;
+
+	/**
+	 * Check if the connection is closing (under flagsMutex)
+	 */
+	bool 				isClosing();
+
+	/**
+	 * Clear the installation flag and release the installation
+	 * lock of the core, if this connection holds it
+	 */
+	void 				endInstall();
+
+	/**
+	 * Check if the session requests are blocked (under throttleMutex)
+	 */
+	bool 				throttled();
+
+	/**
+	 * Run a task on the worker pool, or on the given strand of a session
+	 */
+	void 				submitTask( const WorkerTask& task, int lane, WorkerStrandPtr strand = WorkerStrandPtr() );
+
+	/**
+	 * Run a submitted task, unless the connection is closing
+	 */
+	void 				runTask( const WorkerTask& task );
+
+	/**
+	 * Wrap a task that someone else runs later (like a PreparationGate).
+	 * Cleanup waits for it until it has run or it was dropped.
+	 */
+	WorkerTask 			deferTask( const WorkerTask& task );
+
+	/**
+	 * Run a task on the worker pool after the given delay
+	 */
+	TimerID 			scheduleTask( unsigned long delay, const WorkerTask& task );
+
+	/**
+	 * Cancel a task scheduled with scheduleTask, unless it has already started
+	 */
+	void 				cancelTask( TimerID id );
+
+	/**
+	 * Count a denied session request, blocking further requests if
+	 * the user keeps denying them within the throttle window
+	 */
+	void 				throttleDeny();
+
+	/**
+	 * The user accepted a session request, so forget the past denies
+	 */
+	void 				throttleAccept();
+
+	/**
+	 * [Timer] The throttle window is over
+	 */
+	void 				throttleExpire();
 
 	/**
 	 * A flag that defines if this session is authenticated
@@ -101,16 +278,30 @@ protected:
 	 */
 	bool 	privileged;
 
+	/**
+	 * Flag raised when the browser declared during the handshake
+	 * that it can apply stateDelta events.
+	 */
+	bool 	stateDeltas;
+
 	/**
 	 * Flag that denotes that an installation was started
 	 * by this session.
 	 */
 	bool 	installInProgress;
 
-    // Throttling protection
-    long	throttleTimestamp;
-    int 	throttleDenies;
-    bool 	throttleBlock;
+	/**
+	 * Mutex for the closing, stateDeltas and installInProgress flags,
+	 * which are accessed from the webserver and the worker threads
+	 */
+	boost::mutex 	flagsMutex;
+
+    // Throttling protection: the denies are counted until the
+    // timer of the throttle window expires.
+    TimerID 		throttleTimer;
+    int 			throttleDenies;
+    bool 			throttleBlock;
+    boost::mutex 	throttleMutex;
 
 private:
 
@@ -123,17 +314,87 @@ private:
 	void __callbackLicenseURL	(const std::string&, const std::string&, const callbackResult& cb);
 
 	/**
-	 * The user interaction callback where we should forward the responses
-	 * from the WebSocket -> to userInteraction
+	 * A prompt waiting for the user
+	 */
+	struct Prompt {
+		std::string 	type;
+		std::string 	title;
+		std::string 	body;
+		callbackResult 	callback;
+	};
+
+	/**
+	 * The prompts of this connection. The browser shows one prompt at a
+	 * time: the first one is shown, and its callback receives the response
+	 * from the WebSocket. The rest are shown after it.
+	 */
+	std::deque< Prompt > 	prompts;
+	boost::mutex 			promptsMutex;
+
+	/**
+	 * Show a prompt to the user (or queue it after the one that is shown)
+	 * and pass the response to the given callback.
+	 */
+	void promptUser( const std::string& type, const std::string& title, const std::string& body, const callbackResult& cb );
+
+	/**
+	 * The stages of the session request pipeline. Every stage runs on a
+	 * worker and hands the request to the next stage with
+	 * requestSession_continue(), so the worker is given back in between.
+	 * The user confirmation holds no worker at all while the user decides,
+	 * and neither does a stage that waits for a keystore update or a
+	 * hypervisor initialization started by someone else.
+	 *
+	 * A stage returns false if the request should not go on (after firing
+	 * the failure with requestSession_fail, if needed).
+	 */
+	typedef bool (DaemonConnection::*SessionRequestStage)( SessionRequestPtr req );
+	void requestSession_begin 					( const std::string& eventID, const std::string& vmcpURL, CancelTokenPtr cancelToken, int progressRate );
+	void requestSession_continue 				( SessionRequestPtr req, SessionRequestStage stage, int lane, int id = 0 );
+	void requestSession_step 					( SessionRequestPtr req, SessionRequestStage stage, int id );
+	void requestSession_advance 				( SessionRequestPtr req, int completed );
+	void requestSession_fail 					( SessionRequestPtr req, const std::string& message, int code );
+	bool requestSession_cancelled 				( SessionRequestPtr req );
+	bool requestSession_ready 					( SessionRequestPtr req );
+	bool requestSession_keystore 				( SessionRequestPtr req );
+	bool requestSession_fetch 					( SessionRequestPtr req );
+	bool requestSession_validate 				( SessionRequestPtr req );
+	void requestSession_confirmed 				( SessionRequestPtr req, int result );
+	bool requestSession_open 					( SessionRequestPtr req );
+
+	/**
+	 * A stage of the session request graph, that is started when all the
+	 * stages it depends on are completed.
+	 */
+	struct SessionRequestNode {
+		int 					id;
+		SessionRequestStage 	stage;
+		int 					lane;
+		int 					depends;
+	};
+
+	/**
+	 * The session request graph. The hypervisor initialization runs in
+	 * parallel with the keystore update and the VMCP download, and they
+	 * join before the validation of the VMCP response.
+	 */
+	static const SessionRequestNode 		requestGraph[];
+
+	/**
+	 * Hypervisor installation, that continues with the session request. The
+	 * user is asked first, without holding a worker while the user decides.
+	 * The installation itself blocks a worker of the blocking lane, since the
+	 * libcernvm installer downloads and runs it synchronously.
 	 */
-	callbackResult interactionCallback;
+	void installHV_confirmed 					( const std::string& eventID, const std::string& vmcpURL, CancelTokenPtr cancelToken, int progressRate, int result );
+	void installHV_andRequestSession_thread 	( const std::string& eventID, const std::string& vmcpURL, CancelTokenPtr cancelToken, int progressRate );
+	void handleAction_thread 					( CVMWebAPISessionPtr session, const std::string& id, const CVMWebAPISessionAction* action, ParameterMapPtr parameters, CancelTokenPtr cancelToken );
 
 	/**
-	 * RequestSession Thread
+	 * Batch requests, split in one task per action on the strand of the session
 	 */
-	void requestSession_thread 					( boost::thread** t, const std::string& eventID, const std::string& vmcpURL );
-	void installHV_andRequestSession_thread 	( boost::thread ** thread, const std::string& eventID, const std::string& vmcpURL );
-	void handleAction_thread 					( boost::thread** t, CVMWebAPISession* session, const std::string& id, const std::string& action, ParameterMapPtr parameters );
+	void handleBatch 							( CVMWebAPISessionPtr session, const std::string& id, ParameterMapPtr parameters, CancelTokenPtr cancelToken );
+	void handleBatch_thread 					( CVMWebAPISessionPtr session, const std::string& id, CVMWebAPIBatchPtr batch, Json::Value::ArrayIndex index, CancelTokenPtr cancelToken, int progressRate );
 
 };
 
@@ -32,20 +32,18 @@
 /**
  * Initialize daemon code
  */
-DaemonCore::DaemonCore(): authKeys(), sessions(), keystore(), config(), installInProgress(false) {
+DaemonCore::DaemonCore(): authKeys(), sessions(), eventBus(), workerPool(), timers(), keystore(), config(), installInProgress(false), sessionsMutex(), stateMutex(), keystoreGate(workerPool), readyGate(workerPool), warmupRunning(false), warmupTime(0), hypervisorMutex() {
     CRASH_REPORT_BEGIN;
 
 	// Initialize local config
     config = LocalConfig::global();
 
-	// Detect and instantiate hypervisor
-	hypervisor = detectHypervisor();
-    if (hypervisor) {
+    // Start the worker threads (sized to the host by default)
+    workerPool.start( config->getNum<int>("worker-threads", 0), config->getNum<int>("long-worker-threads", 0), config->getNum<int>("blocking-worker-threads", 0) );
+    timers.start( &workerPool );
 
-        // Load stored sessions
-        hypervisor->loadSessions();
-
-    }
+	// Detect and instantiate hypervisor, and load the stored sessions
+	reloadHypervisor();
 
     // Initialize download provider
     downloadProvider = DownloadProvider::Default();
@@ -56,22 +54,74 @@ DaemonCore::DaemonCore(): authKeys(), sessions(), keystore(), config(), installI
     CRASH_REPORT_END;
 }
 
+/**
+ * Release daemon core
+ */
+DaemonCore::~DaemonCore() {
+    CRASH_REPORT_BEGIN;
+
+    // The members are destroyed in reverse order, so the gates, the mutexes
+    // and the timers would be gone before the worker pool runs the tasks
+    // still queued. Stop the timers first, since they feed the pool.
+    timers.stop();
+    workerPool.stop();
+
+    CRASH_REPORT_END;
+}
+
 /**
  * Check if daemon has exited
  */
 bool DaemonCore::hasExited() {
     CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(hypervisorMutex);
 	return !running;
     CRASH_REPORT_END;
 }
 
+/**
+ * Mark the daemon for shutdown
+ */
+void DaemonCore::requestExit() {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(hypervisorMutex);
+    running = false;
+    CRASH_REPORT_END;
+}
+
+/**
+ * Return the identified hypervisor
+ */
+HVInstancePtr DaemonCore::getHypervisor() {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(hypervisorMutex);
+    return hypervisor;
+    CRASH_REPORT_END;
+}
+
+/**
+ * Detect the hypervisor and load its stored sessions
+ */
+HVInstancePtr DaemonCore::reloadHypervisor() {
+    CRASH_REPORT_BEGIN;
+
+    // Detection can take a while, so it's done outside the lock
+    HVInstancePtr hv = detectHypervisor();
+    if (hv) hv->loadSessions();
+
+    boost::mutex::scoped_lock lock(hypervisorMutex);
+    hypervisor = hv;
+    return hv;
+    CRASH_REPORT_END;
+}
 
 /**
  * Check if a hypervisor was detected
  */
 bool DaemonCore::hasHypervisor() {
     CRASH_REPORT_BEGIN;
-    return (hypervisor->getType() != HV_NONE);
+    HVInstancePtr hv = getHypervisor();
+    return hv && (hv->getType() != HV_NONE);
     CRASH_REPORT_END;
 };
 
@@ -80,36 +130,58 @@ bool DaemonCore::hasHypervisor() {
  */
 void DaemonCore::syncHypervisorReflection() {
     CRASH_REPORT_BEGIN;
+    // This is called by the reactors and the workers alike,
+    // so work on a copy and replace it only if nobody else did
+    HVInstancePtr hv = getHypervisor();
+
     // If things look good, check if they are not any more
-    if (hypervisor && (hypervisor->getType() != HV_NONE)) {
+    if (hv && (hv->getType() != HV_NONE)) {
         // Check instance integrity
-        if (!hypervisor->validateIntegrity()) {
+        if (!hv->validateIntegrity()) {
 
-            // Hypervisor has gone away. Let all sessions know and dispose...
-            for (std::map<int, CVMWebAPISession* >::iterator it = sessions.begin(); it != sessions.end(); ++it) {
-                CVMWebAPISession * session = (*it).second;
+            // Release hypervisor pointer
+            {
+                boost::mutex::scoped_lock lock(hypervisorMutex);
+                if (hypervisor != hv) return;
+                hypervisor.reset();
+            }
 
-                // Let session know that a hypervisor is uninstalled
-                session->sendFailure("Hypervisor was uninstalled");
+            std::vector< CVMWebAPISessionPtr > all;
+            {
+                boost::mutex::scoped_lock lock(sessionsMutex);
 
-                // Disconnect socket
-                session->connection.disconnect();
+                // Hypervisor has gone away. Let all sessions know and unregister them
+                for (std::map<int, CVMWebAPISessionPtr >::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+                    CVMWebAPISessionPtr session = (*it).second;
 
-                // Dispose
-                session->abort();
-                delete session;
-            }
+                    // Let session know that a hypervisor is uninstalled
+                    session->sendFailure("Hypervisor was uninstalled");
+
+                    // Disconnect socket, or forget the lease
+                    if (session->connection != NULL) {
+                        session->connection->disconnect();
+                    } else {
+                        timers.cancel( session->leaseTimer );
+                        session->leaseTimer = 0;
+                    }
+
+                    eventBus.releaseSession( (*it).first );
+                    all.push_back( session );
+                }
                 
-            // Remove all sessions
-            sessions.clear();
+                // Remove all sessions
+                sessions.clear();
+            }
 
-            // Release hypervisor pointer
-            hypervisor.reset();
+            // Dispose them on their strands, after the actions queued there
+            closeSessions( all );
 
         }
     } else {
-        // Detect hypervisor
-        hypervisor = detectHypervisor();
+        // Detect hypervisor (outside the lock, since it can take a while)
+        HVInstancePtr detected = detectHypervisor();
+        boost::mutex::scoped_lock lock(hypervisorMutex);
+        if (hypervisor == hv) hypervisor = detected;
     }
     CRASH_REPORT_END;
 };
@@ -119,10 +191,11 @@ void DaemonCore::syncHypervisorReflection() {
  */
 std::string DaemonCore::get_hv_name() {
     CRASH_REPORT_BEGIN;
-    if (!hypervisor) {
+    HVInstancePtr hv = getHypervisor();
+    if (!hv) {
         return "";
     } else {
-        if (hypervisor->getType() == HV_VIRTUALBOX) {
+        if (hv->getType() == HV_VIRTUALBOX) {
             return "virtualbox";
         } else {
             return "unknown";
@@ -136,10 +209,11 @@ std::string DaemonCore::get_hv_name() {
  */
 std::string DaemonCore::get_hv_version() {
     CRASH_REPORT_BEGIN;
-    if (!hypervisor) {
+    HVInstancePtr hv = getHypervisor();
+    if (!hv) {
         return "";
     } else {
-        return hypervisor->version.verString;
+        return hv->version.verString;
     }
     CRASH_REPORT_END;
 }
@@ -149,14 +223,16 @@ std::string DaemonCore::get_hv_version() {
  */
 std::string DaemonCore::newAuthKey() {
     CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(stateMutex);
 	AuthKey key;
 
 	// The key lasts 5 minutes
 	key.expireTime = getMillis() + 300000;
 	// Allocate new UUID
 	key.key = newGUID();
-	// Store on list
-	authKeys.push_back( key );
+	// Store on map and forget it when it expires
+	authKeys[key.key] = key;
+	timers.schedule( 300000, boost::bind( &DaemonCore::expireAuthKey, this, key.key ) );
 
 	// Return the key
 	return key.key;
@@ -169,28 +245,13 @@ std::string DaemonCore::newAuthKey() {
  */
 bool DaemonCore::authKeyValid( const std::string& key ) {
     CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(stateMutex);
 
-    // If we are empty, forget about it
-    if (authKeys.empty()) {
-        return false;
-    }
-    
-	// Expire past keys
-	bool found = false;
-	unsigned long ts = getMillis();
-	for (std::list< AuthKey >::iterator it = authKeys.begin(); it != authKeys.end(); ++it) {
-		AuthKey k = *it;
-		if (ts >= k.expireTime) {
-			it = authKeys.erase(it);
-            if (authKeys.empty())
-                break;
-		} else if (k.key == key) {
-			found = true;
-		}
-	}
-
-	// Check if we found it
-	return found;
+    // Expired keys are removed by their timer, but the timer
+    // might be a tick late
+    std::map< std::string, AuthKey >::iterator it = authKeys.find(key);
+    if (it == authKeys.end()) return false;
+    return (getMillis() < it->second.expireTime);
 
     CRASH_REPORT_END;
 }
@@ -205,6 +266,7 @@ std::string DaemonCore::calculateHostID( std::string& domain ) {
     /* Fetch/Generate user UUID */
     std::string machineID = config->get("local-id");
     if (machineID.empty()) {
+        boost::shared_lock< boost::shared_mutex > lock(keystoreMutex);
         machineID = keystore.generateSalt();
         config->set("local-id", machineID);
     }
@@ -223,8 +285,19 @@ std::string DaemonCore::calculateHostID( std::string& domain ) {
 /**
  * Store the given session and return it's unique ID
  */
-CVMWebAPISession* DaemonCore::storeSession( DaemonConnection& connection, HVSessionPtr hvSession ) {
+CVMWebAPISessionPtr DaemonCore::storeSession( DaemonConnection& connection, HVSessionPtr hvSession ) {
     CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(sessionsMutex);
+
+    // If the session of this VM is leased (its page reloaded and
+    // requested it again), take it over instead of opening another
+    for (std::map<int, CVMWebAPISessionPtr >::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+        CVMWebAPISessionPtr cvmSession = (*it).second;
+        if ((cvmSession->hvSession == hvSession) && (cvmSession->connection == NULL) && (cvmSession->domain == connection.getDomain())) {
+            attachSession( cvmSession, connection );
+            return cvmSession;
+        }
+    }
 
     // Create a random int that does not exist in the sessions
     int uuid;
@@ -241,9 +314,12 @@ CVMWebAPISession* DaemonCore::storeSession( DaemonConnection& connection, HVSess
     }
 
     // Create CVMWebAPISession wrapper and store it on sessionss
-    CVMWebAPISession * cvmSession = new CVMWebAPISession( this, connection, hvSession, uuid );
+    CVMWebAPISessionPtr cvmSession = boost::make_shared< CVMWebAPISession >( this, boost::ref(connection), hvSession, uuid );
     sessions[uuid] = cvmSession;
 
+    // The connection that opened the session receives all of its events
+    eventBus.subscribe( &connection, uuid, EVENT_ALL );
+
     // Return session
     return cvmSession;
 
@@ -253,42 +329,281 @@ CVMWebAPISession* DaemonCore::storeSession( DaemonConnection& connection, HVSess
 /**
  * Unregister all sessions launched from the given connection
  */
-void DaemonCore::releaseConnectionSessions( DaemonConnection& connection ) {
+DrainSemaphorePtr DaemonCore::releaseConnectionSessions( DaemonConnection& connection ) {
     CRASH_REPORT_BEGIN;
     CVMWA_LOG("Debug", "Releasing connection sessions");
-    std::map<int, CVMWebAPISession* >::iterator it = sessions.begin();
-    for (; it != sessions.end(); ++it) {
-        CVMWebAPISession* sess = (*it).second;
-        if (&sess->connection == &connection) {
-
-            // Dispose
-            sess->abort();
-            delete sess;
-            
-            // Remove from list
-            sessions.erase( it );
+    int grace = !hasExited() ? config->getNum<int>("session-grace-period", CVMWA_LEASE_GRACE) : 0;
+    std::vector< CVMWebAPISessionPtr > released;
+    {
+        boost::mutex::scoped_lock lock(sessionsMutex);
+        std::map<int, CVMWebAPISessionPtr >::iterator it = sessions.begin();
+        while (it != sessions.end()) {
+            if (it->second->connection != &connection) {
+                ++it;
+            } else if ((grace > 0) && !it->second->aborted()) {
+                // Keep the session running, so the page can resume it
+                it->second->connection = NULL;
+                it->second->leaseTimer = timers.schedule( grace, boost::bind( &DaemonCore::expireLease, this, it->first, it->second->leaseToken ) );
+                ++it;
+            } else {
+                eventBus.releaseSession( it->first );
+                released.push_back( it->second );
+                sessions.erase( it++ );
+            }
+        }
+    }
 
-            // And break if we are done
-            if (sessions.empty()) break;
-            
-            // Rewind iterator
-            it = sessions.begin();
+    // Close them outside the lock, since it can take a while
+    return closeSessions( released );
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Abort the downloads of the sessions of a connection
+ */
+void DaemonCore::abortConnectionSessions( DaemonConnection& connection ) {
+    CRASH_REPORT_BEGIN;
+    std::vector< CVMWebAPISessionPtr > aborted;
+    {
+        boost::mutex::scoped_lock lock(sessionsMutex);
+        for (std::map<int, CVMWebAPISessionPtr >::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+            if (it->second->connection == &connection)
+                aborted.push_back( it->second );
+        }
+    }
+
+    // Abort them outside the lock, since it waits for a poll in progress
+    for (std::vector< CVMWebAPISessionPtr >::iterator it = aborted.begin(); it != aborted.end(); ++it)
+        (*it)->abort();
+    CRASH_REPORT_END;
+}
+
+/**
+ * Resume a leased session on a new connection
+ */
+CVMWebAPISessionPtr DaemonCore::resumeSession( DaemonConnection& connection, const std::string& token ) {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(sessionsMutex);
+    for (std::map<int, CVMWebAPISessionPtr >::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+        CVMWebAPISessionPtr session = (*it).second;
+        if (session->leaseToken != token) continue;
+
+        // Only a leased session can be resumed, and only by its website
+        if ((session->connection != NULL) || (session->domain != connection.getDomain()))
+            return CVMWebAPISessionPtr();
+        attachSession( session, connection );
+        return session;
+    }
+    return CVMWebAPISessionPtr();
+    CRASH_REPORT_END;
+}
+
+/**
+ * Attach a leased session to a connection
+ */
+void DaemonCore::attachSession( const CVMWebAPISessionPtr& session, DaemonConnection& connection ) {
+    CRASH_REPORT_BEGIN;
+    CVMWA_LOG("Debug", "Resuming session " << session->uuid);
+
+    // If the lease has just expired, expireLease will find
+    // the session attached and leave it alone
+    timers.cancel( session->leaseTimer );
+    session->leaseTimer = 0;
+    session->connection = &connection;
+    eventBus.subscribe( &connection, session->uuid, EVENT_ALL );
+    CRASH_REPORT_END;
+}
+
+/**
+ * [Timer] Close a session whose lease has expired
+ */
+void DaemonCore::expireLease( int uuid, const std::string& token ) {
+    CRASH_REPORT_BEGIN;
+    std::vector< CVMWebAPISessionPtr > expired;
+    {
+        boost::mutex::scoped_lock lock(sessionsMutex);
+        std::map<int, CVMWebAPISessionPtr >::iterator it = sessions.find(uuid);
+        if ((it == sessions.end()) || (it->second->connection != NULL) || (it->second->leaseToken != token))
+            return;
+        eventBus.releaseSession( uuid );
+        expired.push_back( it->second );
+        sessions.erase( it );
+    }
+    CVMWA_LOG("Debug", "Lease of session " << uuid << " expired");
+    closeSessions( expired );
+    CRASH_REPORT_END;
+}
+
+/**
+ * [Worker] Close a session. It's released when the actions
+ * that still hold it are over.
+ */
+static void closeSession_task( CVMWebAPISessionPtr sess, DrainSemaphorePtr drain ) {
+    CRASH_REPORT_BEGIN;
+    try {
+        sess->close();
+    } catch (boost::thread_interrupted &e) {
+        // Interrupted while closing
+    }
+    drain->decrement();
+    CRASH_REPORT_END;
+}
+
+/**
+ * Close sessions in parallel
+ */
+DrainSemaphorePtr DaemonCore::closeSessions( const std::vector< CVMWebAPISessionPtr >& list ) {
+    CRASH_REPORT_BEGIN;
+    DrainSemaphorePtr drain = boost::make_shared< DrainSemaphore >();
+    for (std::vector< CVMWebAPISessionPtr >::const_iterator it = list.begin(); it != list.end(); ++it) {
+        const CVMWebAPISessionPtr& sess = *it;
+
+        // Stop the polls and the downloads right away, and close the
+        // session when the actions already queued on its strand are over
+        sess->abort();
+        drain->increment();
+        sess->strand->post( boost::bind( &closeSession_task, sess, drain ), WORKER_LANE_LONG, sess.get() );
+    }
+    return drain;
+    CRASH_REPORT_END;
+}
+
+/**
+ * Return the session with the given ID, or NULL if it does not exist
+ */
+CVMWebAPISessionPtr DaemonCore::getSession( int uuid ) {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(sessionsMutex);
+    std::map<int, CVMWebAPISessionPtr >::iterator it = sessions.find(uuid);
+    if (it == sessions.end()) return CVMWebAPISessionPtr();
+    return (*it).second;
+    CRASH_REPORT_END;
+}
+
+/**
+ * Mark that a hypervisor installation is in progress
+ */
+bool DaemonCore::beginInstall() {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(stateMutex);
+    if (installInProgress) return false;
+    installInProgress = true;
+    return true;
+    CRASH_REPORT_END;
+}
+
+/**
+ * Mark that the hypervisor installation is over
+ */
+void DaemonCore::endInstall() {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(stateMutex);
+    installInProgress = false;
+    CRASH_REPORT_END;
+}
+
+/**
+ * Start a speculative warm-up, unless one is running or ran recently
+ * (for any connection, since what it prepares is shared)
+ */
+void DaemonCore::warmUp( const std::string& domain ) {
+    CRASH_REPORT_BEGIN;
+    {
+        boost::mutex::scoped_lock lock(stateMutex);
+        if (warmupRunning) return;
+        if ((warmupTime != 0) && (getMillis() - warmupTime < CVMWA_WARMUP_INTERVAL)) return;
+        warmupRunning = true;
+    }
+    workerPool.submit( boost::bind( &DaemonCore::warmUp_task, this, domain ), WORKER_LANE_BLOCKING, this );
+    CRASH_REPORT_END;
+}
 
+/**
+ * Decline a user interaction of the warm-up
+ */
+static void declineInteraction( const std::string&, const std::string&, const callbackResult& cb ) {
+    cb( UI_CANCEL );
+}
+
+/**
+ * [Worker] Prepare everything a session request will need
+ */
+void DaemonCore::warmUp_task( const std::string& domain ) {
+    CRASH_REPORT_BEGIN;
+    unsigned long started = getMillis();
+    try {
+
+        // Refresh the keystore and look up the domain. The domain is only
+        // checked here, nothing is fetched on its behalf. What a request
+        // is already preparing is not waited for.
+        prepareKeystore( downloadProvider->clone() );
+        {
+            boost::shared_lock< boost::shared_mutex > lock(keystoreMutex);
+            if (keystore.valid && !keystore.isDomainValid( domain ))
+                CVMWA_LOG("Debug", "Warm-up for untrusted domain " << domain);
         }
+
+        // Initialize the hypervisor. Anything that needs the user is
+        // declined, and it's left to the session request.
+        HVInstancePtr hv = getHypervisor();
+        if (hv && (hv->version.compareStr(CERNVM_WEBAPI_MIN_HV_VERSION) <= 0)) {
+            UserInteractionPtr ui = boost::make_shared<UserInteraction>();
+            ui->setConfirmHandler( &declineInteraction );
+            ui->setAlertHandler( &declineInteraction );
+            ui->setLicenseHandler( &declineInteraction );
+            ui->setLicenseURLHandler( &declineInteraction );
+            int res = prepareHypervisor( FiniteTaskPtr(), ui );
+            if (res != HVE_OK)
+                CVMWA_LOG("Debug", "Hypervisor warm-up left to the session request (" << res << ")");
+        }
+
+        CVMWA_LOG("Debug", "Warm-up for " << domain << " completed in " << (getMillis() - started) << "ms");
+
+    } catch (boost::thread_interrupted &e) {
+        // Interrupted by shutdown
     }
 
+    boost::mutex::scoped_lock lock(stateMutex);
+    warmupRunning = false;
+    warmupTime = getMillis();
     CRASH_REPORT_END;
 }
 
 /**
- * Forward the tick event to all of the child nodes
+ * Update the keystore only once, no matter how many callers need it
  */
-void DaemonCore::processPeriodicJobs() {
+bool DaemonCore::prepareKeystore( DownloadProviderPtr downloadProvider, const WorkerTask& retry ) {
     CRASH_REPORT_BEGIN;
-    for (std::map<int, CVMWebAPISession* >::iterator it = sessions.begin(); it != sessions.end(); ++it) {
-        CVMWebAPISession* sess = (*it).second;
-        sess->processPeriodicJobs();
-    }   
+    if (!keystoreGate.enter( retry )) return false;
+    PreparationGate::Scope scope( keystoreGate );
+    boost::unique_lock< boost::shared_mutex > lock(keystoreMutex);
+    keystore.updateAuthorizedKeystore( downloadProvider );
+    return true;
+    CRASH_REPORT_END;
+}
+
+/**
+ * Initialize the hypervisor only once, no matter how many callers need it
+ */
+int DaemonCore::prepareHypervisor( const FiniteTaskPtr& pf, const UserInteractionPtr& ui, const WorkerTask& retry ) {
+    CRASH_REPORT_BEGIN;
+    if (!readyGate.enter( retry )) return HVE_SCHEDULED;
+    PreparationGate::Scope scope( readyGate );
+    HVInstancePtr hv = getHypervisor();
+    if (!hv) return HVE_NOT_FOUND;
+    boost::shared_lock< boost::shared_mutex > lock(keystoreMutex);
+    return hv->waitTillReady( keystore, pf, ui );
+    CRASH_REPORT_END;
+}
+
+/**
+ * [Timer] Forget an expired authentication key
+ */
+void DaemonCore::expireAuthKey( const std::string& key ) {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(stateMutex);
+    authKeys.erase(key);
     CRASH_REPORT_END;
 }
 
@@ -296,8 +611,33 @@ void DaemonCore::processPeriodicJobs() {
 /**
  * Start shutdown cleanups
  */
-void DaemonCore::shutdownCleanup() {
+bool DaemonCore::shutdownCleanup( unsigned long timeout ) {
     CRASH_REPORT_BEGIN;
     downloadProvider->abortAll();
+    workerPool.interrupt( this );
+
+    // Unregister all the sessions, interrupting the actions
+    // of their connections that are still running
+    std::vector< CVMWebAPISessionPtr > all;
+    {
+        boost::mutex::scoped_lock lock(sessionsMutex);
+        for (std::map<int, CVMWebAPISessionPtr >::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+            eventBus.releaseSession( it->first );
+            if (it->second->connection != NULL)
+                workerPool.interrupt( it->second->connection );
+            all.push_back( it->second );
+        }
+        sessions.clear();
+    }
+
+    // Close them all in parallel
+    if (all.empty()) return true;
+    CVMWA_LOG("Debug", "Closing " << all.size() << " sessions");
+    if (!closeSessions( all )->wait( timeout )) {
+        CVMWA_LOG("Warning", "Some sessions were still closing after " << timeout << "ms");
+        return false;
+    }
+    return true;
+
     CRASH_REPORT_END;
 }
@@ -24,10 +24,27 @@
 
 #include "daemon.h"
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include <CernVM/Hypervisor.h>
 #include <CernVM/DomainKeystore.h>
 #include <CernVM/DownloadProvider.h>
+#include <utilities.h>
+
+#include <vector>
+
+// How long (in milliseconds) to wait for all the sessions
+// to close when the daemon shuts down
+#define CVMWA_SHUTDOWN_DEADLINE		15000
+
+// How long (in milliseconds) after a speculative warm-up
+// the connections do not trigger another one
+#define CVMWA_WARMUP_INTERVAL		60000
+
+// How long (in milliseconds) the sessions of a closed connection are
+// leased, waiting for their page to reconnect and resume them
+#define CVMWA_LEASE_GRACE			60000
 
 class AuthKey {
 public:
@@ -52,15 +69,27 @@ public:
 	 */
 	DaemonCore();
 
+	/**
+	 * Stop the timers and the workers before releasing anything
+	 * their pending tasks might still use
+	 */
+	~DaemonCore();
+
 	/**
 	 * Check if the daemon has exited
 	 */
 	bool 						hasExited();
 
 	/**
-	 * Start shutdown cleanups
+	 * Mark the daemon for shutdown
 	 */
-	void 						shutdownCleanup();
+	void 						requestExit();
+
+	/**
+	 * Start shutdown cleanups, closing all the sessions in parallel. Returns
+	 * false if some sessions were still closing when the timeout expired.
+	 */
+	bool 						shutdownCleanup( unsigned long timeout = CVMWA_SHUTDOWN_DEADLINE );
 
 	/**
 	 * Allocate new authenticatino key
@@ -81,12 +110,44 @@ public:
 	 * Allocate a new UUID and store the given session information to the
 	 * sessions map.
 	 */
-	CVMWebAPISession*			storeSession( DaemonConnection& session, HVSessionPtr hvSession );
+	CVMWebAPISessionPtr			storeSession( DaemonConnection& session, HVSessionPtr hvSession );
 
 	/**
-	 * Unregister all sessions launched from the given connection
+	 * Release all sessions launched from the given connection. They are leased
+	 * for the grace period ('session-grace-period' in the config), unless it's
+	 * zero or the daemon is exiting. Otherwise they are unregistered and closed
+	 * in parallel, and the returned semaphore drains when all of them are closed.
 	 */
-	void 						releaseConnectionSessions( DaemonConnection& connection );
+	DrainSemaphorePtr			releaseConnectionSessions( DaemonConnection& connection );
+
+	/**
+	 * Attach the leased session with the given token to the connection.
+	 * Returns NULL if there is no such lease for the domain of the connection.
+	 */
+	CVMWebAPISessionPtr			resumeSession( DaemonConnection& connection, const std::string& token );
+
+	/**
+	 * Abort the downloads of the sessions launched from the given connection
+	 */
+	void 						abortConnectionSessions( DaemonConnection& connection );
+
+	/**
+	 * Return the session with the given ID, or NULL if it does not exist.
+	 * The session is kept alive as long as the caller holds the pointer,
+	 * even if it's closed in the meantime.
+	 */
+	CVMWebAPISessionPtr			getSession( int uuid );
+
+	/**
+	 * Mark that a hypervisor installation is in progress. Returns false
+	 * if an installation was already in progress.
+	 */
+	bool 						beginInstall();
+
+	/**
+	 * Mark that the hypervisor installation is over
+	 */
+	void 						endInstall();
 
 	/**
 	 * Check if a hypervisor was detected
@@ -94,9 +155,17 @@ public:
 	bool 						hasHypervisor();
 
 	/**
-	 * Run periodic jobs
+	 * Return the identified hypervisor, or NULL if there is none. The
+	 * reactors and the workers can replace it at any time, so the callers
+	 * use the returned copy instead of looking it up again.
+	 */
+	HVInstancePtr 				getHypervisor();
+
+	/**
+	 * Detect the hypervisor again (after it was installed) and load its
+	 * stored sessions. Returns the new hypervisor, or NULL if none was found.
 	 */
-	void 						processPeriodicJobs();
+	HVInstancePtr 				reloadHypervisor();
 
 	/**
 	 * Synchronize hypervisor reflection
@@ -113,18 +182,78 @@ public:
 	 */
 	std::string 				get_hv_version();
 
-public:
+	/**
+	 * Speculatively prepare the keystore and the hypervisor in the background
+	 * when a page connects, so its first session request finds them ready.
+	 *
+	 * The warm-up is global, not per connection: the keystore and the
+	 * hypervisor are shared by all the connections, and once prepared they
+	 * stay so. The only per-page part is the domain lookup, which is a map
+	 * lookup the request repeats anyway. A per-connection warm-up would
+	 * only queue the same work again for every page (or tab) that connects.
+	 */
+	void 						warmUp( const std::string& domain );
+
+	/**
+	 * Update the authorized keystore if needed. If an update is already in
+	 * progress, return false without waiting for it: ``retry`` (if given)
+	 * is queued when it's over, so the caller can give back its worker.
+	 */
+	bool 						prepareKeystore( DownloadProviderPtr downloadProvider, const WorkerTask& retry = WorkerTask() );
+
+	/**
+	 * Wait for the delayed initialization of the hypervisor. If it is already
+	 * being initialized, return HVE_SCHEDULED without waiting for it:
+	 * ``retry`` (if given) is queued when it's over.
+	 */
+	int 						prepareHypervisor( const FiniteTaskPtr& pf, const UserInteractionPtr& ui, const WorkerTask& retry = WorkerTask() );
+
+private:
+
+	/**
+	 * [Worker] Run the speculative warm-up
+	 */
+	void 						warmUp_task( const std::string& domain );
 
 	/**
-	 * The identified hypervisor
+	 * Forget an authentication key when its timer expires
+	 */
+	void 						expireAuthKey( const std::string& key );
+
+	/**
+	 * Attach a leased session to a connection (the caller must hold sessionsMutex)
+	 */
+	void 						attachSession( const CVMWebAPISessionPtr& session, DaemonConnection& connection );
+
+	/**
+	 * Close a leased session when its grace period is over
+	 */
+	void 						expireLease( int uuid, const std::string& token );
+
+	/**
+	 * Close the given (already unregistered) sessions in parallel, each one on
+	 * its own strand, after the actions queued there. Returns the semaphore
+	 * that drains when all of them are closed.
+	 */
+	DrainSemaphorePtr			closeSessions( const std::vector< CVMWebAPISessionPtr >& list );
+
+	/**
+	 * The identified hypervisor (protected by hypervisorMutex)
 	 */
 	HVInstancePtr								hypervisor;
 
 	/**
-	 * Connection status
+	 * Connection status (protected by hypervisorMutex)
 	 */
 	bool 										running;
 
+	/**
+	 * Mutex for accessing the hypervisor and the running flag
+	 */
+	boost::mutex								hypervisorMutex;
+
+public:
+
 	/**
 	 * Global flag that lets sessions know that an installation is already in progress
 	 */
@@ -136,6 +265,13 @@ public:
 	 */
 	DomainKeystore								keystore;
 
+	/**
+	 * Lock of the keystore. The stages of the session requests run in
+	 * parallel and DomainKeystore is not thread-safe, so its update takes
+	 * the lock exclusively and everything that reads it takes it shared.
+	 */
+	boost::shared_mutex							keystoreMutex;
+
 	/**
 	 * Local config
 	 */
@@ -147,14 +283,53 @@ public:
 	DownloadProviderPtr							downloadProvider;
 
 	/**
-	 * Authenticated keys
+	 * Authenticated keys, indexed by key string
 	 */
-	std::list< AuthKey >						authKeys;
+	std::map< std::string, AuthKey >			authKeys;
 
 	/**
 	 * Sessions
 	 */
-	std::map<int, CVMWebAPISession* >			sessions;
+	std::map<int, CVMWebAPISessionPtr >			sessions;
+
+	/**
+	 * The bus where the sessions publish their events
+	 */
+	EventBus 									eventBus;
+
+	/**
+	 * The worker threads shared by all the connections
+	 */
+	WorkerPool 									workerPool;
+
+	/**
+	 * The timers of the daemon (running on the worker pool)
+	 */
+	TimerWheel 									timers;
+
+	/**
+	 * Mutex for accessing the sessions map (the core is shared
+	 * between the webserver reactors and the session threads)
+	 */
+	boost::mutex								sessionsMutex;
+
+	/**
+	 * Mutex for accessing the auth keys and the installation flag
+	 */
+	boost::mutex								stateMutex;
+
+	/**
+	 * Gates that make the keystore update and the hypervisor
+	 * initialization run once, no matter how many callers need them
+	 */
+	PreparationGate								keystoreGate;
+	PreparationGate								readyGate;
+
+	/**
+	 * The state of the speculative warm-up (protected by stateMutex)
+	 */
+	bool 										warmupRunning;
+	unsigned long 								warmupTime;
 
 };
 
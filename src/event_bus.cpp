@@ -0,0 +1,169 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+// Everything is included in daemon.h
+// (Including cross-referencing)
+#include "daemon.h"
+
+#include <CernVM/CrashReport.h>
+
+#include <algorithm>
+
+/**
+ * Check if the connection was already visited during a fan-out, since it
+ * can have a subscription to the session and one to all the sessions.
+ */
+static bool visited( std::vector< DaemonConnection* >& connections, DaemonConnection * connection ) {
+	if (std::find( connections.begin(), connections.end(), connection ) != connections.end())
+		return true;
+	connections.push_back( connection );
+	return false;
+}
+
+/**
+ * Subscribe a connection to the events of a session
+ */
+void EventBus::subscribe( DaemonConnection * connection, int session, int classes ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(subscriptionsMutex);
+
+	// Update the existing subscription
+	for (std::vector< EventSubscription >::iterator it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+		if ((it->connection == connection) && (it->session == session)) {
+			if (classes == 0) {
+				subscriptions.erase( it );
+			} else {
+				it->classes = classes;
+			}
+			return;
+		}
+	}
+
+	// Or create a new one
+	if (classes == 0) return;
+	EventSubscription sub;
+	sub.connection = connection;
+	sub.session = session;
+	sub.classes = classes;
+	subscriptions.push_back( sub );
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Remove all the subscriptions of a connection
+ */
+void EventBus::unsubscribeAll( DaemonConnection * connection ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(subscriptionsMutex);
+	for (std::vector< EventSubscription >::iterator it = subscriptions.begin(); it != subscriptions.end(); ) {
+		if (it->connection == connection) {
+			it = subscriptions.erase( it );
+		} else {
+			++it;
+		}
+	}
+	CRASH_REPORT_END;
+}
+
+/**
+ * Remove all the subscriptions to a session
+ */
+void EventBus::releaseSession( int session ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(subscriptionsMutex);
+	for (std::vector< EventSubscription >::iterator it = subscriptions.begin(); it != subscriptions.end(); ) {
+		if (it->session == session) {
+			it = subscriptions.erase( it );
+		} else {
+			it->states.erase( session );
+			++it;
+		}
+	}
+	CRASH_REPORT_END;
+}
+
+/**
+ * Queue the event to the subscribers of its topic
+ */
+void EventBus::publish( int session, int eventClass, const CVMWebserverBufferPtr& frame, const std::string& key ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(subscriptionsMutex);
+	std::vector< DaemonConnection* > connections;
+	for (std::vector< EventSubscription >::iterator it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+		if (matches( *it, session, eventClass ) && !visited( connections, it->connection ))
+			it->connection->sendRawData( frame, key );
+	}
+	CRASH_REPORT_END;
+}
+
+/**
+ * Queue the state variables to the subscribers of the session
+ */
+void EventBus::publishState( int session, StateEncoder& encoder, bool full ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(subscriptionsMutex);
+	std::vector< DaemonConnection* > connections;
+	for (std::vector< EventSubscription >::iterator it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+		if (!matches( *it, session, EVENT_STATE ) || visited( connections, it->connection )) continue;
+
+		// Every delta builds on the previous frame, so the frames of
+		// browsers that accept deltas are chained, and collapsed to a full
+		// frame if the browser falls behind. The full frames of the rest
+		// of the browsers supersede each other.
+		const bool deltas = it->connection->acceptsStateDeltas();
+		StateCursor& cursor = it->states[session];
+		CVMWebserverBufferPtr frame = encoder.update( cursor, deltas, full );
+		if (!frame) continue;
+		if (deltas) {
+			it->connection->sendRawData( frame, "stateVariables:" + ntos<int>(session), encoder.rebase( cursor ) );
+		} else {
+			it->connection->sendRawData( frame, "stateVariables:" + ntos<int>(session) );
+		}
+	}
+	CRASH_REPORT_END;
+}
+
+/**
+ * Parse a comma-separated list of event class names
+ */
+int EventBus::parseClasses( const std::string& names ) {
+	CRASH_REPORT_BEGIN;
+	int classes = 0;
+	size_t start = 0;
+	while (start <= names.length()) {
+		size_t end = names.find(',', start);
+		if (end == std::string::npos) end = names.length();
+		std::string name = names.substr(start, end - start);
+		start = end + 1;
+
+		if (name == "state") {
+			classes |= EVENT_STATE;
+		} else if (name == "progress") {
+			classes |= EVENT_PROGRESS;
+		} else if (name == "failure") {
+			classes |= EVENT_FAILURE;
+		} else if (name == "all") {
+			classes |= EVENT_ALL;
+		}
+	}
+	return classes;
+	CRASH_REPORT_END;
+}
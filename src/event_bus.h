@@ -0,0 +1,130 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef DAEMON_EVENT_BUS_H
+#define DAEMON_EVENT_BUS_H
+
+#include "web/buffer.h"
+#include "state_delta.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include <string>
+#include <vector>
+#include <map>
+
+// The classes of the session events
+#define EVENT_STATE			0x01 	// stateVariables, stateDelta, stateChanged, apiStateChanged, resolutionChanged, succeed
+#define EVENT_PROGRESS		0x02 	// started, progress, completed and failed of the session tasks
+#define EVENT_FAILURE		0x04 	// failure, failed of the session requests
+#define EVENT_ALL			0x07
+
+// Subscribe to the events of every session
+#define EVENT_ALL_SESSIONS	-1
+
+class DaemonConnection;
+
+/**
+ * A subscription of a connection to the events of a session
+ */
+struct EventSubscription {
+	DaemonConnection * 	connection;
+	int 				session;
+	int 				classes;
+
+	// The state variables sent through this subscription, by session
+	std::map< int, StateCursor >	states;
+};
+
+/**
+ * The bus where the sessions publish their events.
+ *
+ * An event is serialized once by the publisher, and the same buffer is
+ * queued to every connection with a matching subscription. The connection
+ * that opened a session is subscribed to all of its events, while other
+ * connections can subscribe to particular sessions or event classes.
+ */
+class EventBus {
+public:
+
+	/**
+	 * Initialize an empty event bus
+	 */
+	EventBus() : subscriptions(), subscriptionsMutex() { };
+
+	/**
+	 * Subscribe the connection to the given classes of events of a session
+	 * (or of all the sessions). An existing subscription of the connection
+	 * to the same session is replaced, and it's removed if ``classes`` is 0.
+	 */
+	void 				subscribe( DaemonConnection * connection, int session, int classes );
+
+	/**
+	 * Remove all the subscriptions of a connection
+	 */
+	void 				unsubscribeAll( DaemonConnection * connection );
+
+	/**
+	 * Remove all the subscriptions to a session that was released
+	 */
+	void 				releaseSession( int session );
+
+	/**
+	 * Queue the given event to all the subscribers of its topic
+	 */
+	void 				publish( int session, int eventClass, const CVMWebserverBufferPtr& frame, const std::string& key = "" );
+
+	/**
+	 * Queue the state variables of a session to the subscribers whose state
+	 * is not up to date (or to all of them if ``full`` is true). Every
+	 * subscriber gets the frame the encoder picks for it. The frames of
+	 * browsers that accept deltas are chained in their egress queue, while
+	 * the full frames of the rest supersede their queued one.
+	 */
+	void 				publishState( int session, StateEncoder& encoder, bool full );
+
+	/**
+	 * Parse a comma-separated list of event class names
+	 */
+	static int 			parseClasses( const std::string& names );
+
+private:
+
+	/**
+	 * Check if the subscription matches the given topic
+	 */
+	static bool 		matches( const EventSubscription& sub, int session, int eventClass ) {
+		return ((sub.session == session) || (sub.session == EVENT_ALL_SESSIONS)) && ((sub.classes & eventClass) != 0);
+	};
+
+	/**
+	 * The active subscriptions
+	 */
+	std::vector< EventSubscription >	subscriptions;
+
+	/**
+	 * Mutex for accessing the subscriptions
+	 */
+	boost::mutex 		subscriptionsMutex;
+
+};
+
+#endif /* end of include guard: DAEMON_EVENT_BUS_H */
@@ -406,11 +406,31 @@ SocketPrototype.__handleOpen = function(data) {
 SocketPrototype.__handleData = function(data) {
 	var o = JSON.parse(data);
 
+	// Unpack batched frames
+	if (o instanceof Array) {
+		for (var i=0; i<o.length; i++)
+			this.__handleFrame(o[i]);
+	} else {
+		this.__handleFrame(o);
+	}
+
+}
+
+/**
+ * Handle a single parsed frame
+ */
+SocketPrototype.__handleFrame = function(o) {
+
 	// Forward all the frames of the given ID to the
 	// frame-handling callback.
 	if (o['id']) {
 		var cb = this.responseCallbacks[o['id']];
-		if (cb != undefined) cb(o);
+		if (cb != undefined) {
+			cb(o);
+		} else if (this.__subscriptionCallback) {
+			// Events of sessions we are subscribed to
+			this.__subscriptionCallback(o);
+		}
 	}
 
 	// Fire event if we got an event response
@@ -455,8 +475,9 @@ SocketPrototype.send = function(action, data, responseEvents, responseTimeout) {
 		if (responseTimeout !== 0) {
 			timeoutTimer = setTimeout(function() {
 
-				// Remove slot
+				// Remove slot and stop the daemon from working on it
 				delete self.responseCallbacks[frameID];
+				self.send("cancel", { "target": frameID });
 
 				// Send error event
 				responseEvents(null, "Response timeout");
@@ -493,8 +514,9 @@ SocketPrototype.send = function(action, data, responseEvents, responseTimeout) {
 		if (responseTimeout !== 0) {
 			timeoutTimer = setTimeout(function() {
 
-				// Remove slot
+				// Remove slot and stop the daemon from working on it
 				delete self.responseCallbacks[frameID];
+				self.send("cancel", { "target": frameID });
 
 				// Send error event
 				if (responseEvents['onError'])
@@ -727,7 +749,9 @@ SocketPrototype.connect = function( cbAPIState, autoLaunch ) {
 		// to finalize the connection
 		self.send("handshake", {
 			"version": _NS_.version,
-			"auth": self.authToken
+			"auth": self.authToken,
+			"batch": 1,
+			"delta": 1
 		}, function(data, type, raw) {
 			console.info("Successful handshake with CernVM WebAPI v" + data['version']);
 			// Keep version information
@@ -1578,6 +1602,26 @@ WebAPIPlugin.prototype = Object.create( Socket.prototype );
 // Hint for minimization
 var WebAPIPluginPrototype = WebAPIPlugin.prototype;
 
+/**
+ * The lease tokens are kept in the session storage, so a page
+ * can resume its sessions after a reload.
+ */
+var _leaseKey = function( vmcp ) {
+	return "cvmwebapi-lease:" + vmcp;
+}
+var _loadLease = function( vmcp ) {
+	try { return window.sessionStorage.getItem( _leaseKey(vmcp) ); } catch (e) { return null; }
+}
+var _storeLease = function( vmcp, token ) {
+	try {
+		if (token) {
+			window.sessionStorage.setItem( _leaseKey(vmcp), token );
+		} else {
+			window.sessionStorage.removeItem( _leaseKey(vmcp) );
+		}
+	} catch (e) { }
+}
+
 /**
  * Attempt to reheat the connection if it went offline
  */
@@ -1588,64 +1632,91 @@ WebAPIPluginPrototype.__reheat = function( socket ) {
 	// Reset response callbacks
 	this.responseCallbacks = {};
 
-	// Reopen valid connections
-	for (var i=0; i<this._sessions.length; i++) {
-		var session = this._sessions[i].ref,
-			vmcp = this._sessions[i].vmcp;
+	// Re-attach a session with the given ID
+	var reheated = function( entry, session_id, token ) {
+		var session = entry.ref;
+		console.log("Session ", session_id, " reheated");
 
-		if (session.__valid) {
+		// Update session ID reference and lease
+		session.session_id = session_id;
+		entry.token = token;
+		_storeLease( entry.vmcp, token );
 
-			// Send requestSession
-			this.send("requestSession", {
-				"vmcp": vmcp
-			}, {
-				onSucceed : function( msg, session_id ) {
-					console.log("Session ", session_id, " reheated");
+		// Receive events with id=session_id
+		self.responseCallbacks[session_id] = function(data) {
+			session.handleEvent(data);
+		}
+		
+		// Send sync message
+		setTimeout(function() {
+			session.sync();
+		}, 100);
 
-					// Update session ID reference
-					session.session_id = session_id;
+	};
 
-					// Receive events with id=session_id
-					self.responseCallbacks[session_id] = function(data) {
-						session.handleEvent(data);
-					}
-					
-					// Send sync message
-					setTimeout(function() {
-						session.sync();
-					}, 100);
+	// Open the session again, if it could not be resumed
+	var reopen = function( entry ) {
 
-				},
-				onFailed: function( msg, code ) {
-					console.warn("Unable to reheat a saved session!");
+		// Send requestSession
+		self.send("requestSession", {
+			"vmcp": entry.vmcp
+		}, {
+			onSucceed : function( msg, session_id, token ) {
+				reheated( entry, session_id, token );
+			},
+			onFailed: function( msg, code ) {
+				console.warn("Unable to reheat a saved session!");
 
-					// If a single vmcp failed to re-open after
-					// a re-heat, consider the connection closed,
-					// so the handling application has to restart,
+				// If a single vmcp failed to re-open after
+				// a re-heat, consider the connection closed,
+				// so the handling application has to restart,
 
-					if (already_closed) return;
-					self.__handleClose();
-					already_closed = true;
-
-				},
-				// Progress feedbacks
-				onLengthyTask: function( msg, isLengthy ) {
-					// Control the occupied window
-					UserInteraction.controlOccupied( isLengthy, msg );
-				},
-				onProgress: function( msg, percent ) {
-					self.__fire("progress", [msg, percent]);
-				},
-				onStarted: function( msg ) {
-					self.__fire("started", [msg]);
-				},
-				onCompleted: function( msg ) {
-					self.__fire("completed", [msg]);
-				}
+				if (already_closed) return;
+				self.__handleClose();
+				already_closed = true;
 
-			});
+			},
+			// Progress feedbacks
+			onLengthyTask: function( msg, isLengthy ) {
+				// Control the occupied window
+				UserInteraction.controlOccupied( isLengthy, msg );
+			},
+			onProgress: function( msg, percent ) {
+				self.__fire("progress", [msg, percent]);
+			},
+			onStarted: function( msg ) {
+				self.__fire("started", [msg]);
+			},
+			onCompleted: function( msg ) {
+				self.__fire("completed", [msg]);
+			}
+
+		});
 
+	};
+
+	// Reopen valid connections, resuming their leases if possible
+	for (var i=0; i<this._sessions.length; i++) {
+		var entry = this._sessions[i];
+		if (!entry.ref.__valid) continue;
+
+		if (entry.token) {
+			(function( entry ) {
+				self.send("resumeSession", {
+					"token": entry.token
+				}, {
+					onSucceed : function( msg, session_id, token ) {
+						reheated( entry, session_id, token );
+					},
+					onFailed: function( msg, code ) {
+						reopen( entry );
+					}
+				});
+			})( entry );
+		} else {
+			reopen( entry );
 		}
+
 	}
 
 }
@@ -1661,34 +1732,58 @@ WebAPIPluginPrototype.stopService = function() {
  * Open a session and call the cbOk when ready
  */
 WebAPIPluginPrototype.requestSession = function(vmcp, cbOk, cbFail) {
-	var self = this;
+	var self = this,
+		token = _loadLease( vmcp );
 
-	// Send requestSession
-	this.send("requestSession", {
-		"vmcp": vmcp
-	}, {
+	// Track the session once it's open
+	var opened = function( session_id, token ) {
 
-		// Basic responses
-		onSucceed : function( msg, session_id ) {
+		// Create a new session object
+		var session = new WebAPISession( self, session_id, function() {
+			
+			// Fire the ok callback only when we are initialized
+			if (cbOk) cbOk(session);
 
-			// Create a new session object
-			var session = new WebAPISession( self, session_id, function() {
-				
-				// Fire the ok callback only when we are initialized
-				if (cbOk) cbOk(session);
+		});
 
-			});
+		self._sessions.push({
+			'vmcp': vmcp,
+			'ref': session,
+			'token': token
+		});
+		_storeLease( vmcp, token );
 
-			self._sessions.push({
-				'vmcp': vmcp,
-				'ref': session
-			});
+		// Receive events with id=session_id
+		self.responseCallbacks[session_id] = function(data) {
+			session.handleEvent(data);
+		}
+
+	};
 
-			// Receive events with id=session_id
-			self.responseCallbacks[session_id] = function(data) {
-				session.handleEvent(data);
+	// If the page was reloaded, try to resume the session it had
+	if (token) {
+		this.send("resumeSession", {
+			"token": token
+		}, {
+			onSucceed : function( msg, session_id, token ) {
+				opened( session_id, token );
+			},
+			onFailed: function( msg, code ) {
+				_storeLease( vmcp, null );
+				self.requestSession( vmcp, cbOk, cbFail );
 			}
+		});
+		return;
+	}
 
+	// Send requestSession
+	this.send("requestSession", {
+		"vmcp": vmcp
+	}, {
+
+		// Basic responses
+		onSucceed : function( msg, session_id, token ) {
+			opened( session_id, token );
 		},
 		onFailed: function( msg, code ) {
 
@@ -1771,6 +1866,36 @@ WebAPIPluginPrototype.controlSession = function(session_id, action, callback) {
 
 };
 
+/**
+ * Receive the events of a session opened by another page, or of all the
+ * sessions if session_id is null (available only if the session is privileged).
+ * The events are a comma-separated list of: state, progress, failure, all
+ */
+WebAPIPluginPrototype.subscribe = function(session_id, events, callback) {
+	var self = this;
+	var data = { "events": events || "all" };
+	if (session_id != null) data["session"] = session_id;
+
+	// Send subscribe
+	this.send("subscribe", data, {
+
+		// Forward the events of the session
+		onSucceed : function() {
+			if (!callback) return;
+			if (session_id != null) {
+				self.responseCallbacks[session_id] = callback;
+			} else {
+				self.__subscriptionCallback = callback;
+			}
+		},
+		onFailed: function( msg, code ) {
+			if (callback) callback(null, msg, code);
+		}
+
+	});
+
+};
+
 /**
  * Synchronize the state of all session objects
  */
@@ -1798,6 +1923,8 @@ var WebAPISession = function( socket, session_id, init_callback ) {
 	this.__apiState = false;
 	this.__properties = {};
 	this.__config = {};
+	this.__stateVersion = 0;
+	this.__stateSyncing = false;
 	this.__valid = true;
 
 	// The last RDP window
@@ -1911,6 +2038,11 @@ WebAPISessionPrototype.handleEvent = function(data) {
 				this.__config = data[0] || { };
 			if (data.length >= 2)
 				this.__properties = data[1] || { };
+
+			// The deltas are numbered from the last full snapshot, or
+			// continue from the version a collapsed snapshot carries
+			this.__stateVersion = data[2] || 0;
+			this.__stateSyncing = false;
 		}
 
 		// Fire init callback
@@ -1922,6 +2054,32 @@ WebAPISessionPrototype.handleEvent = function(data) {
 		// Don't forward
 		return;
 
+	} else if (data['name'] == 'stateDelta') {
+
+		// Apply the changes since the previous state version
+		data = data['data'];
+		if (!data) return; // Invalid
+
+		// If we missed a version, ask (once) for a full snapshot
+		if (data[3] != this.__stateVersion + 1) {
+			if (!this.__stateSyncing) {
+				this.__stateSyncing = true;
+				this.sync();
+			}
+			return;
+		}
+
+		for (var k in data[0])
+			this.__config[k] = data[0][k];
+		for (var k in data[1])
+			this.__properties[k] = data[1][k];
+		for (var i=0; i<data[2].length; i++)
+			delete this.__properties[data[2][i]];
+		this.__stateVersion = data[3];
+
+		// Don't forward
+		return;
+
 	} else if (data['name'] == 'failure') {
 
 		// Handle serious failures
@@ -2052,9 +2210,30 @@ WebAPISessionPrototype.sync = function() {
 	})
 }
 
+WebAPISessionPrototype.batch = function(actions, cb) {
+	// Run many actions with a single request. Every item of
+	// the results is { "status": "succeed"|"failed", "data": [..] }
+	if (!this.__valid) return;
+	this.socket.send("batch", {
+		"session_id": this.session_id,
+		"actions": actions
+	},{
+		onSucceed : function( results ) {
+			if (cb) cb(results);
+		}
+	})
+}
+
 WebAPISessionPrototype.getAsync = function(parameter, cb) {
-	// Get a session parameter
+	// Get many session parameters at once
 	if (!this.__valid) return;
+	if (parameter instanceof Array) {
+		this.batch([ { "name": "get", "data": { "keys": parameter } } ], function(results) {
+			if (cb) cb(results[0]['data'][0]);
+		});
+		return;
+	}
+	// Get a session parameter
 	this.socket.send("get", {
 		"session_id": this.session_id,
 		"key": parameter
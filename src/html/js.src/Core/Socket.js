@@ -67,11 +67,31 @@ SocketPrototype.__handleOpen = function(data) {
 SocketPrototype.__handleData = function(data) {
 	var o = JSON.parse(data);
 
+	// Unpack batched frames
+	if (o instanceof Array) {
+		for (var i=0; i<o.length; i++)
+			this.__handleFrame(o[i]);
+	} else {
+		this.__handleFrame(o);
+	}
+
+}
+
+/**
+ * Handle a single parsed frame
+ */
+SocketPrototype.__handleFrame = function(o) {
+
 	// Forward all the frames of the given ID to the
 	// frame-handling callback.
 	if (o['id']) {
 		var cb = this.responseCallbacks[o['id']];
-		if (cb != undefined) cb(o);
+		if (cb != undefined) {
+			cb(o);
+		} else if (this.__subscriptionCallback) {
+			// Events of sessions we are subscribed to
+			this.__subscriptionCallback(o);
+		}
 	}
 
 	// Fire event if we got an event response
@@ -116,8 +136,9 @@ SocketPrototype.send = function(action, data, responseEvents, responseTimeout) {
 		if (responseTimeout !== 0) {
 			timeoutTimer = setTimeout(function() {
 
-				// Remove slot
+				// Remove slot and stop the daemon from working on it
 				delete self.responseCallbacks[frameID];
+				self.send("cancel", { "target": frameID });
 
 				// Send error event
 				responseEvents(null, "Response timeout");
@@ -154,8 +175,9 @@ SocketPrototype.send = function(action, data, responseEvents, responseTimeout) {
 		if (responseTimeout !== 0) {
 			timeoutTimer = setTimeout(function() {
 
-				// Remove slot
+				// Remove slot and stop the daemon from working on it
 				delete self.responseCallbacks[frameID];
+				self.send("cancel", { "target": frameID });
 
 				// Send error event
 				if (responseEvents['onError'])
@@ -388,7 +410,9 @@ SocketPrototype.connect = function( cbAPIState, autoLaunch ) {
 		// to finalize the connection
 		self.send("handshake", {
 			"version": _NS_.version,
-			"auth": self.authToken
+			"auth": self.authToken,
+			"batch": 1,
+			"delta": 1
 		}, function(data, type, raw) {
 			console.info("Successful handshake with CernVM WebAPI v" + data['version']);
 			// Keep version information
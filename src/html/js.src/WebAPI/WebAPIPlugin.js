@@ -20,6 +20,26 @@ WebAPIPlugin.prototype = Object.create( Socket.prototype );
 // Hint for minimization
 var WebAPIPluginPrototype = WebAPIPlugin.prototype;
 
+/**
+ * The lease tokens are kept in the session storage, so a page
+ * can resume its sessions after a reload.
+ */
+var _leaseKey = function( vmcp ) {
+	return "cvmwebapi-lease:" + vmcp;
+}
+var _loadLease = function( vmcp ) {
+	try { return window.sessionStorage.getItem( _leaseKey(vmcp) ); } catch (e) { return null; }
+}
+var _storeLease = function( vmcp, token ) {
+	try {
+		if (token) {
+			window.sessionStorage.setItem( _leaseKey(vmcp), token );
+		} else {
+			window.sessionStorage.removeItem( _leaseKey(vmcp) );
+		}
+	} catch (e) { }
+}
+
 /**
  * Attempt to reheat the connection if it went offline
  */
@@ -30,64 +50,91 @@ WebAPIPluginPrototype.__reheat = function( socket ) {
 	// Reset response callbacks
 	this.responseCallbacks = {};
 
-	// Reopen valid connections
-	for (var i=0; i<this._sessions.length; i++) {
-		var session = this._sessions[i].ref,
-			vmcp = this._sessions[i].vmcp;
+	// Re-attach a session with the given ID
+	var reheated = function( entry, session_id, token ) {
+		var session = entry.ref;
+		console.log("Session ", session_id, " reheated");
 
-		if (session.__valid) {
+		// Update session ID reference and lease
+		session.session_id = session_id;
+		entry.token = token;
+		_storeLease( entry.vmcp, token );
 
-			// Send requestSession
-			this.send("requestSession", {
-				"vmcp": vmcp
-			}, {
-				onSucceed : function( msg, session_id ) {
-					console.log("Session ", session_id, " reheated");
+		// Receive events with id=session_id
+		self.responseCallbacks[session_id] = function(data) {
+			session.handleEvent(data);
+		}
+		
+		// Send sync message
+		setTimeout(function() {
+			session.sync();
+		}, 100);
+
+	};
+
+	// Open the session again, if it could not be resumed
+	var reopen = function( entry ) {
+
+		// Send requestSession
+		self.send("requestSession", {
+			"vmcp": entry.vmcp
+		}, {
+			onSucceed : function( msg, session_id, token ) {
+				reheated( entry, session_id, token );
+			},
+			onFailed: function( msg, code ) {
+				console.warn("Unable to reheat a saved session!");
+
+				// If a single vmcp failed to re-open after
+				// a re-heat, consider the connection closed,
+				// so the handling application has to restart,
+
+				if (already_closed) return;
+				self.__handleClose();
+				already_closed = true;
+
+			},
+			// Progress feedbacks
+			onLengthyTask: function( msg, isLengthy ) {
+				// Control the occupied window
+				UserInteraction.controlOccupied( isLengthy, msg );
+			},
+			onProgress: function( msg, percent ) {
+				self.__fire("progress", [msg, percent]);
+			},
+			onStarted: function( msg ) {
+				self.__fire("started", [msg]);
+			},
+			onCompleted: function( msg ) {
+				self.__fire("completed", [msg]);
+			}
 
-					// Update session ID reference
-					session.session_id = session_id;
+		});
 
-					// Receive events with id=session_id
-					self.responseCallbacks[session_id] = function(data) {
-						session.handleEvent(data);
-					}
-					
-					// Send sync message
-					setTimeout(function() {
-						session.sync();
-					}, 100);
-
-				},
-				onFailed: function( msg, code ) {
-					console.warn("Unable to reheat a saved session!");
-
-					// If a single vmcp failed to re-open after
-					// a re-heat, consider the connection closed,
-					// so the handling application has to restart,
-
-					if (already_closed) return;
-					self.__handleClose();
-					already_closed = true;
-
-				},
-				// Progress feedbacks
-				onLengthyTask: function( msg, isLengthy ) {
-					// Control the occupied window
-					UserInteraction.controlOccupied( isLengthy, msg );
-				},
-				onProgress: function( msg, percent ) {
-					self.__fire("progress", [msg, percent]);
-				},
-				onStarted: function( msg ) {
-					self.__fire("started", [msg]);
-				},
-				onCompleted: function( msg ) {
-					self.__fire("completed", [msg]);
-				}
-
-			});
+	};
 
+	// Reopen valid connections, resuming their leases if possible
+	for (var i=0; i<this._sessions.length; i++) {
+		var entry = this._sessions[i];
+		if (!entry.ref.__valid) continue;
+
+		if (entry.token) {
+			(function( entry ) {
+				self.send("resumeSession", {
+					"token": entry.token
+				}, {
+					onSucceed : function( msg, session_id, token ) {
+						reheated( entry, session_id, token );
+					},
+					onFailed: function( msg, code ) {
+						reopen( entry );
+					}
+				});
+			})( entry );
+		} else {
+			reopen( entry );
 		}
+
 	}
 
 }
@@ -103,34 +150,58 @@ WebAPIPluginPrototype.stopService = function() {
  * Open a session and call the cbOk when ready
  */
 WebAPIPluginPrototype.requestSession = function(vmcp, cbOk, cbFail) {
-	var self = this;
+	var self = this,
+		token = _loadLease( vmcp );
 
-	// Send requestSession
-	this.send("requestSession", {
-		"vmcp": vmcp
-	}, {
+	// Track the session once it's open
+	var opened = function( session_id, token ) {
 
-		// Basic responses
-		onSucceed : function( msg, session_id ) {
+		// Create a new session object
+		var session = new WebAPISession( self, session_id, function() {
+			
+			// Fire the ok callback only when we are initialized
+			if (cbOk) cbOk(session);
 
-			// Create a new session object
-			var session = new WebAPISession( self, session_id, function() {
-				
-				// Fire the ok callback only when we are initialized
-				if (cbOk) cbOk(session);
+		});
 
-			});
+		self._sessions.push({
+			'vmcp': vmcp,
+			'ref': session,
+			'token': token
+		});
+		_storeLease( vmcp, token );
 
-			self._sessions.push({
-				'vmcp': vmcp,
-				'ref': session
-			});
+		// Receive events with id=session_id
+		self.responseCallbacks[session_id] = function(data) {
+			session.handleEvent(data);
+		}
 
-			// Receive events with id=session_id
-			self.responseCallbacks[session_id] = function(data) {
-				session.handleEvent(data);
+	};
+
+	// If the page was reloaded, try to resume the session it had
+	if (token) {
+		this.send("resumeSession", {
+			"token": token
+		}, {
+			onSucceed : function( msg, session_id, token ) {
+				opened( session_id, token );
+			},
+			onFailed: function( msg, code ) {
+				_storeLease( vmcp, null );
+				self.requestSession( vmcp, cbOk, cbFail );
 			}
+		});
+		return;
+	}
+
+	// Send requestSession
+	this.send("requestSession", {
+		"vmcp": vmcp
+	}, {
 
+		// Basic responses
+		onSucceed : function( msg, session_id, token ) {
+			opened( session_id, token );
 		},
 		onFailed: function( msg, code ) {
 
@@ -213,6 +284,36 @@ WebAPIPluginPrototype.controlSession = function(session_id, action, callback) {
 
 };
 
+/**
+ * Receive the events of a session opened by another page, or of all the
+ * sessions if session_id is null (available only if the session is privileged).
+ * The events are a comma-separated list of: state, progress, failure, all
+ */
+WebAPIPluginPrototype.subscribe = function(session_id, events, callback) {
+	var self = this;
+	var data = { "events": events || "all" };
+	if (session_id != null) data["session"] = session_id;
+
+	// Send subscribe
+	this.send("subscribe", data, {
+
+		// Forward the events of the session
+		onSucceed : function() {
+			if (!callback) return;
+			if (session_id != null) {
+				self.responseCallbacks[session_id] = callback;
+			} else {
+				self.__subscriptionCallback = callback;
+			}
+		},
+		onFailed: function( msg, code ) {
+			if (callback) callback(null, msg, code);
+		}
+
+	});
+
+};
+
 /**
  * Synchronize the state of all session objects
  */
@@ -17,6 +17,8 @@ var WebAPISession = function( socket, session_id, init_callback ) {
 	this.__apiState = false;
 	this.__properties = {};
 	this.__config = {};
+	this.__stateVersion = 0;
+	this.__stateSyncing = false;
 	this.__valid = true;
 
 	// The last RDP window
@@ -130,6 +132,11 @@ WebAPISessionPrototype.handleEvent = function(data) {
 				this.__config = data[0] || { };
 			if (data.length >= 2)
 				this.__properties = data[1] || { };
+
+			// The deltas are numbered from the last full snapshot, or
+			// continue from the version a collapsed snapshot carries
+			this.__stateVersion = data[2] || 0;
+			this.__stateSyncing = false;
 		}
 
 		// Fire init callback
@@ -141,6 +148,32 @@ WebAPISessionPrototype.handleEvent = function(data) {
 		// Don't forward
 		return;
 
+	} else if (data['name'] == 'stateDelta') {
+
+		// Apply the changes since the previous state version
+		data = data['data'];
+		if (!data) return; // Invalid
+
+		// If we missed a version, ask (once) for a full snapshot
+		if (data[3] != this.__stateVersion + 1) {
+			if (!this.__stateSyncing) {
+				this.__stateSyncing = true;
+				this.sync();
+			}
+			return;
+		}
+
+		for (var k in data[0])
+			this.__config[k] = data[0][k];
+		for (var k in data[1])
+			this.__properties[k] = data[1][k];
+		for (var i=0; i<data[2].length; i++)
+			delete this.__properties[data[2][i]];
+		this.__stateVersion = data[3];
+
+		// Don't forward
+		return;
+
 	} else if (data['name'] == 'failure') {
 
 		// Handle serious failures
@@ -271,9 +304,30 @@ WebAPISessionPrototype.sync = function() {
 	})
 }
 
+WebAPISessionPrototype.batch = function(actions, cb) {
+	// Run many actions with a single request. Every item of
+	// the results is { "status": "succeed"|"failed", "data": [..] }
+	if (!this.__valid) return;
+	this.socket.send("batch", {
+		"session_id": this.session_id,
+		"actions": actions
+	},{
+		onSucceed : function( results ) {
+			if (cb) cb(results);
+		}
+	})
+}
+
 WebAPISessionPrototype.getAsync = function(parameter, cb) {
-	// Get a session parameter
+	// Get many session parameters at once
 	if (!this.__valid) return;
+	if (parameter instanceof Array) {
+		this.batch([ { "name": "get", "data": { "keys": parameter } } ], function(results) {
+			if (cb) cb(results[0]['data'][0]);
+		});
+		return;
+	}
+	// Get a session parameter
 	this.socket.send("get", {
 		"session_id": this.session_id,
 		"key": parameter
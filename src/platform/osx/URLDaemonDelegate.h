@@ -31,8 +31,6 @@
   	@private NSTimer *			timer;
   	// The reaping probe timer
   	@private NSTimer *			reapTimer;
-    // The cron jobs timer
-    @private NSTimer *      cronTimer;
     // The timer used for delay-starting reap timer
     @private NSTimer *      delayStartTimer;
     // The timer used for delay-activating the URL launching
@@ -61,11 +59,6 @@
  */
 - (void)serverLoop;
 
-/**
- * CRON Event
- */
-- (void)forwardCronEvent;
-
 /**
  * Check server for reaping dead connections
  */
@@ -77,8 +77,8 @@
 	core = new DaemonCore();
 	// Create a factory which is going to create the instances
 	factory = new DaemonFactory(*core);
-	// Create the webserver instance
-	webserver = new CVMWebserver(*factory);
+	// Create the webserver instance (with as many reactors as configured)
+	webserver = new CVMWebserver(*factory, CERNVM_WEBAPI_PORT, core->config->getNum<int>("webserver-reactors", 1));
 	// Create the RPC handler
 	rpcHandler = new WebRPCHandler();
 	webserver->setStaticURLHandler(rpcHandler);
@@ -115,14 +115,6 @@
 		userInfo:nil
 		repeats:YES];
 
-	// Start CRON timer
-	cronTimer = [NSTimer
-		scheduledTimerWithTimeInterval:1
-		target:self
-		selector:@selector(forwardCronEvent)
-		userInfo:nil
-		repeats:YES];
-
 	// If we were not launched by URL, open the management interface
 	// in the browser.
 	if (launchedByURL) {
@@ -144,17 +136,6 @@
 
 }
 
-/**
- * The cron jobs timer
- /*/
-- (void)forwardCronEvent
-{
-	
-	// Trigger the scheduled jobs loop
-	core->processPeriodicJobs();
-	
-}
-
 /**
  * Polling timer
  */
@@ -323,16 +304,21 @@
 	[timer invalidate];
 	[reapTimer invalidate];
 
-	// Start core cleanups
-	core->shutdownCleanup();
-
 	// Abory any lingering sysExec commands
 	abortSysExec();
 
-	// Destruct webserver components
-	delete webserver;
+	// Start core cleanups, closing all the sessions in parallel
+	// (for up to CVMWA_SHUTDOWN_DEADLINE)
+	bool sessionsClosed = core->shutdownCleanup();
+
+	// Destruct webserver components. The connections abandoned after
+	// their teardown deadline can still use the webserver and the core.
+	bool connectionsReleased = webserver->shutdown();
+	if (connectionsReleased) delete webserver;
 	delete factory;
-	delete core;
+	// Sessions still closing after the deadline are abandoned
+	// to the process exit, instead of waiting for their workers
+	if (sessionsClosed && connectionsReleased) delete core;
 	delete rpcHandler;
 
 	// Cleanup subsystems
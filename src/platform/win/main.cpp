@@ -42,6 +42,47 @@ CVMWebserver *		webserver;
 // RPC Handler
 WebRPCHandler *     rpcHandler;
 
+// Idle tracking (updated by the idle check on the timers of the core)
+unsigned long       lastIdle;
+bool                launchedBySetup;
+bool                launchedByService;
+bool                idleStopped = false;
+boost::mutex        idleMutex;
+
+/**
+ * [Timer] Exit if idle for 10 seconds, and wake up the I/O loop when
+ * the daemon has exited, since it blocks until there is I/O.
+ */
+void idleCheck() {
+    boost::mutex::scoped_lock lock(idleMutex);
+    if (idleStopped) return;
+    unsigned long now = getMillis();
+
+    // Update idle timer when we have connections
+    if (webserver->hasLiveConnections()) {
+        lastIdle = now;
+
+        // The moment we got an active connection, we are allowed
+        // to dismiss the process. Therefore reset any possible
+        // launchedBySetup flag
+        launchedBySetup = false;
+
+    }
+
+    // Exit if we are idle for 10 seconds
+    // (.. but not if we were launched by setup)
+    else if ((now - lastIdle > 10000) && !launchedBySetup && !launchedByService) {
+        core->requestExit();
+    }
+
+    // Let the loop notice the exit, or check again in a second
+    if (core->hasExited()) {
+        webserver->wakeup();
+    } else {
+        core->timers.schedule( 1000, &idleCheck );
+    }
+}
+
 /**
  * Check if string is empty
  */
@@ -120,8 +161,8 @@ int WINAPI WinMain(HINSTANCE hInstance,
     core = new DaemonCore();
     // Create a factory which is going to create the instances
     factory = new DaemonFactory(*core);
-    // Create the webserver instance
-    webserver = new CVMWebserver(*factory);
+    // Create the webserver instance (with as many reactors as configured)
+    webserver = new CVMWebserver(*factory, CERNVM_WEBAPI_PORT, core->config->getNum<int>("webserver-reactors", 1));
     // Create the RPC handler
     rpcHandler = new WebRPCHandler();
     webserver->setStaticURLHandler(rpcHandler);
@@ -130,58 +171,53 @@ int WINAPI WinMain(HINSTANCE hInstance,
     bool launchURL = isEmpty(lpCmdLine);
 
     // Check if we were launched with a 'setup' argument
-    bool launchedBySetup = (lstrcmp(lpCmdLine, "setup") == 0);
-    bool launchedByService = (lstrcmp(lpCmdLine, "service") == 0);
+    launchedBySetup = (lstrcmp(lpCmdLine, "setup") == 0);
+    launchedByService = (lstrcmp(lpCmdLine, "service") == 0);
+
+    // The server is already listening, so the URL can be launched
+    if (launchURL) {
+        openAuthenticatedURL();
+    }
 
-    // Start server
-    long lastIdle = getMillis();
-    long lastCronTime = lastIdle;
+    // Start server, checking for idleness on the timers of the core
+    lastIdle = getMillis();
+    core->timers.schedule( 1000, &idleCheck );
     while (!core->hasExited()) {
-        long now = getMillis();
-        webserver->poll();
-
-        // Update idle timer when we have connections
-        if (webserver->hasLiveConnections()) {
-            lastIdle = now;
-
-            // The moment we got an active connection, we are allowed
-            // to dismiss the process. Therefore reset any possible
-            // launchedBySetup flag
-            launchedBySetup = false;
-
-        }
-
-        // Exit if we are idle for 10 seconds
-        else if (now - lastIdle > 10000) {
-            // .. but not if we were launched by setup
-            if (!launchedBySetup && !launchedByService) break;
-        }
-
-        // If we have to launch a URL, do it after the first poll
-        if (launchURL) {
-            openAuthenticatedURL();
-            launchURL = false;
-        }
-
-        // Check and forward cron jobs
-        if (now > lastCronTime) {
-            core->processPeriodicJobs();
-            lastCronTime = now + 1000;
-        }
+
+        // Block until there is I/O. Egress frames queued by the sessions
+        // wake up the server, and so does the idle check once the exit of
+        // the daemon is requested, whichever thread requested it. (The
+        // periodic jobs of the sessions and the idle check run on the timers)
+        webserver->poll( CVMWS_POLL_FOREVER );
 
     }
 
-    // Start core cleanups
-    core->shutdownCleanup();
+    // Stop the idle checks before the webserver goes away
+    {
+        boost::mutex::scoped_lock lock(idleMutex);
+        idleStopped = true;
+    }
 
     // Abory any lingering sysExec commands
     abortSysExec();
 
-    // Destruct webserver components
-    delete webserver;
+    // Start core cleanups, closing all the sessions in parallel
+    // (for up to CVMWA_SHUTDOWN_DEADLINE)
+    bool sessionsClosed = core->shutdownCleanup();
+
+    // Destruct webserver components. The connections abandoned after
+    // their teardown deadline can still use the webserver and the core.
+    bool connectionsReleased = webserver->shutdown();
+    if (connectionsReleased) delete webserver;
     delete rpcHandler;
     delete factory;
-    delete core;
+    // Sessions still closing after the deadline are abandoned
+    // to the process exit, instead of waiting for their workers
+    if (sessionsClosed && connectionsReleased) {
+        delete core;
+    } else {
+        CVMWA_LOG("Warning", "Sessions or connections still closing, leaving the core to the process exit");
+    }
 
     // Cleanup components
 #ifdef CRASH_REPORTING
@@ -0,0 +1,82 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "progress_throttle.h"
+
+/**
+ * Create a throttle that delivers the first update
+ */
+ProgressThrottle::ProgressThrottle( unsigned long interval )
+	: interval(interval), timestamp(0), message(), droppedCount(0) {
+}
+
+/**
+ * Change the interval
+ */
+void ProgressThrottle::setInterval( unsigned long interval ) {
+	this->interval = interval;
+}
+
+/**
+ * Check if the update should be dropped
+ */
+bool ProgressThrottle::drop( const std::string * message, unsigned long now ) {
+	if (interval == 0) return false;
+
+	// Check if this is an update of the last step we sent
+	if ((message != NULL) && sameStep( *message, this->message ) && (now - timestamp < interval)) {
+		droppedCount++;
+		return true;
+	}
+
+	// Deliver it
+	timestamp = now;
+	if (message != NULL) this->message = *message;
+	return false;
+}
+
+/**
+ * Skip a number (digits, with their separators)
+ */
+static size_t skipNumber( const std::string& str, size_t i ) {
+	while ((i < str.length()) && (((str[i] >= '0') && (str[i] <= '9')) ||
+		   (((str[i] == '.') || (str[i] == ',')) && (i + 1 < str.length()) && (str[i+1] >= '0') && (str[i+1] <= '9'))))
+		++i;
+	return i;
+}
+
+/**
+ * Compare the messages, with every number matching any other number
+ */
+bool ProgressThrottle::sameStep( const std::string& a, const std::string& b ) {
+	size_t i = 0, j = 0;
+	while ((i < a.length()) && (j < b.length())) {
+		const bool digitA = (a[i] >= '0') && (a[i] <= '9'), digitB = (b[j] >= '0') && (b[j] <= '9');
+		if (digitA && digitB) {
+			i = skipNumber( a, i );
+			j = skipNumber( b, j );
+		} else if (a[i] == b[j]) {
+			++i; ++j;
+		} else {
+			return false;
+		}
+	}
+	return (i == a.length()) && (j == b.length());
+}
@@ -0,0 +1,96 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef DAEMON_PROGRESS_THROTTLE_H
+#define DAEMON_PROGRESS_THROTTLE_H
+
+#include <string>
+
+/**
+ * Decides which progress updates of a request are delivered.
+ *
+ * Updates of the same step that arrive faster than the given interval are
+ * dropped, while the first update of a new step is always delivered. A step
+ * is identified by its message with the numbers masked out, since the
+ * messages of a step carry changing counters ("Downloading 12 of 80 MB").
+ * The throttle is not thread-safe; its owner must serialize the calls.
+ */
+class ProgressThrottle {
+public:
+
+	/**
+	 * Deliver at most one update of a step every ``interval`` milliseconds
+	 */
+	ProgressThrottle( unsigned long interval );
+
+	/**
+	 * Change the interval (0 delivers every update)
+	 */
+	void 					setInterval( unsigned long interval );
+
+	/**
+	 * The current interval
+	 */
+	unsigned long 			getInterval() const { return interval; };
+
+	/**
+	 * Check if an update of the given step (NULL if it has no message)
+	 * that arrived at ``now`` milliseconds should be dropped.
+	 */
+	bool 					drop( const std::string * message, unsigned long now );
+
+	/**
+	 * The number of updates dropped so far
+	 */
+	int 					dropped() const { return droppedCount; };
+
+	/**
+	 * Count an update that was dropped and sent later after all
+	 */
+	void 					undrop() { if (droppedCount > 0) droppedCount--; };
+
+	/**
+	 * Check if two messages are of the same step (equal, apart from
+	 * the numbers they contain)
+	 */
+	static bool 			sameStep( const std::string& a, const std::string& b );
+
+private:
+
+	/**
+	 * The minimum time between two updates of the same step
+	 */
+	unsigned long 			interval;
+
+	/**
+	 * When the last update was delivered, and it's message
+	 */
+	unsigned long 			timestamp;
+	std::string 			message;
+
+	/**
+	 * The number of updates dropped
+	 */
+	int 					droppedCount;
+
+};
+
+#endif /* end of include guard: DAEMON_PROGRESS_THROTTLE_H */
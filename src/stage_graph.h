@@ -0,0 +1,49 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+
+#pragma once
+#ifndef STAGE_GRAPH_H
+#define STAGE_GRAPH_H
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * Collect the stages of a graph that can start, given the stages that are
+ * already started and completed (as bit masks). Every ``Node`` has an ``id``
+ * bit and the ``depends`` mask of the stages it waits for.
+ *
+ * The stages returned are marked in ``started``, so each of them is handed
+ * out exactly once, no matter how many of its dependencies complete at the
+ * same time. The caller is responsible for the locking.
+ */
+template <typename Node>
+inline void stageGraphReady( const Node * graph, size_t count, int * started, int completed, std::vector< const Node* > * ready ) {
+	for (size_t i = 0; i < count; ++i) {
+		const Node * node = &graph[i];
+		if (*started & node->id) continue;
+		if ((node->depends & completed) != node->depends) continue;
+		*started |= node->id;
+		ready->push_back( node );
+	}
+}
+
+#endif /* end of include guard: STAGE_GRAPH_H */
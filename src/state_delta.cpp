@@ -0,0 +1,146 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "state_delta.h"
+#include "web/jsonstream.h"
+
+#include <boost/bind.hpp>
+#include <vector>
+
+/**
+ * Prepare the frames of a state update
+ */
+StateEncoder::StateEncoder( const std::string& sessionID, const Json::Value& state )
+	: sessionID(sessionID), state(state), snapshot(), sharedState(), delta(), deltaBase(), deltaVersion(0) {
+}
+
+/**
+ * Bring a subscriber to the new state
+ */
+CVMWebserverBufferPtr StateEncoder::update( StateCursor& cursor, bool acceptsDeltas, bool full, bool * isDelta ) {
+	if (isDelta != NULL) *isDelta = false;
+
+	// Nothing to send if the subscriber is up to date
+	const bool first = cursor.snapshot.isNull();
+	if (!full && !first && (cursor.snapshot == state))
+		return CVMWebserverBufferPtr();
+
+	// The full frame starts a new sequence of deltas
+	if (full || first || !acceptsDeltas) {
+		cursor.snapshot = state;
+		cursor.version = 0;
+		return snapshotFrame();
+	}
+
+	// Re-use the delta of a subscriber that was at the same point
+	const unsigned int version = cursor.version + 1;
+	if (!delta || (deltaVersion != version) || (deltaBase != cursor.snapshot)) {
+
+		// Delta: [changed config, changed properties, removed properties, version]
+		Json::Value config(Json::objectValue), properties(Json::objectValue), removed(Json::arrayValue);
+		diff( cursor.snapshot[0u], state[0u], &config, NULL );
+		diff( cursor.snapshot[1u], state[1u], &properties, &removed );
+		CVMWebserverMutableBufferPtr buf = CVMWebserverBufferPool::acquire();
+		JSONStream json( buf->data );
+		json.literal("{\"data\":[").value( config )
+			.literal(",").value( properties )
+			.literal(",").value( removed )
+			.literal(",").number( (int)version )
+			.literal("],\"id\":").string( sessionID )
+			.literal(",\"name\":\"stateDelta\",\"type\":\"event\"}\n");
+
+		delta = buf;
+		deltaBase = cursor.snapshot;
+		deltaVersion = version;
+
+	}
+
+	cursor.snapshot = state;
+	cursor.version = version;
+	if (isDelta != NULL) *isDelta = true;
+	return delta;
+}
+
+/**
+ * Serialize the full frame once
+ */
+CVMWebserverBufferPtr StateEncoder::snapshotFrame() {
+	if (!snapshot)
+		snapshot = buildSnapshot( sessionID, state, 0 );
+	return snapshot;
+}
+
+/**
+ * Return the function that builds the full frame of a subscriber
+ */
+WebsocketEgressRebase StateEncoder::rebase( const StateCursor& cursor ) {
+	if (!sharedState)
+		sharedState.reset( new Json::Value( state ) );
+	return boost::bind( &StateEncoder::buildRebase, sessionID, sharedState, cursor.version );
+}
+
+/**
+ * Serialize the full frame of a state
+ */
+CVMWebserverBufferPtr StateEncoder::buildSnapshot( const std::string& sessionID, const Json::Value& state, unsigned int version ) {
+	CVMWebserverMutableBufferPtr buf = CVMWebserverBufferPool::acquire();
+	JSONStream json( buf->data );
+	if (version == 0) {
+		json.literal("{\"data\":").value( state );
+	} else {
+		json.literal("{\"data\":[").value( state[0u] )
+			.literal(",").value( state[1u] )
+			.literal(",").number( (int)version )
+			.literal("]");
+	}
+	json.literal(",\"id\":").string( sessionID )
+		.literal(",\"name\":\"stateVariables\",\"type\":\"event\"}\n");
+	return buf;
+}
+
+/**
+ * Build the full frame of a shared copy of the state
+ */
+CVMWebserverBufferPtr StateEncoder::buildRebase( const std::string sessionID, boost::shared_ptr< const Json::Value > state, unsigned int version ) {
+	return buildSnapshot( sessionID, *state, version );
+}
+
+/**
+ * Compare two objects of the state
+ */
+size_t StateEncoder::diff( const Json::Value& previous, const Json::Value& current, Json::Value* changed, Json::Value* removed ) {
+	size_t changes = 0;
+	std::vector<std::string> keys = current.getMemberNames();
+	for (std::vector<std::string>::iterator it = keys.begin(); it != keys.end(); ++it) {
+		if (!previous.isMember(*it) || (previous[*it] != current[*it])) {
+			(*changed)[*it] = current[*it];
+			changes++;
+		}
+	}
+	if (removed == NULL) return changes;
+	keys = previous.getMemberNames();
+	for (std::vector<std::string>::iterator it = keys.begin(); it != keys.end(); ++it) {
+		if (!current.isMember(*it)) {
+			removed->append( *it );
+			changes++;
+		}
+	}
+	return changes;
+}
@@ -0,0 +1,140 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef DAEMON_STATE_DELTA_H
+#define DAEMON_STATE_DELTA_H
+
+#include "web/buffer.h"
+#include "web/egress.h"
+
+#include <boost/shared_ptr.hpp>
+#include <json/json.h>
+#include <string>
+
+/**
+ * The state variables of a session, as last sent to one subscriber.
+ *
+ * A browser that accepts deltas receives the full 'stateVariables' frame
+ * first, and then 'stateDelta' frames with the keys changed since the
+ * previous frame. The deltas are numbered from 1 after every full frame,
+ * so the browser can tell if it missed one and ask for a new snapshot.
+ *
+ * The frames of a subscriber are chained in its egress queue, so if the
+ * browser falls behind they are collapsed to a full frame of the latest
+ * state, carrying the version of the last delta. The cursor stays valid.
+ */
+struct StateCursor {
+
+	/**
+	 * The state the subscriber has (null if it has none yet)
+	 */
+	Json::Value 		snapshot;
+
+	/**
+	 * The number of deltas sent since the last full frame
+	 */
+	unsigned int 		version;
+
+	StateCursor() : snapshot(), version(0) { };
+
+};
+
+/**
+ * Serializes the state variable frames of one update of a session for
+ * all of its subscribers. The full frame is serialized at most once, and
+ * subscribers that are at the same point share the same delta frame.
+ */
+class StateEncoder {
+public:
+
+	/**
+	 * Prepare the frames of the session with the given ID, that bring
+	 * the subscribers to ``state`` ([config, properties]). Both are
+	 * referenced, so they must outlive the encoder.
+	 */
+	StateEncoder( const std::string& sessionID, const Json::Value& state );
+
+	/**
+	 * Return the frame the subscriber needs and advance its cursor, or
+	 * NULL if it already has this state. Subscribers that don't accept
+	 * deltas, or that have no state yet, receive the full frame. A full
+	 * frame is also sent if ``full`` is true, even if nothing changed.
+	 * ``delta`` (if given) is set if the returned frame is a delta.
+	 */
+	CVMWebserverBufferPtr 	update( StateCursor& cursor, bool acceptsDeltas, bool full, bool * delta = NULL );
+
+	/**
+	 * The full frame: {"name":"stateVariables","data":[config, properties]}
+	 */
+	CVMWebserverBufferPtr 	snapshotFrame();
+
+	/**
+	 * Return the function that builds the full frame of the state the
+	 * subscriber was brought to by update(), for it's egress queue.
+	 */
+	WebsocketEgressRebase 	rebase( const StateCursor& cursor );
+
+	/**
+	 * Serialize the full frame of a state. A non-zero version is appended
+	 * to the data: [config, properties, version]
+	 */
+	static CVMWebserverBufferPtr	buildSnapshot( const std::string& sessionID, const Json::Value& state, unsigned int version );
+
+	/**
+	 * Collect in ``changed`` the keys of ``current`` that differ from
+	 * ``previous`` and, if ``removed`` is given, the keys that no longer
+	 * exist in it. Returns the number of changes.
+	 */
+	static size_t 			diff( const Json::Value& previous, const Json::Value& current, Json::Value* changed, Json::Value* removed );
+
+private:
+
+	/**
+	 * The session ID and its new state
+	 */
+	const std::string& 		sessionID;
+	const Json::Value& 		state;
+
+	/**
+	 * Build the full frame of a shared copy of the state
+	 */
+	static CVMWebserverBufferPtr	buildRebase( const std::string sessionID, boost::shared_ptr< const Json::Value > state, unsigned int version );
+
+	/**
+	 * The full frame, once serialized
+	 */
+	CVMWebserverBufferPtr 	snapshot;
+
+	/**
+	 * A copy of the state for the rebase functions, once taken
+	 */
+	boost::shared_ptr< const Json::Value >	sharedState;
+
+	/**
+	 * The last delta frame, and the state and version it was built for
+	 */
+	CVMWebserverBufferPtr 	delta;
+	Json::Value 			deltaBase;
+	unsigned int 			deltaVersion;
+
+};
+
+#endif /* end of include guard: DAEMON_STATE_DELTA_H */
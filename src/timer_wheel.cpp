@@ -0,0 +1,237 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "timer_wheel.h"
+
+#include <boost/bind.hpp>
+
+#include <CernVM/Utilities.h>
+#include <CernVM/CrashReport.h>
+
+/**
+ * Create an idle wheel
+ */
+TimerWheel::TimerWheel() : timers(), current(0), startTime(0), lastID(0), pool(NULL), thread(NULL), mutex(), wakeup(), stopping(false) {
+}
+
+/**
+ * Stop the wheel
+ */
+TimerWheel::~TimerWheel() {
+	stop();
+}
+
+/**
+ * Start the time-keeping thread
+ */
+void TimerWheel::start( WorkerPool * pool ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(mutex);
+	if (thread != NULL) return;
+
+	this->pool = pool;
+	startTime = getMillis();
+	current = 0;
+	stopping = false;
+	thread = new boost::thread( boost::bind( &TimerWheel::run, this ) );
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Stop the time-keeping thread and drop the pending timers
+ */
+void TimerWheel::stop() {
+	CRASH_REPORT_BEGIN;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		if (thread == NULL) return;
+		stopping = true;
+	}
+	wakeup.notify_all();
+	thread->join();
+	delete thread;
+	thread = NULL;
+
+	// Drop whatever was still pending
+	boost::mutex::scoped_lock lock(mutex);
+	timers.clear();
+	for (int level = 0; level < TIMER_LEVELS; ++level)
+		for (int slot = 0; slot < TIMER_SLOTS; ++slot)
+			slots[level][slot].clear();
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Schedule a task
+ */
+TimerID TimerWheel::schedule( unsigned long delay, const WorkerTask& task, int lane, const void * group ) {
+	CRASH_REPORT_BEGIN;
+
+	boost::mutex::scoped_lock lock(mutex);
+	if ((thread == NULL) || stopping) {
+		CVMWA_LOG("Error", "Dropping task scheduled on a stopped timer wheel");
+		return 0;
+	}
+
+	// The time-keeping thread does not follow the time while the wheel
+	// is empty, so catch up before using the current tick.
+	unsigned long elapsed = getMillis() - startTime;
+	bool wasEmpty = timers.empty();
+	if (wasEmpty)
+		current = elapsed / TIMER_TICK_MS;
+
+	// Expire on the first tick after the delay, but never beyond the last level
+	unsigned long expires = (elapsed + delay + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+	if (expires <= current)
+		expires = current + 1;
+	if (expires - current >= (1UL << (TIMER_LEVELS * TIMER_SLOT_BITS)))
+		expires = current + (1UL << (TIMER_LEVELS * TIMER_SLOT_BITS)) - 1;
+
+	// Store and place the timer
+	TimerList pending( 1 );
+	Timer& timer = pending.front();
+	TimerID id = ++lastID;
+	timer.id = id;
+	timer.expires = expires;
+	timer.task = task;
+	timer.lane = lane;
+	timer.group = group;
+	timers[id] = pending.begin();
+	place( pending, pending.begin() );
+
+	// Wake up the thread if it was waiting for timers
+	lock.unlock();
+	if (wasEmpty) wakeup.notify_all();
+	return id;
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Cancel a pending timer
+ */
+bool TimerWheel::cancel( TimerID id ) {
+	CRASH_REPORT_BEGIN;
+	if (id == 0) return false;
+	boost::mutex::scoped_lock lock(mutex);
+
+	// Unlink the timer from its slot
+	boost::unordered_map< TimerID, TimerList::iterator >::iterator it = timers.find( id );
+	if (it == timers.end()) return false;
+	slots[it->second->level][it->second->slot].erase( it->second );
+	timers.erase( it );
+	return true;
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Return the number of pending timers
+ */
+size_t TimerWheel::size() {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(mutex);
+	return timers.size();
+	CRASH_REPORT_END;
+}
+
+/**
+ * Place a timer on the lowest level whose turn covers its expiry
+ */
+void TimerWheel::place( TimerList& from, TimerList::iterator timer ) {
+	unsigned long delta = (timer->expires > current) ? (timer->expires - current) : 0;
+	int level = 0;
+	while ((level < TIMER_LEVELS - 1) && (delta >= (1UL << ((level + 1) * TIMER_SLOT_BITS))))
+		++level;
+	timer->level = level;
+	timer->slot = (timer->expires >> (level * TIMER_SLOT_BITS)) & (TIMER_SLOTS - 1);
+	TimerList& to = slots[timer->level][timer->slot];
+	to.splice( to.end(), from, timer );
+}
+
+/**
+ * Re-place the timers of a slot, now that they are closer to expiry
+ */
+void TimerWheel::cascade( int level, int slot ) {
+	TimerList pending;
+	pending.swap( slots[level][slot] );
+	while (!pending.empty())
+		place( pending, pending.begin() );
+}
+
+/**
+ * Process the next tick
+ */
+void TimerWheel::advance( TimerList * expired ) {
+	unsigned long tick = ++current;
+
+	// Every time a level completes a turn, the next slot of the
+	// level above it is spread to the levels below.
+	int index = tick & (TIMER_SLOTS - 1);
+	for (int level = 1; (index == 0) && (level < TIMER_LEVELS); ++level) {
+		index = (tick >> (level * TIMER_SLOT_BITS)) & (TIMER_SLOTS - 1);
+		cascade( level, index );
+	}
+
+	// Collect the timers of the current slot
+	TimerList& slot = slots[0][ tick & (TIMER_SLOTS - 1) ];
+	for (TimerList::iterator it = slot.begin(); it != slot.end(); ++it)
+		timers.erase( it->id );
+	expired->splice( expired->end(), slot );
+}
+
+/**
+ * Keep the time and dispatch the expired timers
+ */
+void TimerWheel::run() {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(mutex);
+	while (!stopping) {
+
+		// Sleep until something is scheduled
+		if (timers.empty()) {
+			wakeup.wait( lock );
+			continue;
+		}
+
+		// Sleep until the next tick
+		unsigned long now = getMillis();
+		unsigned long target = (now - startTime) / TIMER_TICK_MS;
+		if (current >= target) {
+			wakeup.timed_wait( lock, boost::posix_time::milliseconds( startTime + (current + 1) * TIMER_TICK_MS - now ) );
+			continue;
+		}
+
+		// Catch up with the time and hand the expired timers to the pool
+		TimerList expired;
+		while (current < target)
+			advance( &expired );
+		if (!expired.empty()) {
+			lock.unlock();
+			for (TimerList::iterator it = expired.begin(); it != expired.end(); ++it)
+				pool->submit( it->task, it->lane, it->group );
+			lock.lock();
+		}
+
+	}
+	CRASH_REPORT_END;
+}
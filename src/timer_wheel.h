@@ -0,0 +1,168 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef DAEMON_TIMER_WHEEL_H
+#define DAEMON_TIMER_WHEEL_H
+
+#include "worker_pool.h"
+
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <list>
+
+// Geometry of the wheel: every level has 64 slots, and a slot of
+// a level spans a full turn of the level below it.
+#define TIMER_TICK_MS 				100
+#define TIMER_SLOT_BITS 			6
+#define TIMER_SLOTS 				(1 << TIMER_SLOT_BITS)
+#define TIMER_LEVELS 				4
+
+/**
+ * The handle of a scheduled timer (zero is never a valid timer)
+ */
+typedef unsigned long 	TimerID;
+
+/**
+ * A hierarchical timing wheel that runs the expired timers on the
+ * worker pool of the daemon.
+ *
+ * Scheduling and cancelling a timer takes constant time (on average, since
+ * the timers are found through a hash table), no matter how many timers are
+ * pending, and a single thread keeps the time for all of them. The timers
+ * are one-shot: periodic jobs schedule their next run when they complete,
+ * so they can adapt their cadence.
+ */
+class TimerWheel {
+public:
+
+	/**
+	 * Create an idle wheel
+	 */
+	TimerWheel();
+
+	/**
+	 * Stop the wheel
+	 */
+	~TimerWheel();
+
+	/**
+	 * Start keeping the time, running the expired timers on the given pool
+	 */
+	void 				start( WorkerPool * pool );
+
+	/**
+	 * Stop keeping the time and drop the pending timers
+	 */
+	void 				stop();
+
+	/**
+	 * Run the given task on the worker pool after the given delay.
+	 * The delay is rounded up to the next tick of the wheel.
+	 */
+	TimerID 			schedule( unsigned long delay, const WorkerTask& task, int lane = WORKER_LANE_INTERACTIVE, const void * group = NULL );
+
+	/**
+	 * Cancel a pending timer. Returns false if the timer has
+	 * already expired (or was never scheduled).
+	 */
+	bool 				cancel( TimerID id );
+
+	/**
+	 * Return the number of pending timers
+	 */
+	size_t 				size();
+
+private:
+
+	/**
+	 * A pending timer, and the slot that lists it
+	 */
+	struct Timer {
+		TimerID 		id;
+		unsigned long 	expires;
+		WorkerTask 		task;
+		int 			lane;
+		const void * 	group;
+		int 			level;
+		int 			slot;
+	};
+	typedef std::list< Timer > 		TimerList;
+
+	/**
+	 * Move a timer from the given list to the slot of the level that
+	 * covers its expiry tick
+	 */
+	void 				place( TimerList& from, TimerList::iterator timer );
+
+	/**
+	 * Move the timers of the given slot to the levels below
+	 */
+	void 				cascade( int level, int slot );
+
+	/**
+	 * Advance the wheel by one tick, collecting the expired timers
+	 */
+	void 				advance( TimerList * expired );
+
+	/**
+	 * The main loop of the time-keeping thread
+	 */
+	void 				run();
+
+	/**
+	 * The timers in every slot of every level. They are moved between
+	 * the slots by splicing, so their iterators stay valid.
+	 */
+	TimerList 						slots[TIMER_LEVELS][TIMER_SLOTS];
+
+	/**
+	 * The pending timers by id, for cancelling them
+	 */
+	boost::unordered_map< TimerID, TimerList::iterator > 	timers;
+
+	/**
+	 * The last tick that was processed, and the time it corresponds to
+	 */
+	unsigned long 					current;
+	unsigned long 					startTime;
+
+	/**
+	 * The id of the last scheduled timer
+	 */
+	TimerID 						lastID;
+
+	/**
+	 * The pool that runs the expired timers
+	 */
+	WorkerPool * 					pool;
+
+	/**
+	 * The time-keeping thread
+	 */
+	boost::thread * 				thread;
+	boost::mutex 					mutex;
+	boost::condition_variable 		wakeup;
+	bool 							stopping;
+
+};
+
+#endif /* end of include guard: DAEMON_TIMER_WHEEL_H */
@@ -29,7 +29,11 @@
 
 #include <CernVM/Hypervisor.h>
 #include <CernVM/ProgressFeedback.h>
+#include <CernVM/DownloadProvider.h>
+#include <CernVM/Utilities.h>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/condition_variable.hpp>
@@ -62,13 +66,12 @@ public:
 	 * Decrement usage
 	 */
 	void decrement() {
-	    {
-	        boost::unique_lock<boost::mutex> lock(accessMutex);
-	        usageCounter--;
-	    }
-	    // Notify condition when we reached zero
-	    if (usageCounter == 0)
-		    drainCondition.notify_all();
+		// Notify while still holding the lock: the waiter might destroy
+		// the semaphore as soon as it wakes, so nothing is touched after
+		// the mutex is released.
+		boost::unique_lock<boost::mutex> lock(accessMutex);
+		if (--usageCounter == 0)
+			drainCondition.notify_all();
 	}
 
 	/**
@@ -81,12 +84,28 @@ public:
 		}
 	}
 
+	/**
+	 * Wait until usages reaches 0, for up to the given number of
+	 * milliseconds. Returns false if the timeout expired first.
+	 */
+	bool wait( unsigned long timeout ) {
+		boost::unique_lock<boost::mutex> lock(accessMutex);
+		boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeout);
+		while(usageCounter > 0) {
+			if (!drainCondition.timed_wait(lock, deadline))
+				return (usageCounter == 0);
+		}
+		return true;
+	}
+
 private:
 	boost::mutex 					accessMutex;
 	boost::condition_variable 		drainCondition;
 	int 							usageCounter;
 };
 
+typedef boost::shared_ptr< DrainSemaphore >	DrainSemaphorePtr;
+
 /**
  * This class waits in scope until the DrainSemaphore reaches zero.
  */
@@ -112,4 +131,80 @@ private:
 	DrainSemaphore *	sem;
 };
 
+/**
+ * Cancellation token of a request, shared between the connection that
+ * received it and the thread that serves it.
+ *
+ * Long-running operations check the token at their stage boundaries. A
+ * download in progress on an attached download provider is aborted as
+ * soon as the token is cancelled.
+ */
+class CancelToken {
+public:
+	CancelToken( unsigned long deadline = 0 ) : accessMutex(), cancelled(false), deadline(deadline), downloadProvider(), release() { };
+
+	/**
+	 * Run the release hook (if any) when the request is over
+	 */
+	~CancelToken() {
+		if (release) release();
+	}
+
+	/**
+	 * Cancel the request and abort the attached download
+	 */
+	void cancel() {
+		boost::unique_lock<boost::mutex> lock(accessMutex);
+		cancelled = true;
+		if (downloadProvider) downloadProvider->abort();
+	}
+
+	/**
+	 * Check if the request was cancelled or its deadline has passed
+	 */
+	bool isCancelled() {
+		{
+			boost::unique_lock<boost::mutex> lock(accessMutex);
+			if (cancelled) return true;
+			if ((deadline == 0) || (getMillis() < deadline)) return false;
+		}
+		expire();
+		return true;
+	}
+
+	/**
+	 * Cancel the request because its deadline has passed
+	 */
+	void expire() {
+		CVMWA_LOG("Debug", "Request deadline expired");
+		cancel();
+	}
+
+	/**
+	 * Run the given function when the token is released, like
+	 * cancelling the timer of its deadline
+	 */
+	void onRelease( const boost::function< void() >& hook ) {
+		release = hook;
+	}
+
+	/**
+	 * Abort the given download provider when the request is cancelled
+	 */
+	void attach( DownloadProviderPtr provider ) {
+		boost::unique_lock<boost::mutex> lock(accessMutex);
+		downloadProvider = provider;
+		if (cancelled) downloadProvider->abort();
+	}
+
+private:
+	boost::mutex 					accessMutex;
+	bool 							cancelled;
+	unsigned long 					deadline;
+	DownloadProviderPtr 			downloadProvider;
+	boost::function< void() > 		release;
+};
+
+typedef boost::shared_ptr< CancelToken >	CancelTokenPtr;
+
 #endif /* end of include guard: WEBAPI_UTILITIES_H */
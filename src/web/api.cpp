@@ -19,6 +19,8 @@
  */
 
 #include "api.h"
+#include "jsonparse.h"
+#include "textscan.h"
 #include <sstream>
  
 #include <CernVM/Utilities.h>
@@ -30,80 +32,91 @@
 void WebsocketAPI::handleRawData( const char * buf, const size_t len ) {
 	CRASH_REPORT_BEGIN;
 
-	// Parse the incoming buffer as JSON
-	Json::Value root;
-	Json::Reader reader;
-	bool parsingSuccessful = reader.parse( buf, buf+len, root );
-	if ( !parsingSuccessful ) {
-	    // report to the user the failure and their locations in the document.
+	// Text frames must be valid UTF-8
+	if ( !textIsValidUTF8( buf, len ) ) {
+		sendError("The incoming request is not valid UTF-8.");
+		return;
+	}
+
+	// Parse the incoming buffer in a single pass, placing
+	// the action data directly in the parameter map
+	ParameterMapPtr map = ParameterMap::instance();
+	JSONActionParser parser( buf, len );
+	if ( !parser.parse( map ) ) {
 		sendError("Unable to parse to JSON the incoming request.");
 	    return;
 	}
 
 	// Ensure we have an action defined
-	if (!root.isMember("type")) {
+	if (!parser.hasType) {
 		sendError("Missing 'type' parameter in the incoming request.");
 		return;
 	}
-	if (!root.isMember("name")) {
+	if (!parser.hasName) {
 		sendError("Missing 'name' parameter in the incoming request.");
 		return;
 	}
-	if (!root.isMember("id")) {
+	if (!parser.hasId) {
 		sendError("Missing 'id' parameter in the incoming request.");
 		return;
 	}
 
-	// Fetch type, action and ID
-	std::string type = root["type"].asString();
-	std::string a = root["name"].asString();
-	std::string id = root["id"].asString();
-
 	// Ensure type = action
-	if (type != "action") {
+	if (!parser.type.equals("action")) {
 		sendError("Unknown request type.");
 		return;
 	}
 
-	// Translate json value to ParameterMapPtr
-	ParameterMapPtr map = ParameterMap::instance();
-	if (root.isMember("data"))
-		map->fromJSON(root["data"]);
-
 	// Handle action
-	handleAction( id, a, map );
+	handleAction( parser.id.str(), parser.name.str(), map );
 
 	CRASH_REPORT_END;
 }
 
 /**
- * Return the next available egress packet
+ * Pop the next available egress message
  */
-std::string WebsocketAPI::getEgressRawData() {
-	CRASH_REPORT_BEGIN;
+bool WebsocketAPI::getEgressMessage( CVMWebserverMessage * msg ) {
+	return egress.pop( msg );
+}
 
-	// Return empty string if the queue is empty
-	if (egress.empty())
-		return "";
+/**
+ * Return the statistics of the egress queue
+ */
+CVMWebserverEgressStats WebsocketAPI::getEgressStats() {
+	return egress.stats();
+}
 
-	// Pop first element
-	std::string ans = egress.front();
-	egress.pop();
-	return ans;
+/**
+ * Enable or disable the batching of the egress frames
+ */
+void WebsocketAPI::setEgressBatching( bool enabled ) {
+	egress.setBatching( enabled );
+}
 
+/**
+ * Send a raw response to the server
+ */
+void WebsocketAPI::sendRawData( const std::string& data, const std::string& key ) {
+	CRASH_REPORT_BEGIN;
+	sendRawData( CVMWebserverBufferPool::wrap(data), key );
 	CRASH_REPORT_END;
 }
 
 /**
- * Send a raw response to the server
+ * Send a raw response, already placed in a buffer, to the server
  */
-void WebsocketAPI::sendRawData( const std::string& data ) {
+void WebsocketAPI::sendRawData( const CVMWebserverBufferPtr& data, const std::string& key, const WebsocketEgressRebase& rebase ) {
 	CRASH_REPORT_BEGIN;
 
-	CVMWA_LOG("Debug", "Pushing egress data: '" << data << "'")
+	CVMWA_LOG("Debug", "Pushing egress data: '" << data->data << "'")
 
 	// Add data to the egress queue
-	egress.push(data);
+	egress.push( data, key, rebase );
+
+	// Let the webserver know that it should flush the queue
+	if (egressNotify)
+		egressNotify();
 
 	CRASH_REPORT_END;
 }
@@ -115,12 +128,13 @@ void WebsocketAPI::sendError( const std::string& error, const std::string& id )
 	CRASH_REPORT_BEGIN;
 
 	// Build and send an error response
-	std::ostringstream oss;
-	oss << "{\"type\":\"error\",";
+	CVMWebserverMutableBufferPtr buf = CVMWebserverBufferPool::acquire();
+	JSONStream json( buf->data );
+	json.literal("{\"type\":\"error\",");
 	if (!id.empty())
-		oss << "\"id\":\"" << id << "\",";
-	oss << "\"error\":\"" << error << "\"}";
-	sendRawData( oss.str() );
+		json.literal("\"id\":").string(id).literal(",");
+	json.literal("\"error\":").string(error).literal("}");
+	sendRawData( buf );
 
 	CRASH_REPORT_END;
 }
@@ -130,51 +144,65 @@ void WebsocketAPI::sendError( const std::string& error, const std::string& id )
  */
 void WebsocketAPI::reply( const std::string& id, const Json::Value& data ) {
 	CRASH_REPORT_BEGIN;
-	// Build and send an action response
-	Json::FastWriter writer;
-	Json::Value root;
 
-	// Populate core fields
-	root["type"] = "result";
-	root["id"] = id;
+	// Build and send an action response
+	CVMWebserverMutableBufferPtr buf = CVMWebserverBufferPool::acquire();
+	JSONStream json( buf->data );
+	json.literal("{\"data\":").value(data)
+		.literal(",\"id\":").string(id)
+		.literal(",\"type\":\"result\"}\n");
+	sendRawData( buf );
 
-	// Populate data
-	root["data"] = data;
+	CRASH_REPORT_END;
+}
 
-	// Compile JSON response
-	sendRawData( writer.write(root) );
+/**
+ * Send a json-formatted event
+ */
+void WebsocketAPI::sendEvent( const std::string& event, const VariantArgList& argVariants, const std::string& id, const std::string& key ) {
+	CRASH_REPORT_BEGIN;
+	sendRawData( buildEvent( event, argVariants, id ), key );
 	CRASH_REPORT_END;
 }
 
 /**
- * Send a json-formatted action response
+ * Build a json-formatted event
  */
-void WebsocketAPI::sendEvent( const std::string& event, const VariantArgList& argVariants, const std::string& id ) {
+CVMWebserverBufferPtr WebsocketAPI::buildEvent( const std::string& event, const VariantArgList& argVariants, const std::string& id ) {
 	CRASH_REPORT_BEGIN;
-	// Build and send an action response
-	Json::FastWriter writer;
-	Json::Value root, data;
-
-	// Populate core fields
-	root["type"] = "event";
-	root["name"] = event;
-	root["id"] = id;
-
-	// Populate json fields
-	for (std::vector< VariantArg >::const_iterator it = argVariants.begin(); it != argVariants.end(); ++it) {
-		if ( const int* pi = boost::get<int>( &(*it) ) )
-			data.append( *pi );
-		else if ( const double* pi = boost::get<double>( &(*it) ) )
-			data.append( *pi );
-		else if ( const float* pi = boost::get<float>( &(*it) ) )
-			data.append( *pi );
-		else if ( const std::string* pi = boost::get<std::string>( &(*it) ) )
-			data.append( *pi );
+
+	// Build an event
+	CVMWebserverMutableBufferPtr buf = CVMWebserverBufferPool::acquire();
+	JSONStream json( buf->data );
+	if (argVariants.empty()) {
+
+		// Json::FastWriter writes an empty data array as null
+		json.literal("{\"data\":null");
+		json.literal(",\"id\":").string(id)
+			.literal(",\"name\":").string(event)
+			.literal(",\"type\":\"event\"}\n");
+
+	} else {
+
+		// Populate json fields
+		json.literal("{\"data\":[");
+		for (std::vector< VariantArg >::const_iterator it = argVariants.begin(); it != argVariants.end(); ++it) {
+			if (it != argVariants.begin()) json.literal(",");
+			json.arg( *it );
+		}
+		closeEvent( json, event, id );
+
 	}
-	root["data"] = data;
+	return buf;
 
-	// Compile JSON response
-    std::string jsonResponse = writer.write(root);
-	sendRawData( jsonResponse );
 	CRASH_REPORT_END;
 }
+
+/**
+ * Terminate the data array and write the rest of the event fields
+ */
+void WebsocketAPI::closeEvent( JSONStream& json, const std::string& event, const std::string& id ) {
+	json.literal("],\"id\":").string(id)
+		.literal(",\"name\":").string(event)
+		.literal(",\"type\":\"event\"}\n");
+}
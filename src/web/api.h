@@ -26,12 +26,11 @@
 #include <CernVM/ArgumentList.h>
 
 #include "webserver.h"
-#include "api.h"
+#include "jsonstream.h"
 
 #include <json/json.h>
 
 #include <map>
-#include <queue>
 #include <string>
 
 class WebsocketAPI : public CVMWebserverConnectionHandler  {
@@ -40,7 +39,7 @@ public:
 	/**
 	 * Constructor for WebsocketAPI
 	 */
-	WebsocketAPI( const std::string& domain, const std::string& uri ) : domain(domain), uri(uri), egress(), connected(true), CVMWebserverConnectionHandler() { };
+	WebsocketAPI( const std::string& domain, const std::string& uri ) : domain(domain), uri(uri), egress(domain), connected(true), CVMWebserverConnectionHandler() { };
 
 	/**
 	 * Virtual destructor
@@ -50,7 +49,7 @@ public:
 	/**
 	 * Virtual cleanup function
 	 */
-	virtual void 			cleanup() { };
+	virtual bool 			cleanup() { return true; };
 
 	/**
 	 * This function is called when there is an incoming data frame 
@@ -65,10 +64,23 @@ public:
 	virtual bool 			isConnected() { return connected; };
 
 	/**
-	 * Pops and returns the next frame from the egress queue, or returns
-	 * an empty string if there are no data in the egress queue.
+	 * Pops the next frame from the egress queue into ``msg``, or returns
+	 * false if there are no data in the egress queue.
+	 *
+	 * If egress batching is enabled, all the pending frames are popped
+	 * and placed in ``msg`` as the elements of a single JSON array.
 	 */
-	virtual std::string 	getEgressRawData();
+	virtual bool 			getEgressMessage( CVMWebserverMessage * msg );
+
+	/**
+	 * Return the statistics of the egress queue
+	 */
+	virtual CVMWebserverEgressStats getEgressStats();
+
+	/**
+	 * Enable or disable the batching of the egress frames
+	 */
+	void 					setEgressBatching( bool enabled );
 
 	/**
 	 * Reply to an action
@@ -76,9 +88,62 @@ public:
 	void 					reply( const std::string& id, const Json::Value& data );
 
 	/**
-	 * Send a named event with array data
-	 */
-	void 					sendEvent( const std::string& event, const VariantArgList& params, const std::string& id = "" );
+	 * Send a named event with array data, optionally with a supersedable key
+	 */
+	void 					sendEvent( const std::string& event, const VariantArgList& params, const std::string& id = "", const std::string& key = "" );
+
+	/**
+	 * Send a named event with a fixed number of arguments. The arguments
+	 * are serialized by the JSONStream overload of their type, without
+	 * going through VariantArgList or a Json::Value tree.
+	 */
+	template <typename A>
+	void 					sendTypedEvent( const std::string& event, const std::string& id, const A& a ) {
+		sendRawData( buildTypedEvent( event, id, a ) );
+	}
+	template <typename A, typename B>
+	void 					sendTypedEvent( const std::string& event, const std::string& id, const A& a, const B& b ) {
+		sendRawData( buildTypedEvent( event, id, a, b ) );
+	}
+	template <typename A, typename B, typename C>
+	void 					sendTypedEvent( const std::string& event, const std::string& id, const A& a, const B& b, const C& c ) {
+		sendRawData( buildTypedEvent( event, id, a, b, c ) );
+	}
+
+	/**
+	 * Serialize an event without sending it, so the same buffer can be
+	 * sent to many connections.
+	 */
+	static CVMWebserverBufferPtr buildEvent( const std::string& event, const VariantArgList& params, const std::string& id = "" );
+	template <typename A>
+	static CVMWebserverBufferPtr buildTypedEvent( const std::string& event, const std::string& id, const A& a ) {
+		CVMWebserverMutableBufferPtr buf = CVMWebserverBufferPool::acquire();
+		JSONStream json( buf->data );
+		json.literal("{\"data\":[").arg(a);
+		closeEvent( json, event, id );
+		return buf;
+	}
+	template <typename A, typename B>
+	static CVMWebserverBufferPtr buildTypedEvent( const std::string& event, const std::string& id, const A& a, const B& b ) {
+		CVMWebserverMutableBufferPtr buf = CVMWebserverBufferPool::acquire();
+		JSONStream json( buf->data );
+		json.literal("{\"data\":[").arg(a).literal(",").arg(b);
+		closeEvent( json, event, id );
+		return buf;
+	}
+	template <typename A, typename B, typename C>
+	static CVMWebserverBufferPtr buildTypedEvent( const std::string& event, const std::string& id, const A& a, const B& b, const C& c ) {
+		CVMWebserverMutableBufferPtr buf = CVMWebserverBufferPool::acquire();
+		JSONStream json( buf->data );
+		json.literal("{\"data\":[").arg(a).literal(",").arg(b).literal(",").arg(c);
+		closeEvent( json, event, id );
+		return buf;
+	}
+
+	/**
+	 * Return the domain of the page that opened the connection
+	 */
+	const std::string& 		getDomain() const { return domain; };
 
 	/**
 	 * Send error response
@@ -86,9 +151,17 @@ public:
 	void 					sendError( const std::string& message, const std::string& id = "" );
 
 	/**
-	 * Send a RAW message
+	 * Send a RAW message. If a supersedable key is specified, any queued
+	 * frame with the same key is replaced by this one.
 	 */
-	void 					sendRawData( const std::string& data );
+	void 					sendRawData( const std::string& data, const std::string& key = "" );
+
+	/**
+	 * Send a RAW message that is already placed in a buffer. If a rebase
+	 * function is specified, the message is chained to the queued ones
+	 * with the same key (see WebsocketEgressFrame).
+	 */
+	void 					sendRawData( const CVMWebserverBufferPtr& data, const std::string& key = "", const WebsocketEgressRebase& rebase = WebsocketEgressRebase() );
 
 	/**
 	 * Request to disconnect from the socket.
@@ -110,7 +183,7 @@ protected:
 	/**
 	 * The egress queue
 	 */
-	std::queue< std::string >	egress;
+	WebsocketEgressQueue 	egress;
 
 	/**
 	 * A status flag to let the server know when to drop the connection
@@ -119,6 +192,12 @@ protected:
 
 protected:
 
+	/**
+	 * Terminate the data array and write the rest of the event fields,
+	 * in the same order Json::FastWriter would write them.
+	 */
+	static void 			closeEvent( JSONStream& json, const std::string& event, const std::string& id );
+
 	/**
 	 * Handle incoming actions
 	 */
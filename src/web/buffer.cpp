@@ -0,0 +1,103 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "buffer.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include <CernVM/CrashReport.h>
+
+/**
+ * The state of the pool. It's allocated on the heap and never released,
+ * since buffers can be returned while static objects are destructed.
+ */
+struct CVMWebserverBufferPoolState {
+	boost::mutex                        mutex;
+	std::vector< CVMWebserverBuffer* >  free;
+	size_t                              allocations;
+	CVMWebserverBufferPoolState() : mutex(), free(), allocations(0) { };
+};
+static CVMWebserverBufferPoolState * poolState() {
+	static CVMWebserverBufferPoolState * state = new CVMWebserverBufferPoolState();
+	return state;
+}
+
+/**
+ * Get an empty buffer from the pool
+ */
+CVMWebserverMutableBufferPtr CVMWebserverBufferPool::acquire() {
+	CRASH_REPORT_BEGIN;
+	CVMWebserverBufferPoolState * state = poolState();
+	{
+		boost::mutex::scoped_lock lock(state->mutex);
+		if (!state->free.empty()) {
+			CVMWebserverBuffer * buf = state->free.back();
+			state->free.pop_back();
+			return CVMWebserverMutableBufferPtr( buf );
+		}
+		state->allocations++;
+	}
+	return CVMWebserverMutableBufferPtr( new CVMWebserverBuffer() );
+	CRASH_REPORT_END;
+}
+
+/**
+ * Get a buffer from the pool, filled with a copy of the given data
+ */
+CVMWebserverBufferPtr CVMWebserverBufferPool::wrap( const std::string& data ) {
+	CRASH_REPORT_BEGIN;
+	CVMWebserverMutableBufferPtr buf = acquire();
+	buf->data.assign( data );
+	return buf;
+	CRASH_REPORT_END;
+}
+
+/**
+ * Return the number of buffers allocated from the heap
+ */
+size_t CVMWebserverBufferPool::allocations() {
+	CRASH_REPORT_BEGIN;
+	CVMWebserverBufferPoolState * state = poolState();
+	boost::mutex::scoped_lock lock(state->mutex);
+	return state->allocations;
+	CRASH_REPORT_END;
+}
+
+/**
+ * Return a buffer to the pool
+ */
+void CVMWebserverBufferPool::release( CVMWebserverBuffer * buf ) {
+	CRASH_REPORT_BEGIN;
+	CVMWebserverBufferPoolState * state = poolState();
+
+	// Recycle buffers of reasonable size, keeping their capacity
+	if (buf->data.capacity() <= CVMWS_BUFFER_MAX_CAPACITY) {
+		buf->data.clear();
+		boost::mutex::scoped_lock lock(state->mutex);
+		if (state->free.size() < CVMWS_BUFFER_POOL_SIZE) {
+			state->free.push_back( buf );
+			return;
+		}
+	}
+
+	// Otherwise release it
+	delete buf;
+	CRASH_REPORT_END;
+}
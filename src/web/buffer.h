@@ -0,0 +1,125 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef WEBSERVER_BUFFER_H
+#define WEBSERVER_BUFFER_H
+
+#include <boost/intrusive_ptr.hpp>
+#include <boost/detail/atomic_count.hpp>
+
+#include <string>
+#include <vector>
+
+// How many free buffers the pool keeps around
+#define CVMWS_BUFFER_POOL_SIZE			256
+
+// Buffers that grew larger than this are not recycled
+#define CVMWS_BUFFER_MAX_CAPACITY		(64 * 1024)
+
+/**
+ * A refcounted buffer of the egress path.
+ *
+ * The buffer is filled once by the producer and it's immutable from the
+ * moment it's placed in the egress queue. References are shared between
+ * the queue and the I/O thread, and when the last one is released the
+ * buffer goes back to the pool, keeping it's capacity.
+ */
+class CVMWebserverBuffer {
+public:
+
+	/**
+	 * The payload of the buffer
+	 */
+	std::string 					data;
+
+private:
+	friend class CVMWebserverBufferPool;
+	friend void intrusive_ptr_add_ref( const CVMWebserverBuffer * buf );
+	friend void intrusive_ptr_release( const CVMWebserverBuffer * buf );
+
+	/**
+	 * Buffers are only created by the pool
+	 */
+	CVMWebserverBuffer() : data(), refs(0) { };
+
+	/**
+	 * The reference counter
+	 */
+	mutable boost::detail::atomic_count	refs;
+
+};
+
+/**
+ * Writable and shared (immutable) references to a buffer
+ */
+typedef boost::intrusive_ptr< CVMWebserverBuffer >			CVMWebserverMutableBufferPtr;
+typedef boost::intrusive_ptr< const CVMWebserverBuffer >	CVMWebserverBufferPtr;
+
+/**
+ * A message is one or more buffers that are written back to back
+ * in the same websocket frame (scatter/gather).
+ */
+typedef std::vector< CVMWebserverBufferPtr >				CVMWebserverMessage;
+
+/**
+ * The process-wide pool of egress buffers
+ */
+class CVMWebserverBufferPool {
+public:
+
+	/**
+	 * Get an empty buffer from the pool
+	 */
+	static CVMWebserverMutableBufferPtr 	acquire();
+
+	/**
+	 * Get a buffer from the pool, filled with a copy of the given data
+	 */
+	static CVMWebserverBufferPtr 			wrap( const std::string& data );
+
+	/**
+	 * Return the number of buffers allocated from the heap, since buffers
+	 * that were recycled by the pool do not count.
+	 */
+	static size_t 							allocations();
+
+private:
+	friend void intrusive_ptr_release( const CVMWebserverBuffer * buf );
+
+	/**
+	 * Return a buffer to the pool
+	 */
+	static void 							release( CVMWebserverBuffer * buf );
+
+};
+
+/**
+ * Reference counting functions for boost::intrusive_ptr
+ */
+inline void intrusive_ptr_add_ref( const CVMWebserverBuffer * buf ) {
+	++buf->refs;
+}
+inline void intrusive_ptr_release( const CVMWebserverBuffer * buf ) {
+	if (--buf->refs == 0)
+		CVMWebserverBufferPool::release( const_cast<CVMWebserverBuffer*>(buf) );
+}
+
+#endif /* end of include guard: WEBSERVER_BUFFER_H */
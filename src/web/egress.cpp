@@ -0,0 +1,193 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "egress.h"
+
+#include <algorithm>
+
+#include <CernVM/Utilities.h>
+#include <CernVM/CrashReport.h>
+
+/**
+ * Create an empty queue
+ */
+WebsocketEgressQueue::WebsocketEgressQueue( const std::string& name )
+	: name(name), frames(), mutex(), batching(false), egressStats() {
+}
+
+/**
+ * Queue a frame
+ */
+void WebsocketEgressQueue::push( const CVMWebserverBufferPtr& data, const std::string& key, const WebsocketEgressRebase& rebase ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(mutex);
+
+	// Replace the queued frame with the same key in place, so
+	// it keeps it's order against the frames around it
+	std::deque< WebsocketEgressFrame >::iterator it = frames.end();
+	if (!key.empty() && !rebase) {
+		for (it = frames.begin(); it != frames.end(); ++it) {
+			if (it->key == key) break;
+		}
+	}
+	if (it != frames.end()) {
+		egressStats.bytes -= it->data->data.length();
+		it->data = data;
+		egressStats.superseded++;
+	} else {
+		WebsocketEgressFrame frame;
+		frame.data = data;
+		frame.key = key;
+		frame.rebase = rebase;
+		frames.push_back( frame );
+	}
+	egressStats.bytes += data->data.length();
+
+	// While we are above the high-water mark, collapse the oldest chains
+	// and drop the oldest progress frames. The other frames are never
+	// dropped: supersession already keeps only the latest of every key.
+	size_t i = 0;
+	while (((frames.size() > CVMWS_EGRESS_MAX_FRAMES) || (egressStats.bytes > CVMWS_EGRESS_MAX_BYTES)) && (i < frames.size())) {
+		if (frames[i].rebase) {
+			collapse( i );
+			++i;
+		} else if (frames[i].key.compare( 0, sizeof(CVMWS_EGRESS_DROPPABLE) - 1, CVMWS_EGRESS_DROPPABLE ) == 0) {
+			egressStats.bytes -= frames[i].data->data.length();
+			frames.erase( frames.begin() + i );
+			egressStats.dropped++;
+		} else {
+			++i;
+		}
+	}
+
+	// Update statistics
+	egressStats.frames = frames.size();
+	egressStats.peakFrames = std::max( egressStats.peakFrames, egressStats.frames );
+	egressStats.peakBytes = std::max( egressStats.peakBytes, egressStats.bytes );
+	if (!egressStats.congested && ((egressStats.frames >= CVMWS_EGRESS_MAX_FRAMES) || (egressStats.bytes >= CVMWS_EGRESS_MAX_BYTES))) {
+		CVMWA_LOG("Warning", "Egress queue of '" << name << "' reached the high-water mark (" 
+			<< egressStats.frames << " frames, " << egressStats.bytes << " bytes). The browser is not consuming fast enough.");
+		egressStats.congested = 1;
+	}
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Collapse a chain of frames
+ */
+void WebsocketEgressQueue::collapse( size_t first ) {
+	const std::string key = frames[first].key;
+
+	// Find the last element of the chain
+	size_t last = first;
+	for (size_t i = first + 1; i < frames.size(); ++i) {
+		if (frames[i].key == key) last = i;
+	}
+	if (last == first) return;
+	WebsocketEgressRebase rebase = frames[last].rebase;
+
+	// Remove the rest of the chain, keeping the order of the other frames
+	size_t out = first + 1;
+	for (size_t i = first + 1; i < frames.size(); ++i) {
+		if (frames[i].key == key) {
+			egressStats.bytes -= frames[i].data->data.length();
+			egressStats.dropped++;
+		} else {
+			if (out != i) std::swap( frames[out], frames[i] );
+			++out;
+		}
+	}
+	frames.resize( out );
+
+	// The first frame of the chain now brings the browser to the end of it
+	egressStats.bytes -= frames[first].data->data.length();
+	frames[first].data = rebase();
+	frames[first].rebase = rebase;
+	egressStats.bytes += frames[first].data->data.length();
+}
+
+/**
+ * Pop the next available message
+ */
+bool WebsocketEgressQueue::pop( CVMWebserverMessage * msg ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(mutex);
+
+	// Return false if the queue is empty
+	if (frames.empty())
+		return false;
+
+	// Coalesce all the pending frames in a single array frame
+	if (batching && (frames.size() > 1)) {
+		static const CVMWebserverBufferPtr
+			openBracket = CVMWebserverBufferPool::wrap("["),
+			comma = CVMWebserverBufferPool::wrap(","),
+			closeBracket = CVMWebserverBufferPool::wrap("]");
+
+		msg->push_back( openBracket );
+		while (!frames.empty()) {
+			msg->push_back( frames.front().data );
+			frames.pop_front();
+			if (!frames.empty()) msg->push_back( comma );
+		}
+		msg->push_back( closeBracket );
+		egressStats.bytes = 0;
+
+	} else {
+
+		// Pop first element
+		msg->push_back( frames.front().data );
+		egressStats.bytes -= frames.front().data->data.length();
+		frames.pop_front();
+
+	}
+
+	// Update statistics
+	egressStats.frames = frames.size();
+	if (egressStats.congested && (egressStats.frames < CVMWS_EGRESS_MAX_FRAMES / 2) && (egressStats.bytes < CVMWS_EGRESS_MAX_BYTES / 2)) {
+		CVMWA_LOG("Info", "Egress queue of '" << name << "' drained");
+		egressStats.congested = 0;
+	}
+
+	return true;
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Enable or disable the batching of the frames
+ */
+void WebsocketEgressQueue::setBatching( bool enabled ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(mutex);
+	batching = enabled;
+	CRASH_REPORT_END;
+}
+
+/**
+ * Return the statistics of the queue
+ */
+CVMWebserverEgressStats WebsocketEgressQueue::stats() {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(mutex);
+	return egressStats;
+	CRASH_REPORT_END;
+}
@@ -0,0 +1,151 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef WEBSERVER_EGRESS_H
+#define WEBSERVER_EGRESS_H
+
+#include "buffer.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
+
+#include <deque>
+#include <string>
+
+// High-water marks of the egress queue of every connection
+#define CVMWS_EGRESS_MAX_FRAMES		1024
+#define CVMWS_EGRESS_MAX_BYTES		(4 * 1024 * 1024)
+
+// The prefix of the keys whose frames can be dropped at the high-water mark
+#define CVMWS_EGRESS_DROPPABLE		"progress:"
+
+/**
+ * Egress queue statistics of a connection (or the sum of many)
+ */
+struct CVMWebserverEgressStats {
+	size_t 	frames; 		// Frames currently queued
+	size_t 	bytes; 			// Bytes currently queued
+	size_t 	peakFrames; 	// The highest number of frames ever queued
+	size_t 	peakBytes; 		// The highest number of bytes ever queued
+	size_t 	superseded; 	// Frames replaced by a newer frame with the same key
+	size_t 	dropped; 		// Frames dropped because of the high-water mark
+	size_t 	congested; 		// Number of connections above the high-water mark
+};
+
+/**
+ * Builds the single frame that can replace a chain of frames
+ */
+typedef boost::function< CVMWebserverBufferPtr() >	WebsocketEgressRebase;
+
+/**
+ * A frame pending in the egress queue.
+ *
+ * Frames with a non-empty key are supersedable: a newer frame with the
+ * same key replaces the queued one. Only the progress frames can be
+ * dropped when the queue reaches its high-water mark, since any other
+ * queued frame is already the latest one of its key (a dropped state
+ * frame would leave the browser with a stale state).
+ *
+ * Frames with a key and a ``rebase`` function are chained instead: each
+ * one builds on the frames queued before it with the same key, so they
+ * are neither superseded nor dropped. When the queue reaches its
+ * high-water mark, the chain is collapsed to the frame that the rebase
+ * function of it's last element builds.
+ */
+struct WebsocketEgressFrame {
+	CVMWebserverBufferPtr 	data;
+	std::string 			key;
+	WebsocketEgressRebase 	rebase;
+};
+
+/**
+ * The frames waiting to be written to a websocket connection. Producers
+ * push from any thread, while the I/O thread pops them.
+ */
+class WebsocketEgressQueue {
+public:
+
+	/**
+	 * Create an empty queue, with the given name in the logs
+	 */
+	WebsocketEgressQueue( const std::string& name );
+
+	/**
+	 * Queue a frame. If a supersedable key is specified, any queued
+	 * frame with the same key is replaced by this one, in it's place.
+	 * If a rebase function is specified too, the frame is chained to
+	 * the queued frames with the same key.
+	 */
+	void 					push( const CVMWebserverBufferPtr& data, const std::string& key = "", const WebsocketEgressRebase& rebase = WebsocketEgressRebase() );
+
+	/**
+	 * Pops the next frame into ``msg``, or returns false if the queue
+	 * is empty. If batching is enabled, all the pending frames are popped
+	 * and placed in ``msg`` as the elements of a single JSON array.
+	 */
+	bool 					pop( CVMWebserverMessage * msg );
+
+	/**
+	 * Enable or disable the batching of the frames
+	 */
+	void 					setBatching( bool enabled );
+
+	/**
+	 * Return the statistics of the queue
+	 */
+	CVMWebserverEgressStats stats();
+
+private:
+
+	/**
+	 * Replace the chain that starts at the given frame with the
+	 * frame built by the rebase function of it's last element
+	 */
+	void 					collapse( size_t first );
+
+	/**
+	 * The name of the queue in the logs
+	 */
+	std::string 			name;
+
+	/**
+	 * The pending frames
+	 */
+	std::deque< WebsocketEgressFrame >	frames;
+
+	/**
+	 * Mutex for accessing the queue
+	 */
+	boost::mutex 			mutex;
+
+	/**
+	 * Flag raised when the browser accepts batched frames
+	 */
+	bool 					batching;
+
+	/**
+	 * Statistics of the queue
+	 */
+	CVMWebserverEgressStats egressStats;
+
+};
+
+#endif /* end of include guard: WEBSERVER_EGRESS_H */
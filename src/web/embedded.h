@@ -0,0 +1,74 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef EMBEDDED_H
+#define EMBEDDED_H
+
+#include <stddef.h>
+#include <string>
+
+/**
+ * One encoding of an embedded file. The data pointer is NULL if the
+ * file is not available in this encoding.
+ */
+struct embedded_variant {
+	const unsigned char *	data;
+	size_t 					size;
+	const char *			etag;
+};
+
+/**
+ * An embedded file, as generated by tools/mkdata.pl
+ */
+struct embedded_file {
+
+	/**
+	 * The URL of the file, relative to the server root
+	 */
+	const char *			name;
+
+	/**
+	 * The MIME type of the file
+	 */
+	const char *			mime;
+
+	/**
+	 * Non-zero if the file name is versioned, therefore
+	 * it's contents will never change.
+	 */
+	int 					immutable;
+
+	/**
+	 * The raw, gzip and brotli encodings of the file
+	 */
+	embedded_variant 		identity;
+	embedded_variant 		gzip;
+	embedded_variant 		br;
+
+};
+
+/**
+ * Lookup the embedded file with the given name, or return NULL if
+ * no such file exists. (This function is generated from source)
+ */
+const embedded_file * find_embedded_file( const std::string& name );
+
+#endif /* end of include guard: EMBEDDED_H */
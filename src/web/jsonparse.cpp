@@ -0,0 +1,395 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "jsonparse.h"
+#include "textscan.h"
+
+#include <CernVM/CrashReport.h>
+
+#include <json/json.h>
+#include <cerrno>
+#include <cstdlib>
+
+// Maximum nesting of objects and arrays we accept
+#define JSON_MAX_DEPTH      32
+
+/**
+ * Decode a hex digit, or return -1
+ */
+static int hexValue( const char c ) {
+	if ((c >= '0') && (c <= '9')) return c - '0';
+	if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * Decode the four hex digits of a \u escape
+ */
+static unsigned int hexQuad( const char * p ) {
+	return (hexValue(p[0]) << 12) | (hexValue(p[1]) << 8) | (hexValue(p[2]) << 4) | hexValue(p[3]);
+}
+
+/**
+ * Format a number literal like Json::Value::asString() does. Integers stay
+ * integers unless they overflow 64 bits, everything else becomes a double.
+ */
+static std::string numberToString( const char * start, const char * end ) {
+	const std::string text( start, end - start );
+	if (text.find_first_of(".eE") == std::string::npos) {
+		errno = 0;
+		if (text[0] == '-') {
+			Json::LargestInt value = strtoll( text.c_str(), NULL, 10 );
+			if (errno == 0) return Json::valueToString( value );
+		} else {
+			Json::LargestUInt value = strtoull( text.c_str(), NULL, 10 );
+			if (errno == 0) return Json::valueToString( value );
+		}
+	}
+	return Json::valueToString( strtod( text.c_str(), NULL ) );
+}
+
+/**
+ * Compare with a literal, without allocating
+ */
+bool JSONStringView::equals( const char * str ) const {
+	if (escaped) return (this->str() == str);
+	return (strlen(str) == len) && (memcmp(data, str, len) == 0);
+}
+
+/**
+ * Return the decoded string
+ */
+std::string JSONStringView::str() const {
+	if (!escaped) return std::string( data, len );
+
+	std::string ans;
+	ans.reserve( len );
+	const char * p = data, * end = data + len;
+	while (p < end) {
+		if (*p != '\\') {
+			ans += *p++;
+			continue;
+		}
+		switch (p[1]) {
+			case 'b': ans += '\b'; p += 2; break;
+			case 'f': ans += '\f'; p += 2; break;
+			case 'n': ans += '\n'; p += 2; break;
+			case 'r': ans += '\r'; p += 2; break;
+			case 't': ans += '\t'; p += 2; break;
+			case 'u': {
+				unsigned int cp = hexQuad( p + 2 );
+				p += 6;
+
+				// Combine surrogate pairs
+				if ((cp >= 0xD800) && (cp <= 0xDBFF) && (p + 6 <= end) && (p[0] == '\\') && (p[1] == 'u')) {
+					unsigned int lo = hexQuad( p + 2 );
+					if ((lo >= 0xDC00) && (lo <= 0xDFFF)) {
+						cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+						p += 6;
+					}
+				}
+
+				// Encode as UTF-8
+				if (cp < 0x80) {
+					ans += (char) cp;
+				} else if (cp < 0x800) {
+					ans += (char)(0xC0 | (cp >> 6));
+					ans += (char)(0x80 | (cp & 0x3F));
+				} else if (cp < 0x10000) {
+					ans += (char)(0xE0 | (cp >> 12));
+					ans += (char)(0x80 | ((cp >> 6) & 0x3F));
+					ans += (char)(0x80 | (cp & 0x3F));
+				} else {
+					ans += (char)(0xF0 | (cp >> 18));
+					ans += (char)(0x80 | ((cp >> 12) & 0x3F));
+					ans += (char)(0x80 | ((cp >> 6) & 0x3F));
+					ans += (char)(0x80 | (cp & 0x3F));
+				}
+				break;
+			}
+			default: ans += p[1]; p += 2; break;
+		}
+	}
+	return ans;
+}
+
+/**
+ * Prepare to parse the given buffer
+ */
+JSONActionParser::JSONActionParser( const char * buffer, const size_t len )
+	: hasType(false), hasName(false), hasId(false), p(buffer), end(buffer + len), typeValue(), nameValue(), idValue() {
+	memset( &type, 0, sizeof(type) );
+	memset( &name, 0, sizeof(name) );
+	memset( &id, 0, sizeof(id) );
+}
+
+/**
+ * Skip whitespace
+ */
+void JSONActionParser::skipWhitespace() {
+	while ((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r')))
+		++p;
+}
+
+/**
+ * Consume the given character after optional whitespace
+ */
+bool JSONActionParser::expect( const char c ) {
+	skipWhitespace();
+	if ((p >= end) || (*p != c)) return false;
+	++p;
+	return true;
+}
+
+/**
+ * Parse a string, keeping a reference to it's raw contents
+ */
+bool JSONActionParser::parseString( JSONStringView * view ) {
+	if (!expect('"')) return false;
+	view->data = p;
+	view->escaped = false;
+	while (p < end) {
+
+		// Skip to the next quote, backslash or control character
+		p += textFindJSONEscape( p, end - p );
+		if (p >= end) break;
+
+		const unsigned char c = (unsigned char) *p;
+		if (c == '"') {
+			view->len = p - view->data;
+			++p;
+			return true;
+		} else if (c == '\\') {
+			if (p + 1 >= end) return false;
+			view->escaped = true;
+			switch (p[1]) {
+				case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+					p += 2;
+					break;
+				case 'u':
+					if ((p + 6 > end) || (hexValue(p[2]) < 0) || (hexValue(p[3]) < 0) || (hexValue(p[4]) < 0) || (hexValue(p[5]) < 0))
+						return false;
+					p += 6;
+					break;
+				default:
+					return false;
+			}
+		} else {
+			// Control characters are not allowed
+			return false;
+		}
+	}
+	return false;
+}
+
+/**
+ * Validate a number
+ */
+bool JSONActionParser::parseNumber() {
+	const char * start = p;
+	if ((p < end) && (*p == '-')) ++p;
+	if ((p >= end) || (*p < '0') || (*p > '9')) return false;
+	if (*p == '0') {
+		++p;
+	} else {
+		while ((p < end) && (*p >= '0') && (*p <= '9')) ++p;
+	}
+	if ((p < end) && (*p == '.')) {
+		++p;
+		if ((p >= end) || (*p < '0') || (*p > '9')) return false;
+		while ((p < end) && (*p >= '0') && (*p <= '9')) ++p;
+	}
+	if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+		++p;
+		if ((p < end) && ((*p == '+') || (*p == '-'))) ++p;
+		if ((p >= end) || (*p < '0') || (*p > '9')) return false;
+		while ((p < end) && (*p >= '0') && (*p <= '9')) ++p;
+	}
+	return (p > start);
+}
+
+/**
+ * Consume a literal (true, false, null)
+ */
+bool JSONActionParser::parseLiteral( const char * literal ) {
+	size_t len = strlen(literal);
+	if (((size_t)(end - p) < len) || (memcmp(p, literal, len) != 0)) return false;
+	p += len;
+	return true;
+}
+
+/**
+ * Parse a number, boolean or null, converting it to a string like
+ * Json::Value::asString() does
+ */
+bool JSONActionParser::parseScalar( std::string * value ) {
+	skipWhitespace();
+	if (p >= end) return false;
+
+	const char * start = p;
+	switch (*p) {
+		case 't':
+			if (!parseLiteral( "true" )) return false;
+			*value = "true";
+			return true;
+		case 'f':
+			if (!parseLiteral( "false" )) return false;
+			*value = "false";
+			return true;
+		case 'n':
+			if (!parseLiteral( "null" )) return false;
+			value->clear();
+			return true;
+		default:
+			if (!parseNumber()) return false;
+			*value = numberToString( start, p );
+			return true;
+	}
+}
+
+/**
+ * Parse an envelope field. Strings are kept as views in the frame, other
+ * scalars are converted to a string kept in ``storage``.
+ */
+bool JSONActionParser::parseField( JSONStringView * view, std::string * storage ) {
+	skipWhitespace();
+	if ((p < end) && (*p == '"')) return parseString( view );
+	if ((p < end) && ((*p == '[') || (*p == '{'))) return false;
+	if (!parseScalar( storage )) return false;
+	view->data = storage->data();
+	view->len = storage->length();
+	view->escaped = false;
+	return true;
+}
+
+/**
+ * Validate and skip any value
+ */
+bool JSONActionParser::skipValue( int depth ) {
+	if (depth > JSON_MAX_DEPTH) return false;
+	skipWhitespace();
+	if (p >= end) return false;
+
+	JSONStringView tmp;
+	switch (*p) {
+		case '"':
+			return parseString( &tmp );
+		case 't':
+			return parseLiteral( "true" );
+		case 'f':
+			return parseLiteral( "false" );
+		case 'n':
+			return parseLiteral( "null" );
+		case '[':
+			++p;
+			if (expect(']')) return true;
+			do {
+				if (!skipValue( depth + 1 )) return false;
+			} while (expect(','));
+			return expect(']');
+		case '{':
+			++p;
+			if (expect('}')) return true;
+			do {
+				if (!parseString( &tmp ) || !expect(':') || !skipValue( depth + 1 )) return false;
+			} while (expect(','));
+			return expect('}');
+		default:
+			return parseNumber();
+	}
+}
+
+/**
+ * Parse the members of an object into the given parameter map
+ */
+bool JSONActionParser::parseObject( ParameterMapPtr map, int depth ) {
+	if (depth > JSON_MAX_DEPTH) return false;
+	if (!expect('{')) return false;
+	if (expect('}')) return true;
+
+	JSONStringView key;
+	do {
+		if (!parseString( &key ) || !expect(':')) return false;
+		skipWhitespace();
+		if (p >= end) return false;
+
+		// Place the value in the map according to it's type
+		const char * start = p;
+		if (*p == '"') {
+			JSONStringView value;
+			if (!parseString( &value )) return false;
+			map->set( key.str(), value.str() );
+		} else if (*p == '{') {
+			if (!parseObject( map->subgroup( key.str() ), depth + 1 )) return false;
+		} else if (*p == '[') {
+			// Arrays are kept as their JSON text
+			if (!skipValue( depth + 1 )) return false;
+			map->set( key.str(), std::string( start, p - start ) );
+		} else {
+			std::string value;
+			if (!parseScalar( &value )) return false;
+			map->set( key.str(), value );
+		}
+
+	} while (expect(','));
+	return expect('}');
+}
+
+/**
+ * Parse the frame
+ */
+bool JSONActionParser::parse( ParameterMapPtr map ) {
+	CRASH_REPORT_BEGIN;
+	if (!expect('{')) return false;
+	if (!expect('}')) {
+
+		JSONStringView key;
+		do {
+			if (!parseString( &key ) || !expect(':')) return false;
+			skipWhitespace();
+
+			// Pick the envelope fields
+			if (key.equals("type")) {
+				if (!parseField( &type, &typeValue )) return false;
+				hasType = true;
+			} else if (key.equals("name")) {
+				if (!parseField( &name, &nameValue )) return false;
+				hasName = true;
+			} else if (key.equals("id")) {
+				if (!parseField( &id, &idValue )) return false;
+				hasId = true;
+			} else if (key.equals("data") && (p < end) && (*p == '{')) {
+				if (!parseObject( map, 1 )) return false;
+			} else {
+				if (!skipValue( 1 )) return false;
+			}
+
+		} while (expect(','));
+		if (!expect('}')) return false;
+
+	}
+
+	// Nothing should follow the frame
+	skipWhitespace();
+	return (p == end);
+
+	CRASH_REPORT_END;
+}
@@ -0,0 +1,115 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef JSONPARSE_H
+#define JSONPARSE_H
+
+#include <CernVM/ParameterMap.h>
+
+#include <string>
+#include <cstring>
+
+/**
+ * A reference to a JSON string inside the frame being parsed, or to the
+ * string the parser converted a non-string scalar to
+ */
+struct JSONStringView {
+	const char *	data; 		// The first character after the opening quote
+	size_t 			len; 		// The length of the raw (still escaped) string
+	bool 			escaped; 	// True if the string contains escape sequences
+
+	/**
+	 * Compare with a literal, without allocating
+	 */
+	bool 			equals( const char * str ) const;
+
+	/**
+	 * Return the decoded string
+	 */
+	std::string 	str() const;
+
+};
+
+/**
+ * A single-pass parser for the action frames sent by the browser:
+ *
+ *   {"type":"action","name":"...","id":"...","data":{...}}
+ *
+ * The frame is parsed in-situ. The envelope fields are returned as views
+ * in the frame buffer, and the members of ``data`` are written directly
+ * to a ParameterMap, without building a Json::Value tree.
+ */
+class JSONActionParser {
+public:
+
+	/**
+	 * Prepare to parse the given buffer
+	 */
+	JSONActionParser( const char * buffer, const size_t len );
+
+	/**
+	 * Parse the frame. Returns false as soon as a syntax error is found.
+	 *
+	 * The has* flags report which envelope fields were present. Scalars are
+	 * converted to strings like Json::Value::asString() does: numbers are
+	 * formatted by Json::valueToString(), booleans become "true"/"false"
+	 * and null becomes "". This applies to the envelope fields (which can
+	 * not be objects or arrays) and to the members of ``data``, which are
+	 * placed in ``map``. Objects become subgroups. Arrays, which asString()
+	 * would reject, are kept as their JSON text.
+	 */
+	bool 			parse( ParameterMapPtr map );
+
+	/**
+	 * The envelope fields (valid as long as the frame and the parser)
+	 */
+	JSONStringView 	type, name, id;
+	bool 			hasType, hasName, hasId;
+
+private:
+
+	/**
+	 * Parser helpers
+	 */
+	void 			skipWhitespace();
+	bool 			expect( const char c );
+	bool 			parseString( JSONStringView * view );
+	bool 			parseNumber();
+	bool 			parseLiteral( const char * literal );
+	bool 			parseScalar( std::string * value );
+	bool 			parseField( JSONStringView * view, std::string * storage );
+	bool 			skipValue( int depth );
+	bool 			parseObject( ParameterMapPtr map, int depth );
+
+	/**
+	 * Parsing state
+	 */
+	const char * 	p;
+	const char * 	end;
+
+	/**
+	 * The converted envelope fields that were not strings
+	 */
+	std::string 	typeValue, nameValue, idValue;
+
+};
+
+#endif /* end of include guard: JSONPARSE_H */
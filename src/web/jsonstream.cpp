@@ -0,0 +1,171 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "jsonstream.h"
+#include "textscan.h"
+
+#include <boost/variant/static_visitor.hpp>
+#include <boost/variant/apply_visitor.hpp>
+
+/**
+ * Visitor that writes a VariantArg without probing every type
+ */
+class JSONStreamArgVisitor : public boost::static_visitor<> {
+public:
+	JSONStreamArgVisitor( JSONStream& stream ) : stream(stream) { };
+	template <typename T>
+	void operator()( const T& value ) const { stream.arg( value ); };
+	JSONStream& stream;
+};
+
+/**
+ * Quote a string with the jsoncpp we are linked against, exactly like
+ * Json::FastWriter (without the trailing newline)
+ */
+static std::string quoteLikeFastWriter( const char * str, const size_t len ) {
+	Json::FastWriter writer;
+	std::string quoted = writer.write( Json::Value( std::string( str, len ) ) );
+	if (!quoted.empty() && (quoted[quoted.length() - 1] == '\n'))
+		quoted.resize( quoted.length() - 1 );
+	return quoted;
+}
+
+/**
+ * Append a quoted and escaped string
+ */
+JSONStream& JSONStream::string( const char * str, const size_t len ) {
+	const char * run = str, * end = str + len;
+	const size_t start = out.length();
+
+	out += '"';
+	for (const char * p = str + textFindJSONEscapeASCII( str, len ); p < end; p = run + textFindJSONEscapeASCII( run, end - run )) {
+		const unsigned char c = (unsigned char) *p;
+
+		// Flush the run of characters that need no escaping
+		out.append( run, p - run );
+		run = p + 1;
+
+		switch (c) {
+			case '"':  out.append( "\\\"", 2 ); break;
+			case '\\': out.append( "\\\\", 2 ); break;
+			case '\b': out.append( "\\b", 2 ); break;
+			case '\f': out.append( "\\f", 2 ); break;
+			case '\n': out.append( "\\n", 2 ); break;
+			case '\r': out.append( "\\r", 2 ); break;
+			case '\t': out.append( "\\t", 2 ); break;
+			default:
+
+				// The other control characters and the non-ASCII text are
+				// written differently by every jsoncpp version (raw UTF-8 or
+				// \uXXXX escapes, in either case), so they are rare enough
+				// to leave the whole string to the one the daemon links.
+				out.resize( start );
+				out += quoteLikeFastWriter( str, len );
+				return *this;
+		}
+	}
+	out.append( run, end - run );
+	out += '"';
+
+	return *this;
+}
+
+/**
+ * Append an integer
+ */
+JSONStream& JSONStream::number( const int value ) {
+	char buf[16], * p = buf + sizeof(buf);
+	unsigned int v = (value < 0) ? -(unsigned int)value : (unsigned int)value;
+	do {
+		*--p = '0' + (v % 10);
+		v /= 10;
+	} while (v != 0);
+	if (value < 0) *--p = '-';
+	out.append( p, buf + sizeof(buf) - p );
+	return *this;
+}
+
+/**
+ * Append a real number, formatted by jsoncpp
+ */
+JSONStream& JSONStream::number( const double value ) {
+	out += Json::valueToString( value );
+	return *this;
+}
+
+/**
+ * Append a VariantArg
+ */
+JSONStream& JSONStream::arg( const VariantArg& value ) {
+	boost::apply_visitor( JSONStreamArgVisitor(*this), value );
+	return *this;
+}
+
+/**
+ * Append a Json::Value tree
+ */
+JSONStream& JSONStream::value( const Json::Value& value ) {
+	switch (value.type()) {
+		case Json::nullValue:
+			literal( "null" );
+			break;
+		case Json::intValue:
+			out += Json::valueToString( value.asLargestInt() );
+			break;
+		case Json::uintValue:
+			out += Json::valueToString( value.asLargestUInt() );
+			break;
+		case Json::realValue:
+			number( value.asDouble() );
+			break;
+		case Json::stringValue:
+			string( value.asString() );
+			break;
+		case Json::booleanValue:
+			if (value.asBool()) {
+				literal( "true" );
+			} else {
+				literal( "false" );
+			}
+			break;
+		case Json::arrayValue: {
+			out += '[';
+			for (Json::ArrayIndex i = 0; i < value.size(); ++i) {
+				if (i > 0) out += ',';
+				this->value( value[i] );
+			}
+			out += ']';
+			break;
+		}
+		case Json::objectValue: {
+			Json::Value::Members members( value.getMemberNames() );
+			out += '{';
+			for (Json::Value::Members::iterator it = members.begin(); it != members.end(); ++it) {
+				if (it != members.begin()) out += ',';
+				string( *it );
+				out += ':';
+				this->value( value[*it] );
+			}
+			out += '}';
+			break;
+		}
+	}
+	return *this;
+}
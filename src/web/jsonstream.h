@@ -0,0 +1,94 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef JSONSTREAM_H
+#define JSONSTREAM_H
+
+#include <CernVM/ArgumentList.h>
+
+#include <json/json.h>
+#include <string>
+#include <cstring>
+
+/**
+ * A streaming JSON writer that appends directly to a string, without
+ * building a Json::Value tree first.
+ *
+ * The output is the same as Json::FastWriter: object members are written
+ * by the caller in the order FastWriter would sort them, and numbers are
+ * formatted the same way. Strings with non-ASCII or control characters
+ * (other than the ones with a short escape) are quoted by jsoncpp itself,
+ * since every version of it writes them differently.
+ */
+class JSONStream {
+public:
+
+	/**
+	 * Append to the given string
+	 */
+	JSONStream( std::string& out ) : out(out) { };
+
+	/**
+	 * Append a literal JSON fragment
+	 */
+	template <size_t N>
+	inline JSONStream&	literal( const char (&str)[N] ) { out.append( str, N - 1 ); return *this; };
+
+	/**
+	 * Append a quoted and escaped string
+	 */
+	JSONStream&			string( const char * str, const size_t len );
+	inline JSONStream&	string( const std::string& str ) { return string( str.c_str(), str.length() ); };
+	inline JSONStream&	string( const char * str ) { return string( str, strlen(str) ); };
+
+	/**
+	 * Append a number
+	 */
+	JSONStream&			number( const int value );
+	JSONStream&			number( const double value );
+
+	/**
+	 * Append a Json::Value tree
+	 */
+	JSONStream&			value( const Json::Value& value );
+
+	/**
+	 * Append an event argument. The overload is selected at compile-time,
+	 * so fixed-shape events never go through VariantArg. Booleans are
+	 * sent as integers, like when converted to VariantArg.
+	 */
+	inline JSONStream&	arg( const int value ) { return number( value ); };
+	inline JSONStream&	arg( const bool value ) { return number( value ? 1 : 0 ); };
+	inline JSONStream&	arg( const double value ) { return number( value ); };
+	inline JSONStream&	arg( const float value ) { return number( (double) value ); };
+	inline JSONStream&	arg( const std::string& value ) { return string( value ); };
+	inline JSONStream&	arg( const char * value ) { return string( value ); };
+	JSONStream&			arg( const VariantArg& value );
+	inline JSONStream&	arg( const Json::Value& value ) { return this->value( value ); };
+
+	/**
+	 * The string we are appending to
+	 */
+	std::string& 		out;
+
+};
+
+#endif /* end of include guard: JSONSTREAM_H */
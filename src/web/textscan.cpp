@@ -0,0 +1,535 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "textscan.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// Vector implementations are only available on x86
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define TEXTSCAN_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TEXTSCAN_VECTOR_TARGETS
+#define TEXTSCAN_SSE2_TARGET
+#define TEXTSCAN_SSSE3_TARGET
+#define TEXTSCAN_AVX2_TARGET
+#define TEXTSCAN_CTZ(x) _textscan_ctz(x)
+static inline unsigned int _textscan_ctz( unsigned int x ) { unsigned long i; _BitScanForward(&i, x); return i; }
+#else
+#include <cpuid.h>
+// The intrinsics of an instruction set can only be used in the functions
+// that target it since GCC 4.9. Older compilers get the SSE2 kernels
+// only if SSE2 is enabled for the whole build (always on x86_64).
+#if defined(__clang__) || (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))
+#define TEXTSCAN_VECTOR_TARGETS
+#endif
+// 32-bit builds may not enable SSE2 globally, so its kernels enable it themselves
+#if defined(__i386__) && !defined(__SSE2__)
+#define TEXTSCAN_SSE2_TARGET __attribute__((target("sse2")))
+#else
+#define TEXTSCAN_SSE2_TARGET
+#endif
+#define TEXTSCAN_SSSE3_TARGET __attribute__((target("ssse3")))
+#define TEXTSCAN_AVX2_TARGET __attribute__((target("avx2")))
+#define TEXTSCAN_CTZ(x) __builtin_ctz(x)
+#endif
+#if defined(TEXTSCAN_VECTOR_TARGETS) || defined(__SSE2__) || defined(__x86_64__)
+#define TEXTSCAN_SSE2
+#endif
+#endif
+
+/**
+ * Validate a single UTF-8 sequence, returning it's length or 0 if invalid
+ */
+static inline size_t utf8Sequence( const unsigned char * s, const size_t avail ) {
+	const unsigned char c = s[0];
+	if (c < 0x80) return 1;
+
+	size_t len;
+	unsigned int cp;
+	if ((c & 0xE0) == 0xC0) { len = 2; cp = c & 0x1F; }
+	else if ((c & 0xF0) == 0xE0) { len = 3; cp = c & 0x0F; }
+	else if ((c & 0xF8) == 0xF0) { len = 4; cp = c & 0x07; }
+	else return 0;
+	if (avail < len) return 0;
+
+	for (size_t i = 1; i < len; ++i) {
+		if ((s[i] & 0xC0) != 0x80) return 0;
+		cp = (cp << 6) | (s[i] & 0x3F);
+	}
+
+	// Reject overlong forms, surrogates and out of range code points
+	if ((len == 2) && (cp < 0x80)) return 0;
+	if ((len == 3) && ((cp < 0x800) || ((cp >= 0xD800) && (cp <= 0xDFFF)))) return 0;
+	if ((len == 4) && ((cp < 0x10000) || (cp > 0x10FFFF))) return 0;
+	return len;
+}
+
+/**
+ * Validate UTF-8 sequences starting at ``i``, until we pass ``until``.
+ * Returns the new offset, or ``len + 1`` if the data are invalid.
+ */
+static inline size_t utf8ValidateUntil( const unsigned char * s, size_t i, const size_t until, const size_t len ) {
+	while (i < until) {
+		size_t n = utf8Sequence( s + i, len - i );
+		if (n == 0) return len + 1;
+		i += n;
+	}
+	return i;
+}
+
+/**
+ * Does this byte need escaping in a JSON string? With ``nonASCII``, the
+ * bytes of the non-ASCII characters need escaping too.
+ */
+template <bool nonASCII>
+static inline bool needsEscape( const unsigned char c ) {
+	return (c < 0x20) || (c == '"') || (c == '\\') || (nonASCII && (c >= 0x80));
+}
+
+/**
+ * The errors that a pair of consecutive bytes can make, for the vector
+ * UTF-8 validators (Keiser & Lemire, "Validating UTF-8 In Less Than One
+ * Instruction Per Byte"). Each table maps a nibble of the pair to the
+ * errors it takes part in, so the pair is invalid if the three lookups
+ * share a bit. The 3rd and 4th bytes of the sequences are checked apart.
+ */
+#define UTF8_TOO_SHORT 		(1 << 0)	// 11______ 0_______, 11______ 11______
+#define UTF8_TOO_LONG 		(1 << 1)	// 0_______ 10______
+#define UTF8_OVERLONG_3 	(1 << 2)	// 11100000 100_____
+#define UTF8_TOO_LARGE 		(1 << 3)	// 11110100 1001____, 11110100 101_____, 11110101 1001____ ...
+#define UTF8_SURROGATE 		(1 << 4)	// 11101101 101_____
+#define UTF8_OVERLONG_2 	(1 << 5)	// 1100000_ 10______
+#define UTF8_TOO_LARGE_1000 (1 << 6)	// 11110101 1000____ ...
+#define UTF8_OVERLONG_4 	(1 << 6)	// 11110000 1000____
+#define UTF8_TWO_CONTS 		(1 << 7)	// 10______ 10______
+#define UTF8_CARRY 			(UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+// The high nibble of the first byte
+static const unsigned char utf8Byte1High[16] = {
+	UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+	UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+	UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+	UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+	UTF8_TOO_SHORT,
+	UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+	UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+};
+
+// The low nibble of the first byte
+static const unsigned char utf8Byte1Low[16] = {
+	UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+	UTF8_CARRY | UTF8_OVERLONG_2,
+	UTF8_CARRY,
+	UTF8_CARRY,
+	UTF8_CARRY | UTF8_TOO_LARGE,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+};
+
+// The high nibble of the second byte
+static const unsigned char utf8Byte2High[16] = {
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+};
+
+// A block ends in the middle of a sequence if one of it's last three
+// bytes is above these (a 4-, 3- and 2-byte lead respectively)
+static const unsigned char utf8MaxComplete[32] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+////////////////////////////////////////
+// Scalar implementation
+////////////////////////////////////////
+
+static bool validateScalar( const char * data, const size_t len ) {
+	return utf8ValidateUntil( (const unsigned char*) data, 0, len, len ) == len;
+}
+
+template <bool nonASCII>
+static size_t findEscapeScalar( const char * data, const size_t len ) {
+	const unsigned char * s = (const unsigned char*) data;
+	for (size_t i = 0; i < len; ++i)
+		if (needsEscape<nonASCII>(s[i])) return i;
+	return len;
+}
+
+#ifdef TEXTSCAN_SSE2
+
+////////////////////////////////////////
+// SSE2 implementation
+////////////////////////////////////////
+
+template <bool nonASCII>
+TEXTSCAN_SSE2_TARGET
+static size_t findEscapeSSE2( const char * data, const size_t len ) {
+	const unsigned char * s = (const unsigned char*) data;
+	const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), ctl = _mm_set1_epi8(0x1F);
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128( (const __m128i*)(s + i) );
+		__m128i m = _mm_or_si128(
+			_mm_or_si128( _mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash) ),
+			_mm_cmpeq_epi8( _mm_max_epu8(v, ctl), ctl ) // v <= 0x1F
+		);
+		if (nonASCII) m = _mm_or_si128( m, v ); // The sign bit of v >= 0x80
+		unsigned int mask = (unsigned int) _mm_movemask_epi8(m);
+		if (mask != 0) return i + TEXTSCAN_CTZ(mask);
+	}
+	return i + findEscapeScalar<nonASCII>( data + i, len - i );
+}
+
+#endif /* TEXTSCAN_SSE2 */
+
+#ifdef TEXTSCAN_VECTOR_TARGETS
+
+////////////////////////////////////////
+// SSSE3 implementation
+////////////////////////////////////////
+
+/**
+ * Return the errors of the UTF-8 sequences that end in the ``input``
+ * block, with ``prev`` being the block before it
+ */
+TEXTSCAN_SSSE3_TARGET
+static inline __m128i utf8ErrorsSSSE3( const __m128i input, const __m128i prev, const __m128i byte1High, const __m128i byte1Low, const __m128i byte2High ) {
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+	const __m128i prev1 = _mm_alignr_epi8( input, prev, 16 - 1 );
+	const __m128i special = _mm_and_si128(
+		_mm_and_si128(
+			_mm_shuffle_epi8( byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble) ),
+			_mm_shuffle_epi8( byte1Low, _mm_and_si128(prev1, nibble) )
+		),
+		_mm_shuffle_epi8( byte2High, _mm_and_si128(_mm_srli_epi16(input, 4), nibble) )
+	);
+
+	// Two bytes after a 3-byte lead, or three after a 4-byte lead, there must
+	// be a continuation. The lookups flag it as TWO_CONTS, which is an error
+	// everywhere else.
+	const __m128i prev2 = _mm_alignr_epi8( input, prev, 16 - 2 );
+	const __m128i prev3 = _mm_alignr_epi8( input, prev, 16 - 3 );
+	const __m128i must23 = _mm_or_si128(
+		_mm_subs_epu8( prev2, _mm_set1_epi8((char)(0xE0 - 0x80)) ),
+		_mm_subs_epu8( prev3, _mm_set1_epi8((char)(0xF0 - 0x80)) )
+	);
+	return _mm_xor_si128( _mm_and_si128(must23, _mm_set1_epi8((char)0x80)), special );
+}
+
+TEXTSCAN_SSSE3_TARGET
+static bool validateSSSE3( const char * data, const size_t len ) {
+	const unsigned char * s = (const unsigned char*) data;
+	const __m128i byte1High = _mm_loadu_si128( (const __m128i*)utf8Byte1High );
+	const __m128i byte1Low = _mm_loadu_si128( (const __m128i*)utf8Byte1Low );
+	const __m128i byte2High = _mm_loadu_si128( (const __m128i*)utf8Byte2High );
+	const __m128i maxComplete = _mm_loadu_si128( (const __m128i*)(utf8MaxComplete + 16) );
+	__m128i prev = _mm_setzero_si128(), errors = _mm_setzero_si128(), incomplete = _mm_setzero_si128();
+
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i input = _mm_loadu_si128( (const __m128i*)(s + i) );
+		if (_mm_movemask_epi8(input) == 0) {
+			// A pure ASCII block is only wrong after an incomplete sequence
+			errors = _mm_or_si128( errors, incomplete );
+			incomplete = _mm_setzero_si128();
+		} else {
+			errors = _mm_or_si128( errors, utf8ErrorsSSSE3(input, prev, byte1High, byte1Low, byte2High) );
+			incomplete = _mm_subs_epu8( input, maxComplete );
+		}
+		prev = input;
+	}
+
+	// The tail is padded with zeros, which end any sequence left open
+	// before them. A sequence left open by the very last bytes is only
+	// caught by the incomplete check.
+	unsigned char tail[16] = { 0 };
+	for (size_t j = 0; i + j < len; ++j)
+		tail[j] = s[i + j];
+	__m128i input = _mm_loadu_si128( (const __m128i*)tail );
+	errors = _mm_or_si128( errors, utf8ErrorsSSSE3(input, prev, byte1High, byte1Low, byte2High) );
+	errors = _mm_or_si128( errors, _mm_subs_epu8(input, maxComplete) );
+
+	return _mm_movemask_epi8( _mm_cmpeq_epi8(errors, _mm_setzero_si128()) ) == 0xFFFF;
+}
+
+////////////////////////////////////////
+// AVX2 implementation
+////////////////////////////////////////
+
+/**
+ * Return the errors of the UTF-8 sequences that end in the ``input``
+ * block, with ``prev`` being the block before it
+ */
+TEXTSCAN_AVX2_TARGET
+static inline __m256i utf8ErrorsAVX2( const __m256i input, const __m256i prev, const __m256i byte1High, const __m256i byte1Low, const __m256i byte2High ) {
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+	// The alignr instruction works on each 128-bit lane, so the lane
+	// before the low lane of the input is brought next to it first
+	const __m256i prevLane = _mm256_permute2x128_si256( prev, input, 0x21 );
+	const __m256i prev1 = _mm256_alignr_epi8( input, prevLane, 16 - 1 );
+	const __m256i special = _mm256_and_si256(
+		_mm256_and_si256(
+			_mm256_shuffle_epi8( byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble) ),
+			_mm256_shuffle_epi8( byte1Low, _mm256_and_si256(prev1, nibble) )
+		),
+		_mm256_shuffle_epi8( byte2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble) )
+	);
+
+	// The continuations that must follow the 3- and 4-byte leads
+	const __m256i prev2 = _mm256_alignr_epi8( input, prevLane, 16 - 2 );
+	const __m256i prev3 = _mm256_alignr_epi8( input, prevLane, 16 - 3 );
+	const __m256i must23 = _mm256_or_si256(
+		_mm256_subs_epu8( prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)) ),
+		_mm256_subs_epu8( prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)) )
+	);
+	return _mm256_xor_si256( _mm256_and_si256(must23, _mm256_set1_epi8((char)0x80)), special );
+}
+
+TEXTSCAN_AVX2_TARGET
+static bool validateAVX2( const char * data, const size_t len ) {
+	const unsigned char * s = (const unsigned char*) data;
+	const __m256i byte1High = _mm256_broadcastsi128_si256( _mm_loadu_si128((const __m128i*)utf8Byte1High) );
+	const __m256i byte1Low = _mm256_broadcastsi128_si256( _mm_loadu_si128((const __m128i*)utf8Byte1Low) );
+	const __m256i byte2High = _mm256_broadcastsi128_si256( _mm_loadu_si128((const __m128i*)utf8Byte2High) );
+	const __m256i maxComplete = _mm256_loadu_si256( (const __m256i*)utf8MaxComplete );
+	__m256i prev = _mm256_setzero_si256(), errors = _mm256_setzero_si256(), incomplete = _mm256_setzero_si256();
+
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i input = _mm256_loadu_si256( (const __m256i*)(s + i) );
+		if (_mm256_movemask_epi8(input) == 0) {
+			// A pure ASCII block is only wrong after an incomplete sequence
+			errors = _mm256_or_si256( errors, incomplete );
+			incomplete = _mm256_setzero_si256();
+		} else {
+			errors = _mm256_or_si256( errors, utf8ErrorsAVX2(input, prev, byte1High, byte1Low, byte2High) );
+			incomplete = _mm256_subs_epu8( input, maxComplete );
+		}
+		prev = input;
+	}
+
+	// The zero-padded tail ends the open sequences (see validateSSSE3)
+	unsigned char tail[32] = { 0 };
+	for (size_t j = 0; i + j < len; ++j)
+		tail[j] = s[i + j];
+	__m256i input = _mm256_loadu_si256( (const __m256i*)tail );
+	errors = _mm256_or_si256( errors, utf8ErrorsAVX2(input, prev, byte1High, byte1Low, byte2High) );
+	errors = _mm256_or_si256( errors, _mm256_subs_epu8(input, maxComplete) );
+
+	bool valid = _mm256_testz_si256( errors, errors ) != 0;
+	_mm256_zeroupper();
+	return valid;
+}
+
+template <bool nonASCII>
+TEXTSCAN_AVX2_TARGET
+static size_t findEscapeAVX2( const char * data, const size_t len ) {
+	const unsigned char * s = (const unsigned char*) data;
+	const __m256i quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\'), ctl = _mm256_set1_epi8(0x1F);
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256( (const __m256i*)(s + i) );
+		__m256i m = _mm256_or_si256(
+			_mm256_or_si256( _mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash) ),
+			_mm256_cmpeq_epi8( _mm256_max_epu8(v, ctl), ctl ) // v <= 0x1F
+		);
+		if (nonASCII) m = _mm256_or_si256( m, v );
+		unsigned int mask = (unsigned int) _mm256_movemask_epi8(m);
+		if (mask != 0) {
+			_mm256_zeroupper();
+			return i + TEXTSCAN_CTZ(mask);
+		}
+	}
+
+	// Clear the upper halves of the registers before running SSE code,
+	// otherwise every SSE instruction after us pays a transition penalty.
+	_mm256_zeroupper();
+	return i + findEscapeSSE2<nonASCII>( data + i, len - i );
+}
+
+#endif /* TEXTSCAN_VECTOR_TARGETS */
+
+#ifdef TEXTSCAN_X86
+
+/**
+ * Read the eax, ebx, ecx and edx registers of a cpuid leaf
+ */
+static void cpuInfo( unsigned int leaf, unsigned int info[4] ) {
+#ifdef _MSC_VER
+	__cpuidex( (int*)info, leaf, 0 );
+#else
+	__cpuid_count( leaf, 0, info[0], info[1], info[2], info[3] );
+#endif
+}
+
+/**
+ * Check if the CPU supports SSE2 (always true on x86_64)
+ */
+static bool cpuHasSSE2() {
+#if defined(__x86_64__) || defined(_M_X64)
+	return true;
+#else
+	unsigned int info[4];
+	cpuInfo( 1, info );
+	return (info[3] & (1 << 26)) != 0;
+#endif
+}
+
+/**
+ * Check if the CPU supports SSSE3
+ */
+static bool cpuHasSSSE3() {
+	unsigned int info[4];
+	cpuInfo( 1, info );
+	return (info[2] & (1 << 9)) != 0;
+}
+
+/**
+ * Check if the CPU and the OS support AVX2
+ */
+static bool cpuHasAVX2() {
+	unsigned int info[4];
+	cpuInfo( 0, info );
+	if (info[0] < 7) return false;
+	cpuInfo( 1, info );
+	if ( !(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) ) return false; // OSXSAVE, AVX
+
+	// The OS must save the XMM and YMM state
+#ifdef _MSC_VER
+	unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__( "xgetbv" : "=a"(eax), "=d"(edx) : "c"(0) );
+	unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+	if ( (xcr0 & 0x6) != 0x6 ) return false;
+
+	cpuInfo( 7, info );
+	return (info[1] & (1 << 5)) != 0;
+}
+
+#endif /* TEXTSCAN_X86 */
+
+////////////////////////////////////////
+// Runtime dispatch
+////////////////////////////////////////
+
+/**
+ * The selected implementation
+ */
+struct TextScanKernels {
+	bool        (*validate)( const char *, const size_t );
+	size_t      (*findEscape)( const char *, const size_t );
+	size_t      (*findEscapeASCII)( const char *, const size_t );
+	const char* name;
+};
+
+/**
+ * Check if an implementation can be used. The CVMWA_TEXTSCAN environment
+ * variable can name a lower one than the best the CPU supports, in order
+ * to test the fallbacks.
+ */
+static bool kernelsAllowed( const char * name ) {
+	static const char * order[] = { "avx2", "ssse3", "sse2", "scalar" };
+	const char * cap = getenv( "CVMWA_TEXTSCAN" );
+	if (cap == NULL) return true;
+	int capRank = -1, rank = -1;
+	for (int i = 0; i < 4; ++i) {
+		if (strcmp(order[i], cap) == 0) capRank = i;
+		if (strcmp(order[i], name) == 0) rank = i;
+	}
+	return (capRank < 0) || (rank >= capRank);
+}
+
+static TextScanKernels selectKernels() {
+#ifdef TEXTSCAN_VECTOR_TARGETS
+	if (kernelsAllowed("avx2") && cpuHasAVX2()) {
+		TextScanKernels k = { validateAVX2, findEscapeAVX2<false>, findEscapeAVX2<true>, "avx2" };
+		return k;
+	}
+	if (kernelsAllowed("ssse3") && cpuHasSSSE3()) {
+		TextScanKernels k = { validateSSSE3, findEscapeSSE2<false>, findEscapeSSE2<true>, "ssse3" };
+		return k;
+	}
+#endif
+#ifdef TEXTSCAN_SSE2
+	// The UTF-8 validator needs the byte shuffles of SSSE3
+	if (kernelsAllowed("sse2") && cpuHasSSE2()) {
+		TextScanKernels k = { validateScalar, findEscapeSSE2<false>, findEscapeSSE2<true>, "sse2" };
+		return k;
+	}
+#endif
+	TextScanKernels k = { validateScalar, findEscapeScalar<false>, findEscapeScalar<true>, "scalar" };
+	return k;
+}
+
+static const TextScanKernels& kernels() {
+	static const TextScanKernels k = selectKernels();
+	return k;
+}
+
+/**
+ * Check if the buffer is valid UTF-8
+ */
+bool textIsValidUTF8( const char * data, const size_t len ) {
+	return kernels().validate( data, len );
+}
+
+/**
+ * Return the offset of the first byte that must be escaped
+ */
+size_t textFindJSONEscape( const char * data, const size_t len ) {
+	return kernels().findEscape( data, len );
+}
+
+/**
+ * Return the offset of the first byte that must be escaped, counting
+ * the bytes of the non-ASCII characters
+ */
+size_t textFindJSONEscapeASCII( const char * data, const size_t len ) {
+	return kernels().findEscapeASCII( data, len );
+}
+
+/**
+ * Return the name of the implementation in use
+ */
+const char* textScanImplementation() {
+	return kernels().name;
+}
@@ -0,0 +1,61 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <cstddef>
+
+/**
+ * Vectorized text scanning kernels of the websocket path.
+ *
+ * Each kernel has a scalar implementation and vector ones (AVX2 and SSSE3
+ * for the UTF-8 validation, AVX2 and SSE2 for the escape scan). The best
+ * ones supported by the CPU are picked at runtime, the first time they're
+ * used. The CVMWA_TEXTSCAN environment variable can pick lower ones.
+ */
+
+/**
+ * Check if the buffer is valid UTF-8 (no overlong forms, no surrogates,
+ * nothing above U+10FFFF). The vector versions check every pair of bytes
+ * of a block at once, with the lookup tables of Keiser and Lemire.
+ */
+bool 		textIsValidUTF8( const char * data, const size_t len );
+
+/**
+ * Return the offset of the first byte that must be escaped in a JSON
+ * string (control characters, '"' and '\'), or ``len`` if there is none.
+ */
+size_t 		textFindJSONEscape( const char * data, const size_t len );
+
+/**
+ * Like textFindJSONEscape, but the bytes above 0x7F must be escaped too,
+ * for writing JSON strings in plain ASCII.
+ */
+size_t 		textFindJSONEscapeASCII( const char * data, const size_t len );
+
+/**
+ * Return the name of the implementation in use ("avx2", "ssse3", "sse2"
+ * or "scalar")
+ */
+const char*	textScanImplementation();
+
+#endif /* end of include guard: TEXTSCAN_H */
@@ -19,22 +19,32 @@
  */
 
 #include "webserver.h"
+#include "embedded.h"
 #include <config.h>
 
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <boost/bind.hpp>
+
+#include <openssl/sha.h>
+#include <openssl/evp.h>
 
 #include <CernVM/Utilities.h>
 #include <CernVM/CrashReport.h>
 
 using namespace std;
 
-/**
- * This function is generated from source
- */
-extern const char *find_embedded_file(const string&, size_t *);
-
 /**
  * Send an error message
  */
@@ -57,15 +67,93 @@ int send_error( struct mg_connection *conn, const char* message, const int code
 }
 
 /**
- * This is the entry point for the CernVM Web API I/O
+ * Check if the given comma-separated header value contains the specified
+ * token. Parameters after ';' are ignored, except for a zero quality value.
  */
-int CVMWebserver::api_handler(struct mg_connection *conn) {
+static bool header_has_token( const char * header, const string& token, bool stripWeak = false ) {
+    if (header == NULL) return false;
+    string value = header;
+    size_t start = 0;
+    while (start <= value.length()) {
+        size_t end = value.find(',', start);
+        if (end == string::npos) end = value.length();
+
+        // Split parameters and trim whitespace
+        string item = value.substr(start, end - start), params = "";
+        size_t semi = item.find(';');
+        if (semi != string::npos) {
+            params = item.substr(semi + 1);
+            item = item.substr(0, semi);
+        }
+        size_t b = item.find_first_not_of(" \t"), e = item.find_last_not_of(" \t");
+        item = (b == string::npos) ? "" : item.substr(b, e - b + 1);
+        if (stripWeak && (item.compare(0, 2, "W/") == 0)) item = item.substr(2);
+
+        // Check for match (unless explicitly refused with q=0)
+        size_t qPos = params.find("q=");
+        if ((item == token) && ((qPos == string::npos) || (atof(params.c_str() + qPos + 2) > 0)))
+            return true;
+
+        start = end + 1;
+    }
+    return false;
+}
+
+/**
+ * Serve an embedded file, picking the best encoding accepted
+ * by the browser and validating the cached copy.
+ */
+static int send_embedded_file( struct mg_connection *conn, const embedded_file * res ) {
     CRASH_REPORT_BEGIN;
 
-	// Fetch 'this' from the connection server object
-	CVMWebserver* self = static_cast<CVMWebserver*>(conn->server_param);
+    // Pick encoding
+    const char * acceptEncoding = mg_get_header(conn, "Accept-Encoding");
+    const embedded_variant * variant = &res->identity;
+    const char * encoding = NULL;
+    if ((res->br.data != NULL) && header_has_token(acceptEncoding, "br")) {
+        variant = &res->br;
+        encoding = "br";
+    } else if ((res->gzip.data != NULL) && header_has_token(acceptEncoding, "gzip")) {
+        variant = &res->gzip;
+        encoding = "gzip";
+    }
 
-    // Try to identify domain by the 'Origin' header
+    // Versioned files can be cached forever, the rest must be re-validated
+    const char * cacheControl = res->immutable ? "public, max-age=31536000, immutable" : "no-cache";
+
+    // Reply with 304 if the browser has the same copy. (It's written raw, since
+    // mg_send_data would also send a chunked body)
+    const char * ifNoneMatch = mg_get_header(conn, "If-None-Match");
+    if ((ifNoneMatch != NULL) && ((strcmp(ifNoneMatch, "*") == 0) || header_has_token(ifNoneMatch, variant->etag, true))) {
+        mg_printf( conn, 
+            "HTTP/1.1 304 Not Modified\r\n"
+            "ETag: %s\r\n"
+            "Cache-Control: %s\r\n"
+            "Vary: Accept-Encoding\r\n"
+            "Content-Length: 0\r\n\r\n",
+            variant->etag, cacheControl );
+        return MG_TRUE;
+    }
+
+    // Send the pre-computed headers
+    mg_send_header(conn, "Content-Type", res->mime );
+    if (encoding != NULL)
+        mg_send_header(conn, "Content-Encoding", encoding );
+    mg_send_header(conn, "ETag", variant->etag );
+    mg_send_header(conn, "Cache-Control", cacheControl );
+    mg_send_header(conn, "Vary", "Accept-Encoding" );
+
+    // Send data
+    mg_send_data( conn, variant->data, variant->size );
+    return MG_TRUE;
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Identify the domain of the request using the 'Origin' header
+ */
+static string origin_domain( struct mg_connection *conn ) {
     const char * c_origin = mg_get_header(conn, "Origin");
     string domain = ""; 
     if (c_origin != NULL) {
@@ -79,6 +167,152 @@ int CVMWebserver::api_handler(struct mg_connection *conn) {
             domain = domain.substr( 0, colonPos );
         }
     }
+    return domain;
+}
+
+/**
+ * Check if the request was made by a local tool (like curl) and not by a
+ * web page: browsers send the Origin header, and the pages of other hosts
+ * that resolve to us (DNS rebinding) have a different Host.
+ */
+static bool is_local_tool_request( struct mg_connection *conn ) {
+    if (mg_get_header(conn, "Origin") != NULL) return false;
+    const char * c_host = mg_get_header(conn, "Host");
+    if (c_host == NULL) return true;
+    string host = c_host;
+    size_t colonPos = host.find(":");
+    if (colonPos != string::npos) host = host.substr( 0, colonPos );
+    return (host == "127.0.0.1") || (host == "localhost");
+}
+
+/**
+ * Write the header of an unmasked websocket frame.
+ *
+ * The frames are framed here and written raw, since mg_websocket_write()
+ * masks the opcode (so RSV1 can't be set for compressed frames) and
+ * accepts only a single contiguous buffer.
+ */
+static void write_frame_header( struct mg_connection *conn, const unsigned char flags, const size_t len ) {
+    unsigned char header[10];
+    size_t headerLen;
+
+    header[0] = 0x80 | flags;
+    if (len < 126) {
+        header[1] = (unsigned char) len;
+        headerLen = 2;
+    } else if (len <= 0xFFFF) {
+        header[1] = 126;
+        header[2] = (unsigned char)(len >> 8);
+        header[3] = (unsigned char)(len);
+        headerLen = 4;
+    } else {
+        header[1] = 127;
+        for (int i=0; i<8; i++)
+            header[2+i] = (unsigned char)(((unsigned long long) len) >> (8 * (7-i)));
+        headerLen = 10;
+    }
+
+    mg_write(conn, header, headerLen);
+}
+
+/**
+ * Duplicate a listening socket, so a reactor can own a descriptor of its own
+ */
+static int share_socket( int sock ) {
+#ifdef _WIN32
+    WSAPROTOCOL_INFO info;
+    if (WSADuplicateSocket( (SOCKET) sock, GetCurrentProcessId(), &info ) != 0)
+        return -1;
+    return (int) WSASocket( FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, &info, 0, 0 );
+#else
+    return dup( sock );
+#endif
+}
+
+/**
+ * Write all the buffers of a message in a single text frame.
+ *
+ * This is not a scatter/gather write: mg_write() copies every buffer to
+ * the send buffer of the connection, which mongoose flushes on its next
+ * poll. What is saved is the copy into a contiguous frame before that.
+ */
+static void write_message( struct mg_connection *conn, const CVMWebserverMessage& msg ) {
+    size_t len = 0;
+    for (CVMWebserverMessage::const_iterator it = msg.begin(); it != msg.end(); ++it)
+        len += (*it)->data.length();
+
+    write_frame_header( conn, 0x01, len );
+    for (CVMWebserverMessage::const_iterator it = msg.begin(); it != msg.end(); ++it)
+        mg_write( conn, (*it)->data.c_str(), (*it)->data.length() );
+}
+
+/**
+ * Create the connection record of a websocket and attach it to the mongoose connection
+ */
+CVMWebserverConnection * CVMWebserver::attachConnection( struct mg_connection *conn ) {
+    CRASH_REPORT_BEGIN;
+
+    CVMWebserverConnection * c = new CVMWebserverConnection( factory.createHandler(origin_domain(conn), conn->uri) );
+    c->h->egressNotify = boost::bind( &CVMWebserver::wakeup, this );
+    conn->connection_param = c;
+    linkConnection( c );
+    return c;
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Complete the websocket handshake, negotiating the extensions we support
+ */
+int CVMWebserver::handshake_handler(struct mg_connection *conn) {
+    CRASH_REPORT_BEGIN;
+
+    // Fetch 'this' from the connection server object
+    CVMWebserver* self = static_cast<CVMWebserver*>(conn->server_param);
+
+    // If the client does not offer any extension, let mongoose
+    // do the default handshake.
+    const char * c_ext = mg_get_header(conn, "Sec-WebSocket-Extensions");
+    const char * c_key = mg_get_header(conn, "Sec-WebSocket-Key");
+    if ((c_ext == NULL) || (c_key == NULL)) return MG_FALSE;
+
+    // Try to negotiate permessage-deflate on a fresh connection record
+    CVMWebserverConnection * c = static_cast<CVMWebserverConnection*>(conn->connection_param);
+    if (c == NULL) c = self->attachConnection( conn );
+    std::string extResponse;
+    if (!c->deflate.negotiate(c_ext, &extResponse)) return MG_FALSE;
+
+    // Calculate the Sec-WebSocket-Accept key
+    std::string key = std::string(c_key) + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char sha[SHA_DIGEST_LENGTH];
+    unsigned char accept[((SHA_DIGEST_LENGTH + 2) / 3) * 4 + 1];
+    SHA1( (const unsigned char*) key.c_str(), key.length(), sha );
+    EVP_EncodeBlock( accept, sha, SHA_DIGEST_LENGTH );
+
+    // Send handshake
+    mg_printf(conn, "HTTP/1.1 101 Switching Protocols\r\n"
+                    "Upgrade: websocket\r\n"
+                    "Connection: Upgrade\r\n"
+                    "Sec-WebSocket-Accept: %s\r\n"
+                    "Sec-WebSocket-Extensions: %s\r\n\r\n",
+                    accept, extResponse.c_str());
+
+    return MG_TRUE;
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * This is the entry point for the CernVM Web API I/O
+ */
+int CVMWebserver::api_handler(struct mg_connection *conn) {
+    CRASH_REPORT_BEGIN;
+
+	// Fetch 'this' from the connection server object
+	CVMWebserver* self = static_cast<CVMWebserver*>(conn->server_param);
+
+    // Try to identify domain by the 'Origin' header
+    string domain = origin_domain(conn);
 
     // Move URI to std::string
     std::string url = conn->uri;
@@ -87,23 +321,34 @@ int CVMWebserver::api_handler(struct mg_connection *conn) {
     if (conn->is_websocket) {
 
         // Check if a connection is active
-        CVMWebserverConnection * c;
-        if (self->connections.find(conn) == self->connections.end()) {
+        CVMWebserverConnection * c = static_cast<CVMWebserverConnection*>(conn->connection_param);
+        if (c == NULL) {
 
             // Initialize a new connection if such connection
             // does not exist.
-            boost::mutex::scoped_lock lock(self->connMutex);
-            c = new CVMWebserverConnection( self->factory.createHandler(domain, url) );
-            c->isIterated = true;
-            self->connections[conn] = c;
-            
-        } else {
-            c = self->connections[conn];
+            c = self->attachConnection( conn );
+
         }
 
         // Handle TEXT frames 
         if ( (conn->wsbits & 0x0F) == 0x01) {
-            c->h->handleRawData(conn->content, conn->content_len);
+            if (conn->wsbits & 0x40) {
+
+                // Compressed frame (RSV1)
+                std::string payload;
+                if (!c->deflate.decompress(conn->content, conn->content_len, &payload)) {
+                    CVMWA_LOG("Error", "Unable to decompress websocket frame");
+
+                    // Close with 1009 (message too big) or 1007 (invalid data)
+                    const char * status = (payload.length() > CVMWS_INFLATE_MAX_BYTES) ? "\x03\xf1" : "\x03\xef";
+                    mg_websocket_write(conn, 0x08, status, 2);
+                    return MG_FALSE;
+                }
+                c->h->handleRawData(payload.c_str(), payload.length());
+
+            } else {
+                c->h->handleRawData(conn->content, conn->content_len);
+            }
         }
 
         // Check if connection is closed
@@ -117,9 +362,7 @@ int CVMWebserver::api_handler(struct mg_connection *conn) {
         if (url[0] == '/')
             url = url.substr(1, url.length()-1);
 
-        // Check for embedded resources
-        size_t res_size;
-        const char *res_buffer = find_embedded_file( url, &res_size);
+        // Dynamic endpoints go first
         if ( url == "info" ) {
 
             // Enable CORS (important for allowing every website to contact us)
@@ -127,6 +370,20 @@ int CVMWebserver::api_handler(struct mg_connection *conn) {
             mg_printf_data(conn, "{\"status\":\"ok\",\"request\":\"%s\",\"domain\":\"%s\",\"version\":\"%s\"}", conn->uri, domain.c_str(), CERNVM_WEBAPI_VERSION);
             return MG_TRUE;
 
+        } else if ( url == "egress" ) {
+
+            // The egress statistics are only for local tools, and not
+            // for websites: no CORS, and no requests from a page.
+            if (!is_local_tool_request( conn ))
+                return send_error( conn, "Forbidden", 403);
+
+            CVMWebserverEgressStats es = self->getEgressStats();
+            mg_printf_data(conn, "{\"status\":\"ok\",\"frames\":%lu,\"bytes\":%lu,\"peakFrames\":%lu,\"peakBytes\":%lu,"
+                                 "\"superseded\":%lu,\"dropped\":%lu,\"congested\":%lu}",
+                                 (unsigned long)es.frames, (unsigned long)es.bytes, (unsigned long)es.peakFrames, (unsigned long)es.peakBytes,
+                                 (unsigned long)es.superseded, (unsigned long)es.dropped, (unsigned long)es.congested);
+            return MG_TRUE;
+
         } else if ( (self->staticURLHandler != NULL) && self->staticURLHandler->canHandleStaticURL(url) ) {
 
             // Handle URL
@@ -138,20 +395,19 @@ int CVMWebserver::api_handler(struct mg_connection *conn) {
 
             return MG_TRUE;
 
-        } else if (res_buffer == NULL) {
+        }
+
+        // Check for embedded resources
+        const embedded_file * res = find_embedded_file( url );
+        if (res == NULL) {
             
             // File not found
             return send_error( conn, "File not found", 404);
 
         } else {
 
-            // Get MIME type of the file to send and send header
-            const char * mimeType = mg_get_mime_type( url.c_str(), "text/plain" );
-            mg_send_header(conn, "Content-Type", mimeType );
-
-            // Send data
-            mg_send_data( conn, res_buffer, res_size );
-            return MG_TRUE;
+            // Send file
+            return send_embedded_file( conn, res );
 
         }
 
@@ -168,39 +424,34 @@ int CVMWebserver::api_handler(struct mg_connection *conn) {
 int CVMWebserver::iterate_callback(struct mg_connection *conn, enum mg_event ev) {
     CRASH_REPORT_BEGIN;
 
-    // Fetch 'this' from the connection server object
-    CVMWebserver* self = static_cast<CVMWebserver*>(conn->server_param);
-
     // Handle websockets
     if ((ev == MG_POLL) && conn->is_websocket) {
 
         // Check if a CVMWebserverConnection is active
-        CVMWebserverConnection * c;
-        if (self->connections.find(conn) == self->connections.end()) {
+        CVMWebserverConnection * c = static_cast<CVMWebserverConnection*>(conn->connection_param);
+        if (c == NULL) {
             // This connection is not handled by us!
             return MG_TRUE;
-
-        } else {
-            c = self->connections[conn];
         }
 
-        // Mark socket as iterated
-        c->isIterated = true;
-
-        // Send all frames of the egress queue
-        std::string buf;
-        while ( !(buf = c->h->getEgressRawData()).empty() ) {
-            mg_websocket_write(conn, 0x01, buf.c_str(), buf.length());
+        // Send all frames of the egress queue. The buffers of the queue
+        // are handed to mongoose as they are, without joining them first.
+        while ( c->h->getEgressMessage(&c->message) ) {
+            if (c->deflate.compress(c->message, &c->deflated)) {
+                write_frame_header( conn, 0x40 | 0x01, c->deflated.length() );
+                mg_write( conn, c->deflated.c_str(), c->deflated.length() );
+            } else {
+                write_message( conn, c->message );
+            }
+            c->message.clear();
         }
 
         // If we are disconnected, send disconnect frame
         if (!c->h->isConnected()) {
 
-            // Send Connection Close Frame
+            // Send Connection Close Frame. The connection record
+            // is released when mongoose closes the connection.
             mg_websocket_write(conn, 0x08, NULL, 0);
-
-            // Mark as non-iterated so it's deleted on poll()
-            c->isIterated = false;
         }
 
     }
@@ -211,6 +462,31 @@ int CVMWebserver::iterate_callback(struct mg_connection *conn, enum mg_event ev)
     CRASH_REPORT_END;
 }
 
+/**
+ * Release the connection handler when mongoose closes the connection
+ */
+int CVMWebserver::close_handler(struct mg_connection *conn) {
+    CRASH_REPORT_BEGIN;
+
+    // Fetch 'this' from the connection server object
+    CVMWebserver* self = static_cast<CVMWebserver*>(conn->server_param);
+
+    // Check if this connection was handled by us
+    CVMWebserverConnection * c = static_cast<CVMWebserverConnection*>(conn->connection_param);
+    if (c == NULL) return MG_TRUE;
+    conn->connection_param = NULL;
+
+    CVMWA_LOG("Debug", "Connection closed. Will delete promptly...");
+
+    // Unregister the connection object and let the reapers release it
+    self->unlinkConnection( c );
+    self->reap( c );
+
+    return MG_TRUE;
+
+    CRASH_REPORT_END;
+}
+
 /**
  * RAW Request handler
  */
@@ -220,6 +496,10 @@ int CVMWebserver::ev_handler(struct mg_connection *conn, enum mg_event ev) {
         return api_handler(conn);
     } else if (ev == MG_AUTH) {
         return MG_TRUE;
+    } else if (ev == MG_WS_HANDSHAKE) {
+        return handshake_handler(conn);
+    } else if (ev == MG_CLOSE) {
+        return close_handler(conn);
     } else {
         return MG_FALSE;
     }
@@ -229,8 +509,10 @@ int CVMWebserver::ev_handler(struct mg_connection *conn, enum mg_event ev) {
 /**
  * Create a webserver and setup listening port
  */
-CVMWebserver::CVMWebserver( CVMWebserverConnectionFactory& factory, const int port ) 
-    : factory(factory), staticResources(), staticURLHandler(NULL) {
+CVMWebserver::CVMWebserver( CVMWebserverConnectionFactory& factory, const int port, const int reactorCount ) 
+    : connections(NULL), connMutex(), server(NULL), reactors(), reactorThreads(), reactorExit(false), reactorsStarted(false),
+      factory(factory), staticURLHandler(NULL), staticResources(), egressPending(false), wakeupRequested(false), wakeupExit(false),
+      wakeupMutex(), wakeupCond(), wakeupThreadPtr(NULL), primary(this), reapQueue(), reapMutex(), reapCond(), reapActive(0), reapAbandoned(0) {
     CRASH_REPORT_BEGIN;
 
 	// Create a mongoose server, passing the pointer
@@ -242,6 +524,40 @@ CVMWebserver::CVMWebserver( CVMWebserverConnectionFactory& factory, const int po
 	ostringstream ss; ss << "127.0.0.1:" << port;
     mg_set_option(server, "listening_port", ss.str().c_str());
 
+    // Start the thread that forwards the egress wakeup requests
+    wakeupThreadPtr = new boost::thread( boost::bind( &CVMWebserver::wakeupThread, this ) );
+
+    // Create the additional reactors (we are the first one). Their
+    // threads are started by our first poll().
+    int numReactors = reactorCount;
+    if (numReactors <= 0) numReactors = boost::thread::hardware_concurrency();
+    for (int i=1; i<numReactors; ++i) {
+        reactors.push_back( new CVMWebserver( ReactorOf( *this ) ) );
+    }
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Create an additional reactor that shares the listening socket
+ * of the primary webserver.
+ */
+CVMWebserver::CVMWebserver( const ReactorOf& reactorOf ) 
+    : connections(NULL), connMutex(), server(NULL), reactors(), reactorThreads(), reactorExit(false), reactorsStarted(false),
+      factory(reactorOf.primary.factory), staticURLHandler(reactorOf.primary.staticURLHandler), staticResources(), egressPending(false),
+      wakeupRequested(false), wakeupExit(false), wakeupMutex(), wakeupCond(), wakeupThreadPtr(NULL), primary(&reactorOf.primary), reapQueue(), reapMutex(), reapCond(), reapActive(0), reapAbandoned(0) {
+    CRASH_REPORT_BEGIN;
+
+    // Create a mongoose server that accepts connections from the same
+    // listening socket. It gets a duplicate of the descriptor in place of
+    // a throwaway listener, so destroying the reactor closes only its own.
+    server = mg_create_server( this, CVMWebserver::ev_handler );
+    mg_set_option( server, "listening_port", "127.0.0.1:0" );
+    mg_set_listening_socket( server, share_socket( mg_get_listening_socket( primary->server ) ) );
+
+    // Start the thread that forwards the egress wakeup requests
+    wakeupThreadPtr = new boost::thread( boost::bind( &CVMWebserver::wakeupThread, this ) );
+
     CRASH_REPORT_END;
 }
 
@@ -251,23 +567,101 @@ CVMWebserver::CVMWebserver( CVMWebserverConnectionFactory& factory, const int po
 CVMWebserver::~CVMWebserver() {
     CRASH_REPORT_BEGIN;
 
-    // Destroy mongoose server
-    mg_destroy_server( &server );
+    // Nothing refers to the reactors any more, unless some connections
+    // were abandoned (their tasks can still wake up their reactors)
+    if (shutdown()) {
+        for (std::vector< CVMWebserver* >::iterator it = reactors.begin(); it != reactors.end(); ++it) {
+            delete *it;
+        }
+    }
+    reactors.clear();
 
-	// Destroy connections
-    {
-        boost::mutex::scoped_lock lock(connMutex);
+    CRASH_REPORT_END;
+}
 
-        std::map<mg_connection*, CVMWebserverConnection*>::iterator it;
-        for (it=connections.begin(); it!=connections.end(); ++it) {
-            CVMWebserverConnection * c = it->second;
-            c->cleanup();
-            delete c;
+/**
+ * Stop the reactors and release the connections
+ */
+bool CVMWebserver::shutdown() {
+    CRASH_REPORT_BEGIN;
+
+    // Stop the additional reactors (and never start them if we were
+    // not polled yet, since stop() polls us). The exit wakeup is not
+    // coalesced with the egress ones: a pending egress wakeup may have
+    // been consumed already, before the reactor saw reactorExit.
+    reactorsStarted = true;
+    for (std::vector< CVMWebserver* >::iterator it = reactors.begin(); it != reactors.end(); ++it) {
+        CVMWebserver * reactor = *it;
+        {
+            boost::mutex::scoped_lock lock(reactor->wakeupMutex);
+            reactor->reactorExit = true;
+            reactor->wakeupRequested = true;
         }
+        reactor->wakeupCond.notify_one();
+    }
+    reactorThreads.join_all();
+
+    // Close the connections of all the reactors, and ours
+    for (std::vector< CVMWebserver* >::iterator it = reactors.begin(); it != reactors.end(); ++it) {
+        (*it)->stop();
+    }
+    stop();
+
+    // Help the reapers release all the closed connections, and wait for them
+    {
+        boost::mutex::scoped_lock lock(reapMutex);
+        reapActive++;
+    }
+    reaperThread();
+
+    boost::mutex::scoped_lock lock(reapMutex);
+    while (reapActive > 0) {
+        reapCond.wait(lock);
+    }
+    if (reapAbandoned > 0) {
+        CVMWA_LOG("Warning", reapAbandoned << " connections were abandoned, leaving the webserver to the process exit");
+        return false;
+    }
+    return true;
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Stop serving and release the connections
+ */
+void CVMWebserver::stop() {
+    CRASH_REPORT_BEGIN;
+    if (server == NULL) return;
+
+    // Stop the wakeup thread
+    {
+        boost::mutex::scoped_lock lock(wakeupMutex);
+        wakeupExit = true;
+    }
+    wakeupCond.notify_all();
+
+    // The thread might be in the middle of a wakeup, waiting for mongoose
+    // to acknowledge it, so keep polling until it exits.
+    while (!wakeupThreadPtr->timed_join( boost::posix_time::milliseconds(10) )) {
+        mg_poll_server(server, 0);
+    }
+    delete wakeupThreadPtr;
+    wakeupThreadPtr = NULL;
 
-        // Clear map
-        connections.clear();
+    // Destroy mongoose server (the listening socket of a reactor is
+    // a duplicate, so this does not close the one of the primary)
+    mg_destroy_server( &server );
+    server = NULL;
 
+	// Release the connections that were not closed by mongoose
+    {
+        boost::mutex::scoped_lock lock(connMutex);
+        while (connections != NULL) {
+            CVMWebserverConnection * c = connections;
+            connections = c->next;
+            reap( c );
+        }
     }
 
     CRASH_REPORT_END;
@@ -277,7 +671,14 @@ CVMWebserver::~CVMWebserver() {
  * Set static url handler
  */
 void CVMWebserver::setStaticURLHandler( CVMWebserverStaticURLHandler * handler ) {
+    if (reactorsStarted) {
+        CVMWA_LOG("Error", "The static URL handler must be registered before the webserver is polled");
+        return;
+    }
     staticURLHandler = handler;
+    for (std::vector< CVMWebserver* >::iterator it = reactors.begin(); it != reactors.end(); ++it) {
+        (*it)->setStaticURLHandler( handler );
+    }
 }
 
 /**
@@ -299,53 +700,27 @@ void CVMWebserver::serve_static( const std::string& url, const std::string& file
 void CVMWebserver::poll( const int timeout) {
     CRASH_REPORT_BEGIN;
 
-    // Mark all the connections as 'not iterated'
-    {
-        boost::mutex::scoped_lock lock(connMutex);
-        std::map<mg_connection*, CVMWebserverConnection*>::iterator it;
-        for (it=connections.begin(); it!=connections.end(); ++it) {
-            CVMWebserverConnection * c = it->second;
-            c->isIterated = false;
+    // Start polling the additional reactors too. Everything they share
+    // with us is set up by now, and starting the threads publishes it.
+    if (!reactorsStarted) {
+        reactorsStarted = true;
+        for (std::vector< CVMWebserver* >::iterator it = reactors.begin(); it != reactors.end(); ++it) {
+            reactorThreads.create_thread( boost::bind( &CVMWebserver::reactorThread, *it ) );
         }
     }
 
-    // Send the message to iterate over connections
-    mg_iterate_over_connections(server, CVMWebserver::iterate_callback, this);
-
-	// Poll mongoose server
-    mg_poll_server(server, timeout);	
-
-    // Find dead connections
+    // We are going to flush all the egress queues, therefore any
+    // frame queued from now on requires a new wakeup.
     {
-        boost::mutex::scoped_lock lock(connMutex);
-        std::map<mg_connection*, CVMWebserverConnection*>::iterator it;
-        for (it=connections.begin(); it!=connections.end(); ++it) {
-            CVMWebserverConnection * c = it->second;
-
-            // Delete non-iterated over actions
-            if (!c->isIterated) {
-
-                CVMWA_LOG("Debug", "Found non-iterated connection. Will delete promptly...");
-
-                // Release connection object
-                c->cleanup();
-                delete c;
-
-                // Delete element
-                connections.erase(it);
+        boost::mutex::scoped_lock lock(wakeupMutex);
+        egressPending = false;
+    }
 
-                // Skip deleted element or exit
-                if (connections.empty()) {
-                    break;
-                    
-                } else {
-                    // Otherwise rewind pointer
-                    it = connections.begin();
-                }
+    // Send the message to iterate over connections
+    mg_iterate_over_connections(server, CVMWebserver::iterate_callback, this);
 
-            }
-        }
-    }
+    // Poll mongoose server (a wakeup() call interrupts the wait)
+    mg_poll_server(server, (timeout < 0) ? 0 : timeout);
 
     CRASH_REPORT_END;
 }
@@ -371,11 +746,216 @@ void CVMWebserver::start() {
  */
 bool CVMWebserver::hasLiveConnections() {
     CRASH_REPORT_BEGIN;
+    for (std::vector< CVMWebserver* >::iterator it = reactors.begin(); it != reactors.end(); ++it) {
+        if ((*it)->hasLiveConnections()) return true;
+    }
     try {
         boost::mutex::scoped_lock lock(connMutex);
-        return !connections.empty();
+        return (connections != NULL);
     } catch (boost::lock_error&) {
-        return connections.empty();
+        return (connections != NULL);
+    }
+    CRASH_REPORT_END;
+}
+
+/**
+ * Collect the egress queue statistics of all the active connections
+ */
+CVMWebserverEgressStats CVMWebserver::getEgressStats() {
+    CRASH_REPORT_BEGIN;
+    CVMWebserverEgressStats total;
+    memset( &total, 0, sizeof(total) );
+
+    // Include the connections of the reactors
+    for (std::vector< CVMWebserver* >::iterator it = reactors.begin(); it != reactors.end(); ++it) {
+        CVMWebserverEgressStats s = (*it)->getEgressStats();
+        total.frames += s.frames; total.bytes += s.bytes;
+        total.peakFrames = std::max( total.peakFrames, s.peakFrames );
+        total.peakBytes = std::max( total.peakBytes, s.peakBytes );
+        total.superseded += s.superseded; total.dropped += s.dropped;
+        total.congested += s.congested;
+    }
+
+    // Sum our connections
+    boost::mutex::scoped_lock lock(connMutex);
+    for (CVMWebserverConnection * c = connections; c != NULL; c = c->next) {
+        CVMWebserverEgressStats s = c->h->getEgressStats();
+        total.frames += s.frames; total.bytes += s.bytes;
+        total.peakFrames = std::max( total.peakFrames, s.peakFrames );
+        total.peakBytes = std::max( total.peakBytes, s.peakBytes );
+        total.superseded += s.superseded; total.dropped += s.dropped;
+        total.congested += s.congested;
     }
+
+    return total;
+    CRASH_REPORT_END;
+}
+
+/**
+ * Main loop of the additional reactor threads
+ */
+void CVMWebserver::reactorThread() {
+    CRASH_REPORT_BEGIN;
+
+    for (;;) {
+
+        // Check if we should exit
+        {
+            boost::mutex::scoped_lock lock(wakeupMutex);
+            if (reactorExit) break;
+        }
+
+        // Block until there are I/O or egress data (shutdown() wakes
+        // us up after raising reactorExit)
+        poll( CVMWS_POLL_FOREVER );
+
+    }
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Link a connection record to the head of the active connections list
+ */
+void CVMWebserver::linkConnection( CVMWebserverConnection * c ) {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(connMutex);
+
+    c->prev = NULL;
+    c->next = connections;
+    if (connections != NULL)
+        connections->prev = c;
+    connections = c;
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Unlink a connection record from the active connections list
+ */
+void CVMWebserver::unlinkConnection( CVMWebserverConnection * c ) {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(connMutex);
+
+    if (c->prev != NULL)
+        c->prev->next = c->next;
+    else
+        connections = c->next;
+    if (c->next != NULL)
+        c->next->prev = c->prev;
+    c->prev = NULL;
+    c->next = NULL;
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Wake up the server from a blocking poll in order to flush the
+ * egress queues.
+ */
+void CVMWebserver::wakeup() {
+    CRASH_REPORT_BEGIN;
+
+    // Coalesce the requests until the next poll
+    {
+        boost::mutex::scoped_lock lock(wakeupMutex);
+        if (egressPending) return;
+        egressPending = true;
+        wakeupRequested = true;
+    }
+
+    // Let the wakeup thread do the actual work
+    wakeupCond.notify_one();
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * The thread that forwards wakeup requests to mongoose.
+ *
+ * mg_wakeup_server() writes to the control socket of the server and waits for
+ * the I/O thread to acknowledge it. Doing so from the producer threads could
+ * dead-lock when the I/O thread is joining them, so we do it from here.
+ */
+void CVMWebserver::wakeupThread() {
+    CRASH_REPORT_BEGIN;
+
+    for (;;) {
+
+        // Wait until a new wakeup is requested
+        {
+            boost::mutex::scoped_lock lock(wakeupMutex);
+            while (!wakeupExit && !wakeupRequested) {
+                wakeupCond.wait(lock);
+            }
+            if (wakeupExit) return;
+            wakeupRequested = false;
+        }
+
+        // Interrupt mg_poll_server()
+        mg_wakeup_server(server);
+
+    }
+
+    CRASH_REPORT_END;
+}
+
+/**
+ * Queue a closed connection for cleanup
+ */
+void CVMWebserver::reap( CVMWebserverConnection * c ) {
+    CRASH_REPORT_BEGIN;
+    boost::mutex::scoped_lock lock(primary->reapMutex);
+    primary->reapQueue.push_back( c );
+
+    // Release it concurrently with the connections already being released
+    if (primary->reapActive < CVMWS_REAPERS_MAX) {
+        try {
+            boost::thread( boost::bind( &CVMWebserver::reaperThread, primary ) ).detach();
+            primary->reapActive++;
+        } catch (boost::thread_resource_error &e) {
+            CVMWA_LOG("Warning", "Unable to start a reaper thread, the connection waits for the next one");
+        }
+    }
+    CRASH_REPORT_END;
+}
+
+/**
+ * The thread that cleans up and releases the closed connections
+ */
+void CVMWebserver::reaperThread() {
+    CRASH_REPORT_BEGIN;
+
+    for (;;) {
+
+        // Pick a closed connection, or exit if there are none. The
+        // waiters are notified under the lock, since shutdown() can
+        // destroy the webserver as soon as the last reaper is over.
+        CVMWebserverConnection * c;
+        {
+            boost::mutex::scoped_lock lock(reapMutex);
+            if (reapQueue.empty()) {
+                if (--reapActive == 0)
+                    reapCond.notify_all();
+                return;
+            }
+            c = reapQueue.front();
+            reapQueue.pop_front();
+        }
+
+        // Release it (the handler waits for its own tasks, up to
+        // its teardown deadline, or it's abandoned)
+        unsigned long started = getMillis();
+        if (c->cleanup()) {
+            CVMWA_LOG("Debug", "Connection released in " << (getMillis() - started) << "ms");
+        } else {
+            CVMWA_LOG("Error", "Connection abandoned after " << (getMillis() - started) << "ms");
+            boost::mutex::scoped_lock lock(reapMutex);
+            reapAbandoned++;
+        }
+        delete c;
+
+    }
+
     CRASH_REPORT_END;
 }
@@ -23,11 +23,26 @@
 #define WEBSERVER_H
 
 #include <mongoose.h>
+#include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/function.hpp>
 #include <config.h>
+#include "buffer.h"
+#include "egress.h"
+#include "wsdeflate.h"
 
 #include <string>
 #include <map>
+#include <vector>
+#include <deque>
+
+// A poll() timeout that blocks until there is I/O or a wakeup
+#define CVMWS_POLL_FOREVER		0x7fffffff
+
+// The most closed connections that are released concurrently. Releasing one
+// mostly waits for it's tasks, so a burst of closes should not queue up.
+#define CVMWS_REAPERS_MAX		32
 
 /**
  * Abstract class for connection handlers
@@ -36,9 +51,11 @@ class CVMWebserverConnectionHandler {
 public:
 
 	/**
-	 * Abstract function to cleanup before destruction
+	 * Abstract function to cleanup before destruction. It returns false
+	 * if the handler is still used by its tasks when its teardown deadline
+	 * expires. Such a handler is abandoned instead of being deleted.
 	 */
-	virtual void 			cleanup() = 0;
+	virtual bool 			cleanup() = 0;
 
 	/**
 	 * This function is called when there is an incoming data frame 
@@ -53,10 +70,22 @@ public:
 	virtual bool 			isConnected() = 0;
 
 	/**
-	 * Pops and returns the next frame from the egress queue, or returns
-	 * an empty string if there are no data in the egress queue.
+	 * Pops the next message from the egress queue into ``msg``, or returns
+	 * false if there are no data in the egress queue.
 	 */
-	virtual std::string 	getEgressRawData() = 0;
+	virtual bool 			getEgressMessage( CVMWebserverMessage * msg ) = 0;
+
+	/**
+	 * Return the statistics of the egress queue
+	 */
+	virtual CVMWebserverEgressStats getEgressStats() = 0;
+
+	/**
+	 * Callback installed by the webserver, that should be fired every time
+	 * a new frame is placed in the egress queue, in order to wake up the
+	 * I/O loop and flush it.
+	 */
+	boost::function<void()>	egressNotify;
 
 };
 
@@ -92,7 +121,11 @@ public:
 };
 
 /**
- * Record for tracking connections and their state
+ * Record for tracking connections and their state.
+ *
+ * The record is attached to the mongoose connection through it's
+ * connection_param and it's linked on the intrusive list of the
+ * active connections of the webserver.
  */
 class CVMWebserverConnection {
 public:
@@ -101,16 +134,18 @@ public:
 	 * Constructor of the CVMWebserverConnection registry entry
 	 */
 	CVMWebserverConnection(CVMWebserverConnectionHandler * handler)
-	 : h(handler), isIterated(false) { };
+	 : h(handler), prev(NULL), next(NULL), deflate(), message(), deflated() { };
 
 	/**
-	 * Cleanup function before destruction
+	 * Cleanup function before destruction. Returns false if the
+	 * handler was abandoned, because it's still in use.
 	 */
-	void cleanup() {
-		if (h != NULL) {
-			h->cleanup();
-			delete h;
-		 }
+	bool cleanup() {
+		if (h == NULL) return true;
+		bool released = h->cleanup();
+		if (released) delete h;
+		h = NULL;
+		return released;
 	}
 
 	/**
@@ -119,9 +154,21 @@ public:
 	CVMWebserverConnectionHandler *	h;
 
 	/**
-	 * Internal flag used to track lost connections
+	 * Previous and next entries in the list of active connections
+	 */
+	CVMWebserverConnection *		prev;
+	CVMWebserverConnection *		next;
+
+	/**
+	 * The permessage-deflate state of the websocket
 	 */
-	bool isIterated;
+	CVMWebsocketDeflate 			deflate;
+
+	/**
+	 * Scratch space of the I/O thread, re-used across flushes
+	 */
+	CVMWebserverMessage 			message;
+	std::string 					deflated;
 
 };
 
@@ -133,15 +180,29 @@ class CVMWebserver {
 public:
 
 	/**
-	 * Create a webserver and setup listening port
+	 * Create a webserver and setup listening port.
+	 *
+	 * If more than one reactors are requested, the additional reactors share
+	 * the listening socket of this server and are polled by their own threads,
+	 * which start with the first poll() of this server. Every connection stays
+	 * on the reactor that accepted it. Passing 0 creates one reactor per CPU
+	 * core.
 	 */
-	CVMWebserver( CVMWebserverConnectionFactory& factory, const int port = CERNVM_WEBAPI_PORT );
+	CVMWebserver( CVMWebserverConnectionFactory& factory, const int port = CERNVM_WEBAPI_PORT, const int reactorCount = 1 );
 
 	/**
 	 * Cleanup and destroy server
 	 */
 	virtual ~CVMWebserver();
 
+	/**
+	 * Stop all the reactors and wait for the closed connections to be
+	 * released. Returns false if some of them were abandoned, because
+	 * their tasks did not finish in time. Their tasks can still wake up
+	 * the webserver, so it must then be left to the process exit.
+	 */
+	bool shutdown();
+
 	/**
 	 * Poll server for incoming events. 
 	 * This function should be called periodically to receive events.
@@ -160,6 +221,17 @@ public:
 	 */
 	bool hasLiveConnections();
 
+	/**
+	 * Collect the egress queue statistics of all the active connections
+	 */
+	CVMWebserverEgressStats getEgressStats();
+
+	/**
+	 * Wake up the server from a blocking poll() in order to flush
+	 * the egress queues. This function is thread-safe and never blocks.
+	 */
+	void wakeup();
+
 public:
 
 	/**
@@ -168,27 +240,68 @@ public:
 	void serve_static( const std::string& url, const std::string& file );
 
 	/**
-	 * Register a static URL handler
+	 * Register a static URL handler. The reactors read it without locking,
+	 * so it must be registered before the first poll().
 	 */
 	void setStaticURLHandler( CVMWebserverStaticURLHandler * handler );
 
 private:
 
 	/**
-	 * A list of active webserver connections
+	 * The head of the list of active webserver connections
 	 */
-	std::map<mg_connection*, CVMWebserverConnection*> 	connections;
+	CVMWebserverConnection * 	connections;
 
 	/**
-	 * Mutex for accessing the connections array
+	 * Mutex for accessing the connections list
 	 */
 	boost::mutex connMutex;
 
+	/**
+	 * Tag of the constructor of the additional reactors
+	 */
+	struct ReactorOf {
+		explicit ReactorOf( CVMWebserver& primary ) : primary(primary) { };
+		CVMWebserver& primary;
+	};
+
+	/**
+	 * Create an additional reactor that shares the listening
+	 * socket of the primary webserver.
+	 */
+	CVMWebserver( const ReactorOf& reactorOf );
+
+	/**
+	 * Main loop of the additional reactor threads
+	 */
+	void reactorThread();
+
 	/**
 	 * The mongoose server instance
 	 */
 	mg_server*	server;
 
+	/**
+	 * The additional reactors spawned by the primary webserver
+	 */
+	std::vector< CVMWebserver* > reactors;
+
+	/**
+	 * The threads polling the additional reactors
+	 */
+	boost::thread_group reactorThreads;
+
+	/**
+	 * Flag raised when an additional reactor should exit
+	 */
+	bool reactorExit;
+
+	/**
+	 * Flag raised when the threads of the additional reactors are started
+	 * (only accessed by the thread that polls the primary webserver)
+	 */
+	bool reactorsStarted;
+
 	/**
 	 * The factory used for connection handler creation
 	 */
@@ -204,6 +317,87 @@ private:
 	 */
 	std::map< std::string, std::string > staticResources;
 
+	/**
+	 * Flag raised when there are pending egress data that were not
+	 * yet flushed by poll()
+	 */
+	bool egressPending;
+
+	/**
+	 * Flag raised when the wakeup thread should interrupt mongoose
+	 */
+	bool wakeupRequested;
+
+	/**
+	 * Flag raised when the wakeup thread should exit
+	 */
+	bool wakeupExit;
+
+	/**
+	 * Mutex and condition variable that control the wakeup thread
+	 */
+	boost::mutex wakeupMutex;
+	boost::condition_variable wakeupCond;
+
+	/**
+	 * The thread that forwards wakeup requests to mongoose
+	 */
+	boost::thread* wakeupThreadPtr;
+
+	/**
+	 * Wakeup thread main loop
+	 */
+	void wakeupThread();
+
+	/**
+	 * The primary webserver, whose reapers release the closed
+	 * connections of all the reactors (points to ourselves on
+	 * the primary).
+	 */
+	CVMWebserver* primary;
+
+	/**
+	 * Closed connections waiting to be cleaned up. The cleanup of a
+	 * connection handler can block for a while, so it never runs on
+	 * the I/O threads.
+	 */
+	std::deque< CVMWebserverConnection* > reapQueue;
+
+	/**
+	 * Mutex and condition variable that control the reaper threads
+	 */
+	boost::mutex reapMutex;
+	boost::condition_variable reapCond;
+
+	/**
+	 * The number of reaper threads running (protected by reapMutex).
+	 * They are started on demand, and exit when the queue is empty.
+	 */
+	size_t reapActive;
+
+	/**
+	 * The number of connection handlers that were abandoned
+	 * by the reapers (protected by reapMutex)
+	 */
+	size_t reapAbandoned;
+
+	/**
+	 * Hand a closed connection to the reapers of the primary webserver
+	 */
+	void reap( CVMWebserverConnection * c );
+
+	/**
+	 * Reaper thread main loop
+	 */
+	void reaperThread();
+
+	/**
+	 * Stop the wakeup thread, destroy the mongoose server and hand the
+	 * remaining connections to the reapers. The object itself stays valid,
+	 * since the connections being reaped can still wake it up.
+	 */
+	void stop();
+
 	/**
 	 * Iterator over the websocket connections
 	 */
@@ -214,11 +408,32 @@ private:
 	 */
 	static int 	api_handler(struct mg_connection *conn);
 
+	/**
+	 * Complete the websocket handshake, negotiating the extensions we support
+	 */
+	static int 	handshake_handler(struct mg_connection *conn);
+
+	/**
+	 * Release the connection handler when mongoose closes the connection
+	 */
+	static int 	close_handler(struct mg_connection *conn);
+
 	/**
 	 * Raw event handler
 	 */
 	static int ev_handler(struct mg_connection *conn, enum mg_event ev);
 
+	/**
+	 * Link/Unlink a connection record to the list of active connections
+	 */
+	void 		linkConnection( CVMWebserverConnection * c );
+	void 		unlinkConnection( CVMWebserverConnection * c );
+
+	/**
+	 * Create the connection record of a websocket and attach it to the mongoose connection
+	 */
+	CVMWebserverConnection * 	attachConnection( struct mg_connection *conn );
+
 };
 
 #endif /* end of include guard: WEBSERVER_H */
\ No newline at end of file
@@ -0,0 +1,210 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "wsdeflate.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include <CernVM/Utilities.h>
+#include <CernVM/CrashReport.h>
+
+/**
+ * The trailer that permessage-deflate strips from every message
+ */
+static const unsigned char DEFLATE_TRAILER[4] = { 0x00, 0x00, 0xff, 0xff };
+
+/**
+ * Trim whitespace around a header token
+ */
+static std::string trim( const std::string& str ) {
+	size_t b = str.find_first_not_of(" \t"), e = str.find_last_not_of(" \t");
+	if (b == std::string::npos) return "";
+	return str.substr(b, e - b + 1);
+}
+
+/**
+ * Initialize an inactive deflate context
+ */
+CVMWebsocketDeflate::CVMWebsocketDeflate() : active(false), noContextTakeover(false) {
+	memset( &deflateStream, 0, sizeof(deflateStream) );
+	memset( &inflateStream, 0, sizeof(inflateStream) );
+}
+
+/**
+ * Release zlib streams
+ */
+CVMWebsocketDeflate::~CVMWebsocketDeflate() {
+	if (active) {
+		deflateEnd( &deflateStream );
+		inflateEnd( &inflateStream );
+	}
+}
+
+/**
+ * Negotiate the extension using the client offers
+ */
+bool CVMWebsocketDeflate::negotiate( const char * offer, std::string * response ) {
+	CRASH_REPORT_BEGIN;
+	if ((offer == NULL) || active) return false;
+
+	// Check every offer until we find one we can accept
+	std::string offers = offer;
+	size_t start = 0;
+	while (start < offers.length()) {
+		size_t end = offers.find(',', start);
+		if (end == std::string::npos) end = offers.length();
+		std::string item = offers.substr(start, end - start);
+		start = end + 1;
+
+		// Split extension name and parameters
+		std::string name = trim(item.substr(0, item.find(';')));
+		if (name != "permessage-deflate") continue;
+
+		// Process parameters
+		bool acceptable = true, noTakeover = false;
+		int windowBits = 15;
+		std::ostringstream oss;
+		oss << "permessage-deflate";
+		size_t pStart = item.find(';');
+		while (acceptable && (pStart != std::string::npos)) {
+			size_t pEnd = item.find(';', pStart + 1);
+			std::string param = trim(item.substr(pStart + 1, (pEnd == std::string::npos) ? std::string::npos : pEnd - pStart - 1));
+			pStart = pEnd;
+
+			std::string pName = trim(param.substr(0, param.find('='))), pValue = "";
+			if (param.find('=') != std::string::npos)
+				pValue = trim(param.substr(param.find('=') + 1));
+			if (!pValue.empty() && (pValue[0] == '"'))
+				pValue = pValue.substr(1, pValue.length() - 2);
+
+			if (pName == "server_no_context_takeover") {
+				noTakeover = true;
+				oss << "; server_no_context_takeover";
+			} else if (pName == "server_max_window_bits") {
+				// zlib does not properly support 8-bit windows
+				windowBits = atoi(pValue.c_str());
+				if ((windowBits < 9) || (windowBits > 15)) acceptable = false;
+				oss << "; server_max_window_bits=" << windowBits;
+			} else if ((pName == "client_no_context_takeover") || (pName == "client_max_window_bits")) {
+				// Our inflate stream handles every client configuration
+			} else {
+				acceptable = false;
+			}
+		}
+		if (!acceptable) continue;
+
+		// Initialize raw deflate/inflate streams
+		if (deflateInit2( &deflateStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -windowBits, 8, Z_DEFAULT_STRATEGY ) != Z_OK)
+			return false;
+		if (inflateInit2( &inflateStream, -15 ) != Z_OK) {
+			deflateEnd( &deflateStream );
+			return false;
+		}
+
+		// We are active
+		CVMWA_LOG("Debug", "Negotiated websocket extension '" << oss.str() << "'");
+		noContextTakeover = noTakeover;
+		active = true;
+		*response = oss.str();
+		return true;
+
+	}
+
+	return false;
+	CRASH_REPORT_END;
+}
+
+/**
+ * Compress an egress message
+ */
+bool CVMWebsocketDeflate::compress( const CVMWebserverMessage& msg, std::string * out ) {
+	CRASH_REPORT_BEGIN;
+	if (!active) return false;
+
+	// Small messages are not worth it
+	size_t len = 0;
+	for (CVMWebserverMessage::const_iterator it = msg.begin(); it != msg.end(); ++it)
+		len += (*it)->data.length();
+	if (len < CVMWS_DEFLATE_THRESHOLD) return false;
+
+	// Compress all the buffers and flush to a byte boundary after the last one
+	unsigned char chunk[4096];
+	out->clear();
+	for (CVMWebserverMessage::const_iterator it = msg.begin(); it != msg.end(); ++it) {
+		const int flush = ((it + 1) == msg.end()) ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+		deflateStream.next_in = (Bytef*) (*it)->data.c_str();
+		deflateStream.avail_in = (*it)->data.length();
+		do {
+			deflateStream.next_out = chunk;
+			deflateStream.avail_out = sizeof(chunk);
+			if (deflate( &deflateStream, flush ) == Z_STREAM_ERROR)
+				return false;
+			out->append( (const char*) chunk, sizeof(chunk) - deflateStream.avail_out );
+		} while (deflateStream.avail_out == 0);
+	}
+
+	// Strip the empty block trailer
+	if ((out->length() >= 4) && (memcmp( out->c_str() + out->length() - 4, DEFLATE_TRAILER, 4 ) == 0))
+		out->resize( out->length() - 4 );
+
+	// Forget history if requested
+	if (noContextTakeover)
+		deflateReset( &deflateStream );
+
+	return true;
+	CRASH_REPORT_END;
+}
+
+/**
+ * Decompress an ingress message
+ */
+bool CVMWebsocketDeflate::decompress( const char * data, const size_t len, std::string * out ) {
+	CRASH_REPORT_BEGIN;
+	if (!active) return false;
+
+	// Restore the stripped trailer
+	std::string payload( data, len );
+	payload.append( (const char*) DEFLATE_TRAILER, 4 );
+
+	// Inflate everything
+	unsigned char chunk[4096];
+	out->clear();
+	inflateStream.next_in = (Bytef*) payload.c_str();
+	inflateStream.avail_in = payload.length();
+	do {
+		inflateStream.next_out = chunk;
+		inflateStream.avail_out = sizeof(chunk);
+		int ret = inflate( &inflateStream, Z_SYNC_FLUSH );
+		if (ret == Z_BUF_ERROR) break;
+		if ((ret != Z_OK) && (ret != Z_STREAM_END))
+			return false;
+		out->append( (const char*) chunk, sizeof(chunk) - inflateStream.avail_out );
+
+		// Don't let a small frame inflate to an arbitrary size
+		if (out->length() > CVMWS_INFLATE_MAX_BYTES)
+			return false;
+
+	} while ((inflateStream.avail_in > 0) || (inflateStream.avail_out == 0));
+
+	return true;
+	CRASH_REPORT_END;
+}
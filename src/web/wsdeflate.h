@@ -0,0 +1,102 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef WSDEFLATE_H
+#define WSDEFLATE_H
+
+#include "buffer.h"
+
+#include <zlib.h>
+#include <string>
+
+// Frames smaller than this are sent uncompressed
+#define CVMWS_DEFLATE_THRESHOLD		128
+
+// Incoming messages are not inflated beyond this size
+#define CVMWS_INFLATE_MAX_BYTES		(4 * 1024 * 1024)
+
+/**
+ * The per-connection state of the permessage-deflate websocket
+ * extension (RFC 7692).
+ *
+ * The compression context is kept across messages (context takeover),
+ * so the JSON keys repeated on every event compress to a few bytes.
+ */
+class CVMWebsocketDeflate {
+public:
+
+	/**
+	 * Initialize an inactive deflate context
+	 */
+	CVMWebsocketDeflate();
+
+	/**
+	 * Release zlib streams
+	 */
+	~CVMWebsocketDeflate();
+
+	/**
+	 * Process the Sec-WebSocket-Extensions header of the handshake request.
+	 * If permessage-deflate was offered and we can accept it, the extension
+	 * is activated and the response header value is placed in ``response``.
+	 */
+	bool 			negotiate( const char * offer, std::string * response );
+
+	/**
+	 * Compress the buffers of the given message. Returns false if the message
+	 * should be sent uncompressed (extension inactive, message too small or error).
+	 */
+	bool 			compress( const CVMWebserverMessage& msg, std::string * out );
+
+	/**
+	 * Decompress the payload of an incoming frame with the RSV1 bit set.
+	 * Fails if the data is corrupt, or if it inflates to more than
+	 * CVMWS_INFLATE_MAX_BYTES (then ``out`` is left longer than that).
+	 */
+	bool 			decompress( const char * data, const size_t len, std::string * out );
+
+	/**
+	 * Check if the extension was negotiated
+	 */
+	bool 			isActive() { return active; };
+
+private:
+
+	/**
+	 * Flag raised when the extension is negotiated
+	 */
+	bool 			active;
+
+	/**
+	 * Reset the compression context after every message, because
+	 * the client asked for server_no_context_takeover.
+	 */
+	bool 			noContextTakeover;
+
+	/**
+	 * The zlib streams for egress and ingress
+	 */
+	z_stream 		deflateStream;
+	z_stream 		inflateStream;
+
+};
+
+#endif /* end of include guard: WSDEFLATE_H */
@@ -0,0 +1,336 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "worker_pool.h"
+
+#include <boost/bind.hpp>
+
+#include <CernVM/Utilities.h>
+#include <CernVM/CrashReport.h>
+
+/**
+ * Create an idle pool
+ */
+WorkerPool::WorkerPool() : pendingMutex(), stopping(false) {
+	for (int i = 0; i < WORKER_LANES; ++i) {
+		cursor[i] = 0;
+		pending[i] = 0;
+	}
+}
+
+/**
+ * Stop the pool
+ */
+WorkerPool::~WorkerPool() {
+	stop();
+}
+
+/**
+ * Start the workers
+ */
+void WorkerPool::start( int interactiveWorkers, int longWorkers, int blockingWorkers ) {
+	CRASH_REPORT_BEGIN;
+	int cores = boost::thread::hardware_concurrency();
+	if (cores < 2) cores = 2;
+
+	// Long-running tasks mostly wait for the hypervisor, so they get at
+	// least a few workers even on small hosts. The tasks waiting for the
+	// network or the user have a lane of their own, so they can't hold
+	// up the polls and the closing of the sessions.
+	int count[WORKER_LANES];
+	count[WORKER_LANE_INTERACTIVE] = (interactiveWorkers > 0) ? interactiveWorkers : cores;
+	count[WORKER_LANE_LONG] = (longWorkers > 0) ? longWorkers : ((cores < 4) ? 4 : cores);
+	count[WORKER_LANE_BLOCKING] = (blockingWorkers > 0) ? blockingWorkers : WORKER_BLOCKING_DEFAULT;
+
+	// Create the queues before starting any thread, since workers steal from each other
+	for (int lane = 0; lane < WORKER_LANES; ++lane) {
+		for (int i = 0; i < count[lane]; ++i) {
+			Worker * worker = new Worker();
+			worker->lane = lane;
+			worker->thread = NULL;
+			worker->running = NULL;
+			workers[lane].push_back( worker );
+		}
+	}
+	for (int lane = 0; lane < WORKER_LANES; ++lane) {
+		for (std::vector< Worker* >::iterator it = workers[lane].begin(); it != workers[lane].end(); ++it)
+			(*it)->thread = new boost::thread( boost::bind( &WorkerPool::run, this, *it ) );
+	}
+
+	CVMWA_LOG("Debug", "Started " << count[WORKER_LANE_INTERACTIVE] << " interactive, " << count[WORKER_LANE_LONG] << " long-running and "
+		<< count[WORKER_LANE_BLOCKING] << " blocking workers");
+	CRASH_REPORT_END;
+}
+
+/**
+ * Wait for the queued tasks and join the workers
+ */
+void WorkerPool::stop() {
+	CRASH_REPORT_BEGIN;
+
+	// Let the workers exit when their lane is drained
+	{
+		boost::mutex::scoped_lock lock(pendingMutex);
+		stopping = true;
+	}
+	for (int lane = 0; lane < WORKER_LANES; ++lane)
+		pendingCondition[lane].notify_all();
+
+	// Join all of them before releasing any, since the workers
+	// still steal from the queues of their siblings
+	for (int lane = 0; lane < WORKER_LANES; ++lane) {
+		for (std::vector< Worker* >::iterator it = workers[lane].begin(); it != workers[lane].end(); ++it)
+			(*it)->thread->join();
+	}
+	{
+		boost::mutex::scoped_lock lock(pendingMutex);
+		for (int lane = 0; lane < WORKER_LANES; ++lane) {
+			for (std::vector< Worker* >::iterator it = workers[lane].begin(); it != workers[lane].end(); ++it) {
+				delete (*it)->thread;
+				delete *it;
+			}
+			workers[lane].clear();
+		}
+	}
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Queue a task
+ */
+void WorkerPool::submit( const WorkerTask& task, int lane, const void * group ) {
+	CRASH_REPORT_BEGIN;
+	Job job;
+	job.task = task;
+	job.group = group;
+
+	// Spread the tasks across the workers of the lane
+	{
+		boost::mutex::scoped_lock lock(pendingMutex);
+		if (workers[lane].empty()) {
+			CVMWA_LOG("Error", "Dropping task submitted to a stopped worker pool");
+			return;
+		}
+		Worker * worker = workers[lane][ cursor[lane]++ % workers[lane].size() ];
+		{
+			boost::mutex::scoped_lock workerLock(worker->mutex);
+			worker->jobs.push_back( job );
+		}
+		pending[lane]++;
+	}
+	pendingCondition[lane].notify_one();
+
+	CRASH_REPORT_END;
+}
+
+/**
+ * Interrupt the running tasks of a group
+ */
+void WorkerPool::interrupt( const void * group ) {
+	CRASH_REPORT_BEGIN;
+
+	// The workers are released by stop() under the same lock
+	boost::mutex::scoped_lock pendingLock(pendingMutex);
+	for (int lane = 0; lane < WORKER_LANES; ++lane) {
+		for (std::vector< Worker* >::iterator it = workers[lane].begin(); it != workers[lane].end(); ++it) {
+			boost::mutex::scoped_lock lock((*it)->mutex);
+			if ((*it)->running == group)
+				(*it)->thread->interrupt();
+		}
+	}
+	CRASH_REPORT_END;
+}
+
+/**
+ * Pop a job of the worker or steal one from its siblings
+ */
+bool WorkerPool::take( Worker * worker, Job * job ) {
+	std::vector< Worker* >& lane = workers[worker->lane];
+
+	// Our own queue first (oldest first), then the newest
+	// job of the other workers of the lane. The group of the job is
+	// marked as running before the job leaves the queue, so
+	// interrupt() never misses a job that is about to start.
+	bool found = false;
+	{
+		boost::mutex::scoped_lock lock(worker->mutex);
+		if (!worker->jobs.empty()) {
+			*job = worker->jobs.front();
+			worker->jobs.pop_front();
+			worker->running = job->group;
+			found = true;
+		}
+	}
+	for (std::vector< Worker* >::iterator it = lane.begin(); !found && (it != lane.end()); ++it) {
+		if (*it == worker) continue;
+
+		// Two workers can steal from each other, so both locks are
+		// taken together
+		boost::unique_lock< boost::mutex > ownLock(worker->mutex, boost::defer_lock);
+		boost::unique_lock< boost::mutex > lock((*it)->mutex, boost::defer_lock);
+		boost::lock( ownLock, lock );
+		if (!(*it)->jobs.empty()) {
+			*job = (*it)->jobs.back();
+			(*it)->jobs.pop_back();
+			worker->running = job->group;
+			found = true;
+		}
+	}
+	if (!found) return false;
+
+	{
+		boost::mutex::scoped_lock lock(pendingMutex);
+		pending[worker->lane]--;
+	}
+	return true;
+}
+
+/**
+ * The main loop of a worker
+ */
+void WorkerPool::run( Worker * worker ) {
+	Job job;
+	while (true) {
+
+		// Wait for tasks in our lane
+		{
+			boost::mutex::scoped_lock lock(pendingMutex);
+			while (!stopping && (pending[worker->lane] == 0))
+				pendingCondition[worker->lane].wait(lock);
+			if (stopping && (pending[worker->lane] == 0))
+				return;
+		}
+		if (!take( worker, &job ))
+			continue;
+
+		// Run the task
+		try {
+			job.task();
+		} catch (boost::thread_interrupted &e) {
+			// Interrupted
+		} catch (...) {
+			CVMWA_LOG("Error", "Unhandled exception in worker task");
+		}
+		job.task.clear();
+
+		// We are no longer running tasks of this group
+		{
+			boost::mutex::scoped_lock lock(worker->mutex);
+			worker->running = NULL;
+		}
+
+		// Forget an interruption that arrived after the task was over,
+		// so it does not hit the next task.
+		if (boost::this_thread::interruption_requested()) {
+			try {
+				boost::this_thread::interruption_point();
+			} catch (boost::thread_interrupted &e) {
+			}
+		}
+
+	}
+}
+
+/**
+ * Queue a task on the strand
+ */
+void WorkerStrand::post( const WorkerTask& task, int lane, const void * group ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(mutex);
+	Job job;
+	job.task = task;
+	job.lane = lane;
+	job.group = group;
+	jobs.push_back( job );
+
+	// Schedule the strand if it's idle
+	if (!running) {
+		running = true;
+		pool.submit( boost::bind( &WorkerStrand::run, shared_from_this() ), lane, group );
+	}
+	CRASH_REPORT_END;
+}
+
+/**
+ * Run the next task of the strand
+ */
+void WorkerStrand::run() {
+	Job job;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		job = jobs.front();
+		jobs.pop_front();
+	}
+
+	// Run the task, making sure the strand goes on even if it was interrupted
+	try {
+		job.task();
+	} catch (boost::thread_interrupted &e) {
+		// Interrupted
+	} catch (...) {
+		CVMWA_LOG("Error", "Unhandled exception in strand task");
+	}
+
+	// Schedule the next one
+	boost::mutex::scoped_lock lock(mutex);
+	if (jobs.empty()) {
+		running = false;
+	} else {
+		pool.submit( boost::bind( &WorkerStrand::run, shared_from_this() ), jobs.front().lane, jobs.front().group );
+	}
+}
+
+/**
+ * Start the preparation, or leave a continuation if it's already running
+ */
+bool PreparationGate::enter( const WorkerTask& retry, int lane, const void * group ) {
+	CRASH_REPORT_BEGIN;
+	boost::mutex::scoped_lock lock(mutex);
+	if (!running) {
+		running = true;
+		return true;
+	}
+	if (retry) {
+		Job job;
+		job.task = retry;
+		job.lane = lane;
+		job.group = group;
+		parked.push_back( job );
+	}
+	return false;
+	CRASH_REPORT_END;
+}
+
+/**
+ * The preparation is over, queue the continuations
+ */
+void PreparationGate::leave() {
+	CRASH_REPORT_BEGIN;
+	std::vector< Job > jobs;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		running = false;
+		jobs.swap( parked );
+	}
+	for (std::vector< Job >::iterator it = jobs.begin(); it != jobs.end(); ++it)
+		pool.submit( it->task, it->lane, it->group );
+	CRASH_REPORT_END;
+}
@@ -0,0 +1,246 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef DAEMON_WORKER_POOL_H
+#define DAEMON_WORKER_POOL_H
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <vector>
+
+// The lanes of the worker pool
+#define WORKER_LANE_INTERACTIVE		0 	// Short actions a user is waiting for
+#define WORKER_LANE_LONG			1 	// Long-running actions (VM power, polls, closing sessions)
+#define WORKER_LANE_BLOCKING		2 	// Actions blocked on the network or the user (session requests, installation)
+#define WORKER_LANES				3
+
+// The default number of workers of the blocking lane. It's bounded
+// regardless of the host, since these workers mostly wait.
+#define WORKER_BLOCKING_DEFAULT		4
+
+/**
+ * A task that runs on the worker pool
+ */
+typedef boost::function< void() >	WorkerTask;
+
+/**
+ * A bounded pool of worker threads shared by the whole daemon.
+ *
+ * Every lane has its own workers, so long-running actions cannot starve
+ * the interactive ones. Every worker has its own queue: tasks are spread
+ * across the workers of their lane, and an idle worker steals from the
+ * back of the queues of its busy siblings.
+ */
+class WorkerPool {
+public:
+
+	/**
+	 * Create an idle pool
+	 */
+	WorkerPool();
+
+	/**
+	 * Stop the pool and join the workers
+	 */
+	~WorkerPool();
+
+	/**
+	 * Start the given number of workers for every lane. A count of
+	 * zero sizes the lane to the host.
+	 */
+	void 				start( int interactiveWorkers = 0, int longWorkers = 0, int blockingWorkers = 0 );
+
+	/**
+	 * Wait for the queued tasks to complete and join the workers
+	 */
+	void 				stop();
+
+	/**
+	 * Queue a task in the given lane. The optional group is used to
+	 * interrupt all the running tasks of the same owner.
+	 */
+	void 				submit( const WorkerTask& task, int lane = WORKER_LANE_INTERACTIVE, const void * group = NULL );
+
+	/**
+	 * Interrupt the tasks of the given group that are currently running
+	 */
+	void 				interrupt( const void * group );
+
+private:
+
+	/**
+	 * A queued task
+	 */
+	struct Job {
+		WorkerTask 		task;
+		const void * 	group;
+	};
+
+	/**
+	 * A worker thread and its queue
+	 */
+	struct Worker {
+		int 				lane;
+		boost::thread * 	thread;
+		std::deque< Job > 	jobs;
+		boost::mutex 		mutex;
+		const void * 		running;
+	};
+
+	/**
+	 * The main loop of a worker
+	 */
+	void 				run( Worker * worker );
+
+	/**
+	 * Pop a job from the queue of the worker, or steal one from
+	 * the other workers of the same lane.
+	 */
+	bool 				take( Worker * worker, Job * job );
+
+	/**
+	 * The workers of every lane
+	 */
+	std::vector< Worker* >		workers[WORKER_LANES];
+
+	/**
+	 * Round-robin cursor for spreading the tasks of every lane
+	 */
+	size_t 						cursor[WORKER_LANES];
+
+	/**
+	 * Number of queued tasks of every lane, used for waking up the workers
+	 */
+	size_t 						pending[WORKER_LANES];
+	boost::mutex 				pendingMutex;
+	boost::condition_variable 	pendingCondition[WORKER_LANES];
+
+	/**
+	 * Flag raised when the pool is stopping
+	 */
+	bool 						stopping;
+
+};
+
+/**
+ * A serial queue of tasks on top of the worker pool. Tasks posted to
+ * the same strand run one after the other, in the order they were
+ * posted, while the tasks of different strands run in parallel.
+ */
+class WorkerStrand : public boost::enable_shared_from_this< WorkerStrand > {
+public:
+
+	/**
+	 * Create a strand on the given pool
+	 */
+	WorkerStrand( WorkerPool& pool ) : pool(pool), jobs(), mutex(), running(false) { };
+
+	/**
+	 * Queue a task. It runs in the given lane after all the
+	 * tasks posted before it are completed.
+	 */
+	void 				post( const WorkerTask& task, int lane = WORKER_LANE_INTERACTIVE, const void * group = NULL );
+
+private:
+
+	/**
+	 * A queued task and its lane
+	 */
+	struct Job {
+		WorkerTask 		task;
+		int 			lane;
+		const void * 	group;
+	};
+
+	/**
+	 * Run the next task and schedule the one after it
+	 */
+	void 				run();
+
+	WorkerPool& 		pool;
+	std::deque< Job > 	jobs;
+	boost::mutex 		mutex;
+	bool 				running;
+
+};
+
+typedef boost::shared_ptr< WorkerStrand >	WorkerStrandPtr;
+
+/**
+ * Runs a preparation shared by many tasks (like the keystore update) one
+ * at a time, without holding a worker for every task that needs it. A
+ * task that finds the preparation running leaves a continuation, which is
+ * submitted to the pool when the preparation is over, and returns.
+ */
+class PreparationGate {
+public:
+
+	/**
+	 * Create a gate on the given pool
+	 */
+	PreparationGate( WorkerPool& pool ) : pool(pool), parked(), mutex(), running(false) { };
+
+	/**
+	 * Start the preparation. Returns false if it's already running, in
+	 * which case ``retry`` (if given) is queued in the given lane when
+	 * it's over. Otherwise the caller must call leave() when it's done.
+	 */
+	bool 				enter( const WorkerTask& retry = WorkerTask(), int lane = WORKER_LANE_INTERACTIVE, const void * group = NULL );
+
+	/**
+	 * Mark the preparation as over, and queue the tasks that waited for it
+	 */
+	void 				leave();
+
+	/**
+	 * Leaves the gate when it goes out of scope
+	 */
+	class Scope {
+	public:
+		Scope( PreparationGate& gate ) : gate(gate) { };
+		~Scope() { gate.leave(); };
+	private:
+		PreparationGate& 	gate;
+	};
+
+private:
+
+	/**
+	 * A continuation and its lane
+	 */
+	struct Job {
+		WorkerTask 		task;
+		int 			lane;
+		const void * 	group;
+	};
+
+	WorkerPool& 		pool;
+	std::vector< Job > 	parked;
+	boost::mutex 		mutex;
+	bool 				running;
+
+};
+
+#endif /* end of include guard: DAEMON_WORKER_POOL_H */
@@ -0,0 +1,76 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef TESTS_BENCH_H
+#define TESTS_BENCH_H
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * A minimal micro-benchmark harness.
+ *
+ * Every case runs its body once to warm-up, then ``iterations`` times,
+ * and prints the average time per iteration (and the throughput, when
+ * the number of bytes processed per iteration is given). It returns the
+ * average time per iteration in nanoseconds.
+ *
+ * The iterations can be scaled with the BENCH_SCALE environment variable
+ * (for example BENCH_SCALE=10 for more stable numbers).
+ */
+template <typename Body>
+inline double benchmark( const char * name, size_t iterations, size_t bytes, Body body ) {
+	const char * scale = getenv( "BENCH_SCALE" );
+	if ((scale != NULL) && (atoi(scale) > 0))
+		iterations *= atoi(scale);
+
+	body();
+	boost::posix_time::ptime started = boost::posix_time::microsec_clock::universal_time();
+	for (size_t i = 0; i < iterations; ++i)
+		body();
+	double usec = (double)(boost::posix_time::microsec_clock::universal_time() - started).total_microseconds();
+
+	// Long iterations are printed in milliseconds
+	double perIteration = usec * 1000.0 / iterations;
+	if (perIteration >= 1000000.0) {
+		printf( "%-44s %12.2f ms/op", name, perIteration / 1000000.0 );
+	} else {
+		printf( "%-44s %12.1f ns/op", name, perIteration );
+	}
+	if (bytes > 0)
+		printf( " %10.1f MB/s", (usec > 0) ? ((double)bytes * iterations / usec) : 0.0 );
+	printf( "\n" );
+	return perIteration;
+}
+
+/**
+ * Keep the compiler from optimizing away a result
+ */
+template <typename T>
+inline void benchmarkKeep( const T& value ) {
+	static const void * volatile sink;
+	sink = &value;
+	(void) sink;
+}
+
+#endif /* end of include guard: TESTS_BENCH_H */
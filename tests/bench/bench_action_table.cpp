@@ -0,0 +1,85 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "action_table.h"
+
+#include <map>
+#include <string>
+
+typedef ActionEntry< int > 	BenchAction;
+
+/**
+ * The names of the session actions
+ */
+static const BenchAction benchActions[] = {
+	{ "start", 0, 0, { } }, { "stop", 1, 0, { } }, { "pause", 2, 0, { } }, { "resume", 3, 0, { } },
+	{ "hibernate", 4, 0, { } }, { "reset", 5, 0, { } }, { "close", 6, 0, { } }, { "sync", 7, 0, { } },
+	{ "get", 8, 0, { } }, { "set", 9, 0, { } }, { "setProperty", 10, 0, { } }, { "batch", 11, 0, { } },
+};
+static const size_t benchCount = sizeof(benchActions) / sizeof(benchActions[0]);
+
+/**
+ * How the actions were dispatched before: a chain of string comparisons
+ */
+static int chain( const std::string& action ) {
+	if (action == "start") return 0;
+	else if (action == "stop") return 1;
+	else if (action == "pause") return 2;
+	else if (action == "resume") return 3;
+	else if (action == "hibernate") return 4;
+	else if (action == "reset") return 5;
+	else if (action == "close") return 6;
+	else if (action == "sync") return 7;
+	else if (action == "get") return 8;
+	else if (action == "set") return 9;
+	else if (action == "setProperty") return 10;
+	else if (action == "batch") return 11;
+	return -1;
+}
+
+int main() {
+	std::string names[benchCount];
+	for (size_t i = 0; i < benchCount; ++i)
+		names[i] = benchActions[i].name;
+
+	ActionTable< BenchAction > table( benchActions, benchCount );
+	std::map< std::string, int > index;
+	for (size_t i = 0; i < benchCount; ++i)
+		index[ benchActions[i].name ] = benchActions[i].handler;
+
+	// Look up every action in turn
+	size_t i = 0;
+	int found;
+	benchmark( "dispatch (if/else chain)", 2000000, 0, [&]() {
+		found = chain( names[i++ % benchCount] );
+		benchmarkKeep( found );
+	});
+	benchmark( "dispatch (std::map)", 2000000, 0, [&]() {
+		found = index.find( names[i++ % benchCount] )->second;
+		benchmarkKeep( found );
+	});
+	benchmark( "dispatch (ActionTable)", 2000000, 0, [&]() {
+		found = table.find( names[i++ % benchCount] )->handler;
+		benchmarkKeep( found );
+	});
+
+	return 0;
+}
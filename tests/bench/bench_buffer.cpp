@@ -0,0 +1,61 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "buffer.h"
+
+#include <boost/shared_ptr.hpp>
+#include <deque>
+#include <string>
+
+int main() {
+	const std::string frame = "{\"data\":[\"progress\",{\"message\":\"Downloading disk image\",\"progress\":42}],"
+							  "\"id\":\"b2ed9b7d-7a80-4c4b-9d51-5ea2b1c2a0f1\",\"name\":\"progress\",\"type\":\"event\"}";
+
+	// Producing a frame and releasing it after it's written
+	benchmark( "heap string (produce + release)", 1000000, frame.length(), [&]() {
+		boost::shared_ptr< std::string > buf( new std::string( frame ) );
+		benchmarkKeep( buf );
+	});
+	benchmark( "pooled buffer (produce + release)", 1000000, frame.length(), [&]() {
+		CVMWebserverBufferPtr buf = CVMWebserverBufferPool::wrap( frame );
+		benchmarkKeep( buf );
+	});
+
+	// Passing a queued frame from the egress queue to the I/O thread
+	std::deque< std::string > copies;
+	benchmark( "queue hand-off by copy", 1000000, frame.length(), [&]() {
+		copies.push_back( frame );
+		std::string out = copies.front();
+		copies.pop_front();
+		benchmarkKeep( out );
+	});
+	std::deque< CVMWebserverBufferPtr > refs;
+	CVMWebserverBufferPtr shared = CVMWebserverBufferPool::wrap( frame );
+	benchmark( "queue hand-off by reference", 1000000, frame.length(), [&]() {
+		refs.push_back( shared );
+		CVMWebserverBufferPtr out = refs.front();
+		refs.pop_front();
+		benchmarkKeep( out );
+	});
+
+	printf( "  %lu buffers allocated from the heap\n", (unsigned long) CVMWebserverBufferPool::allocations() );
+	return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "egress.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * An event storm: the progress, state and reply frames of a few
+ * sessions that are queued before the I/O loop gets to flush them
+ */
+static std::vector< CVMWebserverBufferPtr > makeBurst( int frames ) {
+	std::vector< CVMWebserverBufferPtr > burst;
+	for (int i = 0; i < frames; ++i) {
+		char frame[128];
+		snprintf( frame, sizeof(frame), "{\"data\":[\"Downloading\",%d],\"id\":\"%d\",\"name\":\"progress\",\"type\":\"event\"}\n", i, i % 4 );
+		burst.push_back( CVMWebserverBufferPool::wrap( frame ) );
+	}
+	return burst;
+}
+
+int main() {
+	const int sizes[] = { 4, 16, 64 };
+	for (int s = 0; s < 3; ++s) {
+		std::vector< CVMWebserverBufferPtr > burst = makeBurst( sizes[s] );
+		for (int batching = 0; batching < 2; ++batching) {
+			WebsocketEgressQueue queue( "bench" );
+			queue.setBatching( batching != 0 );
+
+			// Every message is written as one websocket frame, with one
+			// mg_websocket_write() and so one send() on the socket. The
+			// frames per burst are therefore the proxy of the syscalls
+			// that the I/O loop makes during an event storm.
+			size_t messages = 0, bursts = 0;
+			char label[64];
+			snprintf( label, sizeof(label), "burst of %d frames (%s)", sizes[s], batching ? "batched" : "one by one" );
+			benchmark( label, 20000, 0, [&]() {
+				bursts++;
+				for (std::vector< CVMWebserverBufferPtr >::iterator it = burst.begin(); it != burst.end(); ++it)
+					queue.push( *it );
+				CVMWebserverMessage msg;
+				while (queue.pop( &msg )) {
+					messages++;
+					msg.clear();
+				}
+			});
+			snprintf( label, sizeof(label), "  websocket frames / writes (%s)", batching ? "batched" : "one by one" );
+			printf( "%-44s %12.1f per burst\n", label, (double)messages / bursts );
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,239 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "webserver.h"
+#include "embedded.h"
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+
+// The port of the benchmark server (next to the one of the daemon)
+#define BENCH_PORT 		(CERNVM_WEBAPI_PORT + 1)
+
+/**
+ * The benchmark serves no embedded files
+ */
+const embedded_file * find_embedded_file( const std::string& name ) {
+	return NULL;
+}
+
+class LatencyFactory;
+
+/**
+ * A connection handler that only queues the frames of the benchmark
+ */
+class LatencyHandler : public CVMWebserverConnectionHandler {
+public:
+	LatencyHandler( LatencyFactory& factory ) : factory(factory), egress("bench") { };
+
+	virtual bool 			cleanup() { return true; };
+	virtual bool 			isConnected() { return true; };
+	virtual bool 			getEgressMessage( CVMWebserverMessage * msg ) { return egress.pop( msg ); };
+	virtual CVMWebserverEgressStats getEgressStats() { return egress.stats(); };
+	virtual void			handleRawData( const char * buffer, const size_t len );
+
+	// Queue a frame, like WebsocketAPI::sendRawData does
+	void 					send( const CVMWebserverBufferPtr& data ) {
+		egress.push( data );
+		egressNotify();
+	}
+
+private:
+	LatencyFactory& 		factory;
+	WebsocketEgressQueue 	egress;
+
+};
+
+/**
+ * Creates the handler of the benchmark connection
+ */
+class LatencyFactory : public CVMWebserverConnectionFactory {
+public:
+	LatencyFactory() : handler(NULL), mutex(), cond() { };
+
+	virtual CVMWebserverConnectionHandler * createHandler( const std::string& domain, const std::string uri ) {
+		return new LatencyHandler( *this );
+	}
+
+	// The first frame of the client tells us that the connection is attached
+	void 					attached( LatencyHandler * h ) {
+		boost::mutex::scoped_lock lock(mutex);
+		handler = h;
+		cond.notify_all();
+	}
+	LatencyHandler * 		waitAttached() {
+		boost::mutex::scoped_lock lock(mutex);
+		while (handler == NULL) cond.wait(lock);
+		return handler;
+	}
+
+private:
+	LatencyHandler * 		handler;
+	boost::mutex 			mutex;
+	boost::condition_variable cond;
+
+};
+
+void LatencyHandler::handleRawData( const char * buffer, const size_t len ) {
+	factory.attached( this );
+}
+
+/**
+ * The I/O loop of the daemon, blocking until there is I/O or a wakeup
+ */
+static void ioLoop( CVMWebserver * server, bool * exit, boost::mutex * exitMutex ) {
+	for (;;) {
+		{
+			boost::mutex::scoped_lock lock(*exitMutex);
+			if (*exit) return;
+		}
+		server->poll( CVMWS_POLL_FOREVER );
+	}
+}
+
+/**
+ * Read exactly ``len`` bytes from the socket
+ */
+static bool readAll( int fd, char * buf, size_t len ) {
+	while (len > 0) {
+		ssize_t n = recv( fd, buf, len, 0 );
+		if (n <= 0) return false;
+		buf += n; len -= n;
+	}
+	return true;
+}
+
+/**
+ * Read a server frame (unmasked, with a payload of less than 64 KiB)
+ */
+static bool readFrame( int fd, std::string * payload ) {
+	unsigned char hdr[4];
+	if (!readAll( fd, (char*)hdr, 2 )) return false;
+	size_t len = hdr[1] & 0x7f;
+	if (len == 126) {
+		if (!readAll( fd, (char*)hdr + 2, 2 )) return false;
+		len = (hdr[2] << 8) | hdr[3];
+	}
+	payload->resize( len );
+	return (len == 0) || readAll( fd, &(*payload)[0], len );
+}
+
+/**
+ * Open a websocket to the benchmark server and send it a frame
+ */
+static int connectClient() {
+	int fd = socket( AF_INET, SOCK_STREAM, 0 );
+	int one = 1;
+	setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one) );
+
+	struct sockaddr_in addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( BENCH_PORT );
+	addr.sin_addr.s_addr = inet_addr( "127.0.0.1" );
+	if (connect( fd, (struct sockaddr*)&addr, sizeof(addr) ) != 0) {
+		close( fd );
+		return -1;
+	}
+
+	// Handshake (without extensions, so the frames are not deflated)
+	const char request[] =
+		"GET / HTTP/1.1\r\n"
+		"Host: 127.0.0.1\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Sec-WebSocket-Version: 13\r\n\r\n";
+	send( fd, request, sizeof(request) - 1, 0 );
+	std::string response;
+	char c;
+	while (response.find("\r\n\r\n") == std::string::npos) {
+		if (recv( fd, &c, 1, 0 ) <= 0) {
+			close( fd );
+			return -1;
+		}
+		response += c;
+	}
+
+	// A masked text frame (with a zero mask) attaches the connection
+	const char hello[] = { (char)0x81, (char)0x82, 0, 0, 0, 0, 'h', 'i' };
+	send( fd, hello, sizeof(hello), 0 );
+	return fd;
+}
+
+int main() {
+	LatencyFactory factory;
+	CVMWebserver * server = new CVMWebserver( factory, BENCH_PORT );
+	bool exit = false;
+	boost::mutex exitMutex;
+	boost::thread io( boost::bind( &ioLoop, server, &exit, &exitMutex ) );
+
+	int fd = connectClient();
+	if (fd < 0) {
+		printf( "Unable to connect to the benchmark server\n" );
+		return 1;
+	}
+	LatencyHandler * handler = factory.waitAttached();
+
+	// The time from queuing a frame on an idle connection until the client
+	// reads it. The I/O loop is blocked in poll(), so every frame goes
+	// through a wakeup. A missed one would stall the benchmark.
+	CVMWebserverBufferPtr frame = CVMWebserverBufferPool::wrap( "{\"data\":[\"Downloading\",1],\"id\":\"1\",\"name\":\"progress\",\"type\":\"event\"}\n" );
+	std::string payload;
+	bool lost = false;
+	benchmark( "enqueue to read, idle I/O loop", 2000, 0, [&]() {
+		handler->send( frame );
+		if (!readFrame( fd, &payload )) lost = true;
+	});
+
+	// Frames queued back to back, while the previous ones are written
+	benchmark( "enqueue to read, 16 frames back to back", 500, 0, [&]() {
+		for (int i = 0; i < 16; ++i)
+			handler->send( frame );
+		for (int i = 0; i < 16; ++i)
+			if (!readFrame( fd, &payload )) lost = true;
+	});
+
+	// Stop the I/O loop
+	{
+		boost::mutex::scoped_lock lock(exitMutex);
+		exit = true;
+	}
+	server->wakeup();
+	io.join();
+	close( fd );
+	if (server->shutdown()) delete server;
+
+	if (lost) {
+		printf( "The connection was lost\n" );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,80 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "embedded.h"
+
+#include <string>
+#include <vector>
+
+// The number of assets of the generated table (see CMakeLists.txt)
+#ifndef EMBEDDED_ASSETS
+#define EMBEDDED_ASSETS 16
+#endif
+
+/**
+ * The lookup as it was before the table was sorted: compare
+ * the name against every embedded file
+ */
+static const std::string * findLinear( const std::vector< std::string >& names, const std::string& name ) {
+	for (std::vector< std::string >::const_iterator it = names.begin(); it != names.end(); ++it)
+		if (name.compare( *it ) == 0) return &(*it);
+	return NULL;
+}
+
+int main() {
+	char name[64];
+	std::vector< std::string > names;
+	for (int i = 0; i < EMBEDDED_ASSETS; ++i) {
+		snprintf( name, sizeof(name), "js/asset-%d.js", i );
+		names.push_back( name );
+		if (find_embedded_file( name ) == NULL) {
+			printf( "Asset %s is missing from the table\n", name );
+			return 1;
+		}
+	}
+
+	// Look up every asset in turn, and a name that is not embedded
+	// (like the "info" and "rpc/*" URLs used to be)
+	// (The results go through a volatile, so the scans are not optimized away)
+	const void * volatile hit = NULL;
+	char label[64];
+	size_t i = 0;
+	snprintf( label, sizeof(label), "lookup, %d assets (sorted table)", EMBEDDED_ASSETS );
+	benchmark( label, 1000000, 0, [&]() {
+		hit = find_embedded_file( names[++i % names.size()] );
+	});
+	snprintf( label, sizeof(label), "lookup, %d assets (linear scan)", EMBEDDED_ASSETS );
+	benchmark( label, 1000000 / EMBEDDED_ASSETS + 1000, 0, [&]() {
+		hit = findLinear( names, names[++i % names.size()] );
+	});
+	const std::string missing = "rpc/missing";
+	snprintf( label, sizeof(label), "miss, %d assets (sorted table)", EMBEDDED_ASSETS );
+	benchmark( label, 1000000, 0, [&]() {
+		hit = find_embedded_file( missing );
+	});
+	snprintf( label, sizeof(label), "miss, %d assets (linear scan)", EMBEDDED_ASSETS );
+	benchmark( label, 1000000 / EMBEDDED_ASSETS + 1000, 0, [&]() {
+		hit = findLinear( names, missing );
+	});
+
+	(void) hit;
+	return 0;
+}
@@ -0,0 +1,70 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "jsonparse.h"
+
+#include <json/json.h>
+#include <string>
+
+int main() {
+	// A typical action frame, and one with a long string member
+	const std::string action = "{\"type\":\"action\",\"name\":\"requestSession\",\"id\":\"17\",\"data\":{"
+							   "\"vmcpUrl\":\"https://test4theory.cern.ch/vmcp?config=challenge\","
+							   "\"secret\":\"s3cr3t\",\"cpus\":2,\"memory\":2048,\"gui\":false}}";
+	std::string large = "{\"type\":\"action\",\"name\":\"set\",\"id\":\"18\",\"data\":{\"key\":\"userData\",\"value\":\"";
+	for (int i = 0; i < 64; ++i)
+		large += "EXPERIMENT=ATLAS; JOB_DESCRIPTION=simulation step 1 of 4; SEED=1234567890 ";
+	large += "\"}}";
+
+	const std::string * frames[] = { &action, &large };
+	const char * names[][2] = {
+		{ "action frame (Json::Reader + fromJSON)", "action frame (JSONActionParser)" },
+		{ "4.8KB frame (Json::Reader + fromJSON)", "4.8KB frame (JSONActionParser)" }
+	};
+	for (int i = 0; i < 2; ++i) {
+		const std::string& frame = *frames[i];
+
+		// How the frames were parsed before
+		benchmark( names[i][0], 50000, frame.length(), [&]() {
+			Json::Value root;
+			Json::Reader reader;
+			ParameterMapPtr map = ParameterMap::instance();
+			if (reader.parse( frame.c_str(), frame.c_str() + frame.length(), root )) {
+				std::string name = root["name"].asString(), id = root["id"].asString();
+				benchmarkKeep( name );
+				map->fromJSON( root["data"] );
+			}
+			benchmarkKeep( map );
+		});
+
+		benchmark( names[i][1], 50000, frame.length(), [&]() {
+			ParameterMapPtr map = ParameterMap::instance();
+			JSONActionParser parser( frame.c_str(), frame.length() );
+			if (parser.parse( map )) {
+				std::string id = parser.id.str();
+				benchmarkKeep( id );
+			}
+			benchmarkKeep( map );
+		});
+	}
+
+	return 0;
+}
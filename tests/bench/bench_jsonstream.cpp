@@ -0,0 +1,66 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "jsonstream.h"
+
+#include <string>
+
+int main() {
+	const std::string id = "b2ed9b7d-7a80-4c4b-9d51-5ea2b1c2a0f1";
+	const std::string message = "Downloading disk image (cernvm-3.4.0.iso)";
+	std::string out;
+
+	// A progress event, the most frequent frame of the channel
+	benchmark( "progress event (Json::Value + FastWriter)", 200000, 0, [&]() {
+		Json::Value root;
+		root["type"] = "event";
+		root["name"] = "progress";
+		root["id"] = id;
+		root["data"].append( "progress" );
+		root["data"].append( 42 );
+		root["data"].append( message );
+		Json::FastWriter writer;
+		out = writer.write( root );
+		benchmarkKeep( out );
+	});
+	benchmark( "progress event (JSONStream)", 200000, 0, [&]() {
+		out.clear();
+		JSONStream( out ).literal("{\"data\":[").arg( "progress" ).literal(",").arg( 42 ).literal(",").arg( message )
+			.literal("],\"id\":").string( id ).literal(",\"name\":\"progress\",\"type\":\"event\"}\n");
+		benchmarkKeep( out );
+	});
+
+	// Escaping long strings (for example a VM log excerpt)
+	std::string text;
+	for (int i = 0; i < 64; ++i)
+		text += "VirtualBox VM 4.3.12 r93733 linux.amd64 (May 16 2014 19:39:30) release log\n";
+	benchmark( "escape 4.8KB string (FastWriter)", 20000, text.length(), [&]() {
+		out = Json::valueToQuotedString( text.c_str() );
+		benchmarkKeep( out );
+	});
+	benchmark( "escape 4.8KB string (JSONStream)", 20000, text.length(), [&]() {
+		out.clear();
+		JSONStream( out ).string( text );
+		benchmarkKeep( out );
+	});
+
+	return 0;
+}
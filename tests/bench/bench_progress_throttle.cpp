@@ -0,0 +1,126 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "progress_throttle.h"
+
+#include <string>
+
+/**
+ * Count the frames sent for a replayed progress trace
+ */
+struct Trace {
+	Trace( unsigned long interval, bool byMessage ) : throttle( interval ), byMessage(byMessage), message(), sent(0), now(1000000), updates(0), frames(0) { };
+
+	// An update of the given step, ``elapsed`` us after the previous one
+	void 			update( const std::string& step, double elapsed ) {
+		now += elapsed;
+		updates++;
+		const unsigned long ms = (unsigned long)(now / 1000);
+
+		// Keying on the full message is what the throttle did before
+		// it identified the steps (any change was a new step)
+		if (byMessage) {
+			if ((step == message) && (ms - sent < throttle.getInterval())) return;
+			message = step;
+			sent = ms;
+			frames++;
+			return;
+		}
+		if (!throttle.drop( &step, ms )) frames++;
+	}
+
+	ProgressThrottle 	throttle;
+	bool 				byMessage;
+	std::string 		message;
+	unsigned long 		sent;
+	double 				now;
+	int 				updates;
+	int 				frames;
+};
+
+/**
+ * Replay the progress of an installHypervisor run (libcernvm): the
+ * configuration download, the installer download from a local stand-in
+ * server (a progress update for every 16 KiB chunk), the checksum and
+ * the installation
+ */
+static void installHypervisor( Trace * trace, bool counters ) {
+	const double MB = 1024.0 * 1024.0, size = 110 * MB, chunk = 16 * 1024, rate = 100 * MB;
+	char msg[128];
+	trace->update( "Downloading hypervisor configuration", 0 );
+	trace->update( "Validating hypervisor configuration", 20000 );
+	for (double got = chunk; got <= size; got += chunk) {
+		if (counters) {
+			snprintf( msg, sizeof(msg), "Downloading hypervisor installer (%.1f of %.0f MB)", got / MB, size / MB );
+		} else {
+			snprintf( msg, sizeof(msg), "Downloading hypervisor installer" );
+		}
+		trace->update( msg, chunk / rate * 1000000.0 );
+	}
+	trace->update( "Validating checksum", 1000 );
+	trace->update( "Installing hypervisor", 400000 );
+	trace->update( "Hypervisor installed", 30000000 );
+}
+
+int main() {
+	const unsigned long T = 1000000;
+
+	// A request with a few steps, each reporting every millisecond
+	// (like the download of a disk image), at the default 10 frames/s
+	const char * steps[] = { "Downloading disk", "Extracting disk", "Configuring VM", "Starting VM", NULL };
+	const int UPDATES = 5000;
+	ProgressThrottle throttle( 100 );
+	int updates = 0, frames = 0;
+	unsigned long now = T;
+	for (int s = 0; steps[s] != NULL; ++s) {
+		std::string step = steps[s];
+		for (int i = 0; i < UPDATES; ++i, ++now, ++updates) {
+			if (!throttle.drop( &step, now )) frames++;
+		}
+	}
+	printf( "%-44s %12d\n", "progress updates", updates );
+	printf( "%-44s %12d\n", "progress frames sent", frames );
+	printf( "%-44s %12.1f %%\n", "progress frames saved", 100.0 - 100.0 * frames / updates );
+
+	// An installHypervisor run at the default 10 frames/s. The download
+	// messages of a step may carry counters, so both cases are replayed.
+	for (int counters = 0; counters < 2; ++counters) {
+		Trace byMessage( 100, true ), byStep( 100, false );
+		installHypervisor( &byMessage, counters != 0 );
+		installHypervisor( &byStep, counters != 0 );
+		printf( "installHypervisor, %s\n", counters ? "download messages with counters" : "fixed download message" );
+		printf( "%-44s %12d\n", "  progress updates", byStep.updates );
+		printf( "%-44s %12d\n", "  frames sent, keyed on the message", byMessage.frames );
+		printf( "%-44s %12d\n", "  frames sent, keyed on the step", byStep.frames );
+	}
+
+	// The cost of the decision for every update
+	std::string step = steps[0];
+	benchmark( "drop, same step", 1000000, 0, [&]() {
+		benchmarkKeep( throttle.drop( &step, ++now ) );
+	});
+	std::string counter = "Downloading hypervisor installer (12.5 of 110 MB)";
+	benchmark( "drop, same step with counters", 1000000, 0, [&]() {
+		benchmarkKeep( throttle.drop( &counter, ++now ) );
+	});
+
+	return 0;
+}
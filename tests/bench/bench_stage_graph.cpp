@@ -0,0 +1,268 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "stage_graph.h"
+#include "worker_pool.h"
+#include "latch.h"
+
+#include <boost/bind.hpp>
+#include <vector>
+
+/**
+ * The time-to-session of a session request, with the stages replaced by
+ * waits of the typical latency of each of them: the hypervisor probe, the
+ * keystore update and the download of the VMCP response (both network
+ * round-trips to a slow endpoint), and the validation of the signature.
+ */
+#define STAGE_READY 		0x01
+#define STAGE_KEYSTORE 		0x02
+#define STAGE_FETCH 		0x04
+#define STAGE_VALIDATE 		0x08
+
+struct Node {
+	int 	id;
+	int 	lane;
+	int 	depends;
+	int 	latency;
+};
+
+static const Node graph[] = {
+	{ STAGE_READY, 		WORKER_LANE_BLOCKING, 		0, 							120 },
+	{ STAGE_KEYSTORE, 	WORKER_LANE_BLOCKING, 		0, 							40 },
+	{ STAGE_FETCH, 		WORKER_LANE_BLOCKING, 		STAGE_KEYSTORE, 			60 },
+	{ STAGE_VALIDATE, 	WORKER_LANE_INTERACTIVE, 	STAGE_READY | STAGE_FETCH, 	5 },
+};
+static const size_t count = sizeof(graph) / sizeof(Node);
+
+/**
+ * Something prepared only once for all the requests, like the keystore
+ * update and the hypervisor initialization of DaemonCore
+ */
+struct Prepared {
+	Prepared( WorkerPool& pool ) : gate(pool), mutex(), done(false) { };
+
+	/**
+	 * Prepare it, unless it's done. If someone else is preparing it, return
+	 * false and queue ``retry`` when they are done (without a ``retry``,
+	 * skip it), like DaemonCore::prepareKeystore
+	 */
+	bool 			prepare( int latency, const WorkerTask& retry = WorkerTask() ) {
+		if (!gate.enter( retry, WORKER_LANE_BLOCKING )) return false;
+		PreparationGate::Scope scope( gate );
+		if (!done) {
+			boost::this_thread::sleep( boost::posix_time::milliseconds( latency ) );
+			done = true;
+		}
+		return true;
+	}
+
+	/**
+	 * Prepare it, waiting on the worker for anyone else preparing it,
+	 * like the requests did before they parked
+	 */
+	void 			prepareWaiting( int latency ) {
+		boost::mutex::scoped_lock lock(mutex);
+		if (done) return;
+		boost::this_thread::sleep( boost::posix_time::milliseconds( latency ) );
+		done = true;
+	}
+
+	PreparationGate gate;
+	boost::mutex 	mutex;
+	bool 			done;
+};
+
+/**
+ * What the daemon prepares for all the requests, and whether the
+ * requests that find it in progress park or wait on their worker
+ */
+struct Daemon {
+	Daemon( WorkerPool& pool, bool parks = true ) : hypervisor(pool), keystore(pool), parks(parks) { };
+	Prepared 		hypervisor;
+	Prepared 		keystore;
+	bool 			parks;
+};
+
+/**
+ * The state of a request, like SessionRequest
+ */
+struct Request {
+	Request( WorkerPool& pool, TestLatch& finished, Daemon * daemon = NULL ) : pool(pool), finished(finished), daemon(daemon), started(0), completed(0) { };
+	WorkerPool& 	pool;
+	TestLatch& 		finished;
+	Daemon * 		daemon;
+	int 			started;
+	int 			completed;
+	boost::mutex 	mutex;
+};
+
+static void advance( Request * req, int completed );
+
+/**
+ * Run a stage, and the stages that depend on it
+ */
+static void step( Request * req, const Node * node ) {
+	Prepared * prepared = NULL;
+	if (req->daemon && (node->id == STAGE_READY)) prepared = &req->daemon->hypervisor;
+	if (req->daemon && (node->id == STAGE_KEYSTORE)) prepared = &req->daemon->keystore;
+
+	if (prepared && req->daemon->parks) {
+		// The stage is retried when whoever prepares it is done
+		if (!prepared->prepare( node->latency, boost::bind( &step, req, node ) )) return;
+	} else if (prepared) {
+		prepared->prepareWaiting( node->latency );
+	} else {
+		boost::this_thread::sleep( boost::posix_time::milliseconds( node->latency ) );
+	}
+	if (node->id == STAGE_VALIDATE) {
+		req->finished.arrive();
+	} else {
+		advance( req, node->id );
+	}
+}
+
+/**
+ * Mark a stage as completed and start the stages that depend on it,
+ * like DaemonConnection::requestSession_advance
+ */
+static void advance( Request * req, int completed ) {
+	std::vector< const Node* > ready;
+	{
+		boost::mutex::scoped_lock lock(req->mutex);
+		req->completed |= completed;
+		stageGraphReady( graph, count, &req->started, req->completed, &ready );
+	}
+	for (std::vector< const Node* >::iterator it = ready.begin(); it != ready.end(); ++it)
+		req->pool.submit( boost::bind( &step, req, *it ), (*it)->lane );
+}
+
+/**
+ * Run all the stages one after the other, like the requests did before
+ */
+static void sequential( TestLatch * finished ) {
+	for (size_t i = 0; i < count; ++i)
+		boost::this_thread::sleep( boost::posix_time::milliseconds( graph[i].latency ) );
+	finished->arrive();
+}
+
+/**
+ * Run all the stages one after the other, sharing the preparations of the
+ * daemon, like the requests did before
+ */
+static void sequentialShared( Daemon * daemon, TestLatch * finished ) {
+	daemon->hypervisor.prepareWaiting( graph[0].latency );
+	daemon->keystore.prepareWaiting( graph[1].latency );
+	for (size_t i = 2; i < count; ++i)
+		boost::this_thread::sleep( boost::posix_time::milliseconds( graph[i].latency ) );
+	finished->arrive();
+}
+
+/**
+ * The warm-up started when a page connects, like DaemonCore::warmUp_task
+ */
+static void warmUp( Daemon * daemon, TestLatch * finished ) {
+	daemon->keystore.prepare( graph[1].latency );
+	daemon->hypervisor.prepare( graph[0].latency );
+	finished->arrive();
+}
+
+/**
+ * The time-to-session (in ms) of the first request of a page, which
+ * arrives ``delay`` ms after the page connected and started the warm-up
+ */
+static double firstSession( WorkerPool& pool, TestLatch& finished, int delay ) {
+	TestLatch warmedUp;
+	Daemon daemon( pool );
+	pool.submit( boost::bind( &warmUp, &daemon, &warmedUp ), WORKER_LANE_BLOCKING );
+	boost::this_thread::sleep( boost::posix_time::milliseconds( delay ) );
+
+	boost::posix_time::ptime started = boost::posix_time::microsec_clock::universal_time();
+	Request req( pool, finished, &daemon );
+	advance( &req, 0 );
+	finished.consume();
+	double ms = (boost::posix_time::microsec_clock::universal_time() - started).total_microseconds() / 1000.0;
+
+	warmedUp.consume();
+	return ms;
+}
+
+int main() {
+	TestLatch finished;
+	WorkerPool pool;
+	pool.start();
+
+	// A single request on an idle daemon
+	benchmark( "time-to-session (sequential)", 10, 0, [&]() {
+		pool.submit( boost::bind( &sequential, &finished ), WORKER_LANE_BLOCKING );
+		finished.consume();
+	});
+	benchmark( "time-to-session (stage graph)", 10, 0, [&]() {
+		Request req( pool, finished );
+		advance( &req, 0 );
+		finished.consume();
+	});
+
+	// A page opening a few sessions at once. The hypervisor and the
+	// keystore are prepared once for all of them, as the daemon does.
+	benchmark( "time-to-session x4 (sequential)", 10, 0, [&]() {
+		Daemon daemon( pool, false );
+		for (int i = 0; i < 4; ++i)
+			pool.submit( boost::bind( &sequentialShared, &daemon, &finished ), WORKER_LANE_BLOCKING );
+		finished.consume( 4 );
+	});
+	const bool parks[] = { false, true };
+	for (int p = 0; p < 2; ++p) {
+		benchmark( parks[p] ? "time-to-session x4 (stage graph)" : "time-to-session x4 (stage graph, waiting)", 10, 0, [&]() {
+			Daemon daemon( pool, parks[p] );
+			std::vector< Request* > reqs;
+			for (int i = 0; i < 4; ++i) {
+				reqs.push_back( new Request( pool, finished, &daemon ) );
+				advance( reqs.back(), 0 );
+			}
+			finished.consume( 4 );
+			for (size_t i = 0; i < reqs.size(); ++i)
+				delete reqs[i];
+		});
+	}
+
+	// The first request of a page, cold and after a warm-up that started
+	// when the page connected (the delay until the page requests a session)
+	// (only the time from the request to the session is counted)
+	// The warm-up rows also print the time saved against the cold request.
+	double cold = benchmark( "first session (cold)", 10, 0, [&]() {
+		Daemon daemon( pool );
+		Request req( pool, finished, &daemon );
+		advance( &req, 0 );
+		finished.consume();
+	}) / 1000000.0;
+	const int delays[] = { 0, 50, 200 };
+	for (int i = 0; i < 3; ++i) {
+		double total = 0;
+		for (int j = 0; j < 10; ++j)
+			total += firstSession( pool, finished, delays[i] );
+		char name[64];
+		snprintf( name, sizeof(name), "first session (warm-up %dms before)", delays[i] );
+		printf( "%-44s %12.2f ms/op %8.2f ms saved\n", name, total / 10, cold - total / 10 );
+	}
+
+	pool.stop();
+	return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "state_delta.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * A session state like the ones of a running CernVM: [config, properties]
+ */
+static Json::Value makeState( int tick ) {
+	Json::Value state(Json::arrayValue), config(Json::objectValue), properties(Json::objectValue);
+	const char * keys[] = { "cpus", "memory", "disk", "cernvmVersion", "cernvmFlavor", "executionCap", "flags",
+		"daemonControlled", "daemonMinCap", "daemonMaxCap", "daemonFlags", "canonicalName", "secret", "diskURL",
+		"diskChecksum", "userData", "apiPort", "resolution", NULL };
+	for (int i = 0; keys[i] != NULL; ++i)
+		config[keys[i]] = std::string( keys[i] ) + "-value";
+	config["ip"] = "10.0.2.15";
+	for (int i = 0; i < 16; ++i)
+		properties[ "/CVMWeb/property" + std::string( 1, (char)('a' + i) ) ] = "some property value";
+
+	// The state of the VM changes on every tick
+	properties["/CVMWeb/state"] = tick;
+	properties["/CVMWeb/uptime"] = tick * 1000;
+	state.append( config );
+	state.append( properties );
+	return state;
+}
+
+int main() {
+	const std::string id = "1827364512";
+	const int UPDATES = 1000;
+	std::vector< Json::Value > states;
+	for (int i = 0; i <= UPDATES; ++i)
+		states.push_back( makeState( i ) );
+
+	// One browser following the state of a session for many updates
+	size_t fullBytes = 0, deltaBytes = 0;
+	for (int d = 0; d < 2; ++d) {
+		StateCursor cursor;
+		size_t& bytes = d ? deltaBytes : fullBytes;
+		for (int i = 0; i <= UPDATES; ++i) {
+			StateEncoder encoder( id, states[i] );
+			bytes += encoder.update( cursor, d != 0, false )->data.length();
+		}
+	}
+	printf( "%-44s %12.1f bytes/update\n", "egress (full frames)", (double)fullBytes / (UPDATES + 1) );
+	printf( "%-44s %12.1f bytes/update\n", "egress (deltas)", (double)deltaBytes / (UPDATES + 1) );
+	printf( "%-44s %12.1f %%\n", "egress bytes saved by the deltas", 100.0 - 100.0 * deltaBytes / fullBytes );
+
+	// The cost of encoding an update, for one and for many subscribers
+	int i = 0;
+	StateCursor one;
+	benchmark( "update, 1 subscriber (full frame)", 20000, 0, [&]() {
+		StateEncoder encoder( id, states[++i % UPDATES] );
+		benchmarkKeep( encoder.update( one, false, false ) );
+	});
+	benchmark( "update, 1 subscriber (delta)", 20000, 0, [&]() {
+		StateEncoder encoder( id, states[++i % UPDATES] );
+		benchmarkKeep( encoder.update( one, true, false ) );
+	});
+	std::vector< StateCursor > many( 16 );
+	benchmark( "update, 16 subscribers (delta)", 5000, 0, [&]() {
+		StateEncoder encoder( id, states[++i % UPDATES] );
+		for (size_t s = 0; s < many.size(); ++s)
+			benchmarkKeep( encoder.update( many[s], true, false ) );
+	});
+
+	return 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "textscan.h"
+
+#include <string>
+
+/**
+ * The byte-at-a-time loops that the kernels replace
+ */
+static size_t scalarFindEscape( const char * data, const size_t len ) {
+	const unsigned char * s = (const unsigned char*) data;
+	for (size_t i = 0; i < len; ++i)
+		if ((s[i] < 0x20) || (s[i] == '"') || (s[i] == '\\')) return i;
+	return len;
+}
+
+int main() {
+	printf( "Using the %s implementation\n", textScanImplementation() );
+
+	// A 64KB message without anything to escape, in ASCII and in mixed UTF-8
+	std::string ascii, mixed;
+	while (ascii.length() < 65536)
+		ascii += "The virtual machine is booting, please wait while the disk image is downloaded. ";
+	while (mixed.length() < 65536)
+		mixed += "Caf\xc3\xa9 \xe2\x82\xac 10 \xf0\x9f\x98\x80 - the quick brown fox jumps over the lazy dog. ";
+	size_t pos;
+	bool valid;
+
+	benchmark( "find escape, 64KB ASCII (byte loop)", 2000, ascii.length(), [&]() {
+		pos = scalarFindEscape( ascii.data(), ascii.length() );
+		benchmarkKeep( pos );
+	});
+	benchmark( "find escape, 64KB ASCII (textscan)", 2000, ascii.length(), [&]() {
+		pos = textFindJSONEscape( ascii.data(), ascii.length() );
+		benchmarkKeep( pos );
+	});
+	benchmark( "validate UTF-8, 64KB ASCII (textscan)", 2000, ascii.length(), [&]() {
+		valid = textIsValidUTF8( ascii.data(), ascii.length() );
+		benchmarkKeep( valid );
+	});
+	benchmark( "validate UTF-8, 64KB mixed (textscan)", 2000, mixed.length(), [&]() {
+		valid = textIsValidUTF8( mixed.data(), mixed.length() );
+		benchmarkKeep( valid );
+	});
+
+	// Short strings, like the keys and values of an event
+	const std::string shortStr = "stateChanged";
+	benchmark( "find escape, 12 bytes (byte loop)", 1000000, shortStr.length(), [&]() {
+		pos = scalarFindEscape( shortStr.data(), shortStr.length() );
+		benchmarkKeep( pos );
+	});
+	benchmark( "find escape, 12 bytes (textscan)", 1000000, shortStr.length(), [&]() {
+		pos = textFindJSONEscape( shortStr.data(), shortStr.length() );
+		benchmarkKeep( pos );
+	});
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "timer_wheel.h"
+#include "latch.h"
+
+#include <boost/bind.hpp>
+#include <vector>
+
+#define PENDING         10000
+
+static void nothing() { }
+
+int main() {
+	WorkerPool pool;
+	pool.start();
+	TimerWheel wheel;
+	wheel.start( &pool );
+
+	// Re-arming a timer (like the lease of a session), on an empty wheel
+	// and with many pending timers on every level.
+	benchmark( "schedule + cancel (empty wheel)", 200000, 0, [&]() {
+		wheel.cancel( wheel.schedule( 30000, &nothing ) );
+	});
+	std::vector< TimerID > pending;
+	for (int i = 0; i < PENDING; ++i)
+		pending.push_back( wheel.schedule( 60000 + (i * 7919) % 3600000, &nothing ) );
+	benchmark( "schedule + cancel (10000 pending)", 200000, 0, [&]() {
+		wheel.cancel( wheel.schedule( 30000, &nothing ) );
+	});
+	for (size_t i = 0; i < pending.size(); ++i)
+		wheel.cancel( pending[i] );
+
+	// Expiring many timers on the same tick, and handing them to the pool.
+	// This includes waiting for the next tick (up to TIMER_TICK_MS).
+	TestLatch expiry;
+	benchmark( "10000 timers on one tick (incl. the tick wait)", 5, 0, [&]() {
+		for (int i = 0; i < PENDING; ++i)
+			wheel.schedule( 0, boost::bind( &TestLatch::arrive, &expiry ) );
+		expiry.consume( PENDING );
+	});
+
+	wheel.stop();
+	pool.stop();
+	return 0;
+}
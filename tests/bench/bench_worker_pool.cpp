@@ -0,0 +1,84 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "worker_pool.h"
+#include "latch.h"
+
+#include <boost/bind.hpp>
+#include <vector>
+
+#define SESSIONS        200
+#define ACTIONS         50
+
+/**
+ * A short action, like reading the state of a session
+ */
+static void action( TestLatch * completion ) {
+	volatile int sum = 0;
+	for (int i = 0; i < 1000; ++i) sum += i;
+	completion->arrive();
+}
+
+int main() {
+	TestLatch completion;
+	WorkerPool pool;
+	pool.start();
+
+	// How actions were run before: a thread for every action
+	benchmark( "200 sessions x 50 actions (thread each)", 5, 0, [&]() {
+		std::vector< boost::thread* > threads;
+		for (int s = 0; s < SESSIONS; ++s)
+			for (int a = 0; a < ACTIONS; ++a)
+				threads.push_back( new boost::thread( boost::bind( &action, &completion ) ) );
+		completion.consume( SESSIONS * ACTIONS );
+		for (size_t i = 0; i < threads.size(); ++i) {
+			threads[i]->join();
+			delete threads[i];
+		}
+	});
+
+	// The worker pool, without and with per-session ordering
+	benchmark( "200 sessions x 50 actions (pool)", 20, 0, [&]() {
+		for (int s = 0; s < SESSIONS; ++s)
+			for (int a = 0; a < ACTIONS; ++a)
+				pool.submit( boost::bind( &action, &completion ) );
+		completion.consume( SESSIONS * ACTIONS );
+	});
+	std::vector< WorkerStrandPtr > strands;
+	for (int s = 0; s < SESSIONS; ++s)
+		strands.push_back( WorkerStrandPtr( new WorkerStrand( pool ) ) );
+	benchmark( "200 sessions x 50 actions (strands)", 20, 0, [&]() {
+		for (int a = 0; a < ACTIONS; ++a)
+			for (int s = 0; s < SESSIONS; ++s)
+				strands[s]->post( boost::bind( &action, &completion ) );
+		completion.consume( SESSIONS * ACTIONS );
+	});
+
+	// The time from submitting a task to an idle pool until it's done
+	TestLatch ping;
+	benchmark( "dispatch latency (idle pool)", 20000, 0, [&]() {
+		pool.submit( boost::bind( &TestLatch::arrive, &ping ) );
+		ping.consume();
+	});
+
+	pool.stop();
+	return 0;
+}
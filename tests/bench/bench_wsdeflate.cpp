@@ -0,0 +1,85 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#include "bench.h"
+#include "wsdeflate.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * A stream of state events, like the ones sent while a VM boots
+ */
+static std::vector< std::string > events( size_t count ) {
+	std::vector< std::string > list;
+	for (size_t i = 0; i < count; ++i) {
+		std::ostringstream oss;
+		oss << "{\"data\":[\"progress\",{\"message\":\"Downloading disk image\",\"progress\":" << (i % 100)
+			<< "}],\"id\":\"b2ed9b7d-7a80-4c4b-9d51-5ea2b1c2a0f1\",\"name\":\"progress\",\"type\":\"event\"}";
+		list.push_back( oss.str() );
+	}
+	return list;
+}
+
+/**
+ * Compress the stream with the given offer and report the ratio
+ */
+static void compressStream( const char * name, const char * offer, const std::vector< std::string >& list ) {
+	std::string response, out;
+	CVMWebsocketDeflate ws;
+	ws.negotiate( offer, &response );
+
+	size_t raw = 0, compressed = 0, i = 0;
+	for (i = 0; i < list.size(); ++i) {
+		CVMWebserverMessage msg( 1, CVMWebserverBufferPool::wrap( list[i] ) );
+		ws.compress( msg, &out );
+		raw += list[i].length();
+		compressed += out.length();
+	}
+
+	i = 0;
+	benchmark( name, 20000, list[0].length(), [&]() {
+		CVMWebserverMessage msg( 1, CVMWebserverBufferPool::wrap( list[i++ % list.size()] ) );
+		ws.compress( msg, &out );
+	});
+	printf( "  %lu bytes -> %lu bytes (%.1f%%)\n", (unsigned long) raw, (unsigned long) compressed,
+		100.0 * compressed / raw );
+}
+
+int main() {
+	std::vector< std::string > list = events( 256 );
+
+	compressStream( "compress (context takeover)", "permessage-deflate", list );
+	compressStream( "compress (no context takeover)", "permessage-deflate; server_no_context_takeover", list );
+
+	// Inflate a long frame, like a large batch from the browser
+	std::string response, frame, inflated, batch;
+	for (size_t i = 0; i < list.size(); ++i) batch += list[i];
+	CVMWebsocketDeflate server, client;
+	server.negotiate( "permessage-deflate; server_no_context_takeover", &response );
+	client.negotiate( "permessage-deflate", &response );
+	server.compress( CVMWebserverMessage( 1, CVMWebserverBufferPool::wrap( batch ) ), &frame );
+	benchmark( "decompress (batch frame)", 2000, batch.length(), [&]() {
+		client.decompress( frame.c_str(), frame.length(), &inflated );
+	});
+
+	return 0;
+}
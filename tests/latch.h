@@ -0,0 +1,80 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#pragma once
+#ifndef TESTS_LATCH_H
+#define TESTS_LATCH_H
+
+#include <boost/thread.hpp>
+
+/**
+ * A counter that threads can wait on, shared by the tests and the
+ * benchmarks of the asynchronous parts of the daemon.
+ */
+class TestLatch {
+public:
+	TestLatch() : count(0) { };
+
+	/**
+	 * Count one more event and wake up the waiters
+	 */
+	void arrive() {
+		boost::mutex::scoped_lock lock(mutex);
+		++count;
+		cond.notify_all();
+	};
+
+	/**
+	 * Wait until at least ``n`` events arrived, up to the given timeout.
+	 * Returns false if the timeout expired first.
+	 */
+	bool wait( int n = 1, int timeoutMs = 5000 ) {
+		boost::mutex::scoped_lock lock(mutex);
+		boost::system_time until = boost::get_system_time() + boost::posix_time::milliseconds(timeoutMs);
+		while (count < n)
+			if (!cond.timed_wait(lock, until)) return (count >= n);
+		return true;
+	};
+
+	/**
+	 * Wait (without timeout) until ``n`` events arrived and start over
+	 */
+	void consume( int n = 1 ) {
+		boost::mutex::scoped_lock lock(mutex);
+		while (count < n) cond.wait(lock);
+		count -= n;
+	};
+
+	/**
+	 * The number of events so far
+	 */
+	int value() {
+		boost::mutex::scoped_lock lock(mutex);
+		return count;
+	};
+
+private:
+	boost::mutex mutex;
+	boost::condition_variable cond;
+	int count;
+
+};
+
+#endif /* end of include guard: TESTS_LATCH_H */
@@ -0,0 +1,132 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE action_table
+#include <boost/test/included/unit_test.hpp>
+
+#include "action_table.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef ActionEntry< int > 	TestAction;
+
+/**
+ * The shape of the session actions
+ */
+static const TestAction testActions[] = {
+	{ "start",			1,	ACTION_WORKER | ACTION_LONG, { } },
+	{ "stop",			2,	ACTION_WORKER | ACTION_LONG, { } },
+	{ "sync",			3,	ACTION_INLINE, { } },
+	{ "get",			4,	ACTION_WORKER,
+		{ { "key", ACTION_PARAM_STRING, false } } },
+	{ "set",			5,	ACTION_WORKER,
+		{ { "key", ACTION_PARAM_STRING, true }, { "value", ACTION_PARAM_STRING, false } } },
+	{ "resize",			6,	ACTION_WORKER,
+		{ { "cpus", ACTION_PARAM_INT, true }, { "memory", ACTION_PARAM_INT, false } } },
+};
+
+BOOST_AUTO_TEST_CASE( hash ) {
+	// FNV-1a reference values
+	BOOST_CHECK_EQUAL( actionHash( "" ), 0x811c9dc5u );
+	BOOST_CHECK_EQUAL( actionHash( "a" ), 0xe40c292cu );
+	BOOST_CHECK_EQUAL( actionHash( "foobar" ), 0xbf9cf968u );
+
+	// All overloads agree
+	BOOST_CHECK_EQUAL( actionHash( std::string("requestSession") ), actionHash( "requestSession" ) );
+	BOOST_CHECK_EQUAL( actionHash( "requestSession!", 14 ), actionHash( "requestSession" ) );
+	BOOST_CHECK_EQUAL( actionHash( std::string("a\0b", 3) ), actionHash( "a\0b", 3 ) );
+}
+
+BOOST_AUTO_TEST_CASE( find ) {
+	const size_t count = sizeof(testActions) / sizeof(testActions[0]);
+	ActionTable< TestAction > table( testActions, count );
+	for (size_t i = 0; i < count; ++i)
+		BOOST_CHECK_EQUAL( table.find( testActions[i].name ), &testActions[i] );
+
+	const char * unknown[] = { "", "st", "starts", "Start", "sync ", "handshake", NULL };
+	for (int i = 0; unknown[i] != NULL; ++i)
+		BOOST_CHECK( table.find( unknown[i] ) == NULL );
+
+	// A name with an embedded null is not a prefix match
+	BOOST_CHECK( table.find( std::string( "get\0x", 5 ) ) == NULL );
+}
+
+BOOST_AUTO_TEST_CASE( empty_table ) {
+	ActionTable< TestAction > table( testActions, 0 );
+	BOOST_CHECK( table.find( "start" ) == NULL );
+}
+
+BOOST_AUTO_TEST_CASE( many_entries ) {
+	// Enough entries to fill the slots with collisions
+	std::vector< std::string > names;
+	for (int i = 0; i < 500; ++i) {
+		std::ostringstream oss;
+		oss << "action" << i;
+		names.push_back( oss.str() );
+	}
+	std::vector< TestAction > entries( names.size() );
+	for (size_t i = 0; i < names.size(); ++i) {
+		entries[i].name = names[i].c_str();
+		entries[i].handler = (int) i;
+	}
+
+	ActionTable< TestAction > table( &entries[0], entries.size() );
+	for (size_t i = 0; i < names.size(); ++i) {
+		const TestAction * a = table.find( names[i] );
+		BOOST_REQUIRE( a != NULL );
+		BOOST_CHECK_EQUAL( a->handler, (int) i );
+	}
+	BOOST_CHECK( table.find( "action500" ) == NULL );
+	BOOST_CHECK( table.find( "action" ) == NULL );
+}
+
+BOOST_AUTO_TEST_CASE( validate ) {
+	ActionTable< TestAction > table( testActions, sizeof(testActions) / sizeof(testActions[0]) );
+	std::string error;
+
+	// No parameters declared
+	ParameterMapPtr map = ParameterMap::instance();
+	BOOST_CHECK( actionValidate( table.find("start")->params, map, &error ) );
+	BOOST_CHECK( actionValidate( table.find("get")->params, map, &error ) );
+
+	// Required parameters
+	BOOST_CHECK( !actionValidate( table.find("set")->params, map, &error ) );
+	BOOST_CHECK_EQUAL( error, "Missing 'key' parameter" );
+	map->set( "key", "memory" );
+	BOOST_CHECK( actionValidate( table.find("set")->params, map, &error ) );
+
+	// Integer parameters
+	const char * valid[] = { "0", "12", "-3", "2048", NULL };
+	const char * invalid[] = { "", "-", "1a", "1.5", " 1", "+1", "0x10", NULL };
+	for (int i = 0; valid[i] != NULL; ++i) {
+		ParameterMapPtr p = ParameterMap::instance();
+		p->set( "cpus", valid[i] );
+		BOOST_CHECK_MESSAGE( actionValidate( table.find("resize")->params, p, &error ), "rejected: " << valid[i] );
+	}
+	for (int i = 0; invalid[i] != NULL; ++i) {
+		ParameterMapPtr p = ParameterMap::instance();
+		p->set( "cpus", "1" );
+		p->set( "memory", invalid[i] );
+		BOOST_CHECK_MESSAGE( !actionValidate( table.find("resize")->params, p, &error ), "accepted: " << invalid[i] );
+		BOOST_CHECK_EQUAL( error, "Invalid 'memory' parameter" );
+	}
+}
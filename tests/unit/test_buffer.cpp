@@ -0,0 +1,116 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE buffer
+#include <boost/test/included/unit_test.hpp>
+
+#include "buffer.h"
+
+#include <boost/thread.hpp>
+#include <vector>
+
+// The cases below run in order, starting with an empty pool
+
+BOOST_AUTO_TEST_CASE( large_buffers_are_not_recycled ) {
+	{
+		CVMWebserverMutableBufferPtr buf = CVMWebserverBufferPool::acquire();
+		buf->data.assign( CVMWS_BUFFER_MAX_CAPACITY * 2, 'x' );
+	}
+	BOOST_CHECK_EQUAL( CVMWebserverBufferPool::allocations(), 1u );
+	CVMWebserverBufferPool::acquire();
+	BOOST_CHECK_EQUAL( CVMWebserverBufferPool::allocations(), 2u );
+}
+
+BOOST_AUTO_TEST_CASE( buffers_are_recycled ) {
+	const CVMWebserverBuffer * first;
+	size_t capacity;
+	{
+		CVMWebserverBufferPtr buf = CVMWebserverBufferPool::wrap( std::string( 1000, 'a' ) );
+		BOOST_CHECK_EQUAL( buf->data, std::string( 1000, 'a' ) );
+		first = buf.get();
+		capacity = buf->data.capacity();
+	}
+
+	// The same buffer comes back empty, but keeping it's capacity
+	size_t allocations = CVMWebserverBufferPool::allocations();
+	CVMWebserverMutableBufferPtr buf = CVMWebserverBufferPool::acquire();
+	BOOST_CHECK_EQUAL( buf.get(), first );
+	BOOST_CHECK( buf->data.empty() );
+	BOOST_CHECK_GE( buf->data.capacity(), capacity );
+	BOOST_CHECK_EQUAL( CVMWebserverBufferPool::allocations(), allocations );
+}
+
+BOOST_AUTO_TEST_CASE( shared_references ) {
+	CVMWebserverMessage queue, inflight;
+	{
+		CVMWebserverBufferPtr buf = CVMWebserverBufferPool::wrap( "{\"type\":\"event\"}" );
+		queue.push_back( buf );
+		inflight = queue;
+	}
+
+	// Released when the last reference goes away
+	size_t allocations = CVMWebserverBufferPool::allocations();
+	const CVMWebserverBuffer * ptr = queue[0].get();
+	queue.clear();
+	BOOST_CHECK_EQUAL( inflight[0]->data, "{\"type\":\"event\"}" );
+	inflight.clear();
+	BOOST_CHECK_EQUAL( CVMWebserverBufferPool::acquire().get(), ptr );
+	BOOST_CHECK_EQUAL( CVMWebserverBufferPool::allocations(), allocations );
+}
+
+BOOST_AUTO_TEST_CASE( pool_size_is_bounded ) {
+	const size_t count = CVMWS_BUFFER_POOL_SIZE + 44;
+	std::vector< CVMWebserverMutableBufferPtr > list;
+	for (size_t i = 0; i < count; ++i)
+		list.push_back( CVMWebserverBufferPool::acquire() );
+	list.clear();
+
+	size_t allocations = CVMWebserverBufferPool::allocations();
+	for (size_t i = 0; i < count; ++i)
+		list.push_back( CVMWebserverBufferPool::acquire() );
+	BOOST_CHECK_EQUAL( CVMWebserverBufferPool::allocations(), allocations + 44 );
+}
+
+/**
+ * Produce and release buffers, like an event producer and the I/O thread
+ */
+static void churn( CVMWebserverMessage * keep ) {
+	for (int i = 0; i < 20000; ++i) {
+		CVMWebserverBufferPtr buf = CVMWebserverBufferPool::wrap( "{\"type\":\"event\"}" );
+		if ((i % 1000) == 0) keep->push_back( buf );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_use ) {
+	size_t allocations = CVMWebserverBufferPool::allocations();
+	CVMWebserverMessage keep[4];
+	boost::thread_group threads;
+	for (int i = 0; i < 4; ++i)
+		threads.create_thread( boost::bind( &churn, &keep[i] ) );
+	threads.join_all();
+
+	// Steady-state churn is served by the pool
+	BOOST_CHECK_LE( CVMWebserverBufferPool::allocations() - allocations, 4u * 20 + 4 );
+	for (int i = 0; i < 4; ++i) {
+		BOOST_CHECK_EQUAL( keep[i].size(), 20u );
+		for (size_t j = 0; j < keep[i].size(); ++j)
+			BOOST_CHECK_EQUAL( keep[i][j]->data, "{\"type\":\"event\"}" );
+	}
+}
@@ -0,0 +1,172 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE egress
+#include <boost/test/included/unit_test.hpp>
+
+#include "egress.h"
+
+#include <boost/bind.hpp>
+#include <string>
+
+/**
+ * Pop a message and join its buffers
+ */
+static std::string popText( WebsocketEgressQueue& queue ) {
+	CVMWebserverMessage msg;
+	BOOST_REQUIRE( queue.pop( &msg ) );
+	std::string text;
+	for (CVMWebserverMessage::iterator it = msg.begin(); it != msg.end(); ++it)
+		text += (*it)->data;
+	return text;
+}
+
+BOOST_AUTO_TEST_CASE( frames_are_sent_in_order ) {
+	WebsocketEgressQueue queue( "test" );
+	queue.push( CVMWebserverBufferPool::wrap("{\"a\":1}") );
+	queue.push( CVMWebserverBufferPool::wrap("{\"b\":2}") );
+	BOOST_CHECK_EQUAL( queue.stats().frames, 2u );
+	BOOST_CHECK_EQUAL( popText( queue ), "{\"a\":1}" );
+	BOOST_CHECK_EQUAL( popText( queue ), "{\"b\":2}" );
+	CVMWebserverMessage msg;
+	BOOST_CHECK( !queue.pop( &msg ) );
+	BOOST_CHECK_EQUAL( queue.stats().bytes, 0u );
+}
+
+BOOST_AUTO_TEST_CASE( newer_frames_supersede_queued_ones ) {
+	WebsocketEgressQueue queue( "test" );
+	queue.push( CVMWebserverBufferPool::wrap("{\"progress\":1}"), "progress:1" );
+	queue.push( CVMWebserverBufferPool::wrap("{\"reply\":1}") );
+	queue.push( CVMWebserverBufferPool::wrap("{\"progress\":2}"), "progress:1" );
+	BOOST_CHECK_EQUAL( queue.stats().superseded, 1u );
+	BOOST_CHECK_EQUAL( queue.stats().frames, 2u );
+
+	// The newer frame takes the place of the queued one
+	BOOST_CHECK_EQUAL( popText( queue ), "{\"progress\":2}" );
+	BOOST_CHECK_EQUAL( popText( queue ), "{\"reply\":1}" );
+}
+
+BOOST_AUTO_TEST_CASE( pending_frames_are_batched ) {
+	WebsocketEgressQueue queue( "test" );
+	queue.setBatching( true );
+	queue.push( CVMWebserverBufferPool::wrap("{\"a\":1}") );
+	BOOST_CHECK_EQUAL( popText( queue ), "{\"a\":1}" );
+	queue.push( CVMWebserverBufferPool::wrap("{\"a\":1}") );
+	queue.push( CVMWebserverBufferPool::wrap("{\"b\":2}") );
+	queue.push( CVMWebserverBufferPool::wrap("{\"c\":3}") );
+	BOOST_CHECK_EQUAL( popText( queue ), "[{\"a\":1},{\"b\":2},{\"c\":3}]" );
+	CVMWebserverMessage msg;
+	BOOST_CHECK( !queue.pop( &msg ) );
+	BOOST_CHECK_EQUAL( queue.stats().bytes, 0u );
+}
+
+BOOST_AUTO_TEST_CASE( only_progress_frames_are_dropped ) {
+	WebsocketEgressQueue queue( "test" );
+	queue.push( CVMWebserverBufferPool::wrap("{\"reply\":1}") );
+	for (int i = 0; i < CVMWS_EGRESS_MAX_FRAMES + 10; ++i) {
+		char key[24];
+		snprintf( key, sizeof(key), "progress:%d", i );
+		queue.push( CVMWebserverBufferPool::wrap("{}"), key );
+	}
+	CVMWebserverEgressStats stats = queue.stats();
+	BOOST_CHECK_EQUAL( stats.frames, (size_t)CVMWS_EGRESS_MAX_FRAMES );
+	BOOST_CHECK_EQUAL( stats.dropped, 11u );
+	BOOST_CHECK_EQUAL( stats.congested, 1u );
+
+	// The reply is still the first frame
+	BOOST_CHECK_EQUAL( popText( queue ), "{\"reply\":1}" );
+}
+
+BOOST_AUTO_TEST_CASE( latest_state_frames_are_never_dropped ) {
+	WebsocketEgressQueue queue( "test" );
+	queue.push( CVMWebserverBufferPool::wrap("{\"state\":0}"), "stateVariables:1" );
+	queue.push( CVMWebserverBufferPool::wrap("{\"state\":1}"), "stateVariables:1" );
+	for (int i = 0; i < CVMWS_EGRESS_MAX_FRAMES + 10; ++i) {
+		char key[24];
+		snprintf( key, sizeof(key), "progress:%d", i );
+		queue.push( CVMWebserverBufferPool::wrap("{}"), key );
+	}
+
+	// The progress frames are dropped in place of the state
+	CVMWebserverEgressStats stats = queue.stats();
+	BOOST_CHECK_EQUAL( stats.frames, (size_t)CVMWS_EGRESS_MAX_FRAMES );
+	BOOST_CHECK_EQUAL( stats.superseded, 1u );
+	BOOST_CHECK_EQUAL( stats.dropped, 11u );
+	BOOST_CHECK_EQUAL( popText( queue ), "{\"state\":1}" );
+
+	// Even if there is nothing else to drop
+	WebsocketEgressQueue states( "test" );
+	for (int i = 0; i < CVMWS_EGRESS_MAX_FRAMES + 10; ++i) {
+		char key[24];
+		snprintf( key, sizeof(key), "stateVariables:%d", i );
+		states.push( CVMWebserverBufferPool::wrap("{}"), key );
+	}
+	BOOST_CHECK_EQUAL( states.stats().frames, (size_t)CVMWS_EGRESS_MAX_FRAMES + 10 );
+	BOOST_CHECK_EQUAL( states.stats().dropped, 0u );
+}
+
+/**
+ * The rebase function of a chained frame
+ */
+static CVMWebserverBufferPtr rebaseTo( const char * frame ) {
+	return CVMWebserverBufferPool::wrap( frame );
+}
+
+BOOST_AUTO_TEST_CASE( chained_frames_collapse_to_their_rebase ) {
+	WebsocketEgressQueue queue( "test" );
+	queue.push( CVMWebserverBufferPool::wrap("{\"state\":0}"), "state:1", boost::bind( &rebaseTo, "{\"state\":0}" ) );
+	queue.push( CVMWebserverBufferPool::wrap("{\"changed\":0}") );
+	queue.push( CVMWebserverBufferPool::wrap("{\"delta\":1}"), "state:1", boost::bind( &rebaseTo, "{\"state\":1}" ) );
+	queue.push( CVMWebserverBufferPool::wrap("{\"delta\":2}"), "state:1", boost::bind( &rebaseTo, "{\"state\":2}" ) );
+
+	// Chained frames are not superseded
+	BOOST_CHECK_EQUAL( queue.stats().frames, 4u );
+	BOOST_CHECK_EQUAL( queue.stats().superseded, 0u );
+
+	// Congest the queue
+	for (int i = 0; i < CVMWS_EGRESS_MAX_FRAMES; ++i) {
+		char key[24];
+		snprintf( key, sizeof(key), "progress:%d", i );
+		queue.push( CVMWebserverBufferPool::wrap("{}"), key );
+	}
+	CVMWebserverEgressStats stats = queue.stats();
+	BOOST_CHECK_EQUAL( stats.frames, (size_t)CVMWS_EGRESS_MAX_FRAMES );
+	BOOST_CHECK_EQUAL( stats.dropped, 2u + 2u ); // the two deltas, and two other frames
+
+	// A new delta is chained to the collapsed frame
+	queue.push( CVMWebserverBufferPool::wrap("{\"delta\":3}"), "state:1", boost::bind( &rebaseTo, "{\"state\":3}" ) );
+	BOOST_CHECK_EQUAL( queue.stats().frames, (size_t)CVMWS_EGRESS_MAX_FRAMES );
+
+	// The deltas are gone, and the snapshot in their place brings the
+	// browser to the end of the chain, before the frames that followed it
+	BOOST_CHECK_EQUAL( popText( queue ), "{\"state\":3}" );
+	BOOST_CHECK_EQUAL( popText( queue ), "{\"changed\":0}" );
+}
+
+BOOST_AUTO_TEST_CASE( chained_frames_are_never_dropped ) {
+	WebsocketEgressQueue queue( "test" );
+	for (int i = 0; i < CVMWS_EGRESS_MAX_FRAMES + 10; ++i) {
+		char key[16];
+		snprintf( key, sizeof(key), "state:%d", i );
+		queue.push( CVMWebserverBufferPool::wrap("{}"), key, boost::bind( &rebaseTo, "{}" ) );
+	}
+	BOOST_CHECK_EQUAL( queue.stats().frames, (size_t)CVMWS_EGRESS_MAX_FRAMES + 10 );
+	BOOST_CHECK_EQUAL( queue.stats().dropped, 0u );
+}
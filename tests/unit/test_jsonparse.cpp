@@ -0,0 +1,185 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE jsonparse
+#include <boost/test/included/unit_test.hpp>
+
+#include "jsonparse.h"
+
+#include <json/json.h>
+#include <string>
+
+/**
+ * Parse the given frame into a new map
+ */
+static bool parse( const std::string& frame, ParameterMapPtr * map = NULL ) {
+	ParameterMapPtr m = ParameterMap::instance();
+	JSONActionParser parser( frame.c_str(), frame.length() );
+	bool ok = parser.parse( m );
+	if (map) *map = m;
+	return ok;
+}
+
+BOOST_AUTO_TEST_CASE( envelope ) {
+	const std::string frame = "{\"type\":\"action\",\"name\":\"requestSession\",\"id\":\"42\",\"data\":{}}";
+	JSONActionParser parser( frame.c_str(), frame.length() );
+	BOOST_REQUIRE( parser.parse( ParameterMap::instance() ) );
+	BOOST_CHECK( parser.hasType && parser.hasName && parser.hasId );
+	BOOST_CHECK( parser.type.equals( "action" ) );
+	BOOST_CHECK( parser.name.equals( "requestSession" ) );
+	BOOST_CHECK( !parser.name.equals( "requestSessio" ) );
+	BOOST_CHECK_EQUAL( parser.id.str(), "42" );
+
+	// The views point in the frame
+	BOOST_CHECK( (parser.name.data > frame.c_str()) && (parser.name.data < frame.c_str() + frame.length()) );
+	BOOST_CHECK( !parser.name.escaped );
+
+	// Missing fields and unknown members
+	const std::string partial = " { \"name\" : \"start\" , \"extra\" : [1, {\"a\": null}, true] } ";
+	JSONActionParser other( partial.c_str(), partial.length() );
+	BOOST_REQUIRE( other.parse( ParameterMap::instance() ) );
+	BOOST_CHECK( !other.hasType && other.hasName && !other.hasId );
+	BOOST_CHECK_EQUAL( other.name.str(), "start" );
+}
+
+BOOST_AUTO_TEST_CASE( data_members ) {
+	ParameterMapPtr map;
+	BOOST_REQUIRE( parse( "{\"type\":\"action\",\"data\":{"
+		"\"secret\":\"s3cr3t\",\"cpus\":2,\"ratio\":-0.5e+2,\"gui\":true,\"headless\":false,"
+		"\"ignored\":null,\"list\":[1, \"two\"],\"limits\":{\"memory\":512,\"disk\":{\"size\":\"10G\"}}"
+		"}}", &map ) );
+	BOOST_CHECK_EQUAL( map->get("secret"), "s3cr3t" );
+	BOOST_CHECK_EQUAL( map->get("cpus"), "2" );
+	BOOST_CHECK_EQUAL( map->get("ratio"), Json::valueToString( -50.0 ) );
+	BOOST_CHECK_EQUAL( map->get("gui"), "true" );
+	BOOST_CHECK_EQUAL( map->get("headless"), "false" );
+	BOOST_CHECK( map->contains("ignored") );
+	BOOST_CHECK_EQUAL( map->get("ignored", "x"), "" );
+	BOOST_CHECK_EQUAL( map->get("list"), "[1, \"two\"]" );
+	BOOST_CHECK_EQUAL( map->subgroup("limits")->get("memory"), "512" );
+	BOOST_CHECK_EQUAL( map->subgroup("limits")->subgroup("disk")->get("size"), "10G" );
+
+	// Data that is not an object is skipped
+	BOOST_REQUIRE( parse( "{\"data\":[1,2],\"name\":\"x\"}", &map ) );
+	BOOST_CHECK( !map->contains("0") );
+}
+
+BOOST_AUTO_TEST_CASE( scalars_like_asString ) {
+	// Every scalar is converted like Json::Reader and asString() would
+	const char * values[] = {
+		"0", "-0", "7", "-12", "1.5", "2e3", "-0.25E-2", "9223372036854775807", "-9223372036854775808",
+		"18446744073709551615", "18446744073709551616", "true", "false", "null",
+		NULL
+	};
+	for (int i = 0; values[i] != NULL; ++i) {
+		const std::string frame = std::string("{\"data\":{\"v\":") + values[i] + "}}";
+		Json::Value root;
+		Json::Reader reader;
+		BOOST_REQUIRE( reader.parse( frame, root ) );
+
+		ParameterMapPtr map;
+		BOOST_REQUIRE( parse( frame, &map ) );
+		BOOST_CHECK_EQUAL( map->get("v", "x"), root["data"]["v"].asString() );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( non_string_envelope ) {
+	// Numeric ids, as sent by older pages
+	const std::string frame = "{\"type\":\"action\",\"name\":\"start\",\"id\":42,\"data\":{\"gui\":true,\"limits\":{\"cpus\":2,\"fast\":false}}}";
+	ParameterMapPtr map = ParameterMap::instance();
+	JSONActionParser parser( frame.c_str(), frame.length() );
+	BOOST_REQUIRE( parser.parse( map ) );
+	BOOST_CHECK( parser.hasId );
+	BOOST_CHECK( parser.id.equals( "42" ) );
+	BOOST_CHECK_EQUAL( parser.id.str(), "42" );
+	BOOST_CHECK_EQUAL( map->get("gui"), "true" );
+	BOOST_CHECK_EQUAL( map->subgroup("limits")->get("cpus"), "2" );
+	BOOST_CHECK_EQUAL( map->subgroup("limits")->get("fast"), "false" );
+
+	// Other scalars are converted too
+	const std::string other = "{\"type\":\"action\",\"name\":true,\"id\":null}";
+	JSONActionParser scalars( other.c_str(), other.length() );
+	BOOST_REQUIRE( scalars.parse( ParameterMap::instance() ) );
+	BOOST_CHECK_EQUAL( scalars.name.str(), "true" );
+	BOOST_CHECK( scalars.hasId );
+	BOOST_CHECK_EQUAL( scalars.id.str(), "" );
+
+	// But not objects or arrays
+	BOOST_CHECK( !parse( "{\"id\":[1]}" ) );
+	BOOST_CHECK( !parse( "{\"name\":{\"a\":1}}" ) );
+}
+
+BOOST_AUTO_TEST_CASE( escapes ) {
+	ParameterMapPtr map = ParameterMap::instance();
+	const std::string frame = "{\"id\":\"a\\\"b\",\"data\":{\"k\\u0065y\":\"\\\\ \\/ \\b\\f\\n\\r\\t \\u00e9 \\u20ac \\ud83d\\ude00\"}}";
+	JSONActionParser parser( frame.c_str(), frame.length() );
+	BOOST_REQUIRE( parser.parse( map ) );
+	BOOST_CHECK( parser.id.escaped );
+	BOOST_CHECK( parser.id.equals( "a\"b" ) );
+	BOOST_CHECK_EQUAL( map->get("key"), "\\ / \b\f\n\r\t \xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80" );
+
+	// UTF-8 is passed through
+	BOOST_REQUIRE( parse( "{\"data\":{\"name\":\"caf\xc3\xa9\"}}", &map ) );
+	BOOST_CHECK_EQUAL( map->get("name"), "caf\xc3\xa9" );
+}
+
+BOOST_AUTO_TEST_CASE( syntax_errors ) {
+	const char * invalid[] = {
+		"", " ", "[]", "{", "}", "{\"type\"}", "{\"type\":}", "{\"type\":\"action\"",
+		"{\"type\":\"action\",}", "{\"type\":\"action\"} x", "{\"type\":\"act\nion\"}",
+		"{\"type\":\"\\x\"}", "{\"type\":\"\\u12g4\"}", "{\"type\":\"\\u12\"}",
+		"{\"data\":{\"a\":01}}", "{\"data\":{\"a\":1.}}", "{\"data\":{\"a\":-}}", "{\"data\":{\"a\":1e}}",
+		"{\"data\":{\"a\":tru}}", "{\"data\":{\"a\":nul}}", "{\"data\":{\"a\":[1,]}}", "{\"data\":{\"a\" 1}}",
+		"{'type':'action'}", "{\"data\":{\"a\":\"b\"}",
+		NULL
+	};
+	for (int i = 0; invalid[i] != NULL; ++i)
+		BOOST_CHECK_MESSAGE( !parse( invalid[i] ), "accepted: " << invalid[i] );
+	BOOST_CHECK( parse( "{}" ) );
+	BOOST_CHECK( parse( " {\"data\":{}} \r\n" ) );
+}
+
+BOOST_AUTO_TEST_CASE( truncated_frames ) {
+	// No prefix of a valid frame should parse, or read past it's end
+	const std::string frame = "{\"type\":\"action\",\"name\":\"start\",\"id\":\"7\",\"data\":{\"a\":[1,{\"b\":\"c\\u00e9\"}],\"n\":-1.5e3,\"t\":true}}";
+	BOOST_REQUIRE( parse( frame ) );
+	for (size_t len = 0; len < frame.length(); ++len) {
+		std::string prefix = frame.substr( 0, len );
+		BOOST_CHECK_MESSAGE( !parse( prefix ), "accepted: " << prefix );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( nesting_limit ) {
+	std::string deep = "{\"data\":{\"a\":";
+	for (int i = 0; i < 100; ++i) deep += "[";
+	for (int i = 0; i < 100; ++i) deep += "]";
+	deep += "}}";
+	BOOST_CHECK( !parse( deep ) );
+
+	std::string objects = "{\"data\":";
+	for (int i = 0; i < 100; ++i) objects += "{\"a\":";
+	objects += "1";
+	for (int i = 0; i < 100; ++i) objects += "}";
+	objects += "}";
+	BOOST_CHECK( !parse( objects ) );
+
+	std::string shallow = "{\"data\":{\"a\":[[[[1]]]]}}";
+	BOOST_CHECK( parse( shallow ) );
+}
@@ -0,0 +1,179 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE jsonstream
+#include <boost/test/included/unit_test.hpp>
+
+#include "jsonstream.h"
+
+#include <climits>
+#include <string>
+
+/**
+ * What Json::FastWriter produces, without the trailing newline
+ */
+static std::string fastWriter( const Json::Value& value ) {
+	Json::FastWriter writer;
+	std::string out = writer.write( value );
+	if (!out.empty() && (out[out.length() - 1] == '\n'))
+		out.resize( out.length() - 1 );
+	return out;
+}
+
+/**
+ * Stream a single string
+ */
+static std::string streamString( const std::string& str ) {
+	std::string out;
+	JSONStream( out ).string( str );
+	return out;
+}
+
+BOOST_AUTO_TEST_CASE( strings_like_fastwriter ) {
+	const char * samples[] = {
+		"", "plain", "with \"quotes\" and \\backslashes\\", "tab\tnew\nline\rcr",
+		"\b\f", "slash / is not escaped", "{\"nested\":\"json\"}",
+		NULL
+	};
+	for (int i = 0; samples[i] != NULL; ++i)
+		BOOST_CHECK_EQUAL( streamString( samples[i] ), fastWriter( Json::Value( samples[i] ) ) );
+
+	// Every control character
+	std::string controls;
+	for (int c = 1; c < 0x20; ++c) controls += (char) c;
+	BOOST_CHECK_EQUAL( streamString( controls ), fastWriter( Json::Value( controls ) ) );
+	BOOST_CHECK_EQUAL( streamString( std::string( "a\0b", 3 ) ), fastWriter( Json::Value( std::string( "a\0b", 3 ) ) ) );
+}
+
+BOOST_AUTO_TEST_CASE( strings_across_vector_boundaries ) {
+	// Place a character to escape at every offset of a long string, so that
+	// it falls in the vector body and in the scalar tail of the scanner.
+	for (size_t len = 1; len < 80; ++len) {
+		for (size_t at = 0; at < len; ++at) {
+			std::string str( len, 'x' );
+			str[at] = '"';
+			std::string expected = "\"" + str.substr( 0, at ) + "\\\"" + str.substr( at + 1 ) + "\"";
+			BOOST_REQUIRE_EQUAL( streamString( str ), expected );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( utf8_like_fastwriter ) {
+	// Whether it's passed through or escaped depends on the jsoncpp version
+	const char * samples[] = {
+		"caf\xc3\xa9", "\xe2\x82\xac 10", "\xf0\x9f\x98\x80 above the BMP", "\xef\xbf\xbf\x7f",
+		"\"quoted\" caf\xc3\xa9\n",
+		NULL
+	};
+	for (int i = 0; samples[i] != NULL; ++i)
+		BOOST_CHECK_EQUAL( streamString( samples[i] ), fastWriter( Json::Value( samples[i] ) ) );
+
+	Json::Value parsed;
+	Json::Reader reader;
+	BOOST_REQUIRE( reader.parse( "[" + streamString( samples[0] ) + "]", parsed ) );
+	BOOST_CHECK_EQUAL( parsed[0].asString(), samples[0] );
+}
+
+BOOST_AUTO_TEST_CASE( invalid_utf8_like_fastwriter ) {
+	const char * samples[] = {
+		"a\x80z", "\xc3x", "\xe2\x82x", "\xc0\x80", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xc3\xa9\xc3",
+		NULL
+	};
+	for (int i = 0; samples[i] != NULL; ++i)
+		BOOST_CHECK_EQUAL( streamString( samples[i] ), fastWriter( Json::Value( samples[i] ) ) );
+}
+
+BOOST_AUTO_TEST_CASE( utf8_across_vector_boundaries ) {
+	// A character at every offset, in the vector body and in the
+	// scalar tail of the scanner
+	for (size_t len = 1; len < 80; ++len) {
+		for (size_t at = 0; at < len; ++at) {
+			std::string str( len, 'x' );
+			str.replace( at, 1, "\xe2\x82\xac" );
+			BOOST_REQUIRE_EQUAL( streamString( str ), fastWriter( Json::Value( str ) ) );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( numbers_like_fastwriter ) {
+	const int ints[] = { 0, 1, -1, 9, 10, -10, 12345, INT_MAX, INT_MIN };
+	for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); ++i) {
+		std::string out;
+		JSONStream( out ).number( ints[i] );
+		BOOST_CHECK_EQUAL( out, fastWriter( Json::Value( ints[i] ) ) );
+	}
+
+	const double reals[] = { 0.0, 1.5, -2.25, 0.1, 1e300, -1e-300, 3.0 };
+	for (size_t i = 0; i < sizeof(reals) / sizeof(reals[0]); ++i) {
+		std::string out;
+		JSONStream( out ).number( reals[i] );
+		BOOST_CHECK_EQUAL( out, fastWriter( Json::Value( reals[i] ) ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( values_like_fastwriter ) {
+	Json::Value data;
+	data["state"] = 3;
+	data["name"] = "My \"VM\"";
+	data["ratio"] = 0.75;
+	data["flags"] = Json::Value( Json::arrayValue );
+	data["flags"].append( true );
+	data["flags"].append( false );
+	data["flags"].append( Json::Value() );
+	data["flags"].append( Json::Value( (Json::UInt) 4000000000u ) );
+	data["empty"] = Json::Value( Json::objectValue );
+	data["list"] = Json::Value( Json::arrayValue );
+
+	std::string out;
+	JSONStream( out ).value( data );
+	BOOST_CHECK_EQUAL( out, fastWriter( data ) );
+}
+
+BOOST_AUTO_TEST_CASE( events_like_fastwriter ) {
+	// The fixed-shape event of WebsocketAPI, with it's members in the
+	// order that FastWriter sorts them.
+	VariantArgList args;
+	args.push_back( std::string("progress") );
+	args.push_back( 42 );
+	args.push_back( 0.5 );
+	args.push_back( 1.5f );
+
+	std::string out;
+	JSONStream json( out );
+	json.literal("{\"data\":[");
+	for (size_t i = 0; i < args.size(); ++i) {
+		if (i > 0) json.literal(",");
+		json.arg( args[i] );
+	}
+	json.literal(",").arg( true ).literal(",").arg( "text" );
+	json.literal("],\"id\":").string( "a1" ).literal(",\"name\":").string( "progress" ).literal(",\"type\":\"event\"}");
+
+	Json::Value root;
+	root["type"] = "event";
+	root["name"] = "progress";
+	root["id"] = "a1";
+	root["data"].append( "progress" );
+	root["data"].append( 42 );
+	root["data"].append( 0.5 );
+	root["data"].append( 1.5 );
+	root["data"].append( 1 );
+	root["data"].append( "text" );
+	BOOST_CHECK_EQUAL( out, fastWriter( root ) );
+}
@@ -0,0 +1,87 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE progress_throttle
+#include <boost/test/included/unit_test.hpp>
+
+#include "progress_throttle.h"
+
+#include <string>
+
+// Some time after the epoch, like getMillis()
+static const unsigned long T = 1000000;
+
+BOOST_AUTO_TEST_CASE( updates_of_a_step_are_rate_limited ) {
+	ProgressThrottle throttle( 100 );
+	std::string step = "Downloading";
+	BOOST_CHECK( !throttle.drop( &step, T ) );
+	BOOST_CHECK( throttle.drop( &step, T + 10 ) );
+	BOOST_CHECK( throttle.drop( &step, T + 99 ) );
+	BOOST_CHECK( !throttle.drop( &step, T + 100 ) );
+	BOOST_CHECK( throttle.drop( &step, T + 150 ) );
+	BOOST_CHECK_EQUAL( throttle.dropped(), 3 );
+}
+
+BOOST_AUTO_TEST_CASE( a_new_step_is_always_delivered ) {
+	ProgressThrottle throttle( 100 );
+	std::string first = "Downloading", second = "Extracting";
+	BOOST_CHECK( !throttle.drop( &first, T ) );
+	BOOST_CHECK( !throttle.drop( &second, T + 1 ) );
+	BOOST_CHECK( !throttle.drop( &first, T + 2 ) );
+	BOOST_CHECK( !throttle.drop( NULL, T + 3 ) );
+	BOOST_CHECK_EQUAL( throttle.dropped(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( counters_do_not_make_a_new_step ) {
+	ProgressThrottle throttle( 100 );
+	std::string first = "Downloading 1.5 of 80 MB (2%)", second = "Downloading 12.25 of 80 MB (15%)", next = "Extracting 1 of 80 MB";
+	BOOST_CHECK( !throttle.drop( &first, T ) );
+	BOOST_CHECK( throttle.drop( &second, T + 10 ) );
+	BOOST_CHECK( !throttle.drop( &next, T + 20 ) );
+	BOOST_CHECK_EQUAL( throttle.dropped(), 1 );
+
+	BOOST_CHECK( ProgressThrottle::sameStep( "Step 1", "Step 10" ) );
+	BOOST_CHECK( ProgressThrottle::sameStep( "", "" ) );
+	BOOST_CHECK( ProgressThrottle::sameStep( "1,024 bytes.", "3 bytes." ) );
+	BOOST_CHECK( !ProgressThrottle::sameStep( "Step 1", "Step 1." ) );
+	BOOST_CHECK( !ProgressThrottle::sameStep( "Step 1", "Stop 1" ) );
+	BOOST_CHECK( !ProgressThrottle::sameStep( "Step", "Step 1" ) );
+	BOOST_CHECK( !ProgressThrottle::sameStep( "Downloading", "Extracting" ) );
+}
+
+BOOST_AUTO_TEST_CASE( zero_interval_delivers_everything ) {
+	ProgressThrottle throttle( 100 );
+	throttle.setInterval( 0 );
+	std::string step = "Downloading";
+	for (int i = 0; i < 10; ++i)
+		BOOST_CHECK( !throttle.drop( &step, T + i ) );
+	BOOST_CHECK_EQUAL( throttle.getInterval(), 0ul );
+	BOOST_CHECK_EQUAL( throttle.dropped(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( undrop_counts_a_late_delivery ) {
+	ProgressThrottle throttle( 100 );
+	std::string step = "Downloading";
+	throttle.drop( &step, T );
+	throttle.drop( &step, T + 1 );
+	throttle.drop( &step, T + 2 );
+	throttle.undrop();
+	BOOST_CHECK_EQUAL( throttle.dropped(), 1 );
+}
@@ -0,0 +1,83 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE stage_graph
+#include <boost/test/included/unit_test.hpp>
+
+#include "stage_graph.h"
+
+#include <vector>
+
+// The shape of the session request graph
+#define STAGE_READY 		0x01
+#define STAGE_KEYSTORE 		0x02
+#define STAGE_FETCH 		0x04
+#define STAGE_VALIDATE 		0x08
+
+struct Node {
+	int 	id;
+	int 	depends;
+};
+
+static const Node graph[] = {
+	{ STAGE_READY, 		0 },
+	{ STAGE_KEYSTORE, 	0 },
+	{ STAGE_FETCH, 		STAGE_KEYSTORE },
+	{ STAGE_VALIDATE, 	STAGE_READY | STAGE_FETCH },
+};
+static const size_t count = sizeof(graph) / sizeof(Node);
+
+BOOST_AUTO_TEST_CASE( independent_stages_start_together ) {
+	int started = 0;
+	std::vector< const Node* > ready;
+	stageGraphReady( graph, count, &started, 0, &ready );
+	BOOST_REQUIRE_EQUAL( ready.size(), 2u );
+	BOOST_CHECK_EQUAL( ready[0]->id, STAGE_READY );
+	BOOST_CHECK_EQUAL( ready[1]->id, STAGE_KEYSTORE );
+	BOOST_CHECK_EQUAL( started, STAGE_READY | STAGE_KEYSTORE );
+}
+
+BOOST_AUTO_TEST_CASE( a_stage_waits_for_all_its_dependencies ) {
+	int started = STAGE_READY | STAGE_KEYSTORE;
+	std::vector< const Node* > ready;
+
+	// The keystore lets the fetch start, but the validation needs the hypervisor too
+	stageGraphReady( graph, count, &started, STAGE_KEYSTORE, &ready );
+	BOOST_REQUIRE_EQUAL( ready.size(), 1u );
+	BOOST_CHECK_EQUAL( ready[0]->id, STAGE_FETCH );
+
+	ready.clear();
+	stageGraphReady( graph, count, &started, STAGE_KEYSTORE | STAGE_FETCH, &ready );
+	BOOST_CHECK( ready.empty() );
+
+	stageGraphReady( graph, count, &started, STAGE_READY | STAGE_KEYSTORE | STAGE_FETCH, &ready );
+	BOOST_REQUIRE_EQUAL( ready.size(), 1u );
+	BOOST_CHECK_EQUAL( ready[0]->id, STAGE_VALIDATE );
+}
+
+BOOST_AUTO_TEST_CASE( every_stage_is_handed_out_once ) {
+	int started = 0;
+	std::vector< const Node* > ready;
+	stageGraphReady( graph, count, &started, 0, &ready );
+	stageGraphReady( graph, count, &started, STAGE_READY | STAGE_KEYSTORE | STAGE_FETCH, &ready );
+	stageGraphReady( graph, count, &started, STAGE_READY | STAGE_KEYSTORE | STAGE_FETCH, &ready );
+	BOOST_CHECK_EQUAL( ready.size(), count );
+	BOOST_CHECK_EQUAL( started, STAGE_READY | STAGE_KEYSTORE | STAGE_FETCH | STAGE_VALIDATE );
+}
@@ -0,0 +1,199 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE state_delta
+#include <boost/test/included/unit_test.hpp>
+
+#include "state_delta.h"
+
+#include <string>
+
+static const std::string ID = "1234";
+
+/**
+ * A session state: [config, properties]
+ */
+static Json::Value makeState( const std::string& ip, const std::string& prop ) {
+	Json::Value state(Json::arrayValue), config(Json::objectValue), properties(Json::objectValue);
+	config["cpus"] = "2";
+	config["memory"] = "1024";
+	config["ip"] = ip;
+	properties["name"] = "test";
+	if (!prop.empty()) properties["extra"] = prop;
+	state.append( config );
+	state.append( properties );
+	return state;
+}
+
+/**
+ * Parse a frame
+ */
+static Json::Value parse( const CVMWebserverBufferPtr& frame ) {
+	Json::Value root;
+	Json::Reader reader;
+	BOOST_REQUIRE( reader.parse( frame->data, root ) );
+	return root;
+}
+
+BOOST_AUTO_TEST_CASE( first_update_is_the_legacy_frame ) {
+	Json::Value state = makeState( "10.0.0.1", "" );
+	StateEncoder encoder( ID, state );
+	StateCursor cursor;
+	bool delta = true;
+	CVMWebserverBufferPtr frame = encoder.update( cursor, true, false, &delta );
+	BOOST_REQUIRE( frame );
+	BOOST_CHECK( !delta );
+
+	// Exactly what was sent before the deltas, without a version
+	Json::Value root;
+	root["type"] = "event";
+	root["name"] = "stateVariables";
+	root["id"] = ID;
+	root["data"] = state;
+	Json::FastWriter writer;
+	BOOST_CHECK_EQUAL( frame->data, writer.write( root ) );
+	BOOST_CHECK_EQUAL( cursor.version, 0u );
+}
+
+BOOST_AUTO_TEST_CASE( nothing_is_sent_without_changes ) {
+	Json::Value state = makeState( "10.0.0.1", "" );
+	StateCursor deltas, legacy;
+	{
+		StateEncoder encoder( ID, state );
+		encoder.update( deltas, true, false );
+		encoder.update( legacy, false, false );
+	}
+	StateEncoder encoder( ID, state );
+	BOOST_CHECK( !encoder.update( deltas, true, false ) );
+	BOOST_CHECK( !encoder.update( legacy, false, false ) );
+
+	// Unless a full frame is requested
+	BOOST_CHECK( encoder.update( deltas, true, true ) );
+	BOOST_CHECK( encoder.update( legacy, false, true ) );
+}
+
+BOOST_AUTO_TEST_CASE( deltas_are_numbered_per_subscriber ) {
+	Json::Value s1 = makeState( "10.0.0.1", "a" ), s2 = makeState( "10.0.0.2", "a" ), s3 = makeState( "10.0.0.2", "" );
+	StateCursor early, late;
+	{
+		StateEncoder encoder( ID, s1 );
+		encoder.update( early, true, false );
+	}
+	{
+		StateEncoder encoder( ID, s2 );
+		bool delta = false;
+		CVMWebserverBufferPtr frame = encoder.update( early, true, false, &delta );
+		BOOST_REQUIRE( frame );
+		BOOST_CHECK( delta );
+
+		// [changed config, changed properties, removed properties, version]
+		Json::Value root = parse( frame );
+		BOOST_CHECK_EQUAL( root["name"].asString(), "stateDelta" );
+		BOOST_CHECK_EQUAL( root["data"][0u]["ip"].asString(), "10.0.0.2" );
+		BOOST_CHECK_EQUAL( root["data"][0u].size(), 1u );
+		BOOST_CHECK_EQUAL( root["data"][1u].size(), 0u );
+		BOOST_CHECK_EQUAL( root["data"][2u].size(), 0u );
+		BOOST_CHECK_EQUAL( root["data"][3u].asInt(), 1 );
+
+		// A subscriber that joins now starts with the full frame
+		BOOST_CHECK_EQUAL( parse( encoder.update( late, true, false ) )["name"].asString(), "stateVariables" );
+		BOOST_CHECK_EQUAL( late.version, 0u );
+	}
+	{
+		StateEncoder encoder( ID, s3 );
+		Json::Value root = parse( encoder.update( early, true, false ) );
+		BOOST_CHECK_EQUAL( root["data"][2u][0u].asString(), "extra" );
+		BOOST_CHECK_EQUAL( root["data"][3u].asInt(), 2 );
+		root = parse( encoder.update( late, true, false ) );
+		BOOST_CHECK_EQUAL( root["data"][3u].asInt(), 1 );
+	}
+	{
+		// A full frame starts over
+		StateEncoder encoder( ID, s3 );
+		BOOST_CHECK_EQUAL( parse( encoder.update( early, true, true ) )["name"].asString(), "stateVariables" );
+		BOOST_CHECK_EQUAL( early.version, 0u );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( legacy_subscribers_get_full_frames ) {
+	StateCursor cursor;
+	Json::Value s1 = makeState( "10.0.0.1", "" ), s2 = makeState( "10.0.0.2", "" );
+	{
+		StateEncoder encoder( ID, s1 );
+		encoder.update( cursor, false, false );
+	}
+	StateEncoder encoder( ID, s2 );
+	bool delta = true;
+	Json::Value root = parse( encoder.update( cursor, false, false, &delta ) );
+	BOOST_CHECK( !delta );
+	BOOST_CHECK_EQUAL( root["name"].asString(), "stateVariables" );
+	BOOST_CHECK( root["data"] == s2 );
+}
+
+BOOST_AUTO_TEST_CASE( frames_are_serialized_once ) {
+	Json::Value s1 = makeState( "10.0.0.1", "" ), s2 = makeState( "10.0.0.2", "" );
+	StateCursor a, b, c, fresh1, fresh2;
+	{
+		StateEncoder encoder( ID, s1 );
+		encoder.update( a, true, false );
+		encoder.update( b, true, false );
+	}
+	StateEncoder encoder( ID, s2 );
+
+	// Subscribers at the same point share the delta, the rest get their own
+	CVMWebserverBufferPtr da = encoder.update( a, true, false ), db = encoder.update( b, true, false );
+	BOOST_CHECK( da.get() == db.get() );
+	c.snapshot = s1;
+	c.version = 4;
+	CVMWebserverBufferPtr dc = encoder.update( c, true, false );
+	BOOST_CHECK( dc.get() != da.get() );
+	BOOST_CHECK_EQUAL( parse( dc )["data"][3u].asInt(), 5 );
+
+	// Everybody shares the full frame
+	BOOST_CHECK( encoder.update( fresh1, true, false ).get() == encoder.update( fresh2, false, false ).get() );
+}
+
+BOOST_AUTO_TEST_CASE( rebase_carries_the_version ) {
+	Json::Value s1 = makeState( "10.0.0.1", "" ), s2 = makeState( "10.0.0.2", "x" );
+	StateCursor cursor;
+	WebsocketEgressRebase first, second;
+	{
+		StateEncoder encoder( ID, s1 );
+		CVMWebserverBufferPtr frame = encoder.update( cursor, true, false );
+		first = encoder.rebase( cursor );
+
+		// Without deltas, the rebase is the full frame
+		BOOST_CHECK_EQUAL( first()->data, frame->data );
+	}
+	{
+		StateEncoder encoder( ID, s2 );
+		encoder.update( cursor, true, false );
+		second = encoder.rebase( cursor );
+	}
+
+	// After a delta, it's the full state and the version of the delta,
+	// even after the encoder and the state are gone
+	s2 = Json::Value();
+	Json::Value root = parse( second() );
+	BOOST_CHECK_EQUAL( root["name"].asString(), "stateVariables" );
+	BOOST_CHECK( root["data"][0u] == makeState( "10.0.0.2", "x" )[0u] );
+	BOOST_CHECK( root["data"][1u] == makeState( "10.0.0.2", "x" )[1u] );
+	BOOST_CHECK_EQUAL( root["data"][2u].asInt(), 1 );
+}
@@ -0,0 +1,197 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE textscan
+#include <boost/test/included/unit_test.hpp>
+
+#include "textscan.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/**
+ * A straightforward UTF-8 validator to compare against
+ */
+static bool referenceValidUTF8( const std::string& str ) {
+	const unsigned char * s = (const unsigned char*) str.data();
+	size_t i = 0, len = str.length();
+	while (i < len) {
+		unsigned int cp, n;
+		if (s[i] < 0x80) { ++i; continue; }
+		else if ((s[i] >= 0xC2) && (s[i] <= 0xDF)) { n = 1; cp = s[i] & 0x1F; }
+		else if ((s[i] >= 0xE0) && (s[i] <= 0xEF)) { n = 2; cp = s[i] & 0x0F; }
+		else if ((s[i] >= 0xF0) && (s[i] <= 0xF4)) { n = 3; cp = s[i] & 0x07; }
+		else return false;
+		if (i + n >= len) return false;
+		for (unsigned int j = 1; j <= n; ++j) {
+			if ((s[i + j] & 0xC0) != 0x80) return false;
+			cp = (cp << 6) | (s[i + j] & 0x3F);
+		}
+		if ((n == 2) && ((cp < 0x800) || ((cp >= 0xD800) && (cp <= 0xDFFF)))) return false;
+		if ((n == 3) && ((cp < 0x10000) || (cp > 0x10FFFF))) return false;
+		i += n + 1;
+	}
+	return true;
+}
+
+/**
+ * The first byte that needs escaping, the slow way
+ */
+static size_t referenceFindEscape( const std::string& str ) {
+	for (size_t i = 0; i < str.length(); ++i) {
+		unsigned char c = (unsigned char) str[i];
+		if ((c < 0x20) || (c == '"') || (c == '\\')) return i;
+	}
+	return str.length();
+}
+
+BOOST_AUTO_TEST_CASE( implementation ) {
+	std::string name = textScanImplementation();
+	BOOST_TEST_MESSAGE( "Using the " << name << " implementation" );
+	BOOST_CHECK( (name == "avx2") || (name == "ssse3") || (name == "sse2") || (name == "scalar") );
+}
+
+BOOST_AUTO_TEST_CASE( find_escape_at_every_offset ) {
+	// The lengths cover the vector blocks and the scalar tails of every implementation
+	const unsigned char special[] = { 0x00, 0x01, 0x0a, 0x1f, '"', '\\' };
+	const unsigned char plain[] = { 0x20, '!', '#', '[', ']', 0x7f, 0x80, 0xc3, 0xff };
+	for (size_t len = 0; len <= 100; ++len) {
+		std::string str( len, 'a' );
+		BOOST_REQUIRE_EQUAL( textFindJSONEscape( str.data(), len ), len );
+		for (size_t at = 0; at < len; ++at) {
+			for (size_t k = 0; k < sizeof(special); ++k) {
+				std::string s = str;
+				s[at] = (char) special[k];
+				BOOST_REQUIRE_EQUAL( textFindJSONEscape( s.data(), len ), at );
+
+				// Only the first one counts
+				if (at + 1 < len) {
+					s[len - 1] = '"';
+					BOOST_REQUIRE_EQUAL( textFindJSONEscape( s.data(), len ), at );
+				}
+			}
+			for (size_t k = 0; k < sizeof(plain); ++k) {
+				std::string s = str;
+				s[at] = (char) plain[k];
+				BOOST_REQUIRE_EQUAL( textFindJSONEscape( s.data(), len ), len );
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( find_escape_ascii_at_every_offset ) {
+	// The ASCII variant stops at the non-ASCII bytes too
+	const unsigned char special[] = { 0x00, 0x1f, '"', '\\', 0x80, 0xc3, 0xff };
+	for (size_t len = 0; len <= 100; ++len) {
+		std::string str( len, 'a' );
+		BOOST_REQUIRE_EQUAL( textFindJSONEscapeASCII( str.data(), len ), len );
+		for (size_t at = 0; at < len; ++at) {
+			for (size_t k = 0; k < sizeof(special); ++k) {
+				std::string s = str;
+				s[at] = (char) special[k];
+				BOOST_REQUIRE_EQUAL( textFindJSONEscapeASCII( s.data(), len ), at );
+			}
+			std::string s = str;
+			s[at] = 0x7f;
+			BOOST_REQUIRE_EQUAL( textFindJSONEscapeASCII( s.data(), len ), len );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( valid_utf8 ) {
+	const char * valid[] = {
+		"", "ascii only", "caf\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80",
+		"\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xed\x9f\xbf", "\xee\x80\x80", "\xef\xbf\xbf",
+		"\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf",
+		NULL
+	};
+	for (int i = 0; valid[i] != NULL; ++i)
+		BOOST_CHECK_MESSAGE( textIsValidUTF8( valid[i], strlen(valid[i]) ), "rejected sample " << i );
+	BOOST_CHECK( textIsValidUTF8( "a\0b", 3 ) );
+}
+
+BOOST_AUTO_TEST_CASE( invalid_utf8 ) {
+	const char * invalid[] = {
+		"\x80", "\xbf", "\xc0\x80", "\xc1\xbf", "\xe0\x80\x80", "\xe0\x9f\xbf",   // Continuation, overlong
+		"\xed\xa0\x80", "\xed\xbf\xbf",                                         // Surrogates
+		"\xf0\x80\x80\x80", "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", // Overlong, too large
+		"\xf8\x88\x80\x80\x80", "\xfe", "\xff",                                 // Invalid bytes
+		"\xc3", "\xe2\x82", "\xf0\x9f\x98", "\xc3\x28", "\xe2\x28\xa1",         // Truncated, broken
+		NULL
+	};
+	for (int i = 0; invalid[i] != NULL; ++i)
+		BOOST_CHECK_MESSAGE( !textIsValidUTF8( invalid[i], strlen(invalid[i]) ), "accepted sample " << i );
+}
+
+BOOST_AUTO_TEST_CASE( utf8_at_every_offset ) {
+	// Place sequences so that they straddle the vector blocks
+	const char * sequences[] = {
+		"\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xc0\x80", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xe2\x82", "\x80",
+		NULL
+	};
+	for (int k = 0; sequences[k] != NULL; ++k) {
+		for (size_t len = 1; len <= 100; ++len) {
+			for (size_t at = 0; at < len; ++at) {
+				std::string str( len, 'x' );
+				str.replace( at, std::string::npos, sequences[k] );
+				str.resize( std::max( len, str.length() ), 'y' );
+				BOOST_REQUIRE_EQUAL( textIsValidUTF8( str.data(), str.length() ), referenceValidUTF8( str ) );
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( random_against_reference ) {
+	// Mostly text, with some UTF-8 and some noise
+	const char * pieces[] = { "abcd", " ", "\"", "\\", "\n", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xa9", "\xc3", "\xed\xa0\x80" };
+	srand( 1234 );
+	for (int round = 0; round < 20000; ++round) {
+		std::string str;
+		size_t count = rand() % 40;
+		for (size_t i = 0; i < count; ++i)
+			str += pieces[ rand() % (sizeof(pieces) / sizeof(pieces[0])) ];
+		BOOST_REQUIRE_EQUAL( textIsValidUTF8( str.data(), str.length() ), referenceValidUTF8( str ) );
+		BOOST_REQUIRE_EQUAL( textFindJSONEscape( str.data(), str.length() ), referenceFindEscape( str ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( random_bytes_against_reference ) {
+	// Bytes around every boundary of the lookup tables, so that the pairs
+	// of bytes cover each error (and each of its exceptions) many times
+	const unsigned char bytes[] = {
+		0x00, 'a', 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf, 0xc0, 0xc1, 0xc2, 0xdf,
+		0xe0, 0xe1, 0xec, 0xed, 0xee, 0xef, 0xf0, 0xf1, 0xf3, 0xf4, 0xf5, 0xf7, 0xf8, 0xff
+	};
+	srand( 4321 );
+	for (int round = 0; round < 200000; ++round) {
+		std::string str( 60, 'a' );
+		size_t count = rand() % 6;
+		for (size_t i = 0; i < count; ++i) {
+			size_t at = rand() % str.length();
+			size_t n = 1 + rand() % 4;
+			for (size_t j = 0; (j < n) && (at + j < str.length()); ++j)
+				str[at + j] = (char) bytes[ rand() % sizeof(bytes) ];
+		}
+		str.resize( rand() % (str.length() + 1) );
+		BOOST_REQUIRE_EQUAL( textIsValidUTF8( str.data(), str.length() ), referenceValidUTF8( str ) );
+	}
+}
@@ -0,0 +1,171 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE timer_wheel
+#include <boost/test/included/unit_test.hpp>
+
+#include "timer_wheel.h"
+#include "latch.h"
+
+#include <boost/bind.hpp>
+#include <CernVM/Utilities.h>
+#include <vector>
+
+/**
+ * Record when and in which order the timers fire
+ */
+class Recorder {
+public:
+	Recorder() : started( getMillis() ) { };
+
+	void fire( int tag ) {
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			tags.push_back( tag );
+			times.push_back( getMillis() - started );
+		}
+		fired.arrive();
+	};
+
+	bool wait( int count, int timeoutMs ) { return fired.wait( count, timeoutMs ); };
+
+	unsigned long started;
+	boost::mutex mutex;
+	std::vector< int > tags;
+	std::vector< unsigned long > times;
+	TestLatch fired;
+};
+
+/**
+ * A recorder, a pool and a wheel, torn down in the right order. A single
+ * interactive worker runs the expired timers in the order they are
+ * dispatched.
+ */
+struct Fixture {
+	Fixture() { pool.start( 1, 1, 1 ); wheel.start( &pool ); };
+	~Fixture() { wheel.stop(); pool.stop(); };
+	Recorder rec;
+	WorkerPool pool;
+	TimerWheel wheel;
+};
+
+BOOST_FIXTURE_TEST_CASE( fires_in_order, Fixture ) {
+	// The delays are more than a tick apart, so they don't round up to the same tick
+	wheel.schedule( 450, boost::bind( &Recorder::fire, &rec, 3 ) );
+	wheel.schedule( 150, boost::bind( &Recorder::fire, &rec, 1 ) );
+	wheel.schedule( 300, boost::bind( &Recorder::fire, &rec, 2 ) );
+	wheel.schedule( 0, boost::bind( &Recorder::fire, &rec, 0 ) );
+	BOOST_CHECK_EQUAL( wheel.size(), 4u );
+
+	BOOST_REQUIRE( rec.wait( 4, 2000 ) );
+	for (int i = 0; i < 4; ++i) {
+		BOOST_CHECK_EQUAL( rec.tags[i], i );
+
+		// Never early. The upper bound only catches a wheel that lost
+		// track of the time, since a loaded host can delay the workers.
+		BOOST_CHECK_GE( rec.times[i], (unsigned long)(i * 150) );
+		BOOST_CHECK_LE( rec.times[i], (unsigned long)(i * 150 + 1000) );
+		if (i > 0) BOOST_CHECK_GE( rec.times[i], rec.times[i - 1] );
+	}
+	BOOST_CHECK_EQUAL( wheel.size(), 0u );
+}
+
+BOOST_FIXTURE_TEST_CASE( cancel, Fixture ) {
+	TimerID a = wheel.schedule( 200, boost::bind( &Recorder::fire, &rec, 1 ) );
+	TimerID b = wheel.schedule( 100, boost::bind( &Recorder::fire, &rec, 2 ) );
+	BOOST_CHECK( a != b );
+	BOOST_CHECK( wheel.cancel( a ) );
+	BOOST_CHECK( !wheel.cancel( a ) );
+	BOOST_CHECK( !wheel.cancel( 0 ) );
+	BOOST_CHECK_EQUAL( wheel.size(), 1u );
+
+	BOOST_REQUIRE( rec.wait( 1, 2000 ) );
+	BOOST_CHECK( !wheel.cancel( b ) );
+	boost::this_thread::sleep( boost::posix_time::milliseconds( 400 ) );
+	BOOST_REQUIRE_EQUAL( rec.tags.size(), 1u );
+	BOOST_CHECK_EQUAL( rec.tags[0], 2 );
+}
+
+BOOST_FIXTURE_TEST_CASE( catches_up_after_idle, Fixture ) {
+	// The wheel does not tick while empty, which must not shift new timers
+	boost::this_thread::sleep( boost::posix_time::milliseconds( 700 ) );
+	rec.started = getMillis();
+	wheel.schedule( 200, boost::bind( &Recorder::fire, &rec, 1 ) );
+	BOOST_REQUIRE( rec.wait( 1, 2000 ) );
+	BOOST_CHECK_GE( rec.times[0], 200u );
+	BOOST_CHECK_LE( rec.times[0], 200u + 3 * TIMER_TICK_MS );
+}
+
+static void block( TestLatch * gate, TestLatch * done ) { gate->wait( 1, 60000 ); done->arrive(); }
+
+BOOST_FIXTURE_TEST_CASE( runs_on_the_given_lane, Fixture ) {
+	// Keep the interactive lane busy; a timer of the long lane still fires
+	TestLatch gate, done;
+	pool.submit( boost::bind( &block, &gate, &done ) );
+
+	wheel.schedule( 100, boost::bind( &Recorder::fire, &rec, 1 ), WORKER_LANE_LONG );
+	BOOST_CHECK( rec.wait( 1, 2000 ) );
+
+	// Let the blocked task go before the latches are destroyed
+	gate.arrive();
+	BOOST_CHECK( done.wait() );
+}
+
+BOOST_FIXTURE_TEST_CASE( cascades_from_upper_levels, Fixture ) {
+	// A delay beyond the first level (64 ticks) goes through a cascade
+	const unsigned long delay = TIMER_SLOTS * TIMER_TICK_MS + 300;
+	wheel.schedule( delay, boost::bind( &Recorder::fire, &rec, 2 ) );
+	wheel.schedule( 100, boost::bind( &Recorder::fire, &rec, 1 ) );
+
+	// A cascaded timer can still be cancelled from the slot it was moved to
+	TimerID late = wheel.schedule( delay + 500, boost::bind( &Recorder::fire, &rec, 4 ) );
+
+	// Very long delays are clamped to the span of the wheel, but stay pending
+	TimerID far = wheel.schedule( 365UL * 24 * 3600 * 1000, boost::bind( &Recorder::fire, &rec, 3 ) );
+
+	BOOST_REQUIRE( rec.wait( 2, delay + 2000 ) );
+	BOOST_CHECK_EQUAL( rec.tags[0], 1 );
+	BOOST_CHECK_EQUAL( rec.tags[1], 2 );
+	BOOST_CHECK_GE( rec.times[1], delay );
+	BOOST_CHECK_LE( rec.times[1], delay + 3 * TIMER_TICK_MS );
+	BOOST_CHECK( wheel.cancel( late ) );
+	BOOST_CHECK_EQUAL( wheel.size(), 1u );
+	BOOST_CHECK( wheel.cancel( far ) );
+}
+
+BOOST_AUTO_TEST_CASE( stopped_wheel ) {
+	Recorder rec;
+	WorkerPool pool;
+	pool.start( 1, 1, 1 );
+	TimerWheel wheel;
+
+	// Nothing is scheduled before start
+	BOOST_CHECK_EQUAL( wheel.schedule( 100, boost::bind( &Recorder::fire, &rec, 1 ) ), 0u );
+
+	// Stop drops what is pending
+	wheel.start( &pool );
+	BOOST_CHECK( wheel.schedule( 100, boost::bind( &Recorder::fire, &rec, 1 ) ) != 0 );
+	wheel.stop();
+	BOOST_CHECK_EQUAL( wheel.size(), 0u );
+	BOOST_CHECK_EQUAL( wheel.schedule( 100, boost::bind( &Recorder::fire, &rec, 1 ) ), 0u );
+	boost::this_thread::sleep( boost::posix_time::milliseconds( 300 ) );
+	BOOST_CHECK( rec.tags.empty() );
+	pool.stop();
+}
@@ -0,0 +1,259 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE worker_pool
+#include <boost/test/included/unit_test.hpp>
+
+#include "worker_pool.h"
+#include "latch.h"
+
+#include <boost/bind.hpp>
+#include <vector>
+
+// The tests declare their latches before the pool, so that they outlive
+// the tasks still using them when the pool is stopped.
+
+static void blockedTask( TestLatch * gate, TestLatch * finished ) { gate->wait( 1, 60000 ); finished->arrive(); }
+static void countTask( TestLatch * finished ) { finished->arrive(); }
+static void throwTask() { throw std::runtime_error("task failure"); }
+
+BOOST_AUTO_TEST_CASE( runs_and_drains ) {
+	TestLatch finished;
+	{
+		WorkerPool pool;
+		pool.start( 2, 2, 2 );
+		for (int i = 0; i < 3000; ++i)
+			pool.submit( boost::bind( &countTask, &finished ), i % WORKER_LANES );
+		pool.stop();
+		BOOST_CHECK_EQUAL( finished.value(), 3000 );
+
+		// Tasks submitted to a stopped pool are dropped
+		pool.submit( boost::bind( &countTask, &finished ) );
+	}
+	BOOST_CHECK_EQUAL( finished.value(), 3000 );
+}
+
+BOOST_AUTO_TEST_CASE( lanes_are_independent ) {
+	TestLatch gate, blocked, finished;
+	WorkerPool pool;
+	pool.start( 1, 1, 1 );
+
+	// Occupy the long and blocking lanes
+	pool.submit( boost::bind( &blockedTask, &gate, &blocked ), WORKER_LANE_LONG );
+	pool.submit( boost::bind( &blockedTask, &gate, &blocked ), WORKER_LANE_BLOCKING );
+
+	// The interactive lane still runs
+	pool.submit( boost::bind( &countTask, &finished ), WORKER_LANE_INTERACTIVE );
+	BOOST_CHECK( finished.wait( 1 ) );
+	BOOST_CHECK_EQUAL( blocked.value(), 0 );
+
+	gate.arrive();
+	BOOST_CHECK( blocked.wait( 2 ) );
+}
+
+BOOST_AUTO_TEST_CASE( idle_workers_steal ) {
+	TestLatch gate, blocked, finished;
+	WorkerPool pool;
+	pool.start( 2, 1, 1 );
+
+	// The first task blocks the first worker, and the round-robin places
+	// the third task behind it. The second worker must steal it.
+	pool.submit( boost::bind( &blockedTask, &gate, &blocked ) );
+	pool.submit( boost::bind( &countTask, &finished ) );
+	pool.submit( boost::bind( &countTask, &finished ) );
+	BOOST_CHECK( finished.wait( 2 ) );
+	BOOST_CHECK_EQUAL( blocked.value(), 0 );
+	gate.arrive();
+}
+
+static void sleepTask( TestLatch * started, TestLatch * interrupted, TestLatch * completed ) {
+	started->arrive();
+	try {
+		boost::this_thread::sleep( boost::posix_time::seconds(10) );
+		completed->arrive();
+	} catch (boost::thread_interrupted &e) {
+		interrupted->arrive();
+		throw;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( interrupt_group ) {
+	TestLatch started, interrupted, completed, gate, blocked, finished;
+	WorkerPool pool;
+	pool.start( 2, 1, 1 );
+
+	int owner, other;
+	pool.submit( boost::bind( &sleepTask, &started, &interrupted, &completed ), WORKER_LANE_INTERACTIVE, &owner );
+	pool.submit( boost::bind( &blockedTask, &gate, &blocked ), WORKER_LANE_INTERACTIVE, &other );
+	BOOST_REQUIRE( started.wait( 1 ) );
+
+	pool.interrupt( &owner );
+	BOOST_CHECK( interrupted.wait( 1 ) );
+	BOOST_CHECK_EQUAL( completed.value(), 0 );
+
+	// The other group is not affected, and the worker goes on
+	gate.arrive();
+	BOOST_CHECK( blocked.wait( 1 ) );
+	pool.submit( boost::bind( &countTask, &finished ), WORKER_LANE_INTERACTIVE, &owner );
+	pool.submit( boost::bind( &countTask, &finished ), WORKER_LANE_INTERACTIVE, &owner );
+	BOOST_CHECK( finished.wait( 2 ) );
+}
+
+BOOST_AUTO_TEST_CASE( exceptions_do_not_kill_workers ) {
+	TestLatch finished;
+	WorkerPool pool;
+	pool.start( 1, 1, 1 );
+	for (int i = 0; i < 10; ++i) {
+		pool.submit( &throwTask );
+		pool.submit( boost::bind( &countTask, &finished ) );
+	}
+	BOOST_CHECK( finished.wait( 10 ) );
+}
+
+/**
+ * The order in which a strand ran it's tasks, and how many ran at once
+ */
+struct StrandLog {
+	StrandLog() : active(0), maxActive(0) { };
+	boost::mutex mutex;
+	int active, maxActive;
+	std::vector< int > order;
+	TestLatch finished;
+};
+
+static void strandTask( StrandLog * log, int seq ) {
+	{
+		boost::mutex::scoped_lock lock(log->mutex);
+		if (++log->active > log->maxActive) log->maxActive = log->active;
+	}
+	boost::this_thread::yield();
+	log->order.push_back( seq );
+	{
+		boost::mutex::scoped_lock lock(log->mutex);
+		--log->active;
+	}
+	log->finished.arrive();
+}
+
+static void postMany( WorkerStrandPtr strand, StrandLog * log, int producer ) {
+	for (int i = 0; i < 500; ++i)
+		strand->post( boost::bind( &strandTask, log, producer * 1000 + i ), (i % 2) ? WORKER_LANE_INTERACTIVE : WORKER_LANE_LONG );
+}
+
+BOOST_AUTO_TEST_CASE( strand_serializes ) {
+	StrandLog log;
+	WorkerPool pool;
+	pool.start( 4, 4, 1 );
+	WorkerStrandPtr strand( new WorkerStrand( pool ) );
+
+	// Several producers post to the same strand at the same time
+	boost::thread_group producers;
+	for (int p = 0; p < 4; ++p)
+		producers.create_thread( boost::bind( &postMany, strand, &log, p ) );
+	producers.join_all();
+	BOOST_REQUIRE( log.finished.wait( 2000 ) );
+	std::vector< int >& order = log.order;
+
+	// Never two tasks at once, and every producer's tasks in order
+	BOOST_CHECK_EQUAL( log.maxActive, 1 );
+	int last[4] = { -1, -1, -1, -1 };
+	for (size_t i = 0; i < order.size(); ++i) {
+		int p = order[i] / 1000, seq = order[i] % 1000;
+		BOOST_CHECK_GT( seq, last[p] );
+		last[p] = seq;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( strands_run_in_parallel ) {
+	TestLatch gate, blocked, finished;
+	WorkerPool pool;
+	pool.start( 2, 1, 1 );
+	WorkerStrandPtr a( new WorkerStrand( pool ) ), b( new WorkerStrand( pool ) );
+
+	// A blocked strand does not hold up another one
+	a->post( boost::bind( &blockedTask, &gate, &blocked ) );
+	a->post( boost::bind( &countTask, &blocked ) );
+	b->post( boost::bind( &countTask, &finished ) );
+	BOOST_CHECK( finished.wait( 1 ) );
+	BOOST_CHECK_EQUAL( blocked.value(), 0 );
+	gate.arrive();
+	BOOST_CHECK( blocked.wait( 2 ) );
+}
+
+static void repost( WorkerStrandPtr strand, TestLatch * finished, int remaining ) {
+	finished->arrive();
+	if (remaining > 0)
+		strand->post( boost::bind( &repost, strand, finished, remaining - 1 ) );
+}
+
+BOOST_AUTO_TEST_CASE( strand_survives_failures ) {
+	TestLatch finished;
+	WorkerPool pool;
+	pool.start( 2, 1, 1 );
+	WorkerStrandPtr strand( new WorkerStrand( pool ) );
+
+	// Tasks that throw, and tasks that post to their own strand
+	strand->post( &throwTask );
+	strand->post( boost::bind( &repost, strand, &finished, 9 ) );
+	strand->post( &throwTask );
+	BOOST_CHECK( finished.wait( 10 ) );
+}
+
+static void enterGate( PreparationGate * gate, TestLatch * entered, TestLatch * retried ) {
+	if (gate->enter( boost::bind( &countTask, retried ), WORKER_LANE_BLOCKING )) {
+		entered->arrive();
+		gate->leave();
+	}
+}
+
+BOOST_AUTO_TEST_CASE( preparation_gate_parks_waiters ) {
+	TestLatch entered, retried, finished;
+	WorkerPool pool;
+	pool.start( 1, 1, 1 );
+	PreparationGate gate( pool );
+
+	// While the preparation runs, the tasks that need it leave their
+	// continuation and give back the only blocking worker
+	BOOST_REQUIRE( gate.enter() );
+	for (int i = 0; i < 3; ++i)
+		pool.submit( boost::bind( &enterGate, &gate, &entered, &retried ), WORKER_LANE_BLOCKING );
+	pool.submit( boost::bind( &countTask, &finished ), WORKER_LANE_BLOCKING );
+	BOOST_CHECK( finished.wait( 1 ) );
+	BOOST_CHECK_EQUAL( entered.value(), 0 );
+	BOOST_CHECK_EQUAL( retried.value(), 0 );
+
+	// Without a continuation nothing is queued
+	BOOST_CHECK( !gate.enter() );
+
+	// The continuations run when the preparation is over
+	gate.leave();
+	BOOST_CHECK( retried.wait( 3 ) );
+	BOOST_CHECK_EQUAL( entered.value(), 0 );
+
+	// The gate is open again, and the scope leaves it even on failures
+	try {
+		BOOST_REQUIRE( gate.enter() );
+		PreparationGate::Scope scope( gate );
+		throw std::runtime_error("preparation failure");
+	} catch (std::runtime_error &e) {
+	}
+	pool.submit( boost::bind( &enterGate, &gate, &entered, &retried ), WORKER_LANE_BLOCKING );
+	BOOST_CHECK( entered.wait( 1 ) );
+}
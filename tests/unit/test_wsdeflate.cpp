@@ -0,0 +1,184 @@
+/**
+ * This file is part of CernVM Web API Plugin.
+ *
+ * CVMWebAPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CVMWebAPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CVMWebAPI. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Developed by Ioannis Charalampidis 2013
+ * Contact: <ioannis.charalampidis[at]cern.ch>
+ */
+
+#define BOOST_TEST_MODULE wsdeflate
+#include <boost/test/included/unit_test.hpp>
+
+#include "wsdeflate.h"
+
+#include <zlib.h>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+/**
+ * Build a message out of the given parts
+ */
+static CVMWebserverMessage message( const std::string& a, const std::string& b = "" ) {
+	CVMWebserverMessage msg;
+	msg.push_back( CVMWebserverBufferPool::wrap(a) );
+	if (!b.empty()) msg.push_back( CVMWebserverBufferPool::wrap(b) );
+	return msg;
+}
+
+/**
+ * A JSON event like the ones sent to the browser
+ */
+static std::string event( int i ) {
+	std::ostringstream oss;
+	oss << "{\"data\":[\"stateVariables\",{\"cpus\":\"1\",\"memory\":\"512\",\"state\":" << i
+		<< "}],\"id\":\"b2ed9b7d-7a80-4c4b-9d51-5ea2b1c2a0f1\",\"name\":\"stateChanged\",\"type\":\"event\"}";
+	return oss.str();
+}
+
+/**
+ * Raw-deflate the given data the way a browser does
+ */
+static std::string browserDeflate( const std::string& data ) {
+	z_stream s;
+	memset( &s, 0, sizeof(s) );
+	deflateInit2( &s, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY );
+	std::string out( deflateBound( &s, data.length() ) + 16, '\0' );
+	s.next_in = (Bytef*) data.c_str();
+	s.avail_in = data.length();
+	s.next_out = (Bytef*) &out[0];
+	s.avail_out = out.length();
+	deflate( &s, Z_SYNC_FLUSH );
+	out.resize( out.length() - s.avail_out - 4 );
+	deflateEnd( &s );
+	return out;
+}
+
+BOOST_AUTO_TEST_CASE( negotiate_offers ) {
+	std::string response;
+
+	CVMWebsocketDeflate none;
+	BOOST_CHECK( !none.negotiate( NULL, &response ) );
+	BOOST_CHECK( !none.negotiate( "x-webkit-deflate-frame", &response ) );
+	BOOST_CHECK( !none.isActive() );
+
+	CVMWebsocketDeflate plain;
+	BOOST_REQUIRE( plain.negotiate( "permessage-deflate; client_max_window_bits", &response ) );
+	BOOST_CHECK_EQUAL( response, "permessage-deflate" );
+	BOOST_CHECK( plain.isActive() );
+	BOOST_CHECK( !plain.negotiate( "permessage-deflate", &response ) );
+
+	// An unacceptable offer falls back to the next one
+	CVMWebsocketDeflate fallback;
+	BOOST_REQUIRE( fallback.negotiate( "permessage-deflate; server_max_window_bits=8, "
+									   "permessage-deflate; server_no_context_takeover; server_max_window_bits=\"10\"", &response ) );
+	BOOST_CHECK_EQUAL( response, "permessage-deflate; server_no_context_takeover; server_max_window_bits=10" );
+
+	CVMWebsocketDeflate unknown;
+	BOOST_CHECK( !unknown.negotiate( "permessage-deflate; x-unknown=1", &response ) );
+	BOOST_CHECK( !unknown.isActive() );
+}
+
+BOOST_AUTO_TEST_CASE( compress_small_or_inactive ) {
+	std::string out, response;
+	CVMWebsocketDeflate ws;
+	BOOST_CHECK( !ws.compress( message( event(1) ), &out ) );
+	BOOST_REQUIRE( ws.negotiate( "permessage-deflate", &response ) );
+	BOOST_CHECK( !ws.compress( message( "{\"type\":\"ping\"}" ), &out ) );
+	BOOST_CHECK( ws.compress( message( event(1) ), &out ) );
+}
+
+BOOST_AUTO_TEST_CASE( round_trip_with_context_takeover ) {
+	std::string response, compressed, inflated;
+	CVMWebsocketDeflate server, client;
+	BOOST_REQUIRE( server.negotiate( "permessage-deflate", &response ) );
+	BOOST_REQUIRE( client.negotiate( "permessage-deflate", &response ) );
+
+	size_t firstSize = 0;
+	for (int i = 0; i < 16; ++i) {
+		BOOST_REQUIRE( server.compress( message( event(i) ), &compressed ) );
+		BOOST_REQUIRE( client.decompress( compressed.c_str(), compressed.length(), &inflated ) );
+		BOOST_CHECK_EQUAL( inflated, event(i) );
+		if (i == 0) firstSize = compressed.length();
+	}
+
+	// The repeated keys compress to back-references of the previous messages
+	BOOST_CHECK_LT( compressed.length(), firstSize / 2 );
+}
+
+BOOST_AUTO_TEST_CASE( round_trip_scatter_gather ) {
+	std::string response, compressed, inflated;
+	CVMWebsocketDeflate server, client;
+	BOOST_REQUIRE( server.negotiate( "permessage-deflate", &response ) );
+	BOOST_REQUIRE( client.negotiate( "permessage-deflate", &response ) );
+
+	std::string head = "[" + event(1) + ",", tail = event(2) + "]";
+	BOOST_REQUIRE( server.compress( message( head, tail ), &compressed ) );
+	BOOST_REQUIRE( client.decompress( compressed.c_str(), compressed.length(), &inflated ) );
+	BOOST_CHECK_EQUAL( inflated, head + tail );
+}
+
+BOOST_AUTO_TEST_CASE( no_context_takeover ) {
+	std::string response, compressed, inflated;
+	CVMWebsocketDeflate server;
+	BOOST_REQUIRE( server.negotiate( "permessage-deflate; server_no_context_takeover", &response ) );
+
+	// Every message must be inflatable on it's own
+	for (int i = 0; i < 4; ++i) {
+		CVMWebsocketDeflate client;
+		BOOST_REQUIRE( client.negotiate( "permessage-deflate", &response ) );
+		BOOST_REQUIRE( server.compress( message( event(i) ), &compressed ) );
+		BOOST_REQUIRE( client.decompress( compressed.c_str(), compressed.length(), &inflated ) );
+		BOOST_CHECK_EQUAL( inflated, event(i) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( decompress_browser_frames ) {
+	std::string response, inflated;
+	CVMWebsocketDeflate server;
+	BOOST_CHECK( !server.decompress( "x", 1, &inflated ) );
+	BOOST_REQUIRE( server.negotiate( "permessage-deflate", &response ) );
+
+	std::string frame = browserDeflate( "{\"type\":\"action\",\"name\":\"start\",\"id\":\"1\",\"data\":{}}" );
+	BOOST_REQUIRE( server.decompress( frame.c_str(), frame.length(), &inflated ) );
+	BOOST_CHECK_EQUAL( inflated, "{\"type\":\"action\",\"name\":\"start\",\"id\":\"1\",\"data\":{}}" );
+}
+
+BOOST_AUTO_TEST_CASE( decompress_corrupt ) {
+	std::string response, inflated;
+	CVMWebsocketDeflate server;
+	BOOST_REQUIRE( server.negotiate( "permessage-deflate", &response ) );
+	const char garbage[] = "\xff\xff\xff\xff\xff\xff\xff\xff";
+	BOOST_CHECK( !server.decompress( garbage, sizeof(garbage) - 1, &inflated ) );
+}
+
+BOOST_AUTO_TEST_CASE( decompress_bomb ) {
+	std::string response, inflated;
+	CVMWebsocketDeflate server;
+	BOOST_REQUIRE( server.negotiate( "permessage-deflate", &response ) );
+
+	// A few kilobytes that inflate beyond the limit
+	std::string frame = browserDeflate( std::string( CVMWS_INFLATE_MAX_BYTES + 4096, 'A' ) );
+	BOOST_CHECK_LT( frame.length(), 16384u );
+	BOOST_CHECK( !server.decompress( frame.c_str(), frame.length(), &inflated ) );
+	BOOST_CHECK_GT( inflated.length(), (size_t) CVMWS_INFLATE_MAX_BYTES );
+
+	// Right at the limit is fine
+	CVMWebsocketDeflate other;
+	BOOST_REQUIRE( other.negotiate( "permessage-deflate", &response ) );
+	frame = browserDeflate( std::string( CVMWS_INFLATE_MAX_BYTES, 'A' ) );
+	BOOST_CHECK( other.decompress( frame.c_str(), frame.length(), &inflated ) );
+	BOOST_CHECK_EQUAL( inflated.length(), (size_t) CVMWS_INFLATE_MAX_BYTES );
+}
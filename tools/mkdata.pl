@@ -3,27 +3,118 @@
 # a list of files as an input, and produces a .c data file that contains
 # contents of all these files as collection of char arrays.
 #
+# The files are emitted in a table sorted by name, together with their
+# MIME type, a strong ETag and their gzip/brotli compressed versions,
+# so they can be served with a binary search at run-time.
+#
 # Usage: perl <this_file> <file1> [file2, ...] > embedded_data.c
 #
 # (This nice utility is borrowed from cesanta's mongoose library)
 #
 
-foreach my $i (0 .. $#ARGV) {
-  my $f = $ARGV[$i];
-  $f=$1 if ($f =~ /^(.*):/);
-  open FD, '<:raw', $f or die "Cannot open $f: $!\n";
-  printf("static const unsigned char v%d[] = {", $i);
-  my $byte;
+use Digest::MD5 qw(md5_hex);
+use IO::Compress::Gzip qw(gzip $GzipError);
+
+# MIME types of the embedded files, by extension
+my %mime_types = (
+  'html' => 'text/html',
+  'htm'  => 'text/html',
+  'css'  => 'text/css',
+  'js'   => 'application/javascript',
+  'json' => 'application/json',
+  'txt'  => 'text/plain',
+  'png'  => 'image/png',
+  'gif'  => 'image/gif',
+  'jpg'  => 'image/jpeg',
+  'jpeg' => 'image/jpeg',
+  'ico'  => 'image/x-icon',
+  'svg'  => 'image/svg+xml',
+  'eot'  => 'application/vnd.ms-fontobject',
+  'ttf'  => 'application/x-font-ttf',
+  'woff' => 'application/font-woff',
+);
+
+# Brotli is optional: use the perl module or the command-line tool if present
+my $brotli_mode = '';
+if (eval { require IO::Compress::Brotli; 1 }) {
+  $brotli_mode = 'module';
+} elsif (`brotli --version 2>&1` && ($? == 0)) {
+  $brotli_mode = 'cli';
+}
+
+# Compress a buffer with brotli, or return undef if not possible
+sub brotli_compress {
+  my ($file, $buf) = @_;
+  if ($brotli_mode eq 'module') {
+    return IO::Compress::Brotli::bro($buf);
+  } elsif ($brotli_mode eq 'cli') {
+    my $out = `brotli -c -q 11 "$file"`;
+    return $out if ($? == 0);
+  }
+  return undef;
+}
+
+# Dump the given buffer as a C array
+sub print_array {
+  my ($var, $buf) = @_;
+  printf("static const unsigned char %s[] = {", $var);
   my $j = 0;
-  while (read(FD, $byte, 1)) {
+  foreach my $byte (unpack('C*', $buf)) {
     if (($j % 12) == 0) {
       print "\n";
     }
-    printf ' %#04x,', ord($byte);
+    printf ' %#04x,', $byte;
     $j++;
   }
   print " 0x00\n};\n";
+}
+
+# Compressed versions are kept only if they save at least 10%
+sub worth_keeping {
+  my ($compressed, $buf) = @_;
+  return defined($compressed) && (length($compressed) < length($buf) * 0.9);
+}
+
+my @entries;
+foreach my $i (0 .. $#ARGV) {
+  my $f = $ARGV[$i];
+  $f=$1 if ($f =~ /^(.*):/);
+  open FD, '<:raw', $f or die "Cannot open $f: $!\n";
+  my $buf = do { local $/; <FD> };
+  $buf = '' unless defined($buf);
   close FD;
+
+  # Raw contents
+  print_array("v$i", $buf);
+  my $md5 = md5_hex($buf);
+  my %e = ( var => "v$i", etag => $md5 );
+
+  # Gzip version (minimal header, for reproducible builds)
+  my $gz;
+  gzip(\$buf => \$gz, -Level => 9, Minimal => 1) or die "gzip failed: $GzipError\n";
+  if (worth_keeping($gz, $buf)) {
+    print_array("v${i}_gz", $gz);
+    $e{gz} = "v${i}_gz";
+  }
+
+  # Brotli version
+  my $br = brotli_compress($f, $buf);
+  if (worth_keeping($br, $buf)) {
+    print_array("v${i}_br", $br);
+    $e{br} = "v${i}_br";
+  }
+
+  # Collect the table entry
+  my $name = $ARGV[$i];
+  $name=$1 if ($name =~ /[^:]+:(.*)/);
+  $e{name} = $name;
+  $e{mime} = 'text/plain';
+  $e{mime} = $mime_types{lc($1)} if (($name =~ /\.([^.\/]+)$/) && exists($mime_types{lc($1)}));
+
+  # Files with a version in their name never change
+  $e{immutable} = ($name =~ /-\d+(\.\d+)+[^\/]*$/) ? 1 : 0;
+
+  push @entries, \%e;
 }
 
 print <<EOS;
@@ -31,31 +122,42 @@ print <<EOS;
 #include <stddef.h>
 #include <string.h>
 #include <string>
+#include <web/embedded.h>
 using namespace std;
 
-static const struct embedded_file {
-  const char *name;
-  const unsigned char *data;
-  size_t size;
-} embedded_files[] = {
+static const struct embedded_file embedded_files[] = {
 EOS
 
-foreach my $i (0 .. $#ARGV) {
-  my $f = $ARGV[$i];
-  $f=$1 if ($f =~ /[^:]+:(.*)/);
-  print "  {\"$f\", v$i, sizeof(v$i) - 1},\n";
+# Print an embedded_variant initializer
+sub variant {
+  my ($var, $etag) = @_;
+  return "{NULL, 0, NULL}" unless defined($var);
+  return "{$var, sizeof($var) - 1, \"\\\"$etag\\\"\"}";
 }
 
+foreach my $e (sort { $a->{name} cmp $b->{name} } @entries) {
+  printf("  {\"%s\", \"%s\", %d,\n    %s,\n    %s,\n    %s},\n",
+    $e->{name}, $e->{mime}, $e->{immutable},
+    variant($e->{var}, $e->{etag}),
+    variant($e->{gz}, "$e->{etag}-gzip"),
+    variant($e->{br}, "$e->{etag}-br"));
+}
+
+printf("};\n\nstatic const size_t embedded_files_count = %d;\n", scalar(@entries));
+
 print <<EOS;
-  {NULL, NULL, 0}
-};
-
-const char *find_embedded_file(const string& name, size_t *size) {
-  const struct embedded_file *p;
-  for (p = embedded_files; p->name != NULL; p++) {
-    if (!name.compare(p->name)) {
-      if (size != NULL) { *size = p->size; }
-      return (const char *) p->data;
+
+const struct embedded_file *find_embedded_file(const string& name) {
+  size_t lo = 0, hi = embedded_files_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = strcmp(embedded_files[mid].name, name.c_str());
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else if (cmp > 0) {
+      hi = mid;
+    } else {
+      return &embedded_files[mid];
     }
   }
   return NULL;